@@ -16,13 +16,16 @@
  * GNU General Public License for more details.
  */
 #include "postgres.h"
+#include "access/hash.h"
 #include "catalog/pg_type.h"
 #include "fmgr.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/numeric.h"
 #include <math.h>
 #include "pg_strom.h"
+#include "cuda_gpupreagg.h"
 
 /*
  * declarations
@@ -57,6 +60,18 @@ Datum pgstrom_numeric_var_pop(PG_FUNCTION_ARGS);
 Datum pgstrom_numeric_stddev_samp(PG_FUNCTION_ARGS);
 Datum pgstrom_numeric_stddev_pop(PG_FUNCTION_ARGS);
 
+Datum gpupreagg_hll_item(PG_FUNCTION_ARGS);
+Datum pgstrom_hll_item_accum(PG_FUNCTION_ARGS);
+Datum pgstrom_hll_accum(PG_FUNCTION_ARGS);
+Datum pgstrom_hll_combine(PG_FUNCTION_ARGS);
+Datum pgstrom_hll_final(PG_FUNCTION_ARGS);
+
+Datum gpupreagg_qsketch_item(PG_FUNCTION_ARGS);
+Datum pgstrom_qsketch_accum(PG_FUNCTION_ARGS);
+Datum pgstrom_qsketch_item_accum(PG_FUNCTION_ARGS);
+Datum pgstrom_qsketch_final(PG_FUNCTION_ARGS);
+Datum pgstrom_qsketch_final_array(PG_FUNCTION_ARGS);
+
 /* gpupreagg_partial_nrows - placeholder function that generate number
  * of rows being included in this partial group.
  */
@@ -792,3 +807,499 @@ pgstrom_covariance_float8_accum(PG_FUNCTION_ARGS)
 	}
 }
 PG_FUNCTION_INFO_V1(pgstrom_covariance_float8_accum);
+
+/*
+ * HyperLogLog based approximate distinct count
+ *
+ * State of the aggregation is a bytea that contains
+ * GPUPREAGG_HLL_NUM_REGISTERS registers of 1-byte. GpuPreAgg generates
+ * "hll items" using gpupreagg_hll_make_item() on the device side, then
+ * pgstrom.hll_count(int4) builds registers from the items. CPU version
+ * hashes the values by itself, then updates the registers in same way.
+ */
+typedef struct
+{
+	Oid			type_oid;
+	int16		typlen;
+	bool		typbyval;
+} hll_type_cache;
+
+static cl_ulong
+hll_hash_datum(FunctionCallInfo fcinfo, int argno, Datum datum)
+{
+	hll_type_cache *tcache = fcinfo->flinfo->fn_extra;
+	Oid			type_oid = get_fn_expr_argtype(fcinfo->flinfo, argno);
+	union {
+		float4	fval;
+		uint32	ival;
+	} f4;
+	union {
+		float8	fval;
+		uint64	ival;
+	} f8;
+
+	/*
+	 * NOTE: data types supported by the device code have to be hashed
+	 * in same way to gpupreagg_codegen_projection().
+	 */
+	switch (type_oid)
+	{
+		case INT2OID:
+			return (cl_ulong)((int64) DatumGetInt16(datum));
+		case INT4OID:
+		case DATEOID:
+			return (cl_ulong)((int64) DatumGetInt32(datum));
+		case INT8OID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return (cl_ulong) DatumGetInt64(datum);
+		case FLOAT4OID:
+			f4.fval = DatumGetFloat4(datum);
+			return (cl_ulong) f4.ival;
+		case FLOAT8OID:
+			f8.fval = DatumGetFloat8(datum);
+			return (cl_ulong) f8.ival;
+		default:
+			break;
+	}
+
+	/* other data types are hashed on the host side only */
+	if (!tcache || tcache->type_oid != type_oid)
+	{
+		tcache = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+									sizeof(hll_type_cache));
+		tcache->type_oid = type_oid;
+		get_typlenbyval(type_oid, &tcache->typlen, &tcache->typbyval);
+		fcinfo->flinfo->fn_extra = tcache;
+	}
+
+	if (tcache->typbyval)
+		return (cl_ulong) datum;
+	else if (tcache->typlen == -1)
+	{
+		struct varlena *vl = PG_DETOAST_DATUM_PACKED(datum);
+
+		return (cl_ulong) DatumGetUInt32(hash_any((unsigned char *)
+												  VARDATA_ANY(vl),
+												  VARSIZE_ANY_EXHDR(vl)));
+	}
+	else if (tcache->typlen == -2)
+	{
+		char   *cstr = DatumGetCString(datum);
+
+		return (cl_ulong) DatumGetUInt32(hash_any((unsigned char *) cstr,
+												  strlen(cstr)));
+	}
+	return (cl_ulong) DatumGetUInt32(hash_any((unsigned char *)
+											  DatumGetPointer(datum),
+											  tcache->typlen));
+}
+
+/* gpupreagg_hll_item - placeholder function that generates hll item */
+Datum
+gpupreagg_hll_item(PG_FUNCTION_ARGS)
+{
+	cl_ulong	hkey = hll_hash_datum(fcinfo, 0, PG_GETARG_DATUM(0));
+
+	PG_RETURN_INT32(gpupreagg_hll_make_item(hkey));
+}
+PG_FUNCTION_INFO_V1(gpupreagg_hll_item);
+
+static bytea *
+hll_get_state(FunctionCallInfo fcinfo)
+{
+	MemoryContext	aggcxt;
+	bytea		   *state;
+
+	if (!AggCheckCallContext(fcinfo, &aggcxt))
+		elog(ERROR, "aggregate function called in non-aggregate context");
+
+	if (PG_ARGISNULL(0))
+	{
+		state = MemoryContextAllocZero(aggcxt, VARHDRSZ +
+									   GPUPREAGG_HLL_NUM_REGISTERS);
+		SET_VARSIZE(state, VARHDRSZ + GPUPREAGG_HLL_NUM_REGISTERS);
+	}
+	else
+	{
+		state = PG_GETARG_BYTEA_P(0);
+		if (VARSIZE(state) != VARHDRSZ + GPUPREAGG_HLL_NUM_REGISTERS)
+			elog(ERROR, "HyperLogLog registers are corrupted");
+	}
+	return state;
+}
+
+static inline void
+hll_update_registers(bytea *state, cl_int item)
+{
+	cl_uchar   *registers = (cl_uchar *) VARDATA(state);
+	cl_uint		index = ((cl_uint) item >> 8);
+	cl_uchar	rho = (item & 0xff);
+
+	if (index >= GPUPREAGG_HLL_NUM_REGISTERS)
+		elog(ERROR, "Bug? hll item (%08x) is out of range", item);
+	if (registers[index] < rho)
+		registers[index] = rho;
+}
+
+/*
+ * pgstrom_hll_item_accum - update registers by the partial hll items
+ */
+Datum
+pgstrom_hll_item_accum(PG_FUNCTION_ARGS)
+{
+	bytea	   *state = hll_get_state(fcinfo);
+
+	if (!PG_ARGISNULL(1))
+		hll_update_registers(state, PG_GETARG_INT32(1));
+	PG_RETURN_BYTEA_P(state);
+}
+PG_FUNCTION_INFO_V1(pgstrom_hll_item_accum);
+
+/*
+ * pgstrom_hll_accum - update registers by the raw values
+ */
+Datum
+pgstrom_hll_accum(PG_FUNCTION_ARGS)
+{
+	bytea	   *state = hll_get_state(fcinfo);
+
+	if (!PG_ARGISNULL(1))
+	{
+		cl_ulong	hkey = hll_hash_datum(fcinfo, 1, PG_GETARG_DATUM(1));
+
+		hll_update_registers(state, gpupreagg_hll_make_item(hkey));
+	}
+	PG_RETURN_BYTEA_P(state);
+}
+PG_FUNCTION_INFO_V1(pgstrom_hll_accum);
+
+/*
+ * pgstrom_hll_combine - merge two set of registers
+ */
+Datum
+pgstrom_hll_combine(PG_FUNCTION_ARGS)
+{
+	bytea	   *state = hll_get_state(fcinfo);
+	bytea	   *newval;
+	cl_uchar   *dst;
+	cl_uchar   *src;
+	int			i;
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_BYTEA_P(state);
+	newval = PG_GETARG_BYTEA_P(1);
+	if (VARSIZE(newval) != VARHDRSZ + GPUPREAGG_HLL_NUM_REGISTERS)
+		elog(ERROR, "HyperLogLog registers are corrupted");
+
+	dst = (cl_uchar *) VARDATA(state);
+	src = (cl_uchar *) VARDATA(newval);
+	for (i=0; i < GPUPREAGG_HLL_NUM_REGISTERS; i++)
+	{
+		if (dst[i] < src[i])
+			dst[i] = src[i];
+	}
+	PG_RETURN_BYTEA_P(state);
+}
+PG_FUNCTION_INFO_V1(pgstrom_hll_combine);
+
+/*
+ * pgstrom_hll_final - estimate number of distinct values from registers
+ */
+Datum
+pgstrom_hll_final(PG_FUNCTION_ARGS)
+{
+	bytea	   *state;
+	cl_uchar   *registers;
+	double		m = (double) GPUPREAGG_HLL_NUM_REGISTERS;
+	double		alpha = 0.7213 / (1.0 + 1.079 / m);
+	double		sum = 0.0;
+	double		estimate;
+	int			nzeros = 0;
+	int			i;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_INT64(0);		/* no input rows */
+	state = PG_GETARG_BYTEA_P(0);
+	if (VARSIZE(state) != VARHDRSZ + GPUPREAGG_HLL_NUM_REGISTERS)
+		elog(ERROR, "HyperLogLog registers are corrupted");
+
+	registers = (cl_uchar *) VARDATA(state);
+	for (i=0; i < GPUPREAGG_HLL_NUM_REGISTERS; i++)
+	{
+		sum += ldexp(1.0, -(int) registers[i]);
+		if (registers[i] == 0)
+			nzeros++;
+	}
+	estimate = alpha * m * m / sum;
+
+	/* small range correction by linear counting */
+	if (estimate <= 2.5 * m && nzeros > 0)
+		estimate = m * log(m / (double) nzeros);
+
+	PG_RETURN_INT64((int64) rint(estimate));
+}
+PG_FUNCTION_INFO_V1(pgstrom_hll_final);
+
+/*
+ * Quantile sketch based approximate percentile
+ *
+ * State of the aggregation is a set of (qsketch item, count) bins sorted
+ * by the item, thus by the value. Once number of bins exceeds
+ * GPUPREAGG_QSKETCH_MAX_BINS, the lowest two bins are collapsed, so state
+ * never grows more than the limit, and only accuracy of the lowest
+ * percentiles is lost. GpuPreAgg generates the bins for each chunk, then
+ * pgstrom.approx_percentile(int4,int4,...) merges them; CPU version builds
+ * the bins from the raw values by itself.
+ */
+typedef struct
+{
+	cl_int		item;
+	int64		count;
+} qsketch_bin;
+
+typedef struct
+{
+	int64		count;			/* total number of values */
+	int			nbins;			/* number of valid bins */
+	int			nrooms;			/* length of the bins[] */
+	qsketch_bin *bins;
+	bool		is_array;		/* true, if percentile is float8[] */
+	Datum		percentile;		/* copy of the percentile argument */
+} qsketch_state;
+
+/* gpupreagg_qsketch_item - placeholder function that generates an item */
+Datum
+gpupreagg_qsketch_item(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT32(gpupreagg_qsketch_make_item(PG_GETARG_FLOAT8(0)));
+}
+PG_FUNCTION_INFO_V1(gpupreagg_qsketch_item);
+
+static qsketch_state *
+qsketch_get_state(FunctionCallInfo fcinfo, int pc_argno)
+{
+	MemoryContext	aggcxt;
+	MemoryContext	oldcxt;
+	qsketch_state  *state;
+
+	if (!AggCheckCallContext(fcinfo, &aggcxt))
+		elog(ERROR, "aggregate function called in non-aggregate context");
+
+	if (!PG_ARGISNULL(0))
+		return (qsketch_state *) PG_GETARG_POINTER(0);
+
+	/*
+	 * percentile shall be a constant, so we keep the value at the first
+	 * call for the final function.
+	 */
+	oldcxt = MemoryContextSwitchTo(aggcxt);
+	state = palloc0(sizeof(qsketch_state));
+	state->nrooms = 32;
+	state->bins = palloc(sizeof(qsketch_bin) * state->nrooms);
+	state->is_array = (get_fn_expr_argtype(fcinfo->flinfo,
+										   pc_argno) != FLOAT8OID);
+	if (PG_ARGISNULL(pc_argno))
+		state->percentile = PointerGetDatum(NULL);
+	else if (!state->is_array)
+		state->percentile = Float8GetDatum(PG_GETARG_FLOAT8(pc_argno));
+	else
+		state->percentile =
+			PointerGetDatum(PG_GETARG_ARRAYTYPE_P_COPY(pc_argno));
+	MemoryContextSwitchTo(oldcxt);
+
+	return state;
+}
+
+static void
+qsketch_add_bin(qsketch_state *state, cl_int item, int64 count)
+{
+	qsketch_bin *bins = state->bins;
+	int			lo = 0;
+	int			hi = state->nbins;
+
+	/* binary search of the item */
+	while (lo < hi)
+	{
+		int		mid = (lo + hi) / 2;
+
+		if (bins[mid].item < item)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	state->count += count;
+	if (lo < state->nbins && bins[lo].item == item)
+	{
+		bins[lo].count += count;
+		return;
+	}
+
+	/* insert a new bin */
+	if (state->nbins == state->nrooms)
+	{
+		Assert(state->nrooms <= GPUPREAGG_QSKETCH_MAX_BINS);
+		state->nrooms = Min(2 * state->nrooms,
+							GPUPREAGG_QSKETCH_MAX_BINS + 1);
+		state->bins = bins = repalloc(bins, sizeof(qsketch_bin) *
+									  state->nrooms);
+	}
+	memmove(&bins[lo + 1], &bins[lo],
+			sizeof(qsketch_bin) * (state->nbins - lo));
+	bins[lo].item = item;
+	bins[lo].count = count;
+	state->nbins++;
+
+	/* collapse the lowest two bins, if too many */
+	if (state->nbins > GPUPREAGG_QSKETCH_MAX_BINS)
+	{
+		bins[1].count += bins[0].count;
+		memmove(&bins[0], &bins[1],
+				sizeof(qsketch_bin) * (state->nbins - 1));
+		state->nbins--;
+	}
+}
+
+/*
+ * pgstrom_qsketch_accum - update the sketch by the raw values
+ */
+Datum
+pgstrom_qsketch_accum(PG_FUNCTION_ARGS)
+{
+	qsketch_state *state = qsketch_get_state(fcinfo, 2);
+
+	if (!PG_ARGISNULL(1))
+	{
+		cl_int	item = gpupreagg_qsketch_make_item(PG_GETARG_FLOAT8(1));
+
+		qsketch_add_bin(state, item, 1);
+	}
+	PG_RETURN_POINTER(state);
+}
+PG_FUNCTION_INFO_V1(pgstrom_qsketch_accum);
+
+/*
+ * pgstrom_qsketch_item_accum - update the sketch by the partial bins
+ */
+Datum
+pgstrom_qsketch_item_accum(PG_FUNCTION_ARGS)
+{
+	qsketch_state *state = qsketch_get_state(fcinfo, 3);
+
+	if (!PG_ARGISNULL(1) && !PG_ARGISNULL(2))
+	{
+		int32	nrows = PG_GETARG_INT32(2);
+
+		if (nrows < 0)
+			elog(ERROR, "Bug? negative nrows were given");
+		if (nrows > 0)
+			qsketch_add_bin(state, PG_GETARG_INT32(1), nrows);
+	}
+	PG_RETURN_POINTER(state);
+}
+PG_FUNCTION_INFO_V1(pgstrom_qsketch_item_accum);
+
+/*
+ * qsketch_get_value - estimate a value at the supplied percentile
+ */
+static float8
+qsketch_get_value(qsketch_state *state, float8 percentile)
+{
+	double		gamma = GPUPREAGG_QSKETCH_GAMMA;
+	double		rank;
+	int64		total = 0;
+	cl_int		item;
+	int			i;
+
+	if (percentile < 0.0 || percentile > 1.0 || isnan(percentile))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("percentile value %g is not between 0 and 1",
+						percentile)));
+	Assert(state->count > 0 && state->nbins > 0);
+
+	rank = percentile * (double)(state->count - 1);
+	for (i=0; i < state->nbins - 1; i++)
+	{
+		total += state->bins[i].count;
+		if ((double) total > rank)
+			break;
+	}
+	item = state->bins[i].item;
+
+	/* representative value of the bucket */
+	if (item == INT_MAX)
+		return get_float8_nan();
+	else if (item == 0)
+		return 0.0;
+	else if (item > 0)
+		return 2.0 * pow(gamma, (double)(item - GPUPREAGG_QSKETCH_BIAS))
+			/ (gamma + 1.0);
+	return -2.0 * pow(gamma, (double)(-item - GPUPREAGG_QSKETCH_BIAS))
+		/ (gamma + 1.0);
+}
+
+/*
+ * pgstrom_qsketch_final - approx_percentile(float8, float8)
+ */
+Datum
+pgstrom_qsketch_final(PG_FUNCTION_ARGS)
+{
+	qsketch_state *state;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	state = (qsketch_state *) PG_GETARG_POINTER(0);
+	if (state->count == 0 || !DatumGetPointer(state->percentile))
+		PG_RETURN_NULL();
+	Assert(!state->is_array);
+
+	PG_RETURN_FLOAT8(qsketch_get_value(state,
+									   DatumGetFloat8(state->percentile)));
+}
+PG_FUNCTION_INFO_V1(pgstrom_qsketch_final);
+
+/*
+ * pgstrom_qsketch_final_array - approx_percentile(float8, float8[])
+ */
+Datum
+pgstrom_qsketch_final_array(PG_FUNCTION_ARGS)
+{
+	qsketch_state *state;
+	ArrayType  *percentiles;
+	Datum	   *values;
+	bool	   *nulls;
+	int			nitems;
+	int			i;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	state = (qsketch_state *) PG_GETARG_POINTER(0);
+	if (state->count == 0 || !DatumGetPointer(state->percentile))
+		PG_RETURN_NULL();
+	Assert(state->is_array);
+
+	percentiles = DatumGetArrayTypeP(state->percentile);
+	deconstruct_array(percentiles,
+					  FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL, 'd',
+					  &values, &nulls, &nitems);
+	for (i=0; i < nitems; i++)
+	{
+		float8	value;
+
+		if (nulls[i])
+			continue;
+		value = qsketch_get_value(state, DatumGetFloat8(values[i]));
+		values[i] = Float8GetDatum(value);
+	}
+	PG_RETURN_ARRAYTYPE_P(construct_md_array(values, nulls,
+											 ARR_NDIM(percentiles),
+											 ARR_DIMS(percentiles),
+											 ARR_LBOUND(percentiles),
+											 FLOAT8OID,
+											 sizeof(float8),
+											 FLOAT8PASSBYVAL,
+											 'd'));
+}
+PG_FUNCTION_INFO_V1(pgstrom_qsketch_final_array);
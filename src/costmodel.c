@@ -0,0 +1,847 @@
+/*
+ * costmodel.c
+ *
+ * Self-calibration of the cost model for PG-Strom's custom-scan nodes
+ * ----
+ * Copyright 2011-2015 (C) KaiGai Kohei <kaigai@kaigai.gr.jp>
+ * Copyright 2014-2015 (C) The PG-Strom Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include "postgres.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "optimizer/cost.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/snapmgr.h"
+#include "pg_strom.h"
+#include <math.h>
+
+/*
+ * GpuCostModelHead - calibrated cost coefficients shared by all the
+ * backends. It is saved on PGSTROM_COSTMODEL_FILE, then reloaded on
+ * the next startup.
+ */
+typedef struct
+{
+	slock_t			lock;
+	bool			valid[GpuCostNode__Max];
+	GpuCostCoeff	coeff[GpuCostNode__Max];
+} GpuCostModelHead;
+
+#define PGSTROM_COSTMODEL_FILE		"pg_strom_costmodel"
+#define PGSTROM_COSTMODEL_MAGIC		0x20150902
+
+/* static variables */
+static shmem_startup_hook_type shmem_startup_next;
+static GpuCostModelHead *costmodel_head = NULL;
+static bool		pgstrom_calibrated_cost_model;
+static bool		pgstrom_calibrate_at_startup;
+static char	   *pgstrom_calibrate_database;
+
+static const char *costnode_names[] = {
+	"GpuScan",
+	"GpuJoin",
+	"GpuPreAgg",
+	"GpuSort",
+};
+
+/*
+ * Micro-workloads for calibration
+ *
+ * Each workload is run on the tables with two different number of rows
+ * and two different width, and with two different number of operators
+ * in the qualifier. Then, elapsed time is fit to the linear model below:
+ *
+ *   T = setup + N * (tuple + k * operator + w * byte)
+ *
+ * where N is number of rows, k is number of operators and w is width of
+ * the tuples.
+ */
+static const char *costnode_workloads[] = {
+	/* GpuScan */
+	"SELECT count(pad) FROM %s WHERE %s",
+	/* GpuJoin */
+	"SELECT count(t.pad) FROM %s t JOIN __pgstrom_calib_dim d"
+	" ON t.id %% 1000 = d.id WHERE %s",
+	/* GpuPreAgg */
+	"SELECT id %% 100, count(*), sum(x) FROM %s WHERE %s GROUP BY 1",
+	/* GpuSort */
+	"SELECT * FROM %s WHERE %s ORDER BY x OFFSET 1000000000",
+};
+
+#define CALIB_NROWS_SMALL		50000
+#define CALIB_NROWS_LARGE		200000
+#define CALIB_WIDTH_NARROW		8
+#define CALIB_WIDTH_WIDE		200
+#define CALIB_NOPS_FEW			1
+#define CALIB_NOPS_MANY			4
+#define CALIB_NLOOPS			2
+#define CALIB_NSAMPLES			8
+
+/*
+ * pgstrom_get_cost_coeff
+ *
+ * It returns cost coefficients of the supplied node type. If cost model
+ * was not calibrated yet, or pg_strom.calibrated_cost_model is off, it
+ * returns the values configured by GUC parameters, which reproduce the
+ * cost formulas prior to the calibration; no extra per-tuple or per-byte
+ * cost, and GpuScan scales its device qualifiers by gpu_tuple_cost
+ * towards cpu_tuple_cost.
+ */
+void
+pgstrom_get_cost_coeff(GpuCostNode node, GpuCostCoeff *coeff)
+{
+	Assert(node >= 0 && node < GpuCostNode__Max);
+
+	if (pgstrom_calibrated_cost_model && costmodel_head)
+	{
+		bool	found = false;
+
+		SpinLockAcquire(&costmodel_head->lock);
+		if (costmodel_head->valid[node])
+		{
+			memcpy(coeff, &costmodel_head->coeff[node],
+				   sizeof(GpuCostCoeff));
+			found = true;
+		}
+		SpinLockRelease(&costmodel_head->lock);
+
+		if (found)
+			return;
+	}
+	coeff->setup_cost = pgstrom_gpu_setup_cost;
+	coeff->tuple_cost = 0.0;
+	coeff->operator_cost = pgstrom_gpu_operator_cost;
+	coeff->byte_cost = 0.0;
+	if (node == GpuCostNodeScan)
+	{
+		if (cpu_tuple_cost > 0.0)
+			coeff->operator_cost = (cpu_operator_cost *
+									pgstrom_gpu_tuple_cost / cpu_tuple_cost);
+		else
+		{
+			coeff->operator_cost = cpu_operator_cost;
+			coeff->tuple_cost = disable_cost;
+		}
+	}
+}
+
+/*
+ * costmodel_save_file / costmodel_load_file
+ *
+ * It saves / loads the calibrated cost model
+ */
+static void
+costmodel_save_file(bool *valid, GpuCostCoeff *coeff)
+{
+	char	   *tmpfile;
+	FILE	   *filp;
+	uint32		magic = PGSTROM_COSTMODEL_MAGIC;
+	uint32		nitems = GpuCostNode__Max;
+
+	/* concurrent calibrations must not share the temporary file */
+	tmpfile = psprintf("%s.%d.tmp", PGSTROM_COSTMODEL_FILE, MyProcPid);
+	filp = AllocateFile(tmpfile, PG_BINARY_W);
+	if (!filp)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", tmpfile)));
+	if (fwrite(&magic, sizeof(uint32), 1, filp) != 1 ||
+		fwrite(&nitems, sizeof(uint32), 1, filp) != 1 ||
+		fwrite(valid, sizeof(bool), nitems, filp) != nitems ||
+		fwrite(coeff, sizeof(GpuCostCoeff), nitems, filp) != nitems)
+	{
+		FreeFile(filp);
+		unlink(tmpfile);
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", tmpfile)));
+	}
+	if (FreeFile(filp) != 0)
+	{
+		unlink(tmpfile);
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m", tmpfile)));
+	}
+	if (rename(tmpfile, PGSTROM_COSTMODEL_FILE) != 0)
+	{
+		unlink(tmpfile);
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rename file \"%s\" to \"%s\": %m",
+						tmpfile, PGSTROM_COSTMODEL_FILE)));
+	}
+	pfree(tmpfile);
+}
+
+static void
+costmodel_load_file(void)
+{
+	FILE	   *filp;
+	uint32		magic;
+	uint32		nitems;
+	bool		valid[GpuCostNode__Max];
+	GpuCostCoeff coeff[GpuCostNode__Max];
+
+	filp = AllocateFile(PGSTROM_COSTMODEL_FILE, PG_BINARY_R);
+	if (!filp)
+	{
+		if (errno != ENOENT)
+			elog(LOG, "could not open file \"%s\": %m",
+				 PGSTROM_COSTMODEL_FILE);
+		return;
+	}
+
+	if (fread(&magic, sizeof(uint32), 1, filp) != 1 ||
+		fread(&nitems, sizeof(uint32), 1, filp) != 1 ||
+		magic != PGSTROM_COSTMODEL_MAGIC ||
+		nitems != GpuCostNode__Max ||
+		fread(valid, sizeof(bool), nitems, filp) != nitems ||
+		fread(coeff, sizeof(GpuCostCoeff), nitems, filp) != nitems)
+	{
+		elog(LOG, "PG-Strom: cost model file \"%s\" is corrupted, ignored",
+			 PGSTROM_COSTMODEL_FILE);
+	}
+	else
+	{
+		memcpy(costmodel_head->valid, valid, sizeof(valid));
+		memcpy(costmodel_head->coeff, coeff, sizeof(coeff));
+	}
+	FreeFile(filp);
+}
+
+/*
+ * calibrate_set_config
+ */
+static void
+calibrate_set_config(const char *name, const char *value)
+{
+	(void) set_config_option(name, value,
+							 PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+}
+
+/*
+ * calibrate_check_plan
+ *
+ * It checks whether the query is actually run by the node to be
+ * calibrated.
+ */
+static bool
+calibrate_check_plan(const char *query, const char *node_name)
+{
+	char	   *explain = psprintf("EXPLAIN %s", query);
+	bool		found = false;
+	uint64		i;
+
+	if (SPI_execute(explain, false, 0) != SPI_OK_UTILITY)
+		elog(ERROR, "failed on SPI_execute: %s", explain);
+
+	for (i=0; !found && i < SPI_processed; i++)
+	{
+		char   *line = SPI_getvalue(SPI_tuptable->vals[i],
+									SPI_tuptable->tupdesc, 1);
+		if (line && strstr(line, node_name) != NULL)
+			found = true;
+	}
+	pfree(explain);
+
+	return found;
+}
+
+/*
+ * calibrate_run_query
+ *
+ * It returns the best elapsed time in milliseconds. The first execution
+ * is a warm-up, to exclude run-time compile of GPU kernel.
+ */
+static double
+calibrate_run_query(const char *query)
+{
+	struct timeval	tv1, tv2;
+	double			elapsed;
+	double			best = -1.0;
+	int				i;
+
+	for (i=0; i <= CALIB_NLOOPS; i++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		gettimeofday(&tv1, NULL);
+		if (SPI_execute(query, false, 0) != SPI_OK_SELECT)
+			elog(ERROR, "failed on SPI_execute: %s", query);
+		gettimeofday(&tv2, NULL);
+
+		if (i == 0)
+			continue;
+		elapsed = ((double)((tv2.tv_sec - tv1.tv_sec) * 1000000L +
+							(tv2.tv_usec - tv1.tv_usec)) / 1000.0);
+		if (best < 0.0 || elapsed < best)
+			best = elapsed;
+	}
+	return best;
+}
+
+/*
+ * calibrate_fit_linear
+ *
+ * least squares method to fit T = X * beta, using normal equation
+ */
+static bool
+calibrate_fit_linear(double X[CALIB_NSAMPLES][4],
+					 double T[CALIB_NSAMPLES],
+					 double beta[4])
+{
+	double		A[4][5];
+	double		scale[4];
+	int			i, j, k;
+
+	/* normalization of each column to avoid poor condition */
+	for (j=0; j < 4; j++)
+	{
+		scale[j] = 0.0;
+		for (i=0; i < CALIB_NSAMPLES; i++)
+			scale[j] = Max(scale[j], fabs(X[i][j]));
+		if (scale[j] == 0.0)
+			return false;
+	}
+
+	/* normal equation: (X^T X) beta = X^T T */
+	for (j=0; j < 4; j++)
+	{
+		for (k=0; k < 4; k++)
+		{
+			A[j][k] = 0.0;
+			for (i=0; i < CALIB_NSAMPLES; i++)
+				A[j][k] += (X[i][j] / scale[j]) * (X[i][k] / scale[k]);
+		}
+		A[j][4] = 0.0;
+		for (i=0; i < CALIB_NSAMPLES; i++)
+			A[j][4] += (X[i][j] / scale[j]) * T[i];
+	}
+
+	/* gaussian elimination with partial pivoting */
+	for (j=0; j < 4; j++)
+	{
+		int		pivot = j;
+
+		for (i=j+1; i < 4; i++)
+		{
+			if (fabs(A[i][j]) > fabs(A[pivot][j]))
+				pivot = i;
+		}
+		if (fabs(A[pivot][j]) < 1.0e-12)
+			return false;
+		if (pivot != j)
+		{
+			for (k=0; k < 5; k++)
+			{
+				double	temp = A[j][k];
+
+				A[j][k] = A[pivot][k];
+				A[pivot][k] = temp;
+			}
+		}
+		for (i=0; i < 4; i++)
+		{
+			double	ratio;
+
+			if (i == j)
+				continue;
+			ratio = A[i][j] / A[j][j];
+			for (k=j; k < 5; k++)
+				A[i][k] -= ratio * A[j][k];
+		}
+	}
+	for (j=0; j < 4; j++)
+		beta[j] = A[j][4] / A[j][j] / scale[j];
+
+	return true;
+}
+
+/*
+ * calibrate_one_node
+ *
+ * It runs the micro-workloads of the supplied node type, with and
+ * without PG-Strom, then fits the coefficients in cost unit.
+ */
+static bool
+calibrate_one_node(GpuCostNode node, GpuCostCoeff *coeff)
+{
+	const char *node_name = costnode_names[node];
+	double		X[CALIB_NSAMPLES][4];
+	double		T_gpu[CALIB_NSAMPLES];
+	double		T_cpu[CALIB_NSAMPLES];
+	double		beta_gpu[4];
+	double		beta_cpu[4];
+	double		unit;
+	int			index = 0;
+	int			i, j, k;
+
+	for (i=0; i < 2; i++)			/* number of rows */
+	{
+		for (j=0; j < 2; j++)		/* width of the tuple */
+		{
+			for (k=0; k < 2; k++)	/* number of operators */
+			{
+				int		nrows = (i == 0 ? CALIB_NROWS_SMALL
+								 : CALIB_NROWS_LARGE);
+				int		width = (j == 0 ? CALIB_WIDTH_NARROW
+								 : CALIB_WIDTH_WIDE);
+				int		nops = (k == 0 ? CALIB_NOPS_FEW
+								: CALIB_NOPS_MANY);
+				StringInfoData qual;
+				char   *relname;
+				char   *query;
+				int		save_nestlevel;
+				int		l;
+
+				initStringInfo(&qual);
+				for (l=0; l < nops; l++)
+					appendStringInfo(&qual, "%sx + %d.0 > -1.0",
+									 l > 0 ? " AND " : "", l);
+				relname = psprintf("__pgstrom_calib_%d_%d", nrows, width);
+				query = psprintf(costnode_workloads[node],
+								 relname, qual.data);
+
+				/* run the workload with PG-Strom */
+				save_nestlevel = NewGUCNestLevel();
+				calibrate_set_config("pg_strom.enabled", "on");
+				calibrate_set_config("pg_strom.calibrated_cost_model", "off");
+				calibrate_set_config("pg_strom.gpu_setup_cost", "0");
+				calibrate_set_config("pg_strom.gpu_operator_cost", "0");
+				calibrate_set_config("pg_strom.gpu_tuple_cost", "0");
+				calibrate_set_config("pg_strom.enable_gpupreagg",
+									 node == GpuCostNodePreAgg ? "on" : "off");
+				calibrate_set_config("pg_strom.debug_force_gpupreagg",
+									 node == GpuCostNodePreAgg ? "on" : "off");
+				calibrate_set_config("pg_strom.enable_gpusort",
+									 node == GpuCostNodeSort ? "on" : "off");
+				calibrate_set_config("pg_strom.debug_force_gpusort",
+									 node == GpuCostNodeSort ? "on" : "off");
+				if (!calibrate_check_plan(query, node_name))
+				{
+					AtEOXact_GUC(true, save_nestlevel);
+					elog(WARNING, "PG-Strom: planner did not choose %s "
+						 "for the calibration workload, skipped", node_name);
+					return false;
+				}
+				T_gpu[index] = calibrate_run_query(query);
+				AtEOXact_GUC(true, save_nestlevel);
+
+				/* run the workload by the native executor */
+				save_nestlevel = NewGUCNestLevel();
+				calibrate_set_config("pg_strom.enabled", "off");
+				T_cpu[index] = calibrate_run_query(query);
+				AtEOXact_GUC(true, save_nestlevel);
+
+				X[index][0] = 1.0;
+				X[index][1] = (double) nrows;
+				X[index][2] = (double) nrows * (double) nops;
+				X[index][3] = (double) nrows * (double) width;
+				index++;
+
+				elog(DEBUG1, "%s calibration: nrows=%d width=%d nops=%d "
+					 "gpu=%.3fms cpu=%.3fms",
+					 node_name, nrows, width, nops,
+					 T_gpu[index-1], T_cpu[index-1]);
+				pfree(query);
+				pfree(relname);
+				pfree(qual.data);
+			}
+		}
+	}
+	Assert(index == CALIB_NSAMPLES);
+
+	if (!calibrate_fit_linear(X, T_gpu, beta_gpu) ||
+		!calibrate_fit_linear(X, T_cpu, beta_cpu) ||
+		beta_cpu[1] <= 0.0)
+	{
+		elog(WARNING, "PG-Strom: calibration of %s was unstable, skipped",
+			 node_name);
+		return false;
+	}
+
+	/*
+	 * Translation from milliseconds to the cost unit.
+	 *
+	 * The workloads also include scan I/O and the upper nodes, which are
+	 * common to both plans, so every term is derived from the difference
+	 * between GPU and native execution. The operator cost scales the host
+	 * cost of expressions, so the difference is added to cpu_operator_cost.
+	 * The other terms are charged on top of what the GPU nodes already
+	 * charge for the host side, so only the difference is kept.
+	 * The time per operator evaluation is the cleanest anchor, since it
+	 * contains nothing but the expression evaluation; it is equivalent to
+	 * cpu_operator_cost.
+	 */
+	if (beta_cpu[2] > 0.0)
+		unit = cpu_operator_cost / beta_cpu[2];
+	else
+		unit = cpu_tuple_cost / beta_cpu[1];
+	coeff->setup_cost = Max(beta_gpu[0] - beta_cpu[0], 0.0) * unit;
+	coeff->tuple_cost = Max(beta_gpu[1] - beta_cpu[1], 0.0) * unit;
+	coeff->operator_cost = Max(cpu_operator_cost +
+							   (beta_gpu[2] - beta_cpu[2]) * unit, 0.0);
+	coeff->byte_cost = Max(beta_gpu[3] - beta_cpu[3], 0.0) * unit;
+
+	return true;
+}
+
+/*
+ * pgstrom_calibrate_cost_model_internal
+ *
+ * It runs the calibration for all the node types, then saves the result
+ * on the shared memory and the file. Caller must be connected to SPI.
+ */
+static void
+pgstrom_calibrate_cost_model_internal(bool *valid, GpuCostCoeff *coeff)
+{
+	int		i, j;
+	int		node;
+
+	/* construct tables for micro-workloads */
+	for (i=0; i < 2; i++)
+	{
+		for (j=0; j < 2; j++)
+		{
+			int		nrows = (i == 0 ? CALIB_NROWS_SMALL : CALIB_NROWS_LARGE);
+			int		width = (j == 0 ? CALIB_WIDTH_NARROW : CALIB_WIDTH_WIDE);
+			char   *sql;
+
+			sql = psprintf("CREATE TEMP TABLE __pgstrom_calib_%d_%d AS "
+						   "SELECT i AS id, random() AS x, "
+						   "repeat('x', %d) AS pad "
+						   "FROM generate_series(1,%d) i",
+						   nrows, width, width, nrows);
+			if (SPI_execute(sql, false, 0) != SPI_OK_UTILITY)
+				elog(ERROR, "failed on SPI_execute: %s", sql);
+			pfree(sql);
+
+			sql = psprintf("ANALYZE __pgstrom_calib_%d_%d", nrows, width);
+			if (SPI_execute(sql, false, 0) != SPI_OK_UTILITY)
+				elog(ERROR, "failed on SPI_execute: %s", sql);
+			pfree(sql);
+		}
+	}
+	if (SPI_execute("CREATE TEMP TABLE __pgstrom_calib_dim AS "
+					"SELECT i AS id, md5(i::text) AS label "
+					"FROM generate_series(0,999) i", false, 0)
+		!= SPI_OK_UTILITY ||
+		SPI_execute("ANALYZE __pgstrom_calib_dim", false, 0)
+		!= SPI_OK_UTILITY)
+		elog(ERROR, "failed to construct tables for calibration");
+
+	/* run micro-workloads for each node type */
+	for (node=0; node < GpuCostNode__Max; node++)
+	{
+		memset(&coeff[node], 0, sizeof(GpuCostCoeff));
+		valid[node] = calibrate_one_node(node, &coeff[node]);
+		if (valid[node])
+			elog(LOG, "PG-Strom: %s cost model calibrated; "
+				 "setup=%.2f tuple=%.6f operator=%.6f byte=%.8f",
+				 costnode_names[node],
+				 coeff[node].setup_cost,
+				 coeff[node].tuple_cost,
+				 coeff[node].operator_cost,
+				 coeff[node].byte_cost);
+	}
+
+	/* cleanup */
+	for (i=0; i < 2; i++)
+	{
+		for (j=0; j < 2; j++)
+		{
+			char   *sql = psprintf("DROP TABLE __pgstrom_calib_%d_%d",
+								   i == 0 ? CALIB_NROWS_SMALL
+								   : CALIB_NROWS_LARGE,
+								   j == 0 ? CALIB_WIDTH_NARROW
+								   : CALIB_WIDTH_WIDE);
+			if (SPI_execute(sql, false, 0) != SPI_OK_UTILITY)
+				elog(ERROR, "failed on SPI_execute: %s", sql);
+			pfree(sql);
+		}
+	}
+	if (SPI_execute("DROP TABLE __pgstrom_calib_dim", false, 0)
+		!= SPI_OK_UTILITY)
+		elog(ERROR, "failed to drop tables for calibration");
+
+	/* save the result; node types not calibrated keep the last one */
+	SpinLockAcquire(&costmodel_head->lock);
+	for (node=0; node < GpuCostNode__Max; node++)
+	{
+		if (valid[node])
+		{
+			costmodel_head->valid[node] = true;
+			memcpy(&costmodel_head->coeff[node], &coeff[node],
+				   sizeof(GpuCostCoeff));
+		}
+	}
+	memcpy(valid, costmodel_head->valid, sizeof(bool) * GpuCostNode__Max);
+	memcpy(coeff, costmodel_head->coeff,
+		   sizeof(GpuCostCoeff) * GpuCostNode__Max);
+	SpinLockRelease(&costmodel_head->lock);
+
+	costmodel_save_file(valid, coeff);
+}
+
+/*
+ * costmodel_form_tuple
+ */
+static HeapTuple
+costmodel_form_tuple(TupleDesc tupdesc, int node,
+					 bool valid, GpuCostCoeff *coeff)
+{
+	Datum		values[6];
+	bool		isnull[6];
+
+	memset(isnull, 0, sizeof(isnull));
+	values[0] = CStringGetTextDatum(costnode_names[node]);
+	values[1] = BoolGetDatum(valid);
+	values[2] = Float8GetDatum(coeff->setup_cost);
+	values[3] = Float8GetDatum(coeff->tuple_cost);
+	values[4] = Float8GetDatum(coeff->operator_cost);
+	values[5] = Float8GetDatum(coeff->byte_cost);
+
+	return heap_form_tuple(tupdesc, values, isnull);
+}
+
+static TupleDesc
+costmodel_tuple_desc(void)
+{
+	TupleDesc	tupdesc = CreateTemplateTupleDesc(6, false);
+
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "node",
+					   TEXTOID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "calibrated",
+					   BOOLOID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "setup_cost",
+					   FLOAT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "tuple_cost",
+					   FLOAT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 5, "operator_cost",
+					   FLOAT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 6, "byte_cost",
+					   FLOAT8OID, -1, 0);
+	return BlessTupleDesc(tupdesc);
+}
+
+/*
+ * pgstrom_calibrate_cost_model
+ *
+ * SQL function to run calibration of the cost model
+ */
+typedef struct
+{
+	bool			valid[GpuCostNode__Max];
+	GpuCostCoeff	coeff[GpuCostNode__Max];
+} costmodel_result;
+
+Datum
+pgstrom_calibrate_cost_model(PG_FUNCTION_ARGS)
+{
+	FuncCallContext	   *fncxt;
+	costmodel_result   *cm_result;
+	HeapTuple			tuple;
+	int					node;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext	oldcxt;
+
+		if (!superuser())
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+					 errmsg("must be superuser to calibrate cost model")));
+
+		fncxt = SRF_FIRSTCALL_INIT();
+		oldcxt = MemoryContextSwitchTo(fncxt->multi_call_memory_ctx);
+		fncxt->tuple_desc = costmodel_tuple_desc();
+		cm_result = palloc0(sizeof(costmodel_result));
+		fncxt->user_fctx = cm_result;
+		MemoryContextSwitchTo(oldcxt);
+
+		if (SPI_connect() != SPI_OK_CONNECT)
+			elog(ERROR, "failed on SPI_connect");
+		pgstrom_calibrate_cost_model_internal(cm_result->valid,
+											  cm_result->coeff);
+		SPI_finish();
+	}
+	fncxt = SRF_PERCALL_SETUP();
+	cm_result = fncxt->user_fctx;
+	node = fncxt->call_cntr;
+
+	if (node >= GpuCostNode__Max)
+		SRF_RETURN_DONE(fncxt);
+
+	tuple = costmodel_form_tuple(fncxt->tuple_desc, node,
+								 cm_result->valid[node],
+								 &cm_result->coeff[node]);
+	SRF_RETURN_NEXT(fncxt, HeapTupleGetDatum(tuple));
+}
+PG_FUNCTION_INFO_V1(pgstrom_calibrate_cost_model);
+
+/*
+ * pgstrom_cost_model
+ *
+ * SQL function to show the cost coefficients being used by the planner
+ */
+Datum
+pgstrom_cost_model(PG_FUNCTION_ARGS)
+{
+	FuncCallContext	   *fncxt;
+	GpuCostCoeff		coeff;
+	HeapTuple			tuple;
+	bool				valid = false;
+	int					node;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext	oldcxt;
+
+		fncxt = SRF_FIRSTCALL_INIT();
+		oldcxt = MemoryContextSwitchTo(fncxt->multi_call_memory_ctx);
+		fncxt->tuple_desc = costmodel_tuple_desc();
+		MemoryContextSwitchTo(oldcxt);
+	}
+	fncxt = SRF_PERCALL_SETUP();
+	node = fncxt->call_cntr;
+
+	if (node >= GpuCostNode__Max)
+		SRF_RETURN_DONE(fncxt);
+
+	pgstrom_get_cost_coeff(node, &coeff);
+	if (pgstrom_calibrated_cost_model)
+	{
+		SpinLockAcquire(&costmodel_head->lock);
+		valid = costmodel_head->valid[node];
+		SpinLockRelease(&costmodel_head->lock);
+	}
+	tuple = costmodel_form_tuple(fncxt->tuple_desc, node, valid, &coeff);
+
+	SRF_RETURN_NEXT(fncxt, HeapTupleGetDatum(tuple));
+}
+PG_FUNCTION_INFO_V1(pgstrom_cost_model);
+
+/*
+ * bgw_calibrate_entrypoint
+ *
+ * background worker to run calibration on the server startup
+ */
+static void
+bgw_calibrate_entrypoint(Datum main_arg)
+{
+	bool			valid[GpuCostNode__Max];
+	GpuCostCoeff	coeff[GpuCostNode__Max];
+
+	/* We're now ready to receive signals */
+	BackgroundWorkerUnblockSignals();
+	/* Connect to our database */
+	BackgroundWorkerInitializeConnection(pgstrom_calibrate_database, NULL);
+
+	StartTransactionCommand();
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "failed on SPI_connect");
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	pgstrom_calibrate_cost_model_internal(valid, coeff);
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	proc_exit(0);
+}
+
+/*
+ * pgstrom_startup_costmodel
+ */
+static void
+pgstrom_startup_costmodel(void)
+{
+	bool	found;
+
+	if (shmem_startup_next)
+		(*shmem_startup_next)();
+
+	costmodel_head = ShmemInitStruct("PG-Strom Cost Model",
+									 MAXALIGN(sizeof(GpuCostModelHead)),
+									 &found);
+	if (found)
+		elog(ERROR, "Bug? shared memory for cost model already exists");
+
+	memset(costmodel_head, 0, sizeof(GpuCostModelHead));
+	SpinLockInit(&costmodel_head->lock);
+	costmodel_load_file();
+}
+
+/*
+ * pgstrom_init_costmodel
+ */
+void
+pgstrom_init_costmodel(void)
+{
+	DefineCustomBoolVariable("pg_strom.calibrated_cost_model",
+							 "Enables to use calibrated cost model",
+							 NULL,
+							 &pgstrom_calibrated_cost_model,
+							 true,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	DefineCustomBoolVariable("pg_strom.calibrate_at_startup",
+							 "Runs calibration of cost model on startup",
+							 NULL,
+							 &pgstrom_calibrate_at_startup,
+							 false,
+							 PGC_POSTMASTER,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	DefineCustomStringVariable("pg_strom.calibrate_database",
+							   "Database to run calibration on startup",
+							   NULL,
+							   &pgstrom_calibrate_database,
+							   "postgres",
+							   PGC_POSTMASTER,
+							   GUC_NOT_IN_SAMPLE,
+							   NULL, NULL, NULL);
+
+	/* launch calibration worker on startup, if required */
+	if (pgstrom_calibrate_at_startup)
+	{
+		BackgroundWorker	worker;
+
+		memset(&worker, 0, sizeof(BackgroundWorker));
+		snprintf(worker.bgw_name, sizeof(worker.bgw_name),
+				 "PG-Strom cost model calibration");
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+			BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = BGW_NEVER_RESTART;
+		worker.bgw_main = bgw_calibrate_entrypoint;
+		worker.bgw_main_arg = 0;
+		RegisterBackgroundWorker(&worker);
+	}
+
+	/* shared memory for calibrated cost model */
+	RequestAddinShmemSpace(MAXALIGN(sizeof(GpuCostModelHead)));
+	shmem_startup_next = shmem_startup_hook;
+	shmem_startup_hook = pgstrom_startup_costmodel;
+}
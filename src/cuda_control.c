@@ -49,6 +49,11 @@ static CUdevice	   *cuda_devices = NULL;
 /* misc static variables */
 static shmem_startup_hook_type shmem_startup_next;
 
+/* adaptive concurrency of asynchronous tasks */
+static bool			pgstrom_adaptive_async_tasks;
+static int			pgstrom_async_memory_budget;	/* in MB, 0 = unlimited */
+static Size			async_budget_local = 0;		/* charged by this backend */
+
 /* ----------------------------------------------------------------
  *
  * Routines to share the status of device resource consumption
@@ -59,6 +64,7 @@ typedef struct {
 	volatile slock_t lock;
 	cl_uint			num_devices;
 	cl_uint			num_backends;
+	size_t			host_inflight;	/* host memory of in-flight tasks */
 	struct {
 		size_t		gmem_size;
 		size_t		gmem_used;
@@ -73,6 +79,66 @@ cleanup_cuda_score_board(int code, Datum arg)
 	/*
 	 * decrement usage of gmem_used for each active GpuContext
 	 */
+
+	/*
+	 * give back host memory budget held by this backend, if any
+	 */
+	if (gpu_score_board && async_budget_local > 0)
+	{
+		SpinLockAcquire(&gpu_score_board->lock);
+		if (gpu_score_board->host_inflight > async_budget_local)
+			gpu_score_board->host_inflight -= async_budget_local;
+		else
+			gpu_score_board->host_inflight = 0;
+		SpinLockRelease(&gpu_score_board->lock);
+		async_budget_local = 0;
+	}
+}
+
+/*
+ * async_budget_charge / async_budget_uncharge
+ *
+ * It tracks amount of host memory consumed by in-flight GpuTasks across
+ * all the backends, to avoid a flood of asynchronous tasks that exhausts
+ * host memory when multiple concurrent queries run. If 'force' is true,
+ * charge is always accepted even if it goes beyond the budget; caller
+ * uses this mode to ensure at least one task is in-flight.
+ */
+static bool
+async_budget_charge(Size size, bool force)
+{
+	Size	budget = ((Size) pgstrom_async_memory_budget) << 20;
+	bool	result = true;
+
+	SpinLockAcquire(&gpu_score_board->lock);
+	if (!force && gpu_score_board->host_inflight + size > budget)
+		result = false;
+	else
+	{
+		gpu_score_board->host_inflight += size;
+		async_budget_local += size;
+	}
+	SpinLockRelease(&gpu_score_board->lock);
+
+	return result;
+}
+
+static void
+async_budget_uncharge(Size size)
+{
+	if (size == 0)
+		return;
+
+	SpinLockAcquire(&gpu_score_board->lock);
+	Assert(gpu_score_board->host_inflight >= size);
+	if (gpu_score_board->host_inflight > size)
+		gpu_score_board->host_inflight -= size;
+	else
+		gpu_score_board->host_inflight = 0;
+	SpinLockRelease(&gpu_score_board->lock);
+
+	Assert(async_budget_local >= size);
+	async_budget_local -= Min(size, async_budget_local);
 }
 
 /* ----------------------------------------------------------------
@@ -901,6 +967,10 @@ pgstrom_cleanup_gputaskstate(GpuTaskState *gts)
 	gts->num_ready_tasks = 0;
 	SpinLockRelease(&gts->lock);
 
+	/* give back host memory budget charged by the tasks above */
+	async_budget_uncharge(gts->async_budget_used);
+	gts->async_budget_used = 0;
+
 	gts->curr_task = NULL;
 	gts->curr_index = 0;
 }
@@ -961,8 +1031,27 @@ pgstrom_init_gputaskstate(GpuContext *gcontext, GpuTaskState *gts)
 	gts->cb_task_polling = NULL;
 	gts->cb_next_chunk = NULL;
 	gts->cb_next_tuple = NULL;
+	gts->chunk_size = 0;		/* to be set on the first chunk */
+	gts->chunk_direction = 1;
+	gts->chunk_cost = 0.0;
+	memset(&gts->chunk_pfm, 0, sizeof(pgstrom_perfmon));
+	/* in-flight window starts small, then adjust_async_limit expands */
+	gts->async_limit = (pgstrom_adaptive_async_tasks
+						? Min(2, pgstrom_max_async_tasks)
+						: pgstrom_max_async_tasks);
+	gts->async_direction = 1;
+	gts->async_nr_fetched = 0;
+	gettimeofday(&gts->async_tv_last, NULL);
+	gts->async_rate = 0.0;
+	gts->async_latency = 0.0;
+	gts->async_latency_sum = 0.0;
+	gts->async_latency_cnt = 0;
+	gts->async_overbudget = false;
+	gts->async_budget_used = 0;
 	memset(&gts->pfm_accum, 0, sizeof(pgstrom_perfmon));
-	gts->pfm_accum.enabled = pgstrom_perfmon_enabled;
+	/* adaptive chunk size also needs performance counter */
+	gts->pfm_accum.enabled = (pgstrom_perfmon_enabled ||
+							  pgstrom_adaptive_chunk_enabled());
 }
 
 /*
@@ -1012,14 +1101,27 @@ check_completed_tasks(GpuTaskState *gts)
 		 */
 		if (gts->cb_task_complete(gtask))
 		{
+			struct timeval	tv;
+
 			/* release common cuda fields and its stream */
 			pgstrom_cleanup_gputask_cuda_resources(gtask);
+			gettimeofday(&tv, NULL);
 
 			SpinLockAcquire(&gts->lock);
 			if (gtask->errcode != StromError_Success)
 				dlist_push_head(&gts->ready_tasks, &gtask->chain);
 			else
+			{
 				dlist_push_tail(&gts->ready_tasks, &gtask->chain);
+				/* queueing delay; from enqueue to ready, if stamped */
+				if (gtask->tv_enqueue.tv_sec != 0)
+				{
+					gts->async_latency_sum += ((double)
+						((tv.tv_sec - gtask->tv_enqueue.tv_sec) * 1000000L +
+						 (tv.tv_usec - gtask->tv_enqueue.tv_usec)) / 1000.0);
+					gts->async_latency_cnt++;
+				}
+			}
 			gts->num_ready_tasks++;
 		}
 		else
@@ -1249,6 +1351,100 @@ waitfor_ready_tasks(GpuTaskState *gts)
 	return status;
 }
 
+/*
+ * adjust_async_limit
+ *
+ * It adjusts the number of in-flight GpuTasks (running, pending and ready
+ * ones) according to the observed behavior, instead of the fixed
+ * pg_strom.max_async_tasks. Like the adaptive chunk size, it walks the
+ * window towards the direction that improves throughput (number of
+ * tasks fetched per second), but backs off when queueing delay of
+ * the tasks grows rapidly (it means device is already saturated and
+ * additional tasks just wait for the slot) or the host memory budget
+ * shared by all the backends was hit.
+ * pg_strom.max_async_tasks still performs as upper limit of the window.
+ */
+static void
+adjust_async_limit(GpuTaskState *gts)
+{
+	cl_int		limit = gts->async_limit;
+	struct timeval tv;
+	double		elapsed;
+	double		rate;
+	double		latency;
+
+	if (!pgstrom_adaptive_async_tasks)
+	{
+		gts->async_limit = pgstrom_max_async_tasks;
+		return;
+	}
+
+	if (gts->async_overbudget)
+	{
+		/* host memory is exhausted; shrink the window quickly */
+		limit /= 2;
+		gts->async_direction = -1;
+		gts->async_overbudget = false;
+	}
+	else
+	{
+		/* wait for enough samples to evaluate the current window */
+		if (gts->async_nr_fetched < Max(gts->async_limit, 2))
+			return;
+
+		gettimeofday(&tv, NULL);
+		elapsed = ((double)((tv.tv_sec - gts->async_tv_last.tv_sec) * 1000000L +
+							(tv.tv_usec - gts->async_tv_last.tv_usec)) / 1000.0);
+		if (elapsed <= 0.0)
+			return;
+		rate = (double) gts->async_nr_fetched * 1000.0 / elapsed;
+		latency = (gts->async_latency_cnt > 0
+				   ? gts->async_latency_sum / (double) gts->async_latency_cnt
+				   : 0.0);
+
+		if (gts->async_rate == 0.0)
+			limit += gts->async_direction;		/* first evaluation */
+		else if (gts->async_latency > 0.0 &&
+				 latency > 1.5 * gts->async_latency)
+		{
+			/* more tasks just wait for device; back off */
+			gts->async_direction = -1;
+			limit--;
+		}
+		else if (rate > 1.05 * gts->async_rate)
+			limit += gts->async_direction;
+		else if (rate < 0.95 * gts->async_rate)
+		{
+			/* got worse, so try the opposite direction */
+			gts->async_direction = -gts->async_direction;
+			limit += gts->async_direction;
+		}
+		/* elsewhere, throughput is stable; keep the current window */
+
+		gts->async_rate = rate;
+		gts->async_latency = latency;
+		gts->async_tv_last = tv;
+	}
+
+	if (limit >= pgstrom_max_async_tasks)
+	{
+		limit = pgstrom_max_async_tasks;
+		gts->async_direction = -1;
+	}
+	if (limit <= 1)
+	{
+		limit = 1;
+		gts->async_direction = 1;
+	}
+	if (limit != gts->async_limit)
+		elog(DEBUG1, "%s: async tasks window %u => %d",
+			 gts->css.methods->CustomName, gts->async_limit, limit);
+	gts->async_limit = limit;
+	gts->async_nr_fetched = 0;
+	gts->async_latency_sum = 0.0;
+	gts->async_latency_cnt = 0;
+}
+
 /*
  * pgstrom_fetch_gputask
  *
@@ -1276,11 +1472,13 @@ pgstrom_fetch_gputask(GpuTaskState *gts)
 
 	/*
 	 * We try to keep multiple GpuTask requests being enqueued, unless
-	 * it does not reach to pgstrom_max_async_tasks.
-	 *
-	 * TODO: number of requests should be controled by GpuContext, not
-	 * GpuTaskState granuality. Needs more investigation.
+	 * it does not reach to the current in-flight window (async_limit)
+	 * being adjusted by adjust_async_limit().
+	 * Host memory consumed by in-flight tasks is also charged on the
+	 * budget shared by all the backends (pg_strom.async_memory_budget),
+	 * however, at least one task is always allowed to run.
 	 */
+	adjust_async_limit(gts);
 	do {
 		CHECK_FOR_INTERRUPTS();
 
@@ -1290,28 +1488,52 @@ pgstrom_fetch_gputask(GpuTaskState *gts)
 
 		if (!gts->scan_done)
 		{
-			while (pgstrom_max_async_tasks > (gts->num_running_tasks +
-											   gts->num_pending_tasks +
-											   gts->num_ready_tasks))
+			while (gts->async_limit > (gts->num_running_tasks +
+									   gts->num_pending_tasks +
+									   gts->num_ready_tasks))
 			{
+				bool	no_inflight;
+				Size	budget_size = 0;
+
 				/* no urgent reason why to make the scan progress */
 				if (!dlist_is_empty(&gts->ready_tasks) &&
-					pgstrom_max_async_tasks < (gts->num_running_tasks +
-											   gts->num_pending_tasks))
+					gts->async_limit < (gts->num_running_tasks +
+										gts->num_pending_tasks))
 					break;
+				no_inflight = (gts->num_running_tasks +
+							   gts->num_pending_tasks +
+							   gts->num_ready_tasks == 0);
 				SpinLockRelease(&gts->lock);
 
+				if (pgstrom_async_memory_budget > 0)
+				{
+					budget_size = (gts->chunk_size > 0
+								   ? gts->chunk_size
+								   : pgstrom_chunk_size());
+					if (!async_budget_charge(budget_size, no_inflight))
+					{
+						SpinLockAcquire(&gts->lock);
+						gts->async_overbudget = true;
+						break;
+					}
+				}
 				gtask = gts->cb_next_chunk(gts);
 				Assert(!gtask || gtask->gts == gts);
 
 				SpinLockAcquire(&gts->lock);
 				if (!gtask)
 				{
+					SpinLockRelease(&gts->lock);
+					async_budget_uncharge(budget_size);
+					SpinLockAcquire(&gts->lock);
 					gts->scan_done = true;
 					elog(DEBUG1, "scan done (%s)",
 						 gts->css.methods->CustomName);
 					break;
 				}
+				gtask->budget_size = budget_size;
+				gts->async_budget_used += budget_size;
+				gettimeofday(&gtask->tv_enqueue, NULL);
 				dlist_push_tail(&gts->pending_tasks, &gtask->chain);
 				gts->num_pending_tasks++;
 
@@ -1347,8 +1569,15 @@ pgstrom_fetch_gputask(GpuTaskState *gts)
 	dnode = dlist_pop_head_node(&gts->ready_tasks);
 	gtask = dlist_container(GpuTask, chain, dnode);
     memset(&gtask->chain, 0, sizeof(dlist_node));
+	Assert(gts->async_budget_used >= gtask->budget_size);
+	gts->async_budget_used -= gtask->budget_size;
+	gts->async_nr_fetched++;
 	SpinLockRelease(&gts->lock);
 
+	/* task is no longer in-flight, so give back its budget */
+	async_budget_uncharge(gtask->budget_size);
+	gtask->budget_size = 0;
+
 	/*
 	 * Error handling
 	 */
@@ -1405,6 +1634,11 @@ pgstrom_init_gputask(GpuTaskState *gts, GpuTask *gtask)
 {
 	memset(gtask, 0, sizeof(GpuTask));
 	gtask->gts = gts;
+	/*
+	 * Some tasks are pushed to the pending_tasks directly, not via
+	 * pgstrom_fetch_gputask(), so we stamp the enqueue time here also.
+	 */
+	gettimeofday(&gtask->tv_enqueue, NULL);
 	/* to be tracked by GpuTaskState */
 	SpinLockAcquire(&gts->lock);
 	dlist_push_tail(&gts->tracked_tasks, &gtask->tracker);
@@ -1412,6 +1646,29 @@ pgstrom_init_gputask(GpuTaskState *gts, GpuTask *gtask)
 	gtask->pfm.enabled = gts->pfm_accum.enabled;
 }
 
+/*
+ * pgstrom_charge_gputask
+ *
+ * It charges additional host memory on the budget for a task that is
+ * chained on the pending_tasks without pgstrom_fetch_gputask(), like
+ * sub-tasks of a split chunk. The charge is always accepted because the
+ * task is already a part of the in-flight work.
+ */
+void
+pgstrom_charge_gputask(GpuTask *gtask, Size budget_size)
+{
+	GpuTaskState   *gts = gtask->gts;
+
+	if (pgstrom_async_memory_budget <= 0 || budget_size == 0)
+		return;
+
+	async_budget_charge(budget_size, true);
+	SpinLockAcquire(&gts->lock);
+	gtask->budget_size += budget_size;
+	gts->async_budget_used += budget_size;
+	SpinLockRelease(&gts->lock);
+}
+
 void
 pgstrom_release_gputask(GpuTask *gtask)
 {
@@ -1475,6 +1732,13 @@ gpucontext_cleanup_callback(ResourceReleasePhase phase,
 			break;
 		}
 	}
+
+	/*
+	 * No GpuTaskState can be alive without GpuContext, so host memory
+	 * budget still charged here was leaked by an aborted execution.
+	 */
+	if (dlist_is_empty(&gcontext_list) && async_budget_local > 0)
+		async_budget_uncharge(async_budget_local);
 }
 
 
@@ -1826,6 +2090,7 @@ pgstrom_startup_cuda_control(void)
 	SpinLockInit(&gpu_score_board->lock);
 	gpu_score_board->num_devices = num_devices;
 	gpu_score_board->num_backends = 0;
+	gpu_score_board->host_inflight = 0;
 	i = 0;
 	foreach (lc, cuda_device_mem_sizes)
 	{
@@ -1863,6 +2128,28 @@ pgstrom_init_cuda_control(void)
 			elog(ERROR, "failed to set CUDA_VISIBLE_DEVICES");
 	}
 
+	/*
+	 * Adaptive concurrency of asynchronous GpuTasks
+	 */
+	DefineCustomBoolVariable("pg_strom.adaptive_async_tasks",
+							 "Enables adaptive number of asynchronous tasks",
+							 NULL,
+							 &pgstrom_adaptive_async_tasks,
+							 true,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	DefineCustomIntVariable("pg_strom.async_memory_budget",
+							"Host memory budget for in-flight tasks of all the backends",
+							"0 means unlimited",
+							&pgstrom_async_memory_budget,
+							0,
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_MB,
+							NULL, NULL, NULL);
+
 	/*
 	 * initialization of CUDA runtime
 	 */
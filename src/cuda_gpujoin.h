@@ -34,7 +34,8 @@ typedef struct
 		cl_uint		ojmap_offset;	/* offset to Left-Outer Map, if any */
 		cl_bool		left_outer;		/* true, if JOIN_LEFT or JOIN_FULL */
 		cl_bool		right_outer;	/* true, if JOIN_RIGHT or JOIN_FULL */
-		cl_char		__padding__[2];
+		cl_bool		semi_join;		/* true, if JOIN_SEMI */
+		cl_bool		anti_join;		/* true, if JOIN_ANTI */
 	} chunks[FLEXIBLE_ARRAY_MEMBER];
 } kern_multirels;
 
@@ -64,6 +65,12 @@ typedef struct
 #define KERN_MULTIRELS_RIGHT_OUTER_JOIN(kmrels, depth)	\
 	((kmrels)->chunks[(depth)-1].right_outer)
 
+#define KERN_MULTIRELS_SEMI_JOIN(kmrels, depth)		\
+	((kmrels)->chunks[(depth)-1].semi_join)
+
+#define KERN_MULTIRELS_ANTI_JOIN(kmrels, depth)		\
+	((kmrels)->chunks[(depth)-1].anti_join)
+
 /*
  * Hash table and entry
  *
@@ -168,7 +175,12 @@ KERN_HASH_NEXT_ENTRY(kern_hashtable *khtable, kern_hashentry *khentry)
 
 /*
  * kern_gpujoin - control object of GpuJoin
+ *
+ * nitems_depth[d] reports number of input items to the depth (d+1);
+ * host-side uses them for cardinality feedback of the join fan-out.
  */
+#define GPUJOIN_MAX_FEEDBACK_DEPTH		16
+
 typedef struct
 {
 	size_t			kresults_1_offset;
@@ -177,6 +189,7 @@ typedef struct
 	size_t			kresults_max_items;
 	cl_uint			max_depth;
 	cl_int			errcode;
+	cl_uint			nitems_depth[GPUJOIN_MAX_FEEDBACK_DEPTH];
 	kern_parambuf	kparams;
 } kern_gpujoin;
 
@@ -401,6 +414,9 @@ gpujoin_exec_nestloop(kern_gpujoin *kgjoin,
 		assert(depth > 0 && depth <= kgjoin->max_depth);
 		assert(kresults_out->nrels == depth + 1);
 		assert(kresults_in->nrels == depth);
+		/* cardinality feedback; input items of this depth */
+		if (depth <= GPUJOIN_MAX_FEEDBACK_DEPTH)
+			kgjoin->nitems_depth[depth - 1] = kresults_in->nitems;
 	}
 
 	/*
@@ -518,6 +534,8 @@ gpujoin_exec_hashjoin(kern_gpujoin *kgjoin,
 	cl_int			x_index;
 	cl_int			x_limit;
 	cl_int			errcode;
+	cl_bool			is_semi_join;
+	cl_bool			is_anti_join;
 	__shared__ cl_uint base;
 	__shared__ cl_uint pg_crc32_table[256];
 
@@ -535,6 +553,9 @@ gpujoin_exec_hashjoin(kern_gpujoin *kgjoin,
 		assert(depth > 0 && depth <= kgjoin->max_depth);
 		assert(kresults_out->nrels == depth + 1);
 		assert(kresults_in->nrels == depth);
+		/* cardinality feedback; input items of this depth */
+		if (depth <= GPUJOIN_MAX_FEEDBACK_DEPTH)
+			kgjoin->nitems_depth[depth - 1] = kresults_in->nitems;
 	}
 
 	/* move crc32 table to __local memory from __global memory.
@@ -567,6 +588,9 @@ gpujoin_exec_hashjoin(kern_gpujoin *kgjoin,
 	/* will be valid, if LEFT OUTER JOIN */
 	lo_map = KERN_MULTIRELS_OUTER_JOIN_MAP(kmrels, depth, khtable->nitems,
 										   cuda_index, outer_join_map);
+	/* SEMI/ANTI JOIN emits outer rows only, once per outer row */
+	is_semi_join = KERN_MULTIRELS_SEMI_JOIN(kmrels, depth);
+	is_anti_join = KERN_MULTIRELS_ANTI_JOIN(kmrels, depth);
 
 	for (x_index = get_global_xid();
 		 x_index < x_limit;
@@ -579,6 +603,7 @@ gpujoin_exec_hashjoin(kern_gpujoin *kgjoin,
 		cl_uint			offset;
 		cl_uint			count;
 		cl_bool			is_matched;
+		cl_bool			is_semi_matched = false;
 		cl_bool			needs_outer_row = false;
 
 		/*
@@ -625,6 +650,21 @@ gpujoin_exec_hashjoin(kern_gpujoin *kgjoin,
 				needs_outer_row = false;
 			}
 
+			/*
+			 * SEMI/ANTI JOIN never emits a joined row. The first match
+			 * is enough to decide the outer row, so we stop walking on
+			 * the hash chain here, then emit it (or not) below.
+			 */
+			if (is_semi_join || is_anti_join)
+			{
+				if (is_matched)
+				{
+					is_semi_matched = true;
+					khentry = NULL;
+				}
+				is_matched = false;
+			}
+
 			/*
 			 * Expand kresults_out->nitems
 			 */
@@ -665,8 +705,15 @@ gpujoin_exec_hashjoin(kern_gpujoin *kgjoin,
 		/*
 		 * If no inner rows were matched on LEFT OUTER JOIN case, we fill
 		 * up the inner-side of result tuple with NULL.
+		 * SEMI JOIN emits the matched outer rows, and ANTI JOIN emits the
+		 * unmatched ones, in the same manner. Note that needs_outer_row is
+		 * never set if hash-value is out of the range of this chunk.
 		 */
-		if (KERN_MULTIRELS_LEFT_OUTER_JOIN(kmrels, depth))
+		if (is_semi_join)
+			needs_outer_row = is_semi_matched;
+
+		if (KERN_MULTIRELS_LEFT_OUTER_JOIN(kmrels, depth) ||
+			is_semi_join || is_anti_join)
 		{
 			offset = arithmetic_stairlike_add(needs_outer_row ? 1 : 0,
 											  &count);
@@ -147,6 +147,83 @@ typedef struct
 #define GPUPREAGG_FIELD_IS_GROUPKEY		1
 #define GPUPREAGG_FIELD_IS_AGGFUNC		2
 
+/*
+ * HyperLogLog support for approx_count_distinct()
+ *
+ * A value is hashed to 64bit, then upper GPUPREAGG_HLL_REGISTER_BITS bits
+ * choose a register and position of the first 1-bit in the rest bits
+ * (rho) is the value to be stored. GpuPreAgg projects an "hll item" that
+ * packs these two values as (register index << 8 | rho) and uses it as
+ * an additional grouping key, so the partial results are distinct set of
+ * the hll items for each group; alternative aggregate builds registers
+ * from them. gpupreagg_hll_make_item() is shared by the device and the
+ * host (for CPU fallback) code, so both of them produce identical items.
+ */
+#define GPUPREAGG_HLL_REGISTER_BITS		10
+#define GPUPREAGG_HLL_NUM_REGISTERS		(1U << GPUPREAGG_HLL_REGISTER_BITS)
+
+STATIC_INLINE(cl_int)
+gpupreagg_hll_make_item(cl_ulong hkey)
+{
+	cl_ulong	h = hkey + 0x9e3779b97f4a7c15ULL;
+	cl_uint		index;
+	cl_uint		rho = 1;
+
+	/* finalizer of splitmix64 */
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	h = (h ^ (h >> 31));
+
+	index = (cl_uint)(h >> (64 - GPUPREAGG_HLL_REGISTER_BITS));
+	h <<= GPUPREAGG_HLL_REGISTER_BITS;
+	while (rho <= 64 - GPUPREAGG_HLL_REGISTER_BITS &&
+		   (h & (1ULL << 63)) == 0)
+	{
+		h <<= 1;
+		rho++;
+	}
+	return (cl_int)((index << 8) | rho);
+}
+
+/*
+ * Quantile sketch support for approx_percentile()
+ *
+ * A value is mapped to a logarithmic bucket, k = ceil(log_gamma(|x|)),
+ * with gamma = (1 + alpha) / (1 - alpha); any value in the bucket is
+ * estimated within relative error alpha. The "qsketch item" packs the
+ * sign and the bucket into an int4 that keeps the order of the values:
+ * 0 for zero, (BIAS + k) for positive, -(BIAS + k) for negative values
+ * and INT_MAX for NaN. GpuPreAgg uses the item as an additional grouping
+ * key and counts rows per item, so the partial results are the sketch
+ * itself; alternative aggregate merges them into a bounded number of
+ * bins.
+ */
+#define GPUPREAGG_QSKETCH_ACCURACY		0.01
+#define GPUPREAGG_QSKETCH_GAMMA							\
+	((1.0 + GPUPREAGG_QSKETCH_ACCURACY) / (1.0 - GPUPREAGG_QSKETCH_ACCURACY))
+#define GPUPREAGG_QSKETCH_BIAS			(1 << 20)
+#define GPUPREAGG_QSKETCH_MAX_BINS		2048
+
+STATIC_INLINE(cl_int)
+gpupreagg_qsketch_make_item(cl_double value)
+{
+	cl_double	aval = (value < 0.0 ? -value : value);
+	cl_double	k;
+
+	if (value != value)
+		return INT_MAX;		/* NaN is larger than any other values */
+	if (aval == 0.0)
+		return 0;
+	k = ceil(log(aval) / log(GPUPREAGG_QSKETCH_GAMMA));
+	if (k > (cl_double)(GPUPREAGG_QSKETCH_BIAS - 1))
+		k = (cl_double)(GPUPREAGG_QSKETCH_BIAS - 1);
+	else if (k < (cl_double)(1 - GPUPREAGG_QSKETCH_BIAS))
+		k = (cl_double)(1 - GPUPREAGG_QSKETCH_BIAS);
+	if (value > 0.0)
+		return GPUPREAGG_QSKETCH_BIAS + (cl_int) k;
+	return -(GPUPREAGG_QSKETCH_BIAS + (cl_int) k);
+}
+
 #ifdef __CUDACC__
 
 /*
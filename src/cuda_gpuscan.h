@@ -173,5 +173,109 @@ gpuscan_qual(kern_gpuscan *kgpuscan,	/* in/out */
 	kern_writeback_error_status(&kresults->errcode, errcode);
 }
 
+/*
+ * forward declaration of the function to be generated on the fly
+ */
+STATIC_FUNCTION(void)
+gpuscan_projection(cl_int *errcode,
+				   kern_parambuf *kparams,
+				   kern_data_store *kds,
+				   kern_data_store *ktoast,
+				   size_t kds_index,
+				   kern_data_store *kds_dst,
+				   size_t dst_index);
+
+/*
+ * gpuscan_projection_slot
+ *
+ * It computes the target-list on the rows that passed the qualifiers,
+ * then writes them on the kds_dst with tuple-slot format. Its row-index
+ * is identical to the index of kern_resultbuf. Rows to be rechecked are
+ * not projected here, host side evaluates both of qualifiers and target-
+ * list on the original row. Pointer of by-reference datum is adjusted to
+ * the host address of kds_src.
+ */
+KERNEL_FUNCTION(void)
+gpuscan_projection_slot(kern_gpuscan *kgpuscan,	/* in/out */
+						kern_data_store *kds_src,	/* in */
+						kern_data_store *kds_dst)	/* out */
+{
+	kern_parambuf  *kparams = KERN_GPUSCAN_PARAMBUF(kgpuscan);
+	kern_resultbuf *kresults = KERN_GPUSCAN_RESULTBUF(kgpuscan);
+	cl_uint			nitems = kresults->nitems;
+	cl_int			errcode = kresults->errcode;
+	size_t			res_index;
+
+	if (errcode != StromError_Success)
+		goto out;
+	/* sanity checks */
+	if (kds_src->format != KDS_FORMAT_ROW ||
+		kds_dst->format != KDS_FORMAT_SLOT)
+	{
+		STROM_SET_ERROR(&errcode, StromError_SanityCheckViolation);
+		goto out;
+	}
+	/* kds_dst has same number of rooms with kds_src, so usually OK */
+	if (nitems > kds_dst->nrooms)
+	{
+		STROM_SET_ERROR(&errcode, StromError_DataStoreNoSpace);
+		goto out;
+	}
+	/*
+	 * NOTE: every threads set up kds_dst->nitems by itself prior to
+	 * the vstore, because we have no way to synchronize all the threads
+	 * across the blocks. The value to be written is identical.
+	 */
+	kds_dst->nitems = nitems;
+
+	for (res_index = get_global_id();
+		 res_index < nitems;
+		 res_index += get_global_size())
+	{
+		cl_int		row_index = kresults->results[res_index];
+		cl_int		row_errcode = StromError_Success;
+		Datum	   *ts_values;
+		cl_bool	   *ts_isnull;
+		size_t		offset;
+		cl_uint		i;
+
+		/* rows to be rechecked are projected on the host side */
+		if (row_index <= 0)
+			continue;
+
+		gpuscan_projection(&row_errcode, kparams,
+						   kds_src, NULL, row_index - 1,
+						   kds_dst, res_index);
+		if (row_errcode == StromError_CpuReCheck)
+		{
+			/* row-level rechecks */
+			kresults->results[res_index] = -row_index;
+			continue;
+		}
+		else if (row_errcode != StromError_Success)
+		{
+			STROM_SET_ERROR(&errcode, row_errcode);
+			continue;
+		}
+
+		/* fixup pointer variables */
+		ts_values = KERN_DATA_STORE_VALUES(kds_dst, res_index);
+		ts_isnull = KERN_DATA_STORE_ISNULL(kds_dst, res_index);
+		for (i=0; i < kds_dst->ncols; i++)
+		{
+			if (kds_dst->colmeta[i].attbyval || ts_isnull[i])
+				continue;
+			offset = ((size_t)ts_values[i] - (size_t)&kds_src->hostptr);
+			if (offset < kds_src->length)
+				ts_values[i] = kds_src->hostptr + offset;
+			else
+				STROM_SET_ERROR(&errcode, StromError_DataStoreOutOfRange);
+		}
+	}
+out:
+	/* chunk level error, if any */
+	kern_writeback_error_status(&kresults->errcode, errcode);
+}
+
 #endif	/* __CUDACC__ */
 #endif	/* CUDA_GPUSCAN_H */
@@ -186,8 +186,8 @@ STROMCL_VARLENA_TYPE_TEMPLATE(text)
 STATIC_FUNCTION(cl_int)
 text_compare(cl_int *errcode, varlena *arg1, varlena *arg2)
 {
-	cl_char	   *s1 = VARDATA_ANY(arg1);
-	cl_char	   *s2 = VARDATA_ANY(arg2);
+	cl_uchar   *s1 = (cl_uchar *)VARDATA_ANY(arg1);
+	cl_uchar   *s2 = (cl_uchar *)VARDATA_ANY(arg2);
 	cl_int		len1 = VARSIZE_ANY_EXHDR(arg1);
 	cl_int		len2 = VARSIZE_ANY_EXHDR(arg2);
 	cl_int		len = min(len1, len2);
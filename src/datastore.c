@@ -21,6 +21,7 @@
 #include "catalog/catalog.h"
 #include "catalog/pg_tablespace.h"
 #include "catalog/pg_type.h"
+#include "optimizer/var.h"
 #include "storage/bufmgr.h"
 #include "storage/fd.h"
 #include "storage/predicate.h"
@@ -40,6 +41,10 @@
  * GUC variables
  */
 static int		pgstrom_chunk_size_kb;
+static bool		pgstrom_lazy_fetch_enabled;
+static bool		pgstrom_chunk_size_adaptive;
+static int		pgstrom_chunk_size_min_kb;
+static int		pgstrom_chunk_size_max_kb;
 
 /*
  * pgstrom_chunk_size - configured chunk size
@@ -51,10 +56,107 @@ pgstrom_chunk_size(void)
 }
 
 /*
- * pgstrom_temp_dirpath - makes a temporary file according to the system
- * setting. Note that we never gueran
+ * pgstrom_adaptive_chunk_enabled - true, if adaptive chunk size is enabled.
+ * GpuTaskState needs to collect performance counter in this case, even if
+ * pg_strom.perfmon is off.
  */
-static int
+bool
+pgstrom_adaptive_chunk_enabled(void)
+{
+	return pgstrom_chunk_size_adaptive;
+}
+
+/*
+ * pgstrom_adaptive_chunk_size
+ *
+ * It returns the size of the next chunk to be loaded by the GpuTaskState.
+ * Unless pg_strom.chunk_size_adaptive is enabled, it is pg_strom.chunk_size.
+ *
+ * On the adaptive mode, the first chunk is pg_strom.chunk_size_min for
+ * less latency to the first row. Then, every time when tasks are completed,
+ * it compares the cost (time to load, process and materialize per MB)
+ * to the one on the last adjustment, and makes the chunk size larger or
+ * smaller towards the direction where the cost goes down, within the range
+ * of pg_strom.chunk_size_min and pg_strom.chunk_size_max.
+ * If caller knows the remaining length to be loaded ('remain'; 0 means
+ * unknown), chunk size is also limited to the half of the remaining, so
+ * the pipeline is drained evenly at the end of the scan.
+ */
+Size
+pgstrom_adaptive_chunk_size(GpuTaskState *gts, Size remain)
+{
+	pgstrom_perfmon *curr = &gts->pfm_accum;
+	pgstrom_perfmon *last = &gts->chunk_pfm;
+	Size		size_min = ((Size)pgstrom_chunk_size_min_kb) << 10;
+	Size		size_max = ((Size)pgstrom_chunk_size_max_kb) << 10;
+	Size		chunk_size;
+
+	if (!pgstrom_chunk_size_adaptive || !curr->enabled)
+		return pgstrom_chunk_size();
+	if (size_max < size_min)
+		size_max = size_min;
+
+	if (gts->chunk_size == 0)
+	{
+		/* start with the smallest chunk for the first row latency */
+		gts->chunk_size = size_min;
+		gts->chunk_direction = 1;
+		gts->chunk_cost = 0.0;
+		memcpy(last, curr, sizeof(pgstrom_perfmon));
+	}
+	else if (curr->num_samples > last->num_samples &&
+			 curr->bytes_dma_send > last->bytes_dma_send)
+	{
+		double	time_host;
+		double	time_device;
+		double	cost;
+
+		/* time consumed since the last adjustment */
+		time_host = ((curr->time_outer_load - last->time_outer_load) +
+					 (curr->time_materialize - last->time_materialize));
+		time_device = ((curr->time_dma_send - last->time_dma_send) +
+					   (curr->time_dma_recv - last->time_dma_recv) +
+					   (curr->time_kern_qual - last->time_kern_qual) +
+					   (curr->time_kern_join - last->time_kern_join) +
+					   (curr->time_kern_proj - last->time_kern_proj) +
+					   (curr->time_kern_prep - last->time_kern_prep) +
+					   (curr->time_kern_lagg - last->time_kern_lagg) +
+					   (curr->time_kern_gagg - last->time_kern_gagg) +
+					   (curr->time_kern_nogrp - last->time_kern_nogrp));
+		cost = (time_host + time_device) /
+			((double)(curr->bytes_dma_send - last->bytes_dma_send) /
+			 (double)(1UL << 20));
+
+		/* reverse the direction if the last adjustment made things worse */
+		if (gts->chunk_cost > 0.0 && cost > gts->chunk_cost)
+			gts->chunk_direction = -gts->chunk_direction;
+		gts->chunk_cost = cost;
+
+		if (gts->chunk_direction > 0)
+			gts->chunk_size = Min(2 * gts->chunk_size, size_max);
+		else
+			gts->chunk_size = Max(gts->chunk_size / 2, size_min);
+		memcpy(last, curr, sizeof(pgstrom_perfmon));
+
+		elog(DEBUG2, "adaptive chunk size: %zuKB (cost: %.3fms/MB, "
+			 "host: %.3fms, device: %.3fms)",
+			 gts->chunk_size >> 10, cost, time_host, time_device);
+	}
+	chunk_size = Max(Min(gts->chunk_size, size_max), size_min);
+
+	/* shrink the chunk near by the end of scan */
+	if (remain > 0 && chunk_size > remain / 2)
+		chunk_size = Max(remain / 2, size_min);
+
+	return TYPEALIGN(BLCKSZ, chunk_size);
+}
+
+/*
+ * pgstrom_open_tempfile - makes a temporary file according to the system
+ * setting. Note that we never guarantee the file shall be removed on
+ * the end of transaction; caller has to unlink it by itself.
+ */
+int
 pgstrom_open_tempfile(const char **p_tempfilepath)
 {
 	static long	tempFileCounter = 0;
@@ -221,6 +323,195 @@ BulkExecProcNode(PlanState *node)
 	elog(ERROR, "unrecognized node type: %d", (int) nodeTag(node));
 }
 
+/*
+ * pgstrom_try_replace_bulk_input
+ *
+ * It checks whether the supplied child plan can deliver its rows using
+ * BulkExecProcNode() to the parent node which has no device qualifiers
+ * to be pulled-up (GpuSort, MultiRels), then returns an alternative plan
+ * node if available. Unlike pgstrom_try_replace_plannode(), we give up
+ * bulk-loading if the child has qualifiers, because nobody can evaluate
+ * them on the device instead.
+ */
+Plan *
+pgstrom_try_replace_bulk_input(Plan *child_plan, List *range_tables)
+{
+	Plan	   *alter_plan;
+	List	   *pullup_quals = NIL;
+	double		density;
+
+	/* GpuPreAgg delivers its result by row-format chunks */
+	if (pgstrom_plan_is_gpupreagg(child_plan))
+		return child_plan;
+
+	alter_plan = pgstrom_try_replace_plannode(child_plan,
+											  range_tables,
+											  &pullup_quals);
+	if (!alter_plan || pullup_quals != NIL)
+		return NULL;
+
+	density = pgstrom_get_bulkload_density(alter_plan);
+	if (density < (1.0 - pgstrom_bulkload_density) ||
+		density > (1.0 + pgstrom_bulkload_density))
+		return NULL;
+
+	return alter_plan;
+}
+
+/*
+ * pgstrom_init_bulk_input
+ *
+ * It sets up BulkInputState to consume the chunks of the outer node.
+ * Chunks of GpuScan and GpuJoin have layout of their scan tuple, so rows
+ * have to be projected if these nodes have projection. On the other hands,
+ * GpuPreAgg delivers its result tuples as is.
+ */
+void
+pgstrom_init_bulk_input(BulkInputState *bistate, PlanState *outer_ps)
+{
+	CustomScanState	   *ocss = (CustomScanState *) outer_ps;
+
+	if (!IsA(ocss, CustomScanState))
+		elog(ERROR, "Bug? outer node is not CustomScanState");
+
+	memset(bistate, 0, sizeof(BulkInputState));
+	bistate->outer_ps = outer_ps;
+	if (pgstrom_plan_is_gpupreagg(outer_ps->plan))
+	{
+		bistate->bulk_proj = NULL;
+		bistate->bulk_slot = outer_ps->ps_ResultTupleSlot;
+	}
+	else
+	{
+		bistate->bulk_proj = outer_ps->ps_ProjInfo;
+		bistate->bulk_slot = ocss->ss.ss_ScanTupleSlot;
+	}
+	bistate->curr_pds = NULL;
+	bistate->curr_index = 0;
+}
+
+/*
+ * bulk_input_fetch_row - fetch a row in the current chunk, then apply
+ * projection of the outer node if needed.
+ */
+static TupleTableSlot *
+bulk_input_fetch_row(BulkInputState *bistate, cl_uint row_index)
+{
+	TupleTableSlot *slot = bistate->bulk_slot;
+
+	if (!pgstrom_fetch_data_store(slot, bistate->curr_pds, row_index,
+								  &bistate->tuple_buf))
+		elog(ERROR, "Bug? failed to fetch a row (index: %u) from the chunk",
+			 row_index);
+
+	if (bistate->bulk_proj)
+	{
+		ExprContext	   *econtext = bistate->bulk_proj->pi_exprContext;
+		ExprDoneCond	is_done;
+
+		ResetExprContext(econtext);
+		econtext->ecxt_scantuple = slot;
+		slot = ExecProject(bistate->bulk_proj, &is_done);
+		if (is_done == ExprEndResult)
+			return NULL;
+	}
+	return slot;
+}
+
+/*
+ * bulk_input_next_chunk - move to the next chunk, if current one is
+ * already consumed. It returns false on end of the outer scan.
+ */
+static bool
+bulk_input_next_chunk(BulkInputState *bistate)
+{
+	while (!bistate->curr_pds ||
+		   bistate->curr_index >= bistate->curr_pds->kds->nitems)
+	{
+		if (bistate->curr_pds)
+			pgstrom_release_data_store(bistate->curr_pds);
+		bistate->curr_pds = BulkExecProcNode(bistate->outer_ps);
+		bistate->curr_index = 0;
+		if (!bistate->curr_pds)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * pgstrom_bulk_input_fetch
+ *
+ * It returns the next row in the chunks of outer node, or NULL if end of
+ * the scan. Returned slot is valid until the next call.
+ */
+TupleTableSlot *
+pgstrom_bulk_input_fetch(BulkInputState *bistate)
+{
+	TupleTableSlot *slot;
+
+	do {
+		if (!bulk_input_next_chunk(bistate))
+			return NULL;
+		slot = bulk_input_fetch_row(bistate, bistate->curr_index++);
+	} while (TupIsNull(slot));
+
+	return slot;
+}
+
+/*
+ * pgstrom_bulk_input_load
+ *
+ * It moves rows in the chunks of outer node into the supplied row-format
+ * data store, as long as it has enough space. If no projection is needed,
+ * rows are copied chunk-by-chunk without tuple-slot. It returns true if
+ * all the rows are loaded (end of the scan), or false if pds is full.
+ */
+bool
+pgstrom_bulk_input_load(BulkInputState *bistate, pgstrom_data_store *pds)
+{
+	while (bulk_input_next_chunk(bistate))
+	{
+		pgstrom_data_store *pds_src = bistate->curr_pds;
+
+		if (!bistate->bulk_proj &&
+			pds_src->kds->format == KDS_FORMAT_ROW)
+		{
+			if (!pgstrom_data_store_insert_chunk(pds, pds_src,
+												 &bistate->curr_index))
+				return false;
+		}
+		else
+		{
+			while (bistate->curr_index < pds_src->kds->nitems)
+			{
+				TupleTableSlot *slot
+					= bulk_input_fetch_row(bistate, bistate->curr_index);
+
+				/* row index is not advanced until insertion successes */
+				if (!TupIsNull(slot) &&
+					!pgstrom_data_store_insert_tuple(pds, slot))
+					return false;
+				bistate->curr_index++;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * pgstrom_release_bulk_input
+ *
+ * It releases the chunk being consumed, on rescan or end of the node.
+ */
+void
+pgstrom_release_bulk_input(BulkInputState *bistate)
+{
+	if (bistate->curr_pds)
+		pgstrom_release_data_store(bistate->curr_pds);
+	bistate->curr_pds = NULL;
+	bistate->curr_index = 0;
+}
+
 /*
  * pgstrom_fixup_kernel_numeric
  *
@@ -297,7 +588,185 @@ pgstrom_fetch_data_store(TupleTableSlot *slot,
 						 size_t row_index,
 						 HeapTuple tuple)
 {
-	return kern_fetch_data_store(slot, pds->kds, row_index, tuple);
+	cl_uint		i;
+
+	if (!PDS_IS_SEGMENTED(pds))
+		return kern_fetch_data_store(slot, pds->kds, row_index, tuple);
+
+	/* walk on the extent table to find out the kds that has the row */
+	for (i=0; i < pds->num_extents; i++)
+	{
+		kern_data_store *kds = pds->kds_extents[i];
+
+		if (row_index < kds->nitems)
+			return kern_fetch_data_store(slot, kds, row_index, tuple);
+		row_index -= kds->nitems;
+	}
+	return false;	/* out of range */
+}
+
+/*
+ * pgstrom_data_store_nitems
+ *
+ * It returns number of items in the data store, including the ones on
+ * the extents of segmented data store.
+ */
+size_t
+pgstrom_data_store_nitems(pgstrom_data_store *pds)
+{
+	size_t		nitems = 0;
+	cl_uint		i;
+
+	if (!PDS_IS_SEGMENTED(pds))
+		return pds->kds->nitems;
+
+	for (i=0; i < pds->num_extents; i++)
+		nitems += pds->kds_extents[i]->nitems;
+	return nitems;
+}
+
+/*
+ * pgstrom_setup_lazy_fetch
+ *
+ * It returns an array of flags that shows which attributes are referenced
+ * by the targetlist and qualifiers of the node that consumes the scan
+ * tuple-slot, or NULL if lazy fetch mode is not available; whole-row
+ * reference and system columns require a physical heap tuple.
+ */
+bool *
+pgstrom_setup_lazy_fetch(PlanState *ps, Index varno,
+						 List *extra_exprs, TupleDesc tupdesc)
+{
+	Plan	   *plan = ps->plan;
+	Bitmapset  *attrs_needed = NULL;
+	bool	   *attr_needed;
+	int			i, x;
+
+	if (!pgstrom_lazy_fetch_enabled || tupdesc->tdhasoid)
+		return NULL;
+
+	pull_varattnos((Node *)plan->targetlist, varno, &attrs_needed);
+	pull_varattnos((Node *)plan->qual, varno, &attrs_needed);
+	pull_varattnos((Node *)extra_exprs, varno, &attrs_needed);
+
+	attr_needed = palloc0(sizeof(bool) * tupdesc->natts);
+	while ((x = bms_first_member(attrs_needed)) >= 0)
+	{
+		AttrNumber	anum = x + FirstLowInvalidHeapAttributeNumber;
+
+		/* whole-row reference or system columns? */
+		if (anum <= InvalidAttrNumber || anum > tupdesc->natts)
+		{
+			pfree(attr_needed);
+			return NULL;
+		}
+		attr_needed[anum - 1] = true;
+	}
+	/* no benefit if all the attributes are referenced */
+	for (i=0; i < tupdesc->natts; i++)
+	{
+		if (!attr_needed[i])
+			return attr_needed;
+	}
+	pfree(attr_needed);
+	return NULL;
+}
+
+/*
+ * pgstrom_fetch_data_store_lazy
+ *
+ * An alternative of pgstrom_fetch_data_store. It exposes a row in the data
+ * store as a virtual tuple, but only attributes flagged in attr_needed are
+ * extracted; others are filled by null. Offset of the attribute is
+ * picked up from attcacheoff of kern_colmeta as long as the tuple has no
+ * null values, so fixed-length attributes are accessible without walking
+ * on the prior attributes.
+ */
+bool
+pgstrom_fetch_data_store_lazy(TupleTableSlot *slot,
+							  pgstrom_data_store *pds,
+							  size_t row_index,
+							  const bool *attr_needed)
+{
+	kern_data_store	   *kds = pds->kds;
+	kern_tupitem	   *tup_item;
+	HeapTupleHeader		htup;
+	Datum			   *tts_values;
+	bool			   *tts_isnull;
+	bool				hasnulls;
+	char			   *tp;
+	long				off;
+	int					i, natts;
+
+	if (PDS_IS_SEGMENTED(pds))
+	{
+		for (i=0; i < pds->num_extents; i++)
+		{
+			kds = pds->kds_extents[i];
+			if (row_index < kds->nitems)
+				break;
+			row_index -= kds->nitems;
+		}
+	}
+	if (row_index >= kds->nitems)
+		return false;	/* out of range */
+	/* slot format already has a virtual tuple form */
+	if (kds->format != KDS_FORMAT_ROW)
+		return kern_fetch_data_store(slot, kds, row_index, NULL);
+
+	ExecClearTuple(slot);
+	tts_values = slot->tts_values;
+	tts_isnull = slot->tts_isnull;
+
+	tup_item = KERN_DATA_STORE_TUPITEM(kds, row_index);
+	htup = &tup_item->htup;
+	hasnulls = ((htup->t_infomask & HEAP_HASNULL) != 0);
+	natts = Min(HeapTupleHeaderGetNatts(htup), kds->ncols);
+	/* no need to walk on the attributes behind the last needed one */
+	while (natts > 0 && !attr_needed[natts - 1])
+		natts--;
+	tp = (char *) htup;
+	off = htup->t_hoff;
+
+	for (i=0; i < natts; i++)
+	{
+		kern_colmeta   *cmeta = &kds->colmeta[i];
+
+		if (hasnulls && att_isnull(i, htup->t_bits))
+		{
+			tts_values[i] = (Datum) 0;
+			tts_isnull[i] = true;
+			continue;
+		}
+
+		if (!hasnulls && cmeta->attcacheoff >= 0)
+			off = cmeta->attcacheoff;
+		else if (cmeta->attlen > 0 || !VARATT_NOT_PAD_BYTE(tp + off))
+			off = TYPEALIGN(cmeta->attalign, off);
+
+		if (attr_needed[i])
+		{
+			tts_values[i] = fetch_att(tp + off,
+									  cmeta->attbyval,
+									  cmeta->attlen);
+			tts_isnull[i] = false;
+		}
+		else
+		{
+			tts_values[i] = (Datum) 0;
+			tts_isnull[i] = true;
+		}
+		off = att_addlength_pointer(off, cmeta->attlen, tp + off);
+	}
+	/* attributes not needed or not physically stored are null */
+	for (; i < kds->ncols; i++)
+	{
+		tts_values[i] = (Datum) 0;
+		tts_isnull[i] = true;
+	}
+	ExecStoreVirtualTuple(slot);
+
+	return true;
 }
 
 void
@@ -314,7 +783,16 @@ pgstrom_release_data_store(pgstrom_data_store *pds)
 	if (pds->ptoast)
 		pgstrom_release_data_store(pds->ptoast);
 	/* release body of the data store */
-	if (!pds->kds_fname)
+	if (PDS_IS_SEGMENTED(pds))
+	{
+		cl_uint		i;
+
+		Assert(!pds->kds_fname && pds->kds_extents[0] == pds->kds);
+		for (i=0; i < pds->num_extents; i++)
+			pfree(pds->kds_extents[i]);
+		pfree(pds->kds_extents);
+	}
+	else if (!pds->kds_fname)
 		pfree(pds->kds);
 	else
 	{
@@ -405,6 +883,15 @@ init_kern_data_store(kern_data_store *kds,
 	}
 }
 
+/*
+ * pgstrom_expand_data_store
+ *
+ * It expands the data store up to kds_length_new with a larger buffer,
+ * then copies the tuples already loaded. It is still used for the toast
+ * buffer of GpuSort, that is sent to the device as is and doubled on each
+ * expansion, so the total amount of copy is linear to its length.
+ * Elsewhere, use pgstrom_append_data_store_extent() instead.
+ */
 void
 pgstrom_expand_data_store(GpuContext *gcontext,
 						  pgstrom_data_store *pds,
@@ -418,6 +905,7 @@ pgstrom_expand_data_store(GpuContext *gcontext,
 	cl_uint				i, nitems = kds_old->nitems;
 
 	/* sanity checks */
+	Assert(!PDS_IS_SEGMENTED(pds));
 	Assert(pds->kds_offset == 0);
 	Assert(pds->kds_length == kds_length_old);
 	Assert(pds->ptoast == NULL);
@@ -483,6 +971,166 @@ pgstrom_expand_data_store(GpuContext *gcontext,
 	pds->kds = kds_new;
 }
 
+/*
+ * pgstrom_append_data_store_extent
+ *
+ * An alternative of pgstrom_expand_data_store. It expands the data store
+ * up to kds_length_new by appending a new extent, instead of allocation
+ * of a larger buffer and copy of the tuples already loaded. So, the cost
+ * of expansion is independent from the number of tuples, even if the data
+ * store is expanded many times, but the data store is no longer a
+ * contiguous image. The caller has to flatten it using
+ * pgstrom_flatten_data_store() prior to any job that references pds->kds
+ * directly (e.g, DMA send). The destination of pgstrom_fetch_data_store(),
+ * pgstrom_data_store_insert_tuple() and pgstrom_data_store_insert_block()
+ * can handle segmented data store as is.
+ */
+void
+pgstrom_append_data_store_extent(GpuContext *gcontext,
+								 pgstrom_data_store *pds,
+								 Size kds_length_new)
+{
+	kern_data_store	   *kds_head = pds->kds;
+	kern_data_store	   *kds_ext;
+	Size				head_length = KERN_DATA_STORE_HEAD_LENGTH(kds_head);
+	Size				body_length;
+	cl_uint				nrooms;
+
+	/* sanity checks */
+	Assert(pds->kds_offset == 0);
+	Assert(pds->ptoast == NULL);
+	if (pds->kds_fname)
+		elog(ERROR, "Bug? file-mapped data store cannot have extents");
+	if (kds_head->format != KDS_FORMAT_ROW &&
+		kds_head->format != KDS_FORMAT_SLOT)
+		elog(ERROR, "Bug? unexpected data-store format: %d",
+			 kds_head->format);
+
+	/* no need to expand? */
+	if (pds->kds_length >= kds_length_new)
+		return;
+	body_length = STROMALIGN_DOWN(kds_length_new - pds->kds_length);
+
+	/* setup the extent table on the first expansion */
+	if (!PDS_IS_SEGMENTED(pds))
+	{
+		pds->max_extents = 8;
+		pds->kds_extents = MemoryContextAlloc(gcontext->memcxt,
+											  sizeof(kern_data_store *) *
+											  pds->max_extents);
+		pds->kds_extents[0] = kds_head;
+		pds->num_extents = 1;
+	}
+	else if (pds->num_extents == pds->max_extents)
+	{
+		pds->max_extents += pds->max_extents;
+		pds->kds_extents = repalloc(pds->kds_extents,
+									sizeof(kern_data_store *) *
+									pds->max_extents);
+	}
+
+	/* an extent has identical header with the head of data store */
+	if (kds_head->format == KDS_FORMAT_ROW)
+		nrooms = INT_MAX;
+	else
+		nrooms = body_length / LONGALIGN((sizeof(Datum) + sizeof(char)) *
+										 kds_head->ncols);
+	kds_ext = MemoryContextAlloc(gcontext->memcxt,
+								 head_length + body_length);
+	memcpy(kds_ext, kds_head, head_length);
+	kds_ext->hostptr = (hostptr_t) &kds_ext->hostptr;
+	kds_ext->length = head_length + body_length;
+	kds_ext->usage = 0;
+	kds_ext->nitems = 0;
+	kds_ext->nrooms = nrooms;
+
+	pds->kds_extents[pds->num_extents++] = kds_ext;
+	pds->kds_length += body_length;
+}
+
+/*
+ * pgstrom_flatten_data_store
+ *
+ * It rebuilds a contiguous image of the segmented data store, with the
+ * same layout as if pgstrom_expand_data_store() were used for expansion.
+ * Tuples are copied only once here, regardless of the number of extents.
+ */
+void
+pgstrom_flatten_data_store(GpuContext *gcontext,
+						   pgstrom_data_store *pds)
+{
+	kern_data_store	   *kds_head = pds->kds;
+	kern_data_store	   *kds_new;
+	Size				head_length;
+	cl_uint				i, j;
+
+	if (!PDS_IS_SEGMENTED(pds))
+		return;		/* already contiguous */
+
+	head_length = KERN_DATA_STORE_HEAD_LENGTH(kds_head);
+	kds_new = MemoryContextAlloc(gcontext->memcxt, pds->kds_length);
+	memcpy(kds_new, kds_head, head_length);
+	kds_new->hostptr = (hostptr_t) &kds_new->hostptr;
+	kds_new->length = pds->kds_length;
+	kds_new->usage = 0;
+	kds_new->nitems = 0;
+
+	if (kds_head->format == KDS_FORMAT_ROW)
+	{
+		cl_uint	   *tup_index = (cl_uint *)KERN_DATA_STORE_BODY(kds_new);
+
+		for (i=0; i < pds->num_extents; i++)
+		{
+			kern_data_store *kds_ext = pds->kds_extents[i];
+
+			for (j=0; j < kds_ext->nitems; j++)
+			{
+				kern_tupitem   *titem_src = KERN_DATA_STORE_TUPITEM(kds_ext,j);
+				kern_tupitem   *titem_dst;
+				Size			sz = LONGALIGN(offsetof(kern_tupitem, htup) +
+											   titem_src->t_len);
+
+				kds_new->usage += sz;
+				titem_dst = (kern_tupitem *)((char *)kds_new +
+											 kds_new->length -
+											 kds_new->usage);
+				memcpy(titem_dst, titem_src, sz);
+				tup_index[kds_new->nitems++] =
+					(uintptr_t)titem_dst - (uintptr_t)kds_new;
+			}
+		}
+		Assert((uintptr_t)(tup_index + kds_new->nitems) -
+			   (uintptr_t)kds_new + kds_new->usage <= kds_new->length);
+		kds_new->nrooms = INT_MAX;
+	}
+	else
+	{
+		Size	unitsz = LONGALIGN((sizeof(Datum) + sizeof(char)) *
+								   kds_head->ncols);
+
+		kds_new->nrooms = 0;
+		for (i=0; i < pds->num_extents; i++)
+		{
+			kern_data_store *kds_ext = pds->kds_extents[i];
+
+			memcpy(KERN_DATA_STORE_VALUES(kds_new, kds_new->nitems),
+				   KERN_DATA_STORE_VALUES(kds_ext, 0),
+				   unitsz * kds_ext->nitems);
+			kds_new->nitems += kds_ext->nitems;
+			kds_new->nrooms += kds_ext->nrooms;
+		}
+	}
+
+	/* release the extents */
+	for (i=0; i < pds->num_extents; i++)
+		pfree(pds->kds_extents[i]);
+	pfree(pds->kds_extents);
+	pds->kds_extents = NULL;
+	pds->num_extents = 0;
+	pds->max_extents = 0;
+	pds->kds = kds_new;
+}
+
 pgstrom_data_store *
 pgstrom_create_data_store_row(GpuContext *gcontext,
 							  TupleDesc tupdesc, Size length,
@@ -546,6 +1194,20 @@ pgstrom_create_data_store_row(GpuContext *gcontext,
 	return pds;
 }
 
+/*
+ * pgstrom_init_data_store_row
+ *
+ * It initializes a row-format kern_data_store on the buffer supplied by
+ * the caller, like a chunk on the dynamic shared memory segment.
+ */
+void
+pgstrom_init_data_store_row(kern_data_store *kds,
+							TupleDesc tupdesc, Size length)
+{
+	init_kern_data_store(kds, tupdesc, length,
+						 KDS_FORMAT_ROW, INT_MAX, false);
+}
+
 pgstrom_data_store *
 pgstrom_create_data_store_slot(GpuContext *gcontext,
 							   TupleDesc tupdesc, cl_uint nrooms,
@@ -681,12 +1343,38 @@ pgstrom_file_mmap_data_store(FileName kds_fname,
 	CloseTransientFile(kds_fdesc);
 }
 
+/*
+ * pgstrom_file_munmap_data_store
+ *
+ * It unmaps the data store being mapped by pgstrom_file_mmap_data_store.
+ * Long-lived background worker has to call it once a job is done.
+ */
+void
+pgstrom_file_munmap_data_store(kern_data_store *kds,
+							   kern_data_store *ktoast)
+{
+	void	   *mmap_addr = kds;
+	size_t		mmap_length = TYPEALIGN(BLCKSZ, kds->length);
+
+	if (ktoast)
+	{
+		mmap_addr = ktoast;
+		mmap_length += (char *)kds - (char *)ktoast;
+	}
+	if (munmap(mmap_addr, mmap_length) != 0)
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("could not unmap data store %p-%p: %m",
+						(char *)mmap_addr,
+						(char *)mmap_addr + mmap_length - 1)));
+}
+
 int
 pgstrom_data_store_insert_block(pgstrom_data_store *pds,
 								Relation rel, BlockNumber blknum,
 								Snapshot snapshot, bool page_prune)
 {
-	kern_data_store	*kds = pds->kds;
+	kern_data_store	*kds = PDS_LAST_EXTENT(pds);
 	Buffer			buffer;
 	Page			page;
 	int				lines;
@@ -798,7 +1486,7 @@ bool
 pgstrom_data_store_insert_tuple(pgstrom_data_store *pds,
 								TupleTableSlot *slot)
 {
-	kern_data_store	   *kds = pds->kds;
+	kern_data_store	   *kds = PDS_LAST_EXTENT(pds);
 	Size				consume;
 	HeapTuple			tuple;
 	uint			   *tup_index;
@@ -837,6 +1525,62 @@ pgstrom_data_store_insert_tuple(pgstrom_data_store *pds,
 	return true;
 }
 
+/*
+ * pgstrom_data_store_insert_chunk
+ *
+ * It copies rows of the source row-format data store into the destination
+ * at once, starting from *p_src_index. Both of data stores must have
+ * identical layout. If destination has no room to store the rest of rows,
+ * it returns false with *p_src_index pointing the next row to be copied.
+ */
+bool
+pgstrom_data_store_insert_chunk(pgstrom_data_store *pds,
+								pgstrom_data_store *pds_src,
+								cl_uint *p_src_index)
+{
+	kern_data_store	   *kds = PDS_LAST_EXTENT(pds);
+	kern_data_store	   *kds_src = pds_src->kds;
+	cl_uint				src_index = *p_src_index;
+	uint			   *tup_index;
+	kern_tupitem	   *tup_item;
+	kern_tupitem	   *src_item;
+	Size				head_usage;
+	Size				item_size;
+
+	if (kds->format != KDS_FORMAT_ROW ||
+		kds_src->format != KDS_FORMAT_ROW)
+		elog(ERROR, "Bug? unexpected data-store format: %d <- %d",
+			 kds->format, kds_src->format);
+	Assert(!PDS_IS_SEGMENTED(pds_src));
+	Assert(kds->ncols == kds_src->ncols);
+
+	tup_index = (uint *)KERN_DATA_STORE_BODY(kds);
+	head_usage = (uintptr_t)(tup_index + kds->nitems) - (uintptr_t)kds;
+	while (src_index < kds_src->nitems)
+	{
+		if (kds->nitems >= kds->nrooms)
+			break;
+
+		src_item = KERN_DATA_STORE_TUPITEM(kds_src, src_index);
+		item_size = LONGALIGN(offsetof(kern_tupitem, htup) +
+							  src_item->t_len);
+		/* check whether we have room for this tuple */
+		if (head_usage + sizeof(uint) + kds->usage + item_size > kds->length)
+			break;
+
+		kds->usage += item_size;
+		tup_item = (kern_tupitem *)((char *)kds + kds->length - kds->usage);
+		memcpy(tup_item, src_item, offsetof(kern_tupitem, htup) +
+			   src_item->t_len);
+		tup_index[kds->nitems++] = (uintptr_t)tup_item - (uintptr_t)kds;
+		head_usage += sizeof(uint);
+		src_index++;
+	}
+	*p_src_index = src_index;
+
+	return (src_index >= kds_src->nitems);
+}
+
 /*
  * pgstrom_dump_data_store
  *
@@ -884,9 +1628,10 @@ pgstrom_dump_data_store(pgstrom_data_store *pds)
 	int					i, j;
 
 	elog(INFO,
-		 "pds {kds_fname=%s kds_offset=%zu kds_length=%zu kds=%p ktoast=%p}",
+		 "pds {kds_fname=%s kds_offset=%zu kds_length=%zu kds=%p ktoast=%p"
+		 " num_extents=%u}",
 		 pds->kds_fname, pds->kds_offset, pds->kds_length,
-		 pds->kds, pds->ptoast);
+		 pds->kds, pds->ptoast, pds->num_extents);
 	elog(INFO,
 		 "kds {hostptr=%lu length=%u usage=%u ncols=%u nitems=%u nrooms=%u"
 		 " format=%s tdhasoid=%s tdtypeid=%u tdtypmod=%d}",
@@ -965,4 +1710,48 @@ pgstrom_init_datastore(void)
 							PGC_USERSET,
 							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
 							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pg_strom.chunk_size_adaptive",
+							 "Enables to adjust chunk size according to "
+							 "the observed throughput",
+							 NULL,
+							 &pgstrom_chunk_size_adaptive,
+							 false,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pg_strom.chunk_size_min",
+							"minimum size of pgstrom_data_store on the "
+							"adaptive chunk size",
+							NULL,
+							&pgstrom_chunk_size_min_kb,
+							2048,
+							256,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pg_strom.chunk_size_max",
+							"maximum size of pgstrom_data_store on the "
+							"adaptive chunk size",
+							NULL,
+							&pgstrom_chunk_size_max_kb,
+							131072,
+							256,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pg_strom.lazy_fetch",
+							 "Enables to extract referenced attributes only "
+							 "on fetch from the data store",
+							 NULL,
+							 &pgstrom_lazy_fetch_enabled,
+							 true,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
 }
@@ -29,9 +29,15 @@
 #include "optimizer/restrictinfo.h"
 #include "optimizer/var.h"
 #include "parser/parsetree.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/pg_crc.h"
 #include "utils/ruleutils.h"
+#include <ctype.h>
 #include <math.h>
 #include "pg_strom.h"
 #include "cuda_gpujoin.h"
@@ -52,6 +58,39 @@ static CustomScanMethods	gpujoin_plan_methods;
 static PGStromExecMethods	gpujoin_exec_methods;
 static bool					enable_gpunestloop;
 static bool					enable_gpuhashjoin;
+static int					gpujoin_feedback_slots;
+static bool					gpujoin_rerun_split;
+static shmem_startup_hook_type shmem_startup_next;
+
+/*
+ * GpuJoinFeedback - history of the observed join fan-out
+ *
+ * It is keyed by signature of the join, so it works with no query-id
+ * being assigned. Same join on the same relations and qualifiers shares
+ * its history, even if it appears in different queries. An entry with
+ * num_rels == 0 tracks the growth ratio of a particular depth towards
+ * its immediate outer input, and it is used by the planner. An entry
+ * with num_rels > 0 tracks the whole GpuJoin node, and it is used to
+ * size kern_resultbuf and destination data store by the executor.
+ */
+typedef struct
+{
+	uint32		signature;		/* signature of the join */
+	int32		num_rels;		/* 0 for each depth, or GpuJoin node */
+} GpuJoinFeedbackKey;
+
+typedef struct
+{
+	GpuJoinFeedbackKey key;
+	cl_uint		nsamples;			/* number of executions observed */
+	double		nrows_ratio;		/* moving average of growth ratio */
+	double		nrows_ratio_max;	/* largest growth ratio (slow decay) */
+	double		kresults_ratio_max;	/* largest kresults ratio (slow decay) */
+	Size		result_width_max;	/* largest result width */
+} GpuJoinFeedback;
+
+static HTAB	   *gpujoin_feedback_htab = NULL;
+static LWLock  *gpujoin_feedback_lock = NULL;
 
 /*
  * GpuJoinPath
@@ -72,6 +111,7 @@ typedef struct
 		Cost		startup_cost;	/* outer scan cost + materialize */
 		Cost		run_cost;		/* outer scan cost + materialize */
 		double		nrows_ratio;	/* nrows ratio towards outer rows */
+		cl_uint		feedback_sig;	/* signature for cardinality feedback */
 		JoinType	join_type;		/* one of JOIN_* */
 		Path	   *scan_path;		/* outer scan path */
 		Plan	   *scan_plan;		/* for create_gpujoin_plan convenience */
@@ -95,6 +135,7 @@ typedef struct
 	List	   *used_params;
 	double		kresults_ratio;
 	List	   *nrows_ratio;
+	List	   *feedback_sigs;
 	bool		outer_bulkload;
 	double		bulkload_density;
 	Expr	   *outer_quals;
@@ -124,6 +165,7 @@ form_gpujoin_info(CustomScan *cscan, GpuJoinInfo *gj_info)
 	kresults_ratio = (long)(gj_info->kresults_ratio * 1000000.0);
 	privs = lappend(privs, makeInteger(kresults_ratio));
 	privs = lappend(privs, gj_info->nrows_ratio);
+	privs = lappend(privs, gj_info->feedback_sigs);
 	privs = lappend(privs, makeInteger(gj_info->outer_bulkload));
 	lval = double_as_long(gj_info->bulkload_density);
 	privs = lappend(privs, makeInteger(lval));
@@ -158,6 +200,7 @@ deform_gpujoin_info(CustomScan *cscan)
 	kresults_ratio = intVal(list_nth(privs, pindex++));
 	gj_info->kresults_ratio = (double)kresults_ratio / 1000000.0;
 	gj_info->nrows_ratio = list_nth(privs, pindex++);
+	gj_info->feedback_sigs = list_nth(privs, pindex++);
 	gj_info->outer_bulkload = intVal(list_nth(privs, pindex++));
 	fval = long_as_double(intVal(list_nth(privs, pindex++)));
 	gj_info->bulkload_density = fval;
@@ -192,7 +235,15 @@ typedef struct
 	/* buffer population ratio */
 	int				result_width;	/* result width for buffer length calc */
 	double			kresults_ratio;	/* estimated number of rows to outer */
+	double			result_ratio;	/* estimated nrooms ratio to outer */
 	List		   *nrows_ratio;
+	/* cardinality feedback */
+	List		   *feedback_sigs;
+	double			fb_nitems_src;	/* total number of source items */
+	double		   *fb_nitems_depth;/* total number of input items per depth */
+	double			fb_nitems_dst;	/* total number of result items */
+	double			fb_kresults_ratio;	/* largest kresults ratio observed */
+	Size			fb_result_width;	/* largest result width observed */
 	/* supplemental information to ps_tlist  */
 	List		   *ps_src_depth;
 	List		   *ps_src_resno;
@@ -202,6 +253,8 @@ typedef struct
 	pgstrom_data_store *next_pds;
 } GpuJoinState;
 
+static void gpujoin_feedback_record(GpuJoinState *gjs);
+
 /*
  * pgstrom_gpujoin - task object of GpuJoin
  */
@@ -373,7 +426,9 @@ __dump_gpujoin_path(StringInfo buf, PlannerInfo *root,
 	appendStringInfo(buf, ") %s%s (",
 					 join_type == JOIN_FULL ? "F" :
 					 join_type == JOIN_LEFT ? "L" :
-					 join_type == JOIN_RIGHT ? "R" : "I",
+					 join_type == JOIN_RIGHT ? "R" :
+					 join_type == JOIN_SEMI ? "S" :
+					 join_type == JOIN_ANTI ? "A" : "I",
 					 join_label);
 
 	/* inner relations */
@@ -392,6 +447,185 @@ __dump_gpujoin_path(StringInfo buf, PlannerInfo *root,
 	appendStringInfo(buf, ")");
 }
 
+/*
+ * gpujoin_feedback_strip_location
+ *
+ * It removes the token location from the nodeToString() output in place,
+ * because it depends on the query string, not on the join itself.
+ */
+static void
+gpujoin_feedback_strip_location(char *str)
+{
+	char	   *src = str;
+	char	   *dst = str;
+
+	while (*src != '\0')
+	{
+		if (strncmp(src, " :location ", 11) == 0)
+		{
+			src += 11;
+			if (*src == '-')
+				src++;
+			while (isdigit((unsigned char) *src))
+				src++;
+			continue;
+		}
+		*dst++ = *src++;
+	}
+	*dst = '\0';
+}
+
+/*
+ * gpujoin_feedback_comp_quals
+ *
+ * It accumulates the qualifiers on the signature of the join.
+ */
+static void
+gpujoin_feedback_comp_quals(pg_crc32 *crc, List *quals)
+{
+	ListCell   *lc;
+
+	foreach (lc, quals)
+	{
+		RestrictInfo   *rinfo = lfirst(lc);
+		char		   *temp = nodeToString(rinfo->clause);
+
+		gpujoin_feedback_strip_location(temp);
+		COMP_LEGACY_CRC32(*crc, temp, strlen(temp));
+		pfree(temp);
+	}
+}
+
+/*
+ * gpujoin_feedback_signature
+ *
+ * It computes a signature of the join to identify the cardinality
+ * feedback. Relations on both side with their scan qualifiers, join type
+ * and join qualifiers are considered.
+ */
+static cl_uint
+gpujoin_feedback_signature(PlannerInfo *root,
+						   RelOptInfo *outer_rel,
+						   RelOptInfo *inner_rel,
+						   JoinType jointype,
+						   List *join_quals)
+{
+	pg_crc32	crc;
+	RelOptInfo *rels[2];
+	int			i, x;
+
+	rels[0] = outer_rel;
+	rels[1] = inner_rel;
+
+	INIT_LEGACY_CRC32(crc);
+	for (i=0; i < 2; i++)
+	{
+		x = -1;
+		while ((x = bms_next_member(rels[i]->relids, x)) >= 0)
+		{
+			RangeTblEntry  *rte = root->simple_rte_array[x];
+			Oid				relid = (rte ? rte->relid : InvalidOid);
+
+			COMP_LEGACY_CRC32(crc, &x, sizeof(int));
+			COMP_LEGACY_CRC32(crc, &relid, sizeof(Oid));
+		}
+		COMP_LEGACY_CRC32(crc, &i, sizeof(int));
+		/* scan qualifiers of the base relation affect the fan-out also */
+		gpujoin_feedback_comp_quals(&crc, rels[i]->baserestrictinfo);
+	}
+	COMP_LEGACY_CRC32(crc, &jointype, sizeof(JoinType));
+	gpujoin_feedback_comp_quals(&crc, join_quals);
+	FIN_LEGACY_CRC32(crc);
+
+	return (cl_uint) crc;
+}
+
+/*
+ * gpujoin_feedback_lookup
+ *
+ * It looks up the cardinality feedback, if any.
+ */
+static bool
+gpujoin_feedback_lookup(cl_uint signature, int num_rels,
+						GpuJoinFeedback *result)
+{
+	GpuJoinFeedbackKey	key;
+	GpuJoinFeedback	   *entry;
+	bool				found = false;
+
+	if (!gpujoin_feedback_htab)
+		return false;
+
+	memset(&key, 0, sizeof(GpuJoinFeedbackKey));
+	key.signature = signature;
+	key.num_rels = num_rels;
+
+	LWLockAcquire(gpujoin_feedback_lock, LW_SHARED);
+	entry = hash_search(gpujoin_feedback_htab, &key, HASH_FIND, NULL);
+	if (entry && entry->nsamples > 0)
+	{
+		memcpy(result, entry, sizeof(GpuJoinFeedback));
+		found = true;
+	}
+	LWLockRelease(gpujoin_feedback_lock);
+
+	return found;
+}
+
+/*
+ * gpujoin_feedback_update
+ *
+ * It puts an observed result of execution on the cardinality feedback.
+ * Average growth ratio follows the recent executions, and the largest
+ * ones slowly decay to avoid one-time outlier pins larger buffer forever.
+ */
+static void
+gpujoin_feedback_update(cl_uint signature, int num_rels,
+						double nrows_ratio, double kresults_ratio,
+						Size result_width)
+{
+	GpuJoinFeedbackKey	key;
+	GpuJoinFeedback	   *entry;
+	bool				found;
+
+	if (!gpujoin_feedback_htab)
+		return;
+
+	memset(&key, 0, sizeof(GpuJoinFeedbackKey));
+	key.signature = signature;
+	key.num_rels = num_rels;
+
+	LWLockAcquire(gpujoin_feedback_lock, LW_EXCLUSIVE);
+	entry = hash_search(gpujoin_feedback_htab, &key, HASH_ENTER_NULL, &found);
+	if (!entry)
+	{
+		LWLockRelease(gpujoin_feedback_lock);
+		elog(DEBUG1, "GpuJoin: no room for cardinality feedback");
+		return;
+	}
+
+	if (!found || entry->nsamples == 0)
+	{
+		entry->nsamples = 0;
+		entry->nrows_ratio = nrows_ratio;
+		entry->nrows_ratio_max = nrows_ratio;
+		entry->kresults_ratio_max = kresults_ratio;
+		entry->result_width_max = result_width;
+	}
+	else
+	{
+		entry->nrows_ratio = 0.7 * entry->nrows_ratio + 0.3 * nrows_ratio;
+		entry->nrows_ratio_max = Max(nrows_ratio,
+									 0.95 * entry->nrows_ratio_max);
+		entry->kresults_ratio_max = Max(kresults_ratio,
+										0.95 * entry->kresults_ratio_max);
+		entry->result_width_max = Max(result_width,
+									  entry->result_width_max);
+	}
+	entry->nsamples++;
+	LWLockRelease(gpujoin_feedback_lock);
+}
+
 /*
  * check_nrows_growth_ratio
  *
@@ -406,11 +640,13 @@ check_nrows_growth_ratio(PlannerInfo *root,
 						 JoinType jointype,
 						 SpecialJoinInfo *sjinfo,
 						 List *join_quals,
-						 List *host_quals)
+						 List *host_quals,
+						 cl_uint feedback_sig)
 {
 	StringInfoData	buf;
 	double			nrows;
 	double			nrows_ratio;
+	GpuJoinFeedback	feedback;
 
 	/*
 	 * 'nrows_ratio' is used to estimate size of result buffer 
@@ -433,6 +669,17 @@ check_nrows_growth_ratio(PlannerInfo *root,
 	}
 	nrows_ratio = nrows / outer_rel->rows;
 
+	/*
+	 * Growth ratio observed on the previous executions is more reliable
+	 * than the estimation, if any.
+	 */
+	if (gpujoin_feedback_lookup(feedback_sig, 0, &feedback))
+	{
+		elog(DEBUG1, "GpuJoin: nrows growth ratio %.2f => %.2f (observed)",
+			 nrows_ratio, feedback.nrows_ratio);
+		nrows_ratio = feedback.nrows_ratio;
+	}
+
 	/*
 	 * If expected results generated by GPU looks too large, we immediately
 	 * give up to calculate this path.
@@ -491,6 +738,7 @@ cost_gpujoin(PlannerInfo *root,
 	Size		largest_size;
 	int			largest_index;
 	int			i, num_rels = gpath->num_rels;
+	GpuCostCoeff coeff;
 
 	/*
 	 * Buffer size estimation
@@ -507,7 +755,8 @@ cost_gpujoin(PlannerInfo *root,
 	/*
 	 * Cost of per-tuple evaluation
 	 */
-	gpu_cpu_ratio = pgstrom_gpu_operator_cost / cpu_operator_cost;
+	pgstrom_get_cost_coeff(GpuCostNodeJoin, &coeff);
+	gpu_cpu_ratio = coeff.operator_cost / cpu_operator_cost;
 	join_cost = palloc0(sizeof(QualCost) * num_rels);
 	for (i=0; i < num_rels; i++)
 	{
@@ -527,7 +776,7 @@ retry:
 	outer_ntuples = outer_path->rows;
 
 	/* fixed cost to initialize/setup/use GPU device */
-	startup_cost = pgstrom_gpu_setup_cost;
+	startup_cost = coeff.setup_cost;
 
 	for (i=0; i < num_rels; i++)
 	{
@@ -613,7 +862,8 @@ retry:
 		/* cost to execute previous stage */
 		if (i == 0)
 			run_cost = (outer_path->total_cost +
-						cpu_tuple_cost * outer_path->rows);
+						(cpu_tuple_cost + coeff.tuple_cost) *
+						outer_path->rows);
 		else
 			run_cost = (gpath->inners[i-1].startup_cost +
 						gpath->inners[i-1].run_cost);
@@ -638,6 +888,11 @@ retry:
 		/* number of outer items on the next depth */
 		outer_ntuples = gpath->inners[i].nrows_ratio * outer_path->rows;
 	}
+	/* materialization of the result */
+	gpath->inners[num_rels - 1].run_cost +=
+		(coeff.byte_cost * gpath->cpath.path.rows *
+		 gpath->cpath.path.parent->width);
+
 	/* put cost value on the gpath */
 	gpath->cpath.path.startup_cost
 		= gpath->inners[num_rels - 1].startup_cost;
@@ -718,7 +973,8 @@ create_gpujoin_path(PlannerInfo *root,
 					List *host_quals,
 					bool support_bulkload,
 					bool outer_merge,
-					double nrows_ratio)
+					double nrows_ratio,
+					cl_uint feedback_sig)
 {
 	GpuJoinPath	   *result;
 	GpuJoinPath	   *source = NULL;
@@ -762,6 +1018,7 @@ create_gpujoin_path(PlannerInfo *root,
 	result->inners[num_rels - 1].startup_cost = 0.0;	/* to be set later */
 	result->inners[num_rels - 1].run_cost = 0.0;		/* to be set later */
 	result->inners[num_rels - 1].nrows_ratio = nrows_ratio;
+	result->inners[num_rels - 1].feedback_sig = feedback_sig;
 	result->inners[num_rels - 1].scan_path = inner_path;
 	result->inners[num_rels - 1].join_type = jointype;
 	result->inners[num_rels - 1].hash_quals = hash_quals;
@@ -793,7 +1050,8 @@ try_gpujoin_path(PlannerInfo *root,
 				 List *hash_quals,
 				 List *join_quals,
 				 List *host_quals,
-				 double nrows_ratio)
+				 double nrows_ratio,
+				 cl_uint feedback_sig)
 {
 	ParamPathInfo  *param_info;
 	Relids			required_outer;
@@ -852,7 +1110,8 @@ try_gpujoin_path(PlannerInfo *root,
 							outer_path, inner_path,
 							sjinfo, param_info, required_outer,
 							hash_quals, join_quals, host_quals,
-							support_bulkload, false, nrows_ratio);
+							support_bulkload, false, nrows_ratio,
+							feedback_sig);
 
 		if (path_is_mergeable_gpujoin(outer_path))
 		{
@@ -860,7 +1119,8 @@ try_gpujoin_path(PlannerInfo *root,
 								outer_path, inner_path,
 								sjinfo, param_info, required_outer,
 								hash_quals, join_quals, host_quals,
-								support_bulkload, true, nrows_ratio);
+								support_bulkload, true, nrows_ratio,
+								feedback_sig);
 		}
 	}
 
@@ -874,7 +1134,8 @@ try_gpujoin_path(PlannerInfo *root,
 							outer_path, inner_path,
 							sjinfo, param_info, required_outer,
 							NIL, join_quals, host_quals,
-							support_bulkload, false, nrows_ratio);
+							support_bulkload, false, nrows_ratio,
+							feedback_sig);
 
 		if (path_is_mergeable_gpujoin(outer_path))
 		{
@@ -882,7 +1143,8 @@ try_gpujoin_path(PlannerInfo *root,
 								outer_path, inner_path,
 								sjinfo, param_info, required_outer,
 								NIL, join_quals, host_quals,
-								support_bulkload, true, nrows_ratio);
+								support_bulkload, true, nrows_ratio,
+								feedback_sig);
 		}
 	}
 	return;
@@ -913,6 +1175,7 @@ gpujoin_add_join_path(PlannerInfo *root,
 	List	   *join_quals = NIL;
 	ListCell   *lc;
 	double		nrows_ratio;
+	cl_uint		feedback_sig = 0;
 
 	/* calls secondary module if exists */
 	if (set_join_pathlist_next)
@@ -933,7 +1196,8 @@ gpujoin_add_join_path(PlannerInfo *root,
 
 	/* quick exit, if unsupported join type */
 	if (jointype != JOIN_INNER && jointype != JOIN_FULL &&
-		jointype != JOIN_RIGHT && jointype != JOIN_LEFT)
+		jointype != JOIN_RIGHT && jointype != JOIN_LEFT &&
+		jointype != JOIN_SEMI && jointype != JOIN_ANTI)
 		return;
 
 	/*
@@ -989,13 +1253,35 @@ gpujoin_add_join_path(PlannerInfo *root,
 	if (!join_quals)
 		return;
 
+	/*
+	 * SEMI/ANTI JOIN is only supported by GpuHashJoin, and all the join
+	 * clauses have to be evaluated on the device side, because host_quals
+	 * are applied on the joined rows, not on the probe of inner rows.
+	 */
+	if (jointype == JOIN_SEMI || jointype == JOIN_ANTI)
+	{
+		if (host_quals != NIL || hash_quals == NIL)
+			return;
+		foreach (lc, join_quals)
+		{
+			RestrictInfo   *rinfo = (RestrictInfo *) lfirst(lc);
+
+			if (rinfo->is_pushed_down)
+				return;
+		}
+	}
+
 	/*
 	 * Check nrows growth ratio. If too large PDS buffer is required,
 	 * we will give up GpuJoin at all.
 	 */
+	if (gpujoin_feedback_slots > 0)
+		feedback_sig = gpujoin_feedback_signature(root, outerrel, innerrel,
+												  jointype, join_quals);
 	nrows_ratio = check_nrows_growth_ratio(root, joinrel, outerrel, innerrel,
 										   jointype, sjinfo,
-										   join_quals, host_quals);
+										   join_quals, host_quals,
+										   feedback_sig);
 	if (nrows_ratio < 0.0)
 		return;
 
@@ -1057,7 +1343,8 @@ gpujoin_add_join_path(PlannerInfo *root,
 					 hash_quals,
 					 join_quals,
 					 host_quals,
-					 nrows_ratio);
+					 nrows_ratio,
+					 feedback_sig);
 
 	/*
 	 * Try, cheapest_total_inner + mergeable_gpujoin_outer
@@ -1077,7 +1364,8 @@ gpujoin_add_join_path(PlannerInfo *root,
 						 hash_quals,
 						 join_quals,
 						 host_quals,
-						 nrows_ratio);
+						 nrows_ratio,
+						 feedback_sig);
 	}
 }
 
@@ -1291,6 +1579,7 @@ create_gpujoin_plan(PlannerInfo *root,
 		List		   *hash_outer_keys = NIL;
 		List		   *clauses;
 		int				nrows_ratio;
+		bool			hash_dedup;
 
 		foreach (lc, gpath->inners[i].hash_quals)
 		{
@@ -1323,6 +1612,15 @@ create_gpujoin_plan(PlannerInfo *root,
 			else
 				elog(ERROR, "Bug? hash-clause reference bogus varnos");
 		}
+
+		/*
+		 * Inner entries with duplicated keys are redundant for SEMI JOIN,
+		 * as long as no other join clauses than hash-clauses exist.
+		 */
+		hash_dedup = (gpath->inners[i].join_type == JOIN_SEMI &&
+					  hash_inner_keys != NIL &&
+					  list_length(gpath->inners[i].join_quals) ==
+					  list_length(gpath->inners[i].hash_quals));
 		mplan = multirels_create_plan(root,
 									  i + 1,	/* depth */
 									  gpath->inners[i].startup_cost,
@@ -1334,7 +1632,8 @@ create_gpujoin_plan(PlannerInfo *root,
 									  gpath->inners[i].kmrels_rate,
 									  gpath->inners[i].nbatches,
 									  gpath->inners[i].nslots,
-									  hash_inner_keys);
+									  hash_inner_keys,
+									  hash_dedup);
 		gpath->inners[i].scan_plan = (Plan *) mplan;
 		/* add properties of GpuJoinInfo */
 		gj_info.join_types = lappend_int(gj_info.join_types,
@@ -1346,6 +1645,9 @@ create_gpujoin_plan(PlannerInfo *root,
 										  hash_outer_keys);
 		nrows_ratio = (int)(gpath->inners[i].nrows_ratio * 1000000.0);
 		gj_info.nrows_ratio = lappend_int(gj_info.nrows_ratio, nrows_ratio);
+		gj_info.feedback_sigs =
+			lappend_int(gj_info.feedback_sigs,
+						(int) gpath->inners[i].feedback_sig);
 		/* chain it under the GpuJoin */
 		if (prev_plan)
 			innerPlan(prev_plan) = &mplan->scan.plan;
@@ -1499,6 +1801,7 @@ gpujoin_begin(CustomScanState *node, EState *estate, int eflags)
 	CustomScan	   *cscan = (CustomScan *) node->ss.ps.plan;
 	GpuJoinInfo	   *gj_info = deform_gpujoin_info(cscan);
 	TupleDesc		tupdesc = GTS_GET_RESULT_TUPDESC(gjs);
+	GpuJoinFeedback	feedback;
 
 	/* activate GpuContext for device execution */
 	if ((eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
@@ -1577,6 +1880,27 @@ gpujoin_begin(CustomScanState *node, EState *estate, int eflags)
 		MAXALIGN(cscan->scan.plan.plan_width);	/* average width */
 	gjs->kresults_ratio = gj_info->kresults_ratio;
 	gjs->nrows_ratio = gj_info->nrows_ratio;
+	gjs->result_ratio = (double) llast_int(gj_info->nrows_ratio) / 1000000.0;
+
+	/*
+	 * If we have cardinality feedback of the previous executions, buffer
+	 * size shall be determined according to the observed values, to avoid
+	 * re-execution penalty because of StromError_DataStoreNoSpace.
+	 */
+	gjs->feedback_sigs = gj_info->feedback_sigs;
+	gjs->fb_nitems_depth = palloc0(sizeof(double) * gjs->num_rels);
+	if (gpujoin_feedback_lookup((cl_uint) llast_int(gjs->feedback_sigs),
+								gjs->num_rels, &feedback))
+	{
+		elog(DEBUG1, "GpuJoin: kresults ratio %.2f => %.2f, "
+			 "result ratio %.2f => %.2f (observed)",
+			 gjs->kresults_ratio, feedback.kresults_ratio_max,
+			 gjs->result_ratio, feedback.nrows_ratio_max);
+		gjs->kresults_ratio = Max(feedback.kresults_ratio_max, 1.0);
+		gjs->result_ratio = feedback.nrows_ratio_max;
+		if (feedback.result_width_max > 0)
+			gjs->result_width = MAXALIGN(feedback.result_width_max);
+	}
 }
 
 static TupleTableSlot *
@@ -1628,6 +1952,9 @@ gpujoin_end(CustomScanState *node)
 	ExecEndNode(outerPlanState(node));
 	ExecEndNode(innerPlanState(node));
 
+	/* save the observed cardinality for the later executions */
+	gpujoin_feedback_record(gjs);
+
 	pgstrom_release_gputaskstate(&gjs->gts);
 }
 
@@ -1750,7 +2077,9 @@ gpujoin_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 			appendStringInfo(&str, "Logic: GpuHash%sJoin",
 							 join_type == JOIN_FULL ? "Full" :
 							 join_type == JOIN_LEFT ? "Left" :
-							 join_type == JOIN_RIGHT ? "Right" : "");
+							 join_type == JOIN_RIGHT ? "Right" :
+							 join_type == JOIN_SEMI ? "Semi" :
+							 join_type == JOIN_ANTI ? "Anti" : "");
 		}
 		else
 		{
@@ -2386,18 +2715,25 @@ gpujoin_codegen(PlannerInfo *root,
 	return decl.data;
 }
 
-static GpuTask *
-gpujoin_create_task(GpuJoinState *gjs, pgstrom_data_store *pds_src)
+/*
+ * gpujoin_setup_task
+ *
+ * It allocates a pgstrom_gpujoin object that joins the supplied outer
+ * data store with the inner multi-relations, and writes out the results
+ * to the supplied destination data store.
+ */
+static pgstrom_gpujoin *
+gpujoin_setup_task(GpuJoinState *gjs,
+				   pgstrom_multirels *pmrels,
+				   pgstrom_data_store *pds_src,
+				   pgstrom_data_store *pds_dst,
+				   cl_uint total_items)
 {
 	GpuContext		   *gcontext = gjs->gts.gcontext;
 	pgstrom_gpujoin	   *pgjoin;
 	kern_gpujoin	   *kgjoin;
-	TupleDesc			tupdesc;
-	cl_uint				nrooms;
-	cl_uint				total_items;
 	Size				kgjoin_head;
 	Size				required;
-	pgstrom_data_store *pds_dst;
 
 	/*
 	 * Allocation of pgstrom_gpujoin task object
@@ -2409,25 +2745,13 @@ gpujoin_create_task(GpuJoinState *gjs, pgstrom_data_store *pds_src)
 				STROMALIGN(offsetof(kern_resultbuf, results[0])));
 	pgjoin = MemoryContextAllocZero(gcontext->memcxt, required);
 	pgstrom_init_gputask(&gjs->gts, &pgjoin->task);
-	pgjoin->pmrels = multirels_attach_buffer(gjs->curr_pmrels);
+	pgjoin->pmrels = multirels_attach_buffer(pmrels);
 	pgjoin->pds_src = pds_src;
-
-	/*
-	 * Last chunk checks - this information is needed to handle left outer
-	 * join case because last chunk also kicks special kernel to generate
-	 * half-null tuples on GPU.
-	 */
-	if (!gjs->gts.scan_bulk)
-		pgjoin->is_last_chunk = (gjs->gts.scan_overflow == NULL);
-	else
-		pgjoin->is_last_chunk = (gjs->next_pds == NULL);
+	pgjoin->pds_dst = pds_dst;
 
 	/*
 	 * Setup kern_gpujoin
 	 */
-	total_items = (cl_uint)((double)pds_src->kds->nitems *
-							gjs->kresults_ratio *
-							(1.0 + pgstrom_nrows_growth_margin));
 	kgjoin = &pgjoin->kern;
 	kgjoin->kresults_1_offset = kgjoin_head;
 	kgjoin->kresults_2_offset = kgjoin_head +
@@ -2441,11 +2765,24 @@ gpujoin_create_task(GpuJoinState *gjs, pgstrom_data_store *pds_src)
 		   gjs->gts.kern_params,
 		   gjs->gts.kern_params->length);
 
+	return pgjoin;
+}
+
+static GpuTask *
+gpujoin_create_task(GpuJoinState *gjs, pgstrom_data_store *pds_src)
+{
+	GpuContext		   *gcontext = gjs->gts.gcontext;
+	pgstrom_gpujoin	   *pgjoin;
+	TupleDesc			tupdesc;
+	cl_uint				nrooms;
+	cl_uint				total_items;
+	pgstrom_data_store *pds_dst;
+
 	/*
 	 * Allocation of the destination data-store
 	 */
 	nrooms = (cl_uint)((double) pds_src->kds->nitems *
-					   (double) llast_int(gjs->nrows_ratio) / 1000000.0 *
+					   gjs->result_ratio *
 					   (1.0 + pgstrom_nrows_growth_margin));
 	tupdesc = gjs->gts.css.ss.ss_ScanTupleSlot->tts_tupleDescriptor;
 
@@ -2468,12 +2805,28 @@ gpujoin_create_task(GpuJoinState *gjs, pgstrom_data_store *pds_src)
 	else
 		elog(ERROR, "Bug? unexpected result format: %d", gjs->result_format);
 
-	pgjoin->pds_dst = pds_dst;
+	/*
+	 * Allocation of pgstrom_gpujoin with kern_resultbuf
+	 */
+	total_items = (cl_uint)((double)pds_src->kds->nitems *
+							gjs->kresults_ratio *
+							(1.0 + pgstrom_nrows_growth_margin));
+	pgjoin = gpujoin_setup_task(gjs, gjs->curr_pmrels,
+								pds_src, pds_dst, total_items);
+
+	/*
+	 * Last chunk checks - this information is needed to handle left outer
+	 * join case because last chunk also kicks special kernel to generate
+	 * half-null tuples on GPU.
+	 */
+	if (!gjs->gts.scan_bulk)
+		pgjoin->is_last_chunk = (gjs->gts.scan_overflow == NULL);
+	else
+		pgjoin->is_last_chunk = (gjs->next_pds == NULL);
 
 	return &pgjoin->task;
 }
 
-
 static GpuTask *
 gpujoin_next_chunk(GpuTaskState *gts)
 {
@@ -2552,9 +2905,11 @@ retry:
 			/* create a new data-store if not constructed yet */
 			if (!pds)
 			{
+				Size	chunk_size = pgstrom_adaptive_chunk_size(&gjs->gts, 0);
+
 				pds = pgstrom_create_data_store_row(gjs->gts.gcontext,
 													tupdesc,
-													pgstrom_chunk_size(),
+													chunk_size,
 													false);
 			}
 
@@ -2689,6 +3044,264 @@ gpujoin_task_release(GpuTask *gtask)
 	pfree(pgjoin);
 }
 
+/*
+ * gpujoin_feedback_accum
+ *
+ * It accumulates the observed fan-out of the completed task.
+ */
+static void
+gpujoin_feedback_accum(GpuJoinState *gjs, pgstrom_gpujoin *gjoin)
+{
+	kern_gpujoin	   *kgjoin = &gjoin->kern;
+	kern_data_store	   *kds_src;
+	kern_data_store	   *kds_dst;
+	double				kresults_items;
+	int					i;
+
+	if (!gjoin->pds_src || !gjoin->pds_dst)
+		return;
+	kds_src = gjoin->pds_src->kds;
+	kds_dst = gjoin->pds_dst->kds;
+	if (kds_src->nitems == 0)
+		return;
+
+	/*
+	 * kern_resultbuf at the depth (i+1) actually consumed (i+1) slots for
+	 * each of the nitems_depth[i] input items, and the last one consumed
+	 * (num_rels+1) slots for each result item. Its largest one is the
+	 * observed usage, not the capacity we allocated.
+	 */
+	kresults_items = (double)(gjs->num_rels + 1) * (double) kds_dst->nitems;
+	gjs->fb_nitems_src += (double) kds_src->nitems;
+	for (i=0; i < gjs->num_rels && i < GPUJOIN_MAX_FEEDBACK_DEPTH; i++)
+	{
+		gjs->fb_nitems_depth[i] += (double) kgjoin->nitems_depth[i];
+		kresults_items = Max(kresults_items,
+							 (double)(i + 1) * (double) kgjoin->nitems_depth[i]);
+	}
+	gjs->fb_nitems_dst += (double) kds_dst->nitems;
+	gjs->fb_kresults_ratio = Max(gjs->fb_kresults_ratio,
+								 kresults_items / (double) kds_src->nitems);
+	if (kds_dst->format == KDS_FORMAT_ROW && kds_dst->nitems > 0)
+	{
+		Size	result_width;
+
+		result_width = ((Size)(kds_dst->usage -
+							   KERN_DATA_STORE_HEAD_LENGTH(kds_dst) -
+							   sizeof(cl_uint) * kds_dst->nitems) /
+						(Size) kds_dst->nitems) + 1;
+		gjs->fb_result_width = Max(gjs->fb_result_width, result_width);
+	}
+}
+
+/*
+ * gpujoin_feedback_record
+ *
+ * It saves the accumulated fan-out on the cardinality feedback; growth
+ * ratio of each depth towards its input for the planner, and the whole
+ * GpuJoin node for buffer size estimation by the executor.
+ */
+static void
+gpujoin_feedback_record(GpuJoinState *gjs)
+{
+	int			i;
+
+	if (gjs->fb_nitems_src <= 0.0 || gjs->feedback_sigs == NIL)
+		return;
+
+	for (i=0; i < gjs->num_rels && i < GPUJOIN_MAX_FEEDBACK_DEPTH; i++)
+	{
+		double	nitems_in = gjs->fb_nitems_depth[i];
+		double	nitems_out;
+
+		if (i + 1 == gjs->num_rels)
+			nitems_out = gjs->fb_nitems_dst;
+		else if (i + 1 < GPUJOIN_MAX_FEEDBACK_DEPTH)
+			nitems_out = gjs->fb_nitems_depth[i + 1];
+		else
+			break;
+		if (nitems_in <= 0.0)
+			continue;
+
+		gpujoin_feedback_update((cl_uint) list_nth_int(gjs->feedback_sigs, i),
+								0,
+								nitems_out / nitems_in,
+								0.0, 0);
+	}
+	gpujoin_feedback_update((cl_uint) llast_int(gjs->feedback_sigs),
+							gjs->num_rels,
+							gjs->fb_nitems_dst / gjs->fb_nitems_src,
+							gjs->fb_kresults_ratio,
+							gjs->fb_result_width);
+}
+
+/*
+ * gpujoin_split_task
+ *
+ * It splits the outer rows of the overflowing task into multiple sub-chunks
+ * that are small enough to fit the result buffers of the original task, then
+ * chains them on the pending_tasks queue. Nothing the overflowing attempt
+ * produced is kept; the join kernel skips projection once any buffer
+ * overflows, so every sub-chunk re-runs all the depths from its outer rows.
+ * The original task object is reused for the first sub-chunk, and the other
+ * sub-chunks get buffers with same capacity as the original one, so peak
+ * memory consumption is kept bounded regardless of the fan-out of the join.
+ * It returns false if the task cannot be split; caller shall expand the
+ * buffers and re-execute the task as usual.
+ */
+static bool
+gpujoin_split_task(GpuJoinState *gjs, pgstrom_gpujoin *gjoin)
+{
+	GpuContext		   *gcontext = gjs->gts.gcontext;
+	GpuTaskState	   *gts = &gjs->gts;
+	kern_gpujoin	   *kgjoin = &gjoin->kern;
+	pgstrom_data_store *pds_src = gjoin->pds_src;
+	pgstrom_data_store *pds_dst = gjoin->pds_dst;
+	kern_data_store	   *kds_src = pds_src->kds;
+	kern_data_store	   *kds_dst = pds_dst->kds;
+	TupleDesc			tupdesc = ExecGetResultType(outerPlanState(gjs));
+	TupleDesc			tupdesc_dst;
+	double				ratio;
+	cl_uint				nsplits;
+	cl_uint				src_index;
+	Size				max_item = 0;
+	Size				part_length;
+	Size				dst_length;
+	List			   *sub_chunks = NIL;
+	ListCell		   *lc;
+	int					i;
+	bool				is_last_chunk = gjoin->is_last_chunk;
+	struct timeval		tv_enqueue;
+
+	/*
+	 * Only a flat row-format data store can be split; toast references
+	 * of the bulk-loaded chunk are not valid in other data stores.
+	 */
+	if (kds_src->format != KDS_FORMAT_ROW ||
+		PDS_IS_SEGMENTED(pds_src) ||
+		pds_src->ptoast != NULL ||
+		kds_src->nitems < 2)
+		return false;
+
+	/*
+	 * Ratio of the required buffer size towards the current one tells us
+	 * how many sub-chunks are needed. See gpujoin_task_complete() for the
+	 * two scenarios of StromError_DataStoreNoSpace.
+	 */
+	if (kgjoin->kresults_total_items < kgjoin->kresults_max_items)
+		ratio = ((double) kgjoin->kresults_max_items /
+				 (double) Max(kgjoin->kresults_total_items, 1));
+	else if (kds_dst->format == KDS_FORMAT_ROW)
+		ratio = ((double)(KERN_DATA_STORE_HEAD_LENGTH(kds_dst) +
+						  sizeof(cl_uint) * kds_dst->nitems +
+						  kds_dst->usage) /
+				 (double) kds_dst->length);
+	else
+		ratio = ((double) kds_dst->nitems /
+				 (double) Max(kds_dst->nrooms, 1));
+	ratio = ceil(ratio * (1.0 + pgstrom_nrows_growth_margin));
+	nsplits = (ratio < 2.0 ? 2 : (ratio > (double) kds_src->nitems
+								  ? kds_src->nitems : (cl_uint) ratio));
+
+	/*
+	 * Copy the outer rows to sub-chunks. Every sub-chunk has room for at
+	 * least one largest row, so we always make progress.
+	 */
+	for (src_index = 0; src_index < kds_src->nitems; src_index++)
+	{
+		kern_tupitem   *tupitem;
+
+		tupitem = KERN_DATA_STORE_TUPITEM(kds_src, src_index);
+		max_item = Max(max_item, LONGALIGN(offsetof(kern_tupitem, htup) +
+										   tupitem->t_len));
+	}
+	part_length = (STROMALIGN(sizeof(cl_uint) * kds_src->nitems +
+							  kds_src->usage) / nsplits +
+				   STROMALIGN(sizeof(cl_uint)) + max_item);
+
+	src_index = 0;
+	while (src_index < kds_src->nitems)
+	{
+		pgstrom_data_store *pds_part;
+		cl_uint		src_index_prev = src_index;
+
+		pds_part = pgstrom_create_data_store_row(gcontext, tupdesc,
+												 part_length, false);
+		pgstrom_data_store_insert_chunk(pds_part, pds_src, &src_index);
+		if (src_index == src_index_prev)
+			elog(ERROR, "Bug? no outer rows were moved to the sub-chunk");
+		sub_chunks = lappend(sub_chunks, pds_part);
+	}
+	elog(DEBUG1, "GpuJoin split a chunk of %u rows into %d sub-chunks",
+		 kds_src->nitems, list_length(sub_chunks));
+
+	/*
+	 * Construct GpuTasks for the second and later sub-chunks. Its result
+	 * buffers have same capacity as the original task.
+	 */
+	tupdesc_dst = gts->css.ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+	dst_length = kds_dst->length - KERN_DATA_STORE_HEAD_LENGTH(kds_dst);
+	for (lc = lnext(list_head(sub_chunks)); lc != NULL; lc = lnext(lc))
+	{
+		pgstrom_data_store *pds_part = lfirst(lc);
+		pgstrom_data_store *pds_part_dst;
+		pgstrom_gpujoin	   *gjoin_part;
+
+		if (kds_dst->format == KDS_FORMAT_SLOT)
+			pds_part_dst = pgstrom_create_data_store_slot(gcontext,
+														  tupdesc_dst,
+														  kds_dst->nrooms,
+														  false, NULL);
+		else
+			pds_part_dst = pgstrom_create_data_store_row(gcontext,
+														 tupdesc_dst,
+														 dst_length,
+														 false);
+		gjoin_part = gpujoin_setup_task(gjs, gjoin->pmrels,
+										pds_part, pds_part_dst,
+										kgjoin->kresults_total_items);
+		pgstrom_charge_gputask(&gjoin_part->task,
+							   pds_part->kds_length +
+							   pds_part_dst->kds_length);
+		/* only the last sub-chunk takes over the last chunk mark */
+		gjoin_part->is_last_chunk = (is_last_chunk && !lnext(lc));
+		lfirst(lc) = gjoin_part;
+	}
+
+	/*
+	 * The original task is reused for the first sub-chunk
+	 */
+	gjoin->pds_src = linitial(sub_chunks);
+	gjoin->is_last_chunk = (is_last_chunk && list_length(sub_chunks) == 1);
+	pgstrom_release_data_store(pds_src);
+
+	kgjoin->kresults_max_items = 0;
+	kgjoin->errcode = StromError_Success;
+	kds_dst->usage = 0;
+	kds_dst->nitems = 0;
+	linitial(sub_chunks) = gjoin;
+
+	/*
+	 * Chain the sub-chunks on the head of pending_tasks queue; pushed in
+	 * reverse order, so the first sub-chunk shall be processed first.
+	 * Queueing delay of the sub-chunks is sampled from now on.
+	 */
+	gettimeofday(&tv_enqueue, NULL);
+	SpinLockAcquire(&gts->lock);
+	for (i = list_length(sub_chunks) - 1; i >= 0; i--)
+	{
+		pgstrom_gpujoin *gjoin_part = list_nth(sub_chunks, i);
+
+		gjoin_part->task.tv_enqueue = tv_enqueue;
+		dlist_push_head(&gts->pending_tasks, &gjoin_part->task.chain);
+		gts->num_pending_tasks++;
+	}
+	SpinLockRelease(&gts->lock);
+	list_free(sub_chunks);
+
+	return true;
+}
+
 static bool
 gpujoin_task_complete(GpuTask *gtask)
 {
@@ -2735,6 +3348,13 @@ gpujoin_task_complete(GpuTask *gtask)
 		/* GpuJoin should not take file-mapped data store */
 		Assert(!pds_dst->kds_fname);
 
+		/*
+		 * In rerun-split mode, we don't expand the buffers but re-run
+		 * the outer rows of this task by smaller sub-chunks.
+		 */
+		if (gpujoin_rerun_split && gpujoin_split_task(gjs, gjoin))
+			return false;
+
 		/*
 		 * NOTE: StromError_DataStoreNoSpace may happen in two cases.
 		 * First, kern_resultbuf, that stores intermediate results, does
@@ -2825,6 +3445,12 @@ gpujoin_task_complete(GpuTask *gtask)
 		else
 			elog(ERROR, "Bug? unexpected result format: %d", kds_old->format);
 
+		/*
+		 * NOTE: pds_dst is not expanded by extents, unlike the inner
+		 * relations. It is the destination of DMA receive, so it has to be
+		 * a contiguous buffer, and the kernel rebuilds the whole results on
+		 * the next execution. So, only the header is copied here.
+		 */
 		if (kds_length <= kds_old->length)
 		{
 			/* no need to alloc again, just reset usage */
@@ -2860,6 +3486,9 @@ gpujoin_task_complete(GpuTask *gtask)
 
 		return false;
 	}
+	else if (gjoin->task.errcode == StromError_Success)
+		gpujoin_feedback_accum((GpuJoinState *) gts, gjoin);
+
 	return true;
 }
 
@@ -3412,6 +4041,30 @@ gpujoin_task_process(GpuTask *gtask)
 	return status;
 }
 
+/*
+ * pgstrom_startup_gpujoin
+ *
+ * allocation of shared memory for cardinality feedback
+ */
+static void
+pgstrom_startup_gpujoin(void)
+{
+	HASHCTL		ctl;
+
+	if (shmem_startup_next)
+		(*shmem_startup_next)();
+
+	memset(&ctl, 0, sizeof(HASHCTL));
+	ctl.keysize = sizeof(GpuJoinFeedbackKey);
+	ctl.entrysize = sizeof(GpuJoinFeedback);
+	gpujoin_feedback_lock = LWLockAssign();
+	gpujoin_feedback_htab = ShmemInitHash("PG-Strom GpuJoin Feedback",
+										  gpujoin_feedback_slots,
+										  gpujoin_feedback_slots,
+										  &ctl,
+										  HASH_ELEM | HASH_BLOBS);
+}
+
 /*
  * pgstrom_init_gpujoin
  *
@@ -3438,6 +4091,32 @@ pgstrom_init_gpujoin(void)
 							 PGC_USERSET,
 							 GUC_NOT_IN_SAMPLE,
 							 NULL, NULL, NULL);
+	/* number of cardinality feedback entries */
+	DefineCustomIntVariable("pg_strom.gpujoin_feedback_slots",
+							"Number of cardinality feedback entries of GpuJoin",
+							"0 disables cardinality feedback",
+							&gpujoin_feedback_slots,
+							1024,
+							0,
+							INT_MAX / 2,
+							PGC_POSTMASTER,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	/* re-run overflowing chunks by sub-chunks instead of expanding buffers */
+	DefineCustomBoolVariable("pg_strom.gpujoin_rerun_split",
+							 "Re-runs an overflowing GpuJoin chunk by "
+							 "smaller sub-chunks",
+							 "If off, the overflowing chunk is re-executed "
+							 "with expanded buffers. Either way, the rows "
+							 "produced by the overflowing attempt are "
+							 "discarded, because the join kernel skips "
+							 "projection once any buffer overflows; "
+							 "sub-chunks re-run all the depths of the join.",
+							 &gpujoin_rerun_split,
+							 false,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
 	/* setup path methods */
 	gpujoin_path_methods.CustomName				= "GpuJoin";
 	gpujoin_path_methods.PlanCustomPath			= create_gpujoin_plan;
@@ -3462,4 +4141,14 @@ pgstrom_init_gpujoin(void)
 	/* hook registration */
 	set_join_pathlist_next = set_join_pathlist_hook;
 	set_join_pathlist_hook = gpujoin_add_join_path;
+
+	/* shared memory for cardinality feedback */
+	if (gpujoin_feedback_slots > 0)
+	{
+		RequestAddinShmemSpace(hash_estimate_size(gpujoin_feedback_slots,
+												  sizeof(GpuJoinFeedback)));
+		RequestAddinLWLocks(1);
+		shmem_startup_next = shmem_startup_hook;
+		shmem_startup_hook = pgstrom_startup_gpujoin;
+	}
 }
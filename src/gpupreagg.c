@@ -22,7 +22,9 @@
 #include "catalog/pg_namespace.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "executor/executor.h"
 #include "executor/nodeAgg.h"
+#include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "parser/parse_func.h"
@@ -30,12 +32,15 @@
 #include "optimizer/cost.h"
 #include "optimizer/var.h"
 #include "parser/parsetree.h"
+#include "storage/buffile.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/pg_crc.h"
 #include "utils/syscache.h"
+#include "utils/typcache.h"
 #include <math.h>
 #include "pg_strom.h"
 #include "cuda_common.h"
@@ -43,9 +48,10 @@
 #include "cuda_gpupreagg.h"
 
 static CustomScanMethods		gpupreagg_scan_methods;
-static CustomExecMethods		gpupreagg_exec_methods;
+static PGStromExecMethods		gpupreagg_exec_methods;
 static bool						enable_gpupreagg;
 static bool						debug_force_gpupreagg;
+static bool						gpupreagg_host_merge;
 
 typedef enum
 {
@@ -61,6 +67,7 @@ typedef struct
 	bool			outer_bulkload;
 	double			bulkload_density;
 	double			num_groups;		/* estimated number of groups */
+	bool			host_merge;		/* partial results are merged on host */
 	List		   *outer_quals;	/* device quals pulled-up */
 	const char	   *kern_source;
 	int				extra_flags;
@@ -92,6 +99,7 @@ form_gpupreagg_info(CustomScan *cscan, GpuPreAggInfo *gpa_info)
 	privs = lappend(privs, makeInteger(lval));
 	lval = double_as_long(gpa_info->num_groups);
 	privs = lappend(privs, makeInteger(lval));
+	privs = lappend(privs, makeInteger(gpa_info->host_merge));
 	exprs = lappend(exprs, gpa_info->outer_quals);
 	privs = lappend(privs, makeString(pstrdup(gpa_info->kern_source)));
 	privs = lappend(privs, makeInteger(gpa_info->extra_flags));
@@ -143,6 +151,7 @@ deform_gpupreagg_info(CustomScan *cscan)
 	gpa_info->bulkload_density = fval;
 	fval = long_as_double(intVal(list_nth(privs, pindex++)));
 	gpa_info->num_groups = fval;
+	gpa_info->host_merge = intVal(list_nth(privs, pindex++));
 	gpa_info->outer_quals = list_nth(exprs, eindex++);
 	gpa_info->kern_source = strVal(list_nth(privs, pindex++));
 	gpa_info->extra_flags = intVal(list_nth(privs, pindex++));
@@ -172,6 +181,80 @@ deform_gpupreagg_info(CustomScan *cscan)
 
 
 
+/*
+ * GpuPreAggMerge - state of the host-side two-level aggregation
+ *
+ * Partial results of GpuPreAgg are merged on the host across the chunks
+ * using a hash table bounded by work_mem. Once it gets full, partial
+ * results of the groups not in the hash table are written out to the
+ * hash-partitioned temporary files, then re-aggregated partition by
+ * partition after the in-memory groups are returned.
+ *
+ * Every group is returned only once, because a group being absent from the
+ * hash table never gets an entry in the same pass. Only exception is the
+ * partial result that cannot be merged (integer overflow); it is kept as
+ * an extra of the entry, and returned next to the entry. So, the upper Agg
+ * can run with AGG_SORTED strategy without Sort, instead of a HashAgg that
+ * is not bounded by work_mem.
+ */
+#define GPUPREAGG_MERGE_NPARTS_BITS		5
+#define GPUPREAGG_MERGE_NPARTS			(1 << GPUPREAGG_MERGE_NPARTS_BITS)
+#define GPUPREAGG_MERGE_MAX_LEVEL		(32 / GPUPREAGG_MERGE_NPARTS_BITS)
+
+typedef enum
+{
+	PREAGG_MERGE_KEY,		/* grouping key */
+	PREAGG_MERGE_JUNK,		/* junk field (always NULL) */
+	PREAGG_MERGE_ADD,		/* NROWS, PSUM, PSUM_X2 and PCOV_* */
+	PREAGG_MERGE_MIN,		/* PMIN */
+	PREAGG_MERGE_MAX		/* PMAX */
+} PreAggMergeOp;
+
+/* values[] and isnull[] of the partial results follow the header */
+#define PREAGG_MERGE_VALUES(entry)							\
+	((Datum *)((char *)(entry) + MAXALIGN(sizeof(TupleHashEntryData))))
+#define PREAGG_MERGE_ISNULL(entry,natts)					\
+	((bool *)(PREAGG_MERGE_VALUES(entry) + (natts)))
+/* list of the extra partial results of the same group */
+#define PREAGG_MERGE_EXTRAS(entry,natts)					\
+	((List **)((char *)PREAGG_MERGE_ISNULL(entry,natts) +	\
+			   MAXALIGN(sizeof(bool) * (natts))))
+
+typedef struct
+{
+	BufFile		   *file;		/* temporary file of the spilled run */
+	int				level;		/* partitioning level of this run */
+} GpuPreAggSpill;
+
+typedef struct
+{
+	int				natts;
+	PreAggMergeOp  *ops;		/* merge operation for each attribute */
+	FmgrInfo	   *cmpfuncs;	/* comparison function for PMIN/PMAX */
+	int16		   *typlens;
+	bool		   *typbyvals;
+	int				numKeys;	/* number of grouping keys */
+	AttrNumber	   *keyColIdx;	/* index of grouping keys */
+	FmgrInfo	   *eqfuncs;	/* equality function of grouping keys */
+	FmgrInfo	   *hashfuncs;	/* hash function of grouping keys */
+	MemoryContext	tablecxt;	/* memory context of the hash table */
+	MemoryContext	tempcxt;	/* per-tuple working memory */
+	TupleHashTable	htab;
+	TupleHashIterator iter;
+	ListCell	   *extra;		/* next extra of the entry being returned */
+	Size			entry_size;
+	long			max_entries;	/* max number of in-memory groups */
+	long			num_entries;	/* current number of in-memory groups */
+	TupleTableSlot *spill_slot;	/* slot to read back the spilled tuples */
+	int				curr_level;	/* level of the run being loaded */
+	BufFile		   *parts[GPUPREAGG_MERGE_NPARTS];
+	List		   *pending;	/* list of GpuPreAggSpill */
+	bool			input_done;	/* true, if all the chunks were loaded */
+	bool			scanning;	/* true, if hash table is being returned */
+	cl_uint			num_spills;	/* statistics: number of spilled runs */
+	double			num_spilled_tuples;
+} GpuPreAggMerge;
+
 typedef struct
 {
 	GpuTaskState	gts;
@@ -181,6 +264,7 @@ typedef struct
 	double			ntups_per_page;	/* average number of tuples per page */
 	List		   *outer_quals;
 	TupleTableSlot *outer_overflow;
+	TupleTableSlot *result_overflow;	/* only used by bulk-exec */
 
 	bool			needs_grouping;
 	bool			local_reduction;
@@ -188,6 +272,7 @@ typedef struct
 	bool			has_varlena;
 
 	cl_uint			num_rechecks;
+	GpuPreAggMerge *merge;		/* valid, if host-side merge is enabled */
 } GpuPreAggState;
 
 /* Host side representation of kern_gpupreagg. It can perform as a message
@@ -249,6 +334,13 @@ static TupleTableSlot *gpupreagg_next_tuple(GpuTaskState *gts);
 #define ALTFUNC_EXPR_PCOV_X2		108	/* PCOV_X2(X,Y) */
 #define ALTFUNC_EXPR_PCOV_Y2		109	/* PCOV_Y2(X,Y) */
 #define ALTFUNC_EXPR_PCOV_XY		110	/* PCOV_XY(X,Y) */
+#define ALTFUNC_EXPR_HLL_ITEM		111	/* HLL_ITEM(X) */
+#define ALTFUNC_EXPR_QSKETCH_ITEM	112	/* QSKETCH_ITEM(X) */
+#define ALTFUNC_EXPR_CONST_ARG2		113	/* 2nd argument as a constant */
+
+#ifndef FLOAT8ARRAYOID
+#define FLOAT8ARRAYOID				1022
+#endif
 
 /*
  * List of supported aggregate functions
@@ -558,6 +650,30 @@ static aggfunc_catalog_t  aggfunc_catalog[] = {
 	   ALTFUNC_EXPR_PCOV_Y2,
 	   ALTFUNC_EXPR_PCOV_XY}, 0
 	},
+	/*
+	 * APPROX_COUNT_DISTINCT(X) = HLL_COUNT(HLL_ITEM(X))
+	 * HLL_ITEM(X) is not reduced, but works as a grouping key
+	 */
+	{ "approx_count_distinct", 1, {ANYELEMENTOID},
+	  "s:hll_count", 1, {INT4OID}, {ALTFUNC_EXPR_HLL_ITEM}, 0
+	},
+	/*
+	 * APPROX_PERCENTILE(X,P) = EX_APPROX_PERCENTILE(QSKETCH_ITEM(X),
+	 *                                               NROWS(X), P)
+	 * QSKETCH_ITEM(X) is not reduced, but works as a grouping key
+	 */
+	{ "approx_percentile", 2, {FLOAT8OID, FLOAT8OID},
+	  "s:approx_percentile", 3, {INT4OID, INT4OID, FLOAT8OID},
+	  {ALTFUNC_EXPR_QSKETCH_ITEM,
+	   ALTFUNC_EXPR_NROWS,
+	   ALTFUNC_EXPR_CONST_ARG2}, 0
+	},
+	{ "approx_percentile", 2, {FLOAT8OID, FLOAT8ARRAYOID},
+	  "s:approx_percentile", 3, {INT4OID, INT4OID, FLOAT8ARRAYOID},
+	  {ALTFUNC_EXPR_QSKETCH_ITEM,
+	   ALTFUNC_EXPR_NROWS,
+	   ALTFUNC_EXPR_CONST_ARG2}, 0
+	},
 };
 
 static const aggfunc_catalog_t *
@@ -593,7 +709,8 @@ aggfunc_lookup_by_oid(Oid aggfnoid)
 /*
  * cost_gpupreagg
  *
- * cost estimation of Aggregate if GpuPreAgg is injected
+ * cost estimation of Aggregate if GpuPreAgg is injected. num_groups is
+ * the number of groups per chunk, including the sub-groups by sketch items.
  */
 #define LOG2(x)		(log(x) / 0.693147180559945)
 
@@ -601,6 +718,7 @@ static void
 cost_gpupreagg(const Agg *agg, const Sort *sort, const Plan *outer_plan,
 			   AggStrategy new_agg_strategy,
 			   List *gpupreagg_tlist,
+			   double num_groups,
 			   AggClauseCosts *agg_clause_costs,
 			   Plan *p_newcost_agg,
 			   Plan *p_newcost_sort,
@@ -615,9 +733,9 @@ cost_gpupreagg(const Agg *agg, const Sort *sort, const Plan *outer_plan,
 	double		outer_rows;
 	double		rows_per_chunk;
 	double		num_chunks;
-	double		num_groups = Max(agg->plan.plan_rows, 1.0);
 	ListCell   *cell;
 	Path		dummy;
+	GpuCostCoeff coeff;
 
 	Assert(outer_plan != NULL);
 	/*
@@ -638,7 +756,8 @@ cost_gpupreagg(const Agg *agg, const Sort *sort, const Plan *outer_plan,
 	/*
 	 * fixed cost to launch GPU feature
 	 */
-	startup_cost += pgstrom_gpu_setup_cost;
+	pgstrom_get_cost_coeff(GpuCostNodePreAgg, &coeff);
+	startup_cost += coeff.setup_cost;
 
 	/*
 	 * cost estimation of internal sorting by GPU.
@@ -653,11 +772,11 @@ cost_gpupreagg(const Agg *agg, const Sort *sort, const Plan *outer_plan,
 	if (num_chunks < 1.0)
 		num_chunks = 1.0;
 
-	comparison_cost = 2.0 * pgstrom_gpu_operator_cost;
+	comparison_cost = 2.0 * coeff.operator_cost;
 	startup_cost += (comparison_cost *
 					 LOG2(rows_per_chunk * rows_per_chunk) *
 					 num_chunks);
-	run_cost += pgstrom_gpu_operator_cost * outer_rows;
+	run_cost += (coeff.operator_cost + coeff.tuple_cost) * outer_rows;
 
 	/*
 	 * cost estimation of partial aggregate by GPU
@@ -679,10 +798,12 @@ cost_gpupreagg(const Agg *agg, const Sort *sort, const Plan *outer_plan,
 	}
 	startup_cost += pagg_cost.startup;
     run_cost += (pagg_cost.per_tuple *
-				 pgstrom_gpu_operator_cost /
+				 coeff.operator_cost /
 				 cpu_operator_cost *
 				 LOG2(rows_per_chunk) *
 				 num_chunks);
+	/* materialization of the partial results */
+	run_cost += coeff.byte_cost * num_groups * num_chunks * pagg_width;
 	/*
 	 * set cost values on GpuPreAgg
 	 */
@@ -948,6 +1069,31 @@ make_altfunc_expr(const char *func_name, List *args)
 	return expr;
 }
 
+/*
+ * is_altfunc_grouping_key - true, if expression is either of
+ * pgstrom.hll_item() or pgstrom.qsketch_item() that works as
+ * an additional grouping key of GpuPreAgg
+ */
+static bool
+is_altfunc_grouping_key(Node *node)
+{
+	FuncExpr   *func = (FuncExpr *) node;
+	char	   *func_name;
+	bool		result;
+
+	if (!node || !IsA(node, FuncExpr))
+		return false;
+	if (get_func_namespace(func->funcid) !=
+		get_namespace_oid("pgstrom", false))
+		return false;
+	func_name = get_func_name(func->funcid);
+	result = (strcmp(func_name, "hll_item") == 0 ||
+			  strcmp(func_name, "qsketch_item") == 0);
+	pfree(func_name);
+
+	return result;
+}
+
 static Expr *
 make_altfunc_nrows_expr(Aggref *aggref)
 {
@@ -964,9 +1110,13 @@ make_altfunc_nrows_expr(Aggref *aggref)
 	foreach (cell, aggref->args)
 	{
 		TargetEntry *tle = lfirst(cell);
-		NullTest	*ntest = makeNode(NullTest);
+		NullTest	*ntest;
 
 		Assert(IsA(tle, TargetEntry));
+		/* obviously, not-null constant is not NULL */
+		if (IsA(tle->expr, Const) && !((Const *) tle->expr)->constisnull)
+			continue;
+		ntest = makeNode(NullTest);
 		ntest->arg = copyObject(tle->expr);
 		ntest->nulltesttype = IS_NOT_NULL;
 		ntest->argisrow = false;
@@ -1046,6 +1196,23 @@ make_gpupreagg_refnode(Aggref *aggref, List **prep_tlist, int *extra_flags)
 	foreach (cell, aggref->args)
 	{
 		TargetEntry *tle = lfirst(cell);
+
+		/*
+		 * not-null constant on the 2nd argument may be referenced by
+		 * the alternative aggregate as is, not by the device kernel
+		 */
+		if (cell != list_head(aggref->args) &&
+			IsA(tle->expr, Const) &&
+			!((Const *) tle->expr)->constisnull)
+		{
+			for (i=0; i < aggfn_cat->altfn_nargs; i++)
+			{
+				if (aggfn_cat->altfn_argexprs[i] == ALTFUNC_EXPR_CONST_ARG2)
+					break;
+			}
+			if (i < aggfn_cat->altfn_nargs)
+				continue;
+		}
 		if (!pgstrom_codegen_available_expression(tle->expr))
 			return NULL;
 	}
@@ -1208,6 +1375,43 @@ make_gpupreagg_refnode(Aggref *aggref, List **prep_tlist, int *extra_flags)
 			case ALTFUNC_EXPR_PCOV_XY:
 				expr = make_altfunc_pcov_expr(aggref, "pcov_xy");
 				break;
+			case ALTFUNC_EXPR_HLL_ITEM:
+				/* NULL, if argument is not a supported data type */
+				tle = linitial(aggref->args);
+				Assert(IsA(tle, TargetEntry));
+				expr = tle->expr;
+				if (aggref->aggfilter)
+					expr = make_expr_conditional(expr, aggref->aggfilter,
+												 NULL);
+				expr = make_altfunc_expr("hll_item", list_make1(expr));
+				break;
+			case ALTFUNC_EXPR_QSKETCH_ITEM:
+				tle = linitial(aggref->args);
+				Assert(IsA(tle, TargetEntry));
+				expr = tle->expr;
+				if (aggref->aggfilter)
+					expr = make_expr_conditional(expr, aggref->aggfilter,
+												 NULL);
+				expr = make_altfunc_expr("qsketch_item", list_make1(expr));
+				break;
+			case ALTFUNC_EXPR_CONST_ARG2:
+				/*
+				 * A constant argument (like percentile) is not processed
+				 * by GpuPreAgg, but directly referenced by the alternative
+				 * aggregate function.
+				 */
+				tle = lsecond(aggref->args);
+				Assert(IsA(tle, TargetEntry));
+				if (!IsA(tle->expr, Const) ||
+					((Const *) tle->expr)->constisnull ||
+					exprType((Node *) tle->expr) != argtype_oid)
+					return NULL;
+				tle = makeTargetEntry(copyObject(tle->expr),
+									  list_length(altnode->args) + 1,
+									  NULL,
+									  false);
+				altnode->args = lappend(altnode->args, tle);
+				continue;
 			default:
 				elog(ERROR, "Bug? unexpected ALTFUNC_EXPR_* label");
 		}
@@ -1569,18 +1773,21 @@ gpupreagg_codegen_hashvalue(CustomScan *cscan, GpuPreAggInfo *gpa_info,
 		AttrNumber		resno = gpa_info->grpColIdx[i];
 		devtype_info   *dtype;
 		Var			   *var;
+		Oid				type_oid;
 
 		tle = get_tle_by_resno(cscan->scan.plan.targetlist, resno);
 		var = (Var *) tle->expr;
-		if (!IsA(var, Var) || var->varno != INDEX_VAR)
+		if ((!IsA(var, Var) || var->varno != INDEX_VAR) &&
+			!is_altfunc_grouping_key((Node *) var))
 			elog(ERROR, "Bug? A simple Var node is expected for group key: %s",
 				 nodeToString(var));
+		type_oid = exprType((Node *) var);
 
 		/* find a datatype for comparison */
-		dtype = pgstrom_devtype_lookup_and_track(var->vartype, context);
+		dtype = pgstrom_devtype_lookup_and_track(type_oid, context);
 		if (!OidIsValid(dtype->type_cmpfunc))
 			elog(ERROR, "Bug? type (%u) has no comparison function",
-				 var->vartype);
+				 type_oid);
 
 		/* variable declarations */
 		appendStringInfo(
@@ -1642,21 +1849,24 @@ gpupreagg_codegen_keycomp(CustomScan *cscan, GpuPreAggInfo *gpa_info,
 		Var			   *var;
 		devtype_info   *dtype;
 		devfunc_info   *dfunc;
+		Oid				type_oid;
 
 		tle = get_tle_by_resno(cscan->scan.plan.targetlist, resno);
 		var = (Var *) tle->expr;
-		if (!IsA(var, Var) || var->varno != INDEX_VAR)
+		if ((!IsA(var, Var) || var->varno != INDEX_VAR) &&
+			!is_altfunc_grouping_key((Node *) var))
 			elog(ERROR, "Bug? A simple Var node is expected for group key: %s",
 				 nodeToString(var));
+		type_oid = exprType((Node *) var);
 
 		/* find a function to compare this data-type */
 		/* find a datatype for comparison */
-		dtype = pgstrom_devtype_lookup_and_track(var->vartype, context);
+		dtype = pgstrom_devtype_lookup_and_track(type_oid, context);
 		if (!OidIsValid(dtype->type_eqfunc))
 			elog(ERROR, "Bug? type (%u) has no equality function",
-				 var->vartype);
+				 type_oid);
 		dfunc = pgstrom_devfunc_lookup_and_track(dtype->type_eqfunc,
-												 var->varcollid,
+												 exprCollation((Node *) var),
 												 context);
 		/* variable declarations */
 		appendStringInfo(&decl,
@@ -1927,6 +2137,11 @@ gpupreagg_codegen_aggcalc(CustomScan *cscan, GpuPreAggInfo *gpa_info,
 							 aggcalc_method_of_typeoid(FLOAT8OID),
 							 aggcalc_args);
 		}
+		else if (strcmp(func_name, "hll_item") == 0 ||
+				 strcmp(func_name, "qsketch_item") == 0)
+		{
+			/* these are grouping keys, not reduced */
+		}
 		else
 		{
 			elog(NOTICE, "Bug? unexpected function: %s", func_name);
@@ -2304,6 +2519,84 @@ gpupreagg_codegen_projection_corr(StringInfo body, FuncExpr *func,
 		pc->rowidx_label);
 }
 
+static void
+gpupreagg_codegen_projection_item(StringInfo body, FuncExpr *func,
+								  const char *func_name,
+								  codegen_projection_context *pc)
+{
+	/*
+	 * Sketch items are generated by the same routine in cuda_gpupreagg.h
+	 * as the host side (aggfuncs.c) doing, and the argument of hll_item()
+	 * is hashed in same way to hll_hash_datum(). So, CPU fallback also
+	 * produces identical items.
+	 */
+	Node		   *clause = linitial(func->args);
+	Oid				type_oid = exprType(clause);
+	devtype_info   *dtype;
+	const char	   *item_func;
+	const char	   *item_arg;
+
+	if (strcmp(func_name, "qsketch_item") == 0)
+	{
+		/* qsketch_item() takes only float8 */
+		if (type_oid != FLOAT8OID)
+			elog(ERROR, "Bug? device type %s is not expected",
+				 format_type_be(type_oid));
+		item_func = "gpupreagg_qsketch_make_item";
+		item_arg = "item_arg.value";
+	}
+	else if (strcmp(func_name, "hll_item") == 0)
+	{
+		item_func = "gpupreagg_hll_make_item";
+		switch (type_oid)
+		{
+			case INT2OID:
+			case INT4OID:
+			case INT8OID:
+			case DATEOID:
+			case TIMEOID:
+			case TIMESTAMPOID:
+			case TIMESTAMPTZOID:
+				item_arg = "(cl_ulong)(cl_long)item_arg.value";
+				break;
+			case FLOAT4OID:
+				item_arg = "(cl_ulong)(cl_uint)__float_as_int(item_arg.value)";
+				break;
+			case FLOAT8OID:
+				item_arg = "(cl_ulong)__double_as_longlong(item_arg.value)";
+				break;
+			default:
+				elog(ERROR, "Bug? device type %s is not expected",
+					 format_type_be(type_oid));
+		}
+	}
+	else
+		elog(ERROR, "unexpected sketch item function: %s", func_name);
+
+	dtype = pgstrom_devtype_lookup_and_track(type_oid, pc->context);
+	if (!dtype)
+		elog(ERROR, "device type lookup failed: %u", type_oid);
+	if (!pgstrom_devtype_lookup_and_track(INT4OID, pc->context))
+		elog(ERROR, "device type lookup failed: %u", INT4OID);
+
+	pc->use_temp_int4 = true;
+	appendStringInfo(body,
+					 "  {\n"
+					 "    pg_%s_t item_arg = %s;\n"
+					 "\n"
+					 "    temp_int4.isnull = item_arg.isnull;\n"
+					 "    temp_int4.value = (item_arg.isnull ? 0 :\n"
+					 "                       %s(%s));\n"
+					 "  }\n"
+					 "  pg_int4_vstore(%s,errcode,%u,%s,temp_int4);\n",
+					 dtype->type_name,
+					 pgstrom_codegen_expression(clause, pc->context),
+					 item_func, item_arg,
+					 pc->kds_label,
+					 pc->tle->resno - 1,
+					 pc->rowidx_label);
+}
+
 static char *
 gpupreagg_codegen_projection(CustomScan *cscan, GpuPreAggInfo *gpa_info,
 							 codegen_context *context)
@@ -2426,6 +2719,15 @@ gpupreagg_codegen_projection(CustomScan *cscan, GpuPreAggInfo *gpa_info,
 					 strcmp(func_name, "pcov_y2") == 0 ||
 					 strcmp(func_name, "pcov_xy") == 0)
 				gpupreagg_codegen_projection_corr(&body, func, func_name, &pc);
+			else if (strcmp(func_name, "hll_item") == 0 ||
+					 strcmp(func_name, "qsketch_item") == 0)
+			{
+				gpupreagg_codegen_projection_item(&body, func, func_name,
+												  &pc);
+				/* sketch item is an additional grouping key */
+				gpagg_atts[pc.tle->resno - 1] = GPUPREAGG_FIELD_IS_GROUPKEY;
+				continue;
+			}
 			else
 				elog(ERROR, "Bug? unexpected partial aggregate function: %s",
 					 func_name);
@@ -2624,6 +2926,9 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 	int				extra_flags = DEVKERNEL_NEEDS_GPUPREAGG;
 	bool			outer_bulkload = false;
 	double			bulkload_density = 0.0;
+	double			num_groups;
+	int				num_sketch_items = 0;
+	bool			host_merge;
 	codegen_context context;
 
 	/* nothing to do, if feature is turned off */
@@ -2651,6 +2956,22 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 	count_agg_clauses(NULL, (Node *) agg_tlist, &agg_clause_costs);
 	count_agg_clauses(NULL, (Node *) agg_quals, &agg_clause_costs);
 
+	/*
+	 * Agg without aggregate functions (GROUP BY or DISTINCT only) makes
+	 * GpuPreAgg a per-chunk deduplicator, but it makes no sense if here
+	 * is no grouping keys also.
+	 */
+	if (agg->numCols == 0 && agg_clause_costs.numAggs == 0)
+		return;
+
+	/*
+	 * If partial results are merged on the host, GpuPreAgg returns every
+	 * group only once (or with its extras next to). It allows the upper
+	 * Agg to aggregate them with AGG_SORTED strategy without Sort, instead
+	 * of HashAgg that has to keep all the groups in memory.
+	 */
+	host_merge = (agg->numCols > 0 && gpupreagg_host_mergeable(pre_tlist));
+
 	/* be compiler quiet */
 	memset(&newcost_agg,     0, sizeof(Plan));
 	memset(&newcost_sort,    0, sizeof(Plan));
@@ -2671,7 +2992,10 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 												  &outer_quals);
 		if (alter_node)
 			outer_node = alter_node;
-		new_agg_strategy = agg->aggstrategy;
+		if (host_merge && agg->aggstrategy == AGG_HASHED)
+			new_agg_strategy = AGG_SORTED;
+		else
+			new_agg_strategy = agg->aggstrategy;
 	}
 	else if (IsA(outerPlan(agg), Sort))
 	{
@@ -2708,7 +3032,10 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 												  &outer_quals);
 		if (alter_node)
 			outer_node = alter_node;
-		new_agg_strategy = AGG_HASHED;
+		if (host_merge)
+			new_agg_strategy = AGG_SORTED;
+		else
+			new_agg_strategy = AGG_HASHED;
 
 		/*
 		 * NOTE: all the supported aggregate functions are available to
@@ -2717,14 +3044,16 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 		 * This assumption may change in the future version, but not now.
 		 * All we need to check is over-consumption of local memory.
 		 * If estimated amount of local memory usage is larger than
-		 * work_mem, it is a case we should give up.
+		 * work_mem, it is a case we should give up, unless the host-side
+		 * merge keeps the sorted strategy.
 		 * (See the logic in choose_hashed_grouping)
 		 */
 		hashentrysize = (MAXALIGN(sizeof(MinimalTupleData)) +
 						 MAXALIGN(agg->plan.plan_width) +
 						 agg_clause_costs.transitionSpace +
 						 hash_agg_entry_size(agg_clause_costs.numAggs));
-		if (hashentrysize * agg->plan.plan_rows > work_mem * 1024L)
+		if (!host_merge &&
+			hashentrysize * agg->plan.plan_rows > work_mem * 1024L)
 			return;
 	}
 
@@ -2740,6 +3069,34 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 			outer_bulkload = true;
 	}
 
+	/*
+	 * Sketch items (hll_item() and qsketch_item()) are not reduced on the
+	 * device, but work as additional grouping keys. Each group may be
+	 * split into up to number of registers or bins sub-groups per item,
+	 * and two or more items multiply the sub-groups; partial aggregation
+	 * no longer reduces the rows, so we give up GpuPreAgg in this case.
+	 */
+	num_groups = Max(agg->plan.plan_rows, 1.0);
+	foreach (cell, pre_tlist)
+	{
+		TargetEntry	   *tle = lfirst(cell);
+		char		   *func_name;
+		double			nsubgroups;
+
+		if (!is_altfunc_grouping_key((Node *) tle->expr))
+			continue;
+		if (++num_sketch_items > 1)
+			return;
+
+		func_name = get_func_name(((FuncExpr *) tle->expr)->funcid);
+		if (strcmp(func_name, "hll_item") == 0)
+			nsubgroups = (double) GPUPREAGG_HLL_NUM_REGISTERS;
+		else
+			nsubgroups = (double) GPUPREAGG_QSKETCH_MAX_BINS;
+		num_groups = Min(num_groups * nsubgroups,
+						 Max(outer_node->plan_rows, 1.0));
+	}
+
 	/*
 	 * Estimate the cost if GpuPreAgg would be injected, and determine
 	 * which plan is cheaper, unless pg_strom.debug_force_gpupreagg is
@@ -2748,6 +3105,7 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 	cost_gpupreagg(agg, sort_node, outer_node,
 				   new_agg_strategy,
 				   pre_tlist,
+				   num_groups,
 				   &agg_clause_costs,
 				   &newcost_agg,
 				   &newcost_sort,
@@ -2804,15 +3162,26 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 	/* also set up private information */
 	memset(&gpa_info, 0, sizeof(GpuPreAggInfo));
 	gpa_info.numCols        = agg->numCols;
-	gpa_info.grpColIdx      = palloc(sizeof(AttrNumber) * agg->numCols);
+	gpa_info.grpColIdx      = palloc(sizeof(AttrNumber) *
+									 (agg->numCols + list_length(pre_tlist)));
 	memcpy(gpa_info.grpColIdx, agg->grpColIdx,
 		   sizeof(AttrNumber) * agg->numCols);
 	gpa_info.outer_quals    = outer_quals;
 	gpa_info.outer_bulkload = outer_bulkload;
 	gpa_info.bulkload_density = bulkload_density;
-	gpa_info.num_groups     = Max(agg->plan.plan_rows, 1.0);
+	gpa_info.num_groups     = num_groups;
+	gpa_info.host_merge     = host_merge;
 	gpa_info.outer_quals    = outer_quals;
 
+	/* sketch item, if any, works as an additional grouping key */
+	foreach (cell, pre_tlist)
+	{
+		TargetEntry	   *tle = lfirst(cell);
+
+		if (is_altfunc_grouping_key((Node *) tle->expr))
+			gpa_info.grpColIdx[gpa_info.numCols++] = tle->resno;
+	}
+
 	/*
 	 * construction of the kernel code according to the target-list
 	 * and qualifiers (pulled-up from outer plan).
@@ -2863,6 +3232,54 @@ pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg)
 	agg->aggstrategy = new_agg_strategy;
 }
 
+/*
+ * pgstrom_try_insert_gpupreagg_unique
+ *
+ * Unique node on the sorted input (usually, SELECT DISTINCT) works like a
+ * sort-aggregate without any aggregate functions. So, we try to inject
+ * GpuPreAgg under the Sort node as per-chunk deduplicator, using a pseudo
+ * Agg node that has identical grouping keys to the Unique node.
+ */
+void
+pgstrom_try_insert_gpupreagg_unique(PlannedStmt *pstmt, Unique *unique)
+{
+	Sort	   *sort_node = (Sort *) outerPlan(unique);
+	Agg		   *agg;
+
+	/* nothing to do, if feature is turned off */
+	if (!pgstrom_enabled || !enable_gpupreagg)
+		return;
+	if (!sort_node || !IsA(sort_node, Sort))
+		return;
+
+	agg = makeNode(Agg);
+	agg->plan.startup_cost = unique->plan.startup_cost;
+	agg->plan.total_cost = unique->plan.total_cost;
+	agg->plan.plan_rows = unique->plan.plan_rows;
+	agg->plan.plan_width = unique->plan.plan_width;
+	agg->plan.targetlist = unique->plan.targetlist;
+	agg->plan.qual = unique->plan.qual;
+	outerPlan(agg) = &sort_node->plan;
+	agg->aggstrategy = AGG_SORTED;
+	agg->numCols = unique->numCols;
+	agg->grpColIdx = unique->uniqColIdx;
+	agg->grpOperators = unique->uniqOperators;
+	agg->numGroups = (long) Max(unique->plan.plan_rows, 1.0);
+
+	pgstrom_try_insert_gpupreagg(pstmt, agg);
+	if (!pgstrom_plan_is_gpupreagg(outerPlan(sort_node)))
+		return;
+
+	/*
+	 * OK, GpuPreAgg was injected under the Sort node. Target-list of the
+	 * Unique node is kept as is, because GpuPreAgg keeps position of the
+	 * grouping keys.
+	 */
+	Assert(agg->aggstrategy == AGG_SORTED);
+	unique->plan.startup_cost = agg->plan.startup_cost;
+	unique->plan.total_cost = agg->plan.total_cost;
+}
+
 bool
 pgstrom_plan_is_gpupreagg(const Plan *plan)
 {
@@ -2880,7 +3297,7 @@ gpupreagg_create_scan_state(CustomScan *cscan)
 	/* Set tag and executor callbacks */
 	NodeSetTag(gpas, T_CustomScanState);
 	gpas->gts.css.flags = cscan->flags;
-	gpas->gts.css.methods = &gpupreagg_exec_methods;
+	gpas->gts.css.methods = &gpupreagg_exec_methods.c;
 
 	return (Node *) gpas;
 }
@@ -2921,6 +3338,7 @@ gpupreagg_begin(CustomScanState *node, EState *estate, int eflags)
 	gpas->gts.scan_bulk_density = gpa_info->bulkload_density;
 
 	gpas->outer_overflow = NULL;
+	gpas->result_overflow = NULL;
 
 	outer_width = outerPlanState(gpas)->plan->plan_width;
 	gpas->num_groups = gpa_info->num_groups;
@@ -2962,6 +3380,12 @@ gpupreagg_begin(CustomScanState *node, EState *estate, int eflags)
 	gpas->has_numeric = gpa_info->has_numeric;
 	gpas->has_varlena = gpa_info->has_varlena;
 	gpas->num_rechecks = 0;
+
+	/*
+	 * host-side two-level aggregation, if enabled
+	 */
+	if (gpa_info->host_merge)
+		gpas->merge = gpupreagg_merge_init(gpas);
 }
 
 static pgstrom_gpupreagg *
@@ -3041,6 +3465,7 @@ gpupreagg_next_chunk(GpuTaskState *gts)
 		/* Scan the outer relation using row-by-row mode */
 		TupleDesc		tupdesc
 			= subnode->ps_ResultTupleSlot->tts_tupleDescriptor;
+		Size			chunk_size = pgstrom_adaptive_chunk_size(gts, 0);
 
 		while (true)
 		{
@@ -3064,7 +3489,7 @@ gpupreagg_next_chunk(GpuTaskState *gts)
 			if (!pds)
 				pds = pgstrom_create_data_store_row(gcontext,
 													tupdesc,
-													pgstrom_chunk_size(),
+													chunk_size,
 													false);
 			/* insert a tuple to the data-store */
 			if (!pgstrom_data_store_insert_tuple(pds, slot))
@@ -3218,12 +3643,692 @@ gpupreagg_next_tuple(GpuTaskState *gts)
 	return slot;
 }
 
+/*
+ * gpupreagg_merge_classify
+ *
+ * It determines how each field of the GpuPreAgg results are merged on the
+ * host. It returns number of grouping keys, or -1 if any of the fields are
+ * not mergeable. If supplied, ops[], cmp_procs[] and keyColIdx[] shall be
+ * filled up for each field, and eqops[] for each grouping key.
+ */
+static int
+gpupreagg_merge_classify(List *tlist, PreAggMergeOp *ops, Oid *cmp_procs,
+						 AttrNumber *keyColIdx, Oid *eqops)
+{
+	Oid				namespace_oid = get_namespace_oid("pgstrom", false);
+	ListCell	   *cell;
+	int				numKeys = 0;
+	int				i = 0;
+
+	foreach (cell, tlist)
+	{
+		TargetEntry	   *tle = lfirst(cell);
+		Oid				type_oid = exprType((Node *) tle->expr);
+		PreAggMergeOp	op;
+		Oid				cmp_proc = InvalidOid;
+
+		if (IsA(tle->expr, Var) || is_altfunc_grouping_key((Node *) tle->expr))
+		{
+			TypeCacheEntry *tcache;
+			RegProcedure	lhs_hashfn;
+			RegProcedure	rhs_hashfn;
+
+			tcache = lookup_type_cache(type_oid, TYPECACHE_EQ_OPR);
+			if (!OidIsValid(tcache->eq_opr) ||
+				!get_op_hash_functions(tcache->eq_opr,
+									   &lhs_hashfn, &rhs_hashfn))
+				return -1;	/* grouping key is not hashable */
+			if (keyColIdx)
+				keyColIdx[numKeys] = tle->resno;
+			if (eqops)
+				eqops[numKeys] = tcache->eq_opr;
+			numKeys++;
+			op = PREAGG_MERGE_KEY;
+		}
+		else if (IsA(tle->expr, Const))
+			op = PREAGG_MERGE_JUNK;
+		else if (IsA(tle->expr, FuncExpr))
+		{
+			FuncExpr	   *func = (FuncExpr *) tle->expr;
+			const char	   *func_name = get_func_name(func->funcid);
+
+			if (namespace_oid != get_func_namespace(func->funcid))
+				return -1;
+			if (strcmp(func_name, "pmin") == 0 ||
+				strcmp(func_name, "pmax") == 0)
+			{
+				TypeCacheEntry *tcache;
+
+				tcache = lookup_type_cache(type_oid,
+										   TYPECACHE_CMP_PROC_FINFO);
+				if (!OidIsValid(tcache->cmp_proc_finfo.fn_oid))
+					return -1;
+				cmp_proc = tcache->cmp_proc_finfo.fn_oid;
+				op = (strcmp(func_name, "pmin") == 0
+					  ? PREAGG_MERGE_MIN
+					  : PREAGG_MERGE_MAX);
+			}
+			else if ((strcmp(func_name, "nrows") == 0 ||
+					  strcmp(func_name, "psum") == 0 ||
+					  strcmp(func_name, "psum_x2") == 0 ||
+					  strcmp(func_name, "pcov_x") == 0 ||
+					  strcmp(func_name, "pcov_y") == 0 ||
+					  strcmp(func_name, "pcov_x2") == 0 ||
+					  strcmp(func_name, "pcov_y2") == 0 ||
+					  strcmp(func_name, "pcov_xy") == 0) &&
+					 (type_oid == INT4OID ||
+					  type_oid == INT8OID ||
+					  type_oid == FLOAT4OID ||
+					  type_oid == FLOAT8OID ||
+					  type_oid == NUMERICOID))
+				op = PREAGG_MERGE_ADD;
+			else
+				return -1;	/* unknown partial, not mergeable */
+		}
+		else
+			return -1;
+
+		if (ops)
+			ops[i] = op;
+		if (cmp_procs)
+			cmp_procs[i] = cmp_proc;
+		i++;
+	}
+	return numKeys;
+}
+
+/*
+ * gpupreagg_host_mergeable
+ *
+ * It checks whether the partial results can be merged on the host, on the
+ * plan construction time.
+ */
+static bool
+gpupreagg_host_mergeable(List *pre_tlist)
+{
+	return (gpupreagg_host_merge &&
+			gpupreagg_merge_classify(pre_tlist, NULL, NULL, NULL, NULL) > 0);
+}
+
+/*
+ * gpupreagg_merge_init
+ *
+ * It sets up the state of host-side two-level aggregation. The planner
+ * already checked all the fields of GpuPreAgg results are mergeable.
+ */
+static GpuPreAggMerge *
+gpupreagg_merge_init(GpuPreAggState *gpas)
+{
+	PlanState	   *ps = &gpas->gts.css.ss.ps;
+	List		   *targetlist = ps->plan->targetlist;
+	GpuPreAggMerge *merge;
+	Oid			   *cmp_procs;
+	Oid			   *eqops;
+	ListCell	   *cell;
+	long			entry_width;
+	int				natts = list_length(targetlist);
+	int				i;
+
+	merge = palloc0(sizeof(GpuPreAggMerge));
+	merge->natts = natts;
+	merge->ops = palloc0(sizeof(PreAggMergeOp) * natts);
+	merge->cmpfuncs = palloc0(sizeof(FmgrInfo) * natts);
+	merge->typlens = palloc0(sizeof(int16) * natts);
+	merge->typbyvals = palloc0(sizeof(bool) * natts);
+	merge->keyColIdx = palloc0(sizeof(AttrNumber) * natts);
+	cmp_procs = palloc0(sizeof(Oid) * natts);
+	eqops = palloc0(sizeof(Oid) * natts);
+
+	merge->numKeys = gpupreagg_merge_classify(targetlist,
+											  merge->ops,
+											  cmp_procs,
+											  merge->keyColIdx,
+											  eqops);
+	if (merge->numKeys <= 0)
+		elog(ERROR, "Bug? GpuPreAgg results are not mergeable on the host");
+
+	i = 0;
+	foreach (cell, targetlist)
+	{
+		TargetEntry	   *tle = lfirst(cell);
+
+		get_typlenbyval(exprType((Node *) tle->expr),
+						&merge->typlens[i], &merge->typbyvals[i]);
+		if (OidIsValid(cmp_procs[i]))
+			fmgr_info(cmp_procs[i], &merge->cmpfuncs[i]);
+		i++;
+	}
+
+	execTuplesHashPrepare(merge->numKeys, eqops,
+						  &merge->eqfuncs, &merge->hashfuncs);
+
+	/*
+	 * number of in-memory groups is bounded by work_mem
+	 */
+	merge->entry_size = (MAXALIGN(sizeof(TupleHashEntryData)) +
+						 MAXALIGN(sizeof(Datum) * natts) +
+						 MAXALIGN(sizeof(bool) * natts) +
+						 MAXALIGN(sizeof(List *)));
+	entry_width = (MAXALIGN(merge->entry_size) +
+				   MAXALIGN(SizeofMinimalTupleHeader) +
+				   2 * MAXALIGN(ps->plan->plan_width));
+	merge->max_entries = Max((work_mem * 1024L) / entry_width, 1);
+
+	merge->tablecxt = AllocSetContextCreate(CurrentMemoryContext,
+											"GpuPreAgg merge table",
+											ALLOCSET_DEFAULT_MINSIZE,
+											ALLOCSET_DEFAULT_INITSIZE,
+											ALLOCSET_DEFAULT_MAXSIZE);
+	merge->tempcxt = AllocSetContextCreate(CurrentMemoryContext,
+										   "GpuPreAgg merge per-tuple",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+	merge->spill_slot =
+		MakeSingleTupleTableSlot(ps->ps_ResultTupleSlot->tts_tupleDescriptor);
+
+	return merge;
+}
+
+/*
+ * gpupreagg_merge_reset - (re-)construct an empty hash table
+ */
+static void
+gpupreagg_merge_reset(GpuPreAggMerge *merge, double num_groups)
+{
+	long		nbuckets;
+
+	MemoryContextReset(merge->tablecxt);
+	nbuckets = (long) Min(num_groups, (double) merge->max_entries);
+	merge->htab = BuildTupleHashTable(merge->numKeys,
+									  merge->keyColIdx,
+									  merge->eqfuncs,
+									  merge->hashfuncs,
+									  Max(nbuckets, 256),
+									  merge->entry_size,
+									  merge->tablecxt,
+									  merge->tempcxt);
+	merge->num_entries = 0;
+	merge->extra = NULL;
+	merge->scanning = false;
+}
+
+/*
+ * gpupreagg_merge_cleanup - release the hash table and temporary files
+ */
+static void
+gpupreagg_merge_cleanup(GpuPreAggMerge *merge)
+{
+	ListCell   *cell;
+	int			i;
+
+	for (i=0; i < GPUPREAGG_MERGE_NPARTS; i++)
+	{
+		if (merge->parts[i])
+			BufFileClose(merge->parts[i]);
+		merge->parts[i] = NULL;
+	}
+	foreach (cell, merge->pending)
+	{
+		GpuPreAggSpill *spill = lfirst(cell);
+
+		BufFileClose(spill->file);
+	}
+	list_free_deep(merge->pending);
+	merge->pending = NIL;
+	merge->htab = NULL;
+	merge->extra = NULL;
+	merge->input_done = false;
+	merge->scanning = false;
+	MemoryContextReset(merge->tablecxt);
+	MemoryContextReset(merge->tempcxt);
+}
+
+/*
+ * gpupreagg_merge_hash - hash value of the grouping keys
+ *
+ * It has to be consistent for the same group regardless of the level,
+ * because partition of the spilled run is chosen by a part of the bits.
+ */
+static uint32
+gpupreagg_merge_hash(GpuPreAggMerge *merge, TupleTableSlot *slot)
+{
+	uint32		hashkey = 0;
+	int			i;
+
+	for (i=0; i < merge->numKeys; i++)
+	{
+		AttrNumber	anum = merge->keyColIdx[i];
+
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+		if (!slot->tts_isnull[anum - 1])
+		{
+			uint32	hkey = DatumGetUInt32(FunctionCall1(&merge->hashfuncs[i],
+											slot->tts_values[anum - 1]));
+			hashkey ^= hkey;
+		}
+	}
+	return hashkey;
+}
+
+/*
+ * gpupreagg_merge_spill - write out a partial result to the temporary file
+ */
+static void
+gpupreagg_merge_spill(GpuPreAggMerge *merge, TupleTableSlot *slot)
+{
+	MinimalTuple	mtup = ExecFetchSlotMinimalTuple(slot);
+	uint32			hashkey = gpupreagg_merge_hash(merge, slot);
+	int				part;
+
+	/*
+	 * Once all the bits of hash value were consumed, it cannot distribute
+	 * the groups any more. It still makes progress because every run
+	 * absorbs at least one group.
+	 */
+	if (merge->curr_level < GPUPREAGG_MERGE_MAX_LEVEL)
+		part = ((hashkey >> (merge->curr_level * GPUPREAGG_MERGE_NPARTS_BITS))
+				& (GPUPREAGG_MERGE_NPARTS - 1));
+	else
+		part = 0;
+
+	if (!merge->parts[part])
+		merge->parts[part] = BufFileCreateTemp(false);
+	if (BufFileWrite(merge->parts[part], mtup, mtup->t_len) != mtup->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to GpuPreAgg temporary file: %m")));
+	merge->num_spilled_tuples += 1.0;
+}
+
+/*
+ * gpupreagg_merge_read - read back a partial result from the temporary file
+ */
+static TupleTableSlot *
+gpupreagg_merge_read(GpuPreAggMerge *merge, BufFile *file)
+{
+	MinimalTuple	mtup;
+	uint32			t_len;
+	size_t			nbytes;
+
+	nbytes = BufFileRead(file, &t_len, sizeof(uint32));
+	if (nbytes == 0)
+		return NULL;
+	if (nbytes != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from GpuPreAgg temporary file: %m")));
+	mtup = (MinimalTuple) palloc(t_len);
+	mtup->t_len = t_len;
+	nbytes = t_len - sizeof(uint32);
+	if (BufFileRead(file, (char *) mtup + sizeof(uint32), nbytes) != nbytes)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from GpuPreAgg temporary file: %m")));
+	return ExecStoreMinimalTuple(mtup, merge->spill_slot, true);
+}
+
+/*
+ * gpupreagg_merge_combine
+ *
+ * It merges the partial results in the slot into the hash entry. If any of
+ * the partial results cannot be merged (integer overflow), it returns false
+ * without any modification; caller keeps the slot as an extra of the entry.
+ */
+static bool
+gpupreagg_merge_combine(GpuPreAggMerge *merge,
+						TupleHashEntry entry, TupleTableSlot *slot)
+{
+	Datum	   *values = PREAGG_MERGE_VALUES(entry);
+	bool	   *isnull = PREAGG_MERGE_ISNULL(entry, merge->natts);
+	Datum	   *newvals = palloc(sizeof(Datum) * merge->natts);
+	bool	   *updated = palloc0(sizeof(bool) * merge->natts);
+	int			i;
+
+	for (i=0; i < merge->natts; i++)
+	{
+		Datum	newval = slot->tts_values[i];
+		int		comp;
+
+		if (slot->tts_isnull[i] || merge->ops[i] == PREAGG_MERGE_KEY ||
+			merge->ops[i] == PREAGG_MERGE_JUNK)
+			continue;
+		if (isnull[i])
+		{
+			newvals[i] = newval;
+			updated[i] = true;
+			continue;
+		}
+
+		switch (merge->ops[i])
+		{
+			case PREAGG_MERGE_ADD:
+				switch (slot->tts_tupleDescriptor->attrs[i]->atttypid)
+				{
+					case INT4OID:
+						{
+							int64	sum = ((int64) DatumGetInt32(values[i]) +
+										   (int64) DatumGetInt32(newval));
+							if (sum < PG_INT32_MIN || sum > PG_INT32_MAX)
+								return false;
+							newvals[i] = Int32GetDatum((int32) sum);
+						}
+						break;
+					case INT8OID:
+						{
+							int64	arg1 = DatumGetInt64(values[i]);
+							int64	arg2 = DatumGetInt64(newval);
+							int64	sum = arg1 + arg2;
+
+							if ((arg1 < 0) == (arg2 < 0) &&
+								(sum < 0) != (arg1 < 0))
+								return false;
+							newvals[i] = Int64GetDatum(sum);
+						}
+						break;
+					case FLOAT4OID:
+						newvals[i] = Float4GetDatum(DatumGetFloat4(values[i]) +
+													DatumGetFloat4(newval));
+						break;
+					case FLOAT8OID:
+						newvals[i] = Float8GetDatum(DatumGetFloat8(values[i]) +
+													DatumGetFloat8(newval));
+						break;
+					case NUMERICOID:
+						newvals[i] = DirectFunctionCall2(numeric_add,
+														 values[i], newval);
+						break;
+					default:
+						elog(ERROR, "Bug? unexpected type of partial sum");
+				}
+				updated[i] = true;
+				break;
+
+			case PREAGG_MERGE_MIN:
+			case PREAGG_MERGE_MAX:
+				comp = DatumGetInt32(FunctionCall2(&merge->cmpfuncs[i],
+												   newval, values[i]));
+				if (merge->ops[i] == PREAGG_MERGE_MIN ? comp < 0 : comp > 0)
+				{
+					newvals[i] = newval;
+					updated[i] = true;
+				}
+				break;
+
+			default:
+				elog(ERROR, "Bug? unexpected merge operation: %d",
+					 (int) merge->ops[i]);
+		}
+	}
+
+	/* OK, all the partial results are mergeable */
+	for (i=0; i < merge->natts; i++)
+	{
+		if (!updated[i])
+			continue;
+		if (!merge->typbyvals[i] && !isnull[i])
+			pfree(DatumGetPointer(values[i]));
+		values[i] = datumCopy(newvals[i],
+							  merge->typbyvals[i],
+							  merge->typlens[i]);
+		isnull[i] = false;
+	}
+	return true;
+}
+
+/*
+ * gpupreagg_merge_copy - copy a partial result to the hash entry
+ */
+static void
+gpupreagg_merge_copy(GpuPreAggMerge *merge,
+					 TupleHashEntry entry, TupleTableSlot *slot)
+{
+	Datum	   *values = PREAGG_MERGE_VALUES(entry);
+	bool	   *isnull = PREAGG_MERGE_ISNULL(entry, merge->natts);
+	MemoryContext oldcxt;
+	int			i;
+
+	oldcxt = MemoryContextSwitchTo(merge->tablecxt);
+	for (i=0; i < merge->natts; i++)
+	{
+		isnull[i] = slot->tts_isnull[i];
+		values[i] = (isnull[i] ? (Datum) 0
+					 : datumCopy(slot->tts_values[i],
+								 merge->typbyvals[i],
+								 merge->typlens[i]));
+	}
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * gpupreagg_merge_tuple - merge a partial result into the hash table
+ */
+static void
+gpupreagg_merge_tuple(GpuPreAggMerge *merge, TupleTableSlot *slot)
+{
+	TupleHashEntry	entry;
+	MemoryContext	oldcxt;
+	bool			isnew = false;
+
+	MemoryContextReset(merge->tempcxt);
+	slot_getallattrs(slot);
+
+	if (merge->num_entries < merge->max_entries)
+		entry = LookupTupleHashEntry(merge->htab, slot, &isnew);
+	else
+		entry = LookupTupleHashEntry(merge->htab, slot, NULL);
+
+	if (!entry)
+	{
+		/* hash table is full, so write out to the temporary file */
+		gpupreagg_merge_spill(merge, slot);
+	}
+	else if (isnew)
+	{
+		gpupreagg_merge_copy(merge, entry, slot);
+		merge->num_entries++;
+	}
+	else
+	{
+		List	  **extras = PREAGG_MERGE_EXTRAS(entry, merge->natts);
+		bool		merged;
+
+		/* the last extra, if any, absorbs the partial result */
+		if (*extras != NIL)
+			entry = llast(*extras);
+		oldcxt = MemoryContextSwitchTo(merge->tempcxt);
+		merged = gpupreagg_merge_combine(merge, entry, slot);
+		MemoryContextSwitchTo(oldcxt);
+
+		/*
+		 * The partial result which cannot be merged is kept as an extra
+		 * of the entry, not spilled out, because it has to be returned
+		 * next to the entry.
+		 */
+		if (!merged)
+		{
+			entry = MemoryContextAllocZero(merge->tablecxt,
+										   merge->entry_size);
+			gpupreagg_merge_copy(merge, entry, slot);
+			oldcxt = MemoryContextSwitchTo(merge->tablecxt);
+			*extras = lappend(*extras, entry);
+			MemoryContextSwitchTo(oldcxt);
+			merge->num_entries++;
+		}
+	}
+}
+
+/*
+ * gpupreagg_fetch_partial - fetch a partial result from the GPU tasks
+ */
+static TupleTableSlot *
+gpupreagg_fetch_partial(GpuPreAggState *gpas)
+{
+	PlanState	   *ps = &gpas->gts.css.ss.ps;
+	TupleTableSlot *slot = pgstrom_exec_gputask(&gpas->gts);
+
+	/*
+	 * CPU fallback returns the source record as is; it needs projection
+	 * to be the shape of partial results.
+	 */
+	if (!TupIsNull(slot) &&
+		slot != ps->ps_ResultTupleSlot && ps->ps_ProjInfo)
+	{
+		ExprContext	   *econtext = ps->ps_ProjInfo->pi_exprContext;
+		ExprDoneCond	is_done;
+
+		econtext->ecxt_scantuple = slot;
+		slot = ExecProject(ps->ps_ProjInfo, &is_done);
+	}
+	return slot;
+}
+
+/*
+ * gpupreagg_merge_next
+ *
+ * It returns the merged partial results. All the partial results are
+ * loaded on the hash table at first, then the groups in memory are
+ * returned. Next, the spilled runs are loaded and returned one by one.
+ * Extras of the entry, if any, are returned next to the entry.
+ */
+static TupleTableSlot *
+gpupreagg_merge_next(GpuPreAggState *gpas)
+{
+	GpuPreAggMerge *merge = gpas->merge;
+	TupleTableSlot *slot;
+	TupleHashEntry	entry;
+	int				i;
+
+	for (;;)
+	{
+		if (!merge->scanning)
+		{
+			if (!merge->input_done)
+			{
+				gpupreagg_merge_reset(merge, gpas->num_groups);
+				merge->curr_level = 0;
+				while (!TupIsNull(slot = gpupreagg_fetch_partial(gpas)))
+					gpupreagg_merge_tuple(merge, slot);
+				merge->input_done = true;
+			}
+			else if (merge->pending != NIL)
+			{
+				GpuPreAggSpill *spill = linitial(merge->pending);
+
+				merge->pending = list_delete_first(merge->pending);
+				gpupreagg_merge_reset(merge, gpas->num_groups /
+									  (double) GPUPREAGG_MERGE_NPARTS);
+				merge->curr_level = spill->level;
+				if (BufFileSeek(spill->file, 0, 0L, SEEK_SET) != 0)
+					ereport(ERROR,
+							(errcode_for_file_access(),
+							 errmsg("could not rewind GpuPreAgg temporary file: %m")));
+				while (!TupIsNull(slot = gpupreagg_merge_read(merge,
+															  spill->file)))
+					gpupreagg_merge_tuple(merge, slot);
+				BufFileClose(spill->file);
+				pfree(spill);
+			}
+			else
+				return NULL;	/* no more partial results */
+
+			/* runs written out during this pass are re-aggregated later */
+			for (i=0; i < GPUPREAGG_MERGE_NPARTS; i++)
+			{
+				GpuPreAggSpill *spill;
+
+				if (!merge->parts[i])
+					continue;
+				spill = palloc(sizeof(GpuPreAggSpill));
+				spill->file = merge->parts[i];
+				spill->level = merge->curr_level + 1;
+				merge->pending = lappend(merge->pending, spill);
+				merge->parts[i] = NULL;
+				merge->num_spills++;
+			}
+			InitTupleHashIterator(merge->htab, &merge->iter);
+			merge->scanning = true;
+		}
+
+		if (merge->extra)
+		{
+			entry = lfirst(merge->extra);
+			merge->extra = lnext(merge->extra);
+		}
+		else if ((entry = ScanTupleHashTable(&merge->iter)) != NULL)
+			merge->extra = list_head(*PREAGG_MERGE_EXTRAS(entry,
+														  merge->natts));
+		if (entry)
+		{
+			slot = gpas->gts.css.ss.ps.ps_ResultTupleSlot;
+			ExecClearTuple(slot);
+			memcpy(slot->tts_values, PREAGG_MERGE_VALUES(entry),
+				   sizeof(Datum) * merge->natts);
+			memcpy(slot->tts_isnull, PREAGG_MERGE_ISNULL(entry, merge->natts),
+				   sizeof(bool) * merge->natts);
+			return ExecStoreVirtualTuple(slot);
+		}
+		TermTupleHashIterator(&merge->iter);
+		merge->scanning = false;
+	}
+}
+
 static TupleTableSlot *
 gpupreagg_exec(CustomScanState *node)
 {
+	GpuPreAggState *gpas = (GpuPreAggState *) node;
+
+	if (gpas->merge)
+		return gpupreagg_merge_next(gpas);
 	return pgstrom_exec_gputask((GpuTaskState *) node);
 }
 
+/*
+ * gpupreagg_exec_bulk
+ *
+ * It packs the partial aggregation results into a row-format chunk, for
+ * the parent node that takes bulk-input (like GpuSort). Results of the
+ * GPU kernel have to be picked up according to kern_resultbuf with numeric
+ * fixup or CPU fallback, so we walk on the usual path of next_tuple.
+ */
+static void *
+gpupreagg_exec_bulk(CustomScanState *node)
+{
+	GpuPreAggState	   *gpas = (GpuPreAggState *) node;
+	TupleDesc			tupdesc;
+	pgstrom_data_store *pds = NULL;
+	TupleTableSlot	   *slot;
+
+	tupdesc = gpas->gts.css.ss.ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+	while (true)
+	{
+		if (gpas->result_overflow)
+		{
+			slot = gpas->result_overflow;
+			gpas->result_overflow = NULL;
+		}
+		else
+		{
+			slot = gpupreagg_exec(&gpas->gts.css);
+			if (TupIsNull(slot))
+				break;
+		}
+
+		if (!pds)
+			pds = pgstrom_create_data_store_row(gpas->gts.gcontext,
+												tupdesc,
+												pgstrom_chunk_size(),
+												false);
+		if (!pgstrom_data_store_insert_tuple(pds, slot))
+		{
+			/* to be inserted on the next chunk */
+			gpas->result_overflow = slot;
+			break;
+		}
+	}
+	return pds;
+}
+
 static void
 gpupreagg_end(CustomScanState *node)
 {
@@ -3234,6 +4339,12 @@ gpupreagg_end(CustomScanState *node)
 		elog(NOTICE, "GpuPreAgg: %u chunks were re-checked by CPU",
 			 gpas->num_rechecks);
 
+	/* Release the hash table and temporary files of host-side merge */
+	if (gpas->merge)
+	{
+		gpupreagg_merge_cleanup(gpas->merge);
+		ExecDropSingleTupleTableSlot(gpas->merge->spill_slot);
+	}
 	/* Cleanup and relase any concurrent tasks */
 	pgstrom_release_gputaskstate(&gpas->gts);
 	/* Clean up subtree */
@@ -3247,8 +4358,12 @@ gpupreagg_rescan(CustomScanState *node)
 
 	/* Cleanup and relase any concurrent tasks */
 	pgstrom_cleanup_gputaskstate(&gpas->gts);
+	/* Reset the state of host-side merge */
+	if (gpas->merge)
+		gpupreagg_merge_cleanup(gpas->merge);
 	/* Rewind the subtree */
 	gpas->gts.scan_done = false;
+	gpas->result_overflow = NULL;
 	ExecReScan(outerPlanState(node));
 }
 
@@ -3275,6 +4390,23 @@ gpupreagg_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 	else
 		policy = "Global";
 	ExplainPropertyText("Reduction", policy, es);
+	if (gpas->merge)
+	{
+		char   *temp;
+
+		if (es->analyze)
+			temp = psprintf("On (groups in memory: %ld, "
+							"spilled runs: %u, spilled tuples: %.0f)",
+							gpas->merge->max_entries,
+							gpas->merge->num_spills,
+							gpas->merge->num_spilled_tuples);
+		else if (es->verbose)
+			temp = psprintf("On (groups in memory: %ld)",
+							gpas->merge->max_entries);
+		else
+			temp = pstrdup("On");
+		ExplainPropertyText("Host Merge", temp, es);
+	}
 
 	if (gpa_info->outer_quals != NIL)
 	{
@@ -3912,6 +5044,18 @@ pgstrom_init_gpupreagg(void)
                              GUC_NOT_IN_SAMPLE,
                              NULL, NULL, NULL);
 
+	/* pg_strom.gpupreagg_host_merge */
+	DefineCustomBoolVariable("pg_strom.gpupreagg_host_merge",
+							 "Merges partial results of GpuPreAgg on the host",
+							 "Groups beyond work_mem are spilled to temporary "
+							 "files, and the upper Agg takes the merged groups "
+							 "without its own hash table",
+							 &gpupreagg_host_merge,
+							 false,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+
 	/* initialization of plan method table */
 	memset(&gpupreagg_scan_methods, 0, sizeof(CustomScanMethods));
 	gpupreagg_scan_methods.CustomName          = "GpuPreAgg";
@@ -3919,11 +5063,12 @@ pgstrom_init_gpupreagg(void)
 		= gpupreagg_create_scan_state;
 
 	/* initialization of exec method table */
-	memset(&gpupreagg_exec_methods, 0, sizeof(CustomExecMethods));
-	gpupreagg_exec_methods.CustomName          = "GpuPreAgg";
-   	gpupreagg_exec_methods.BeginCustomScan     = gpupreagg_begin;
-	gpupreagg_exec_methods.ExecCustomScan      = gpupreagg_exec;
-	gpupreagg_exec_methods.EndCustomScan       = gpupreagg_end;
-	gpupreagg_exec_methods.ReScanCustomScan    = gpupreagg_rescan;
-	gpupreagg_exec_methods.ExplainCustomScan   = gpupreagg_explain;
+	memset(&gpupreagg_exec_methods, 0, sizeof(PGStromExecMethods));
+	gpupreagg_exec_methods.c.CustomName        = "GpuPreAgg";
+   	gpupreagg_exec_methods.c.BeginCustomScan   = gpupreagg_begin;
+	gpupreagg_exec_methods.c.ExecCustomScan    = gpupreagg_exec;
+	gpupreagg_exec_methods.c.EndCustomScan     = gpupreagg_end;
+	gpupreagg_exec_methods.c.ReScanCustomScan  = gpupreagg_rescan;
+	gpupreagg_exec_methods.c.ExplainCustomScan = gpupreagg_explain;
+	gpupreagg_exec_methods.ExecCustomBulk      = gpupreagg_exec_bulk;
 }
@@ -16,19 +16,34 @@
  * GNU General Public License for more details.
  */
 #include "postgres.h"
+#include "access/heapam.h"
+#include "access/transam.h"
 #include "access/xact.h"
+#include "access/xlog.h"
 #include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
 #include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/plancat.h"
 #include "optimizer/restrictinfo.h"
 #include "parser/parsetree.h"
+#include "postmaster/bgworker.h"
 #include "storage/bufmgr.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/lmgr.h"
+#include "storage/lock.h"
+#include "storage/proc.h"
+#include "storage/spin.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/resowner.h"
+#include "utils/snapmgr.h"
 #include "utils/spccache.h"
 #include "pg_strom.h"
 #include "cuda_gpuscan.h"
@@ -40,6 +55,11 @@ static PGStromExecMethods		gpuscan_exec_methods;
 static CustomScanMethods		bulkscan_plan_methods;
 static PGStromExecMethods		bulkscan_exec_methods;
 static bool						enable_gpuscan;
+static bool						enable_gpuscan_projection;
+static int						gpuscan_loader_workers;
+
+/* GUC of the core, declared in guc.c */
+extern bool						synchronize_seqscans;
 
 /*
  * Path information of GpuScan
@@ -56,21 +76,25 @@ typedef struct {
 typedef struct {
 	char	   *kern_source;	/* source of opencl kernel */
 	int32		extra_flags;	/* extra libraries to be included */
+	bool		dev_projection;	/* true, if target-list is run on device */
 	List	   *used_params;	/* list of Const/Param in use */
 	List	   *used_vars;		/* list of Var in use */
 	List	   *dev_quals;		/* qualifiers to be run on device */
+	List	   *dev_tlist;		/* target-list compiled to the kernel */
 } GpuScanInfo;
 
 static inline void
 form_gpuscan_info(CustomScan *cscan, GpuScanInfo *gscan_info)
 {
 	cscan->custom_private =
-		list_make2(makeString(gscan_info->kern_source),
-				   makeInteger(gscan_info->extra_flags));
+		list_make3(makeString(gscan_info->kern_source),
+				   makeInteger(gscan_info->extra_flags),
+				   makeInteger(gscan_info->dev_projection));
 	cscan->custom_exprs =
-		list_make3(gscan_info->used_params,
+		list_make4(gscan_info->used_params,
 				   gscan_info->used_vars,
-				   gscan_info->dev_quals);
+				   gscan_info->dev_quals,
+				   gscan_info->dev_tlist);
 }
 
 static GpuScanInfo *
@@ -82,9 +106,11 @@ deform_gpuscan_info(Plan *plan)
 	Assert(IsA(cscan, CustomScan));
 	result->kern_source = strVal(linitial(cscan->custom_private));
 	result->extra_flags = intVal(lsecond(cscan->custom_private));
+	result->dev_projection = intVal(lthird(cscan->custom_private));
 	result->used_params = linitial(cscan->custom_exprs);
 	result->used_vars = lsecond(cscan->custom_exprs);
 	result->dev_quals = lthird(cscan->custom_exprs);
+	result->dev_tlist = lfourth(cscan->custom_exprs);
 
 	return result;
 }
@@ -94,25 +120,43 @@ typedef struct
 	GpuTask			task;
 	dlist_node		chain;
 	CUfunction		kern_qual;
+	CUfunction		kern_proj;
 	void		   *kern_qual_args[4];
 	CUdeviceptr		m_gpuscan;
 	CUdeviceptr		m_kds;
+	CUdeviceptr		m_kds_dst;
 	CUevent 		ev_dma_send_start;
 	CUevent			ev_dma_send_stop;	/* also, start kernel exec */
+	CUevent			ev_kern_qual_end;	/* only if device projection */
 	CUevent			ev_dma_recv_start;	/* also, stop kernel exec */
 	CUevent			ev_dma_recv_stop;
 	pgstrom_data_store *pds;
+	pgstrom_data_store *pds_dst;	/* result of device projection, if any */
 	kern_resultbuf *kresults;
 	kern_gpuscan	kern;
 } pgstrom_gpuscan;
 
+#define GSLOADER_MAX_WORKERS		32
+
 typedef struct {
 	GpuTaskState	gts;
 
-	BlockNumber		curr_blknum;
-	BlockNumber		last_blknum;
+	BlockNumber		curr_blknum;	/* number of blocks already read */
+	BlockNumber		last_blknum;	/* number of blocks to be read */
+	BlockNumber		start_blknum;	/* block number to start the scan */
+	bool			syncscan;		/* true, if synchronized scan */
 	HeapTupleData	scan_tuple;
+	/* parallel chunk loader, if any */
+	int				loader_nworkers;	/* number of workers to be used */
+	int				loader_nlaunched;	/* for EXPLAIN ANALYZE */
+	char		   *loader_snapshot;	/* name of the exported snapshot */
+	bool			loader_done;		/* workers completed their job */
+	dsm_segment	   *loader_dsm;
+	cl_uint			loader_index;		/* next chunk to be checked */
+	BackgroundWorkerHandle *loader_handles[GSLOADER_MAX_WORKERS];
 	List		   *dev_quals;
+	bool		   *attr_needed;	/* non-NULL, if lazy fetch mode */
+	bool			dev_projection;	/* true, if device projection */
 
 	cl_uint			num_rechecked;
 } GpuScanState;
@@ -123,6 +167,9 @@ static bool pgstrom_complete_gpuscan(GpuTask *gtask);
 static void pgstrom_release_gpuscan(GpuTask *gtask);
 static GpuTask *gpuscan_next_chunk(GpuTaskState *gts);
 static TupleTableSlot *gpuscan_next_tuple(GpuTaskState *gts);
+static void gpuscan_init_position(GpuScanState *gss, bool keep_startblock);
+static void gpuscan_fill_chunk(GpuScanState *gss, pgstrom_data_store *pds);
+static void gpuscan_loader_main(Datum main_arg);
 
 /*
  * cost_gpuscan
@@ -143,6 +190,7 @@ cost_gpuscan(CustomPath *pathnode, PlannerInfo *root,
 	Cost		gpu_per_tuple;
 	Cost		cpu_per_tuple;
 	Selectivity	dev_sel;
+	GpuCostCoeff coeff;
 
 	/* Should only be applied to base relations */
 	Assert(baserel->relid > 0);
@@ -164,11 +212,11 @@ cost_gpuscan(CustomPath *pathnode, PlannerInfo *root,
 	/* GPU costs */
 	cost_qual_eval(&dev_cost, dev_quals, root);
 	dev_sel = clauselist_selectivity(root, dev_quals, 0, JOIN_INNER, NULL);
-	dev_cost.startup += pgstrom_gpu_setup_cost;
-	if (cpu_tuple_cost > 0.0)
-		dev_cost.per_tuple *= pgstrom_gpu_tuple_cost / cpu_tuple_cost;
-	else
-		dev_cost.per_tuple += disable_cost;
+	pgstrom_get_cost_coeff(GpuCostNodeScan, &coeff);
+	dev_cost.startup += coeff.setup_cost;
+	if (cpu_operator_cost > 0.0)
+		dev_cost.per_tuple *= coeff.operator_cost / cpu_operator_cost;
+	dev_cost.per_tuple += coeff.tuple_cost;
 
 	/* CPU costs */
 	cost_qual_eval(&host_cost, host_quals, root);
@@ -193,6 +241,8 @@ cost_gpuscan(CustomPath *pathnode, PlannerInfo *root,
 	gpu_per_tuple = dev_cost.per_tuple;
 	run_cost += (gpu_per_tuple * baserel->tuples +
 				 cpu_per_tuple * dev_sel * baserel->tuples);
+	/* materialization of the result */
+	run_cost += coeff.byte_cost * path->rows * baserel->width;
 
 	path->startup_cost = startup_cost;
     path->total_cost = startup_cost + run_cost;
@@ -422,16 +472,76 @@ gpuscan_pullup_devquals(Plan *plannode,
 	return &cscan_new->scan.plan;
 }
 
+/*
+ * gpuscan_projection_available
+ *
+ * It checks whether the target-list of GpuScan can be computed on the
+ * device side, and whether it is worth to do. Only simple Var references
+ * and device executable expressions that return a fixed-length by-value
+ * datum can be pushed down, because result of the kernel is written on
+ * a data store with tuple-slot format.
+ */
+static bool
+gpuscan_projection_available(RelOptInfo *rel, List *tlist,
+							 List *host_quals, List *dev_quals)
+{
+	bool		is_trivial = true;
+	ListCell   *lc;
+
+	if (!enable_gpuscan_projection)
+		return false;
+	/* host qualifiers need the original rows */
+	if (host_quals != NIL || dev_quals == NIL || tlist == NIL)
+		return false;
+
+	foreach (lc, tlist)
+	{
+		TargetEntry	   *tle = lfirst(lc);
+		Oid				type_oid = exprType((Node *) tle->expr);
+		devtype_info   *dtype = pgstrom_devtype_lookup(type_oid);
+
+		/* numeric needs host side fixup of the internal format */
+		if (!dtype || type_oid == NUMERICOID)
+			return false;
+
+		if (IsA(tle->expr, Var))
+		{
+			Var	   *var = (Var *) tle->expr;
+
+			/* system columns and whole-row reference are not supported */
+			if (var->varattno <= 0)
+				return false;
+			if (var->varattno != tle->resno)
+				is_trivial = false;
+		}
+		else
+		{
+			if (!pgstrom_codegen_available_expression(tle->expr) ||
+				!get_typbyval(type_oid))
+				return false;
+			is_trivial = false;
+		}
+	}
+	/* no need to run projection, if target-list is identical to the rel */
+	if (is_trivial && list_length(tlist) == rel->max_attr)
+		return false;
+
+	return true;
+}
+
 /*
  * OpenCL code generation that can run on GPU/MIC device
  */
 static char *
-gpuscan_codegen_quals(PlannerInfo *root,
-					  List *dev_quals, codegen_context *context)
+gpuscan_codegen(PlannerInfo *root, List *dev_quals, List *dev_tlist,
+				codegen_context *context)
 {
 	StringInfoData	str;
 	StringInfoData	decl;
+	StringInfoData	body;
+	List		   *qual_vars;
 	char		   *expr_code;
+	ListCell	   *lc;
 
 	pgstrom_init_codegen_context(context);
 	if (dev_quals == NIL)
@@ -442,19 +552,19 @@ gpuscan_codegen_quals(PlannerInfo *root,
 	Assert(expr_code != NULL);
 
 	initStringInfo(&decl);
+	initStringInfo(&body);
 	initStringInfo(&str);
 
 	/*
 	 * make declarations of var and param references
 	 */
-	appendStringInfo(&str, "%s\n", pgstrom_codegen_func_declarations(context));
 	appendStringInfo(&decl, "%s%s\n",
 					 pgstrom_codegen_param_declarations(context),
 					 pgstrom_codegen_var_declarations(context));
 
 	/* qualifier definition with row-store */
 	appendStringInfo(
-		&str,
+		&body,
 		"STATIC_FUNCTION(cl_bool)\n"
 		"gpuscan_qual_eval(cl_int *errcode,\n"
 		"                  kern_parambuf *kparams,\n"
@@ -464,7 +574,60 @@ gpuscan_codegen_quals(PlannerInfo *root,
 		"{\n"
 		"%s"
 		"  return EVAL(%s);\n"
-		"}\n", decl.data, expr_code);
+		"}\n\n", decl.data, expr_code);
+
+	/*
+	 * projection definition from row-store to slot-store; it is
+	 * declared as an empty function if no device projection.
+	 */
+	qual_vars = context->used_vars;
+	context->used_vars = NIL;
+	context->param_refs = NULL;
+	resetStringInfo(&decl);
+	foreach (lc, dev_tlist)
+	{
+		TargetEntry	   *tle = lfirst(lc);
+		devtype_info   *dtype;
+
+		dtype = pgstrom_devtype_lookup_and_track(exprType((Node *)tle->expr),
+												 context);
+		expr_code = pgstrom_codegen_expression((Node *)tle->expr, context);
+		Assert(expr_code != NULL);
+		appendStringInfo(
+			&decl,
+			"  /* projection for resource %u */\n"
+			"  pg_%s_vstore(kds_dst,errcode,%u,dst_index,%s);\n",
+			tle->resno - 1,
+			dtype->type_name,
+			tle->resno - 1,
+			expr_code);
+	}
+	appendStringInfo(
+		&body,
+		"STATIC_FUNCTION(void)\n"
+		"gpuscan_projection(cl_int *errcode,\n"
+		"                   kern_parambuf *kparams,\n"
+		"                   kern_data_store *kds,\n"
+		"                   kern_data_store *ktoast,\n"
+		"                   size_t kds_index,\n"
+		"                   kern_data_store *kds_dst,\n"
+		"                   size_t dst_index)\n"
+		"{\n"
+		"%s%s\n"
+		"%s"
+		"}\n",
+		pgstrom_codegen_param_declarations(context),
+		pgstrom_codegen_var_declarations(context),
+		decl.data);
+	context->used_vars = list_concat_unique(qual_vars, context->used_vars);
+
+	/* function declarations have to be put prior to the definitions */
+	appendStringInfo(&str, "%s\n%s",
+					 pgstrom_codegen_func_declarations(context),
+					 body.data);
+	pfree(decl.data);
+	pfree(body.data);
+
 	return str.data;
 }
 
@@ -481,6 +644,7 @@ create_gpuscan_plan(PlannerInfo *root,
 	List		   *dev_quals = NIL;
 	ListCell	   *cell;
 	char		   *kern_source;
+	bool			dev_projection;
 	codegen_context	context;
 
 	/* It should be a base relation */
@@ -508,9 +672,14 @@ create_gpuscan_plan(PlannerInfo *root,
     dev_quals = extract_actual_clauses(dev_quals, false);
 
 	/*
-	 * Construct OpenCL kernel code
+	 * Construct OpenCL kernel code; target-list is also computed on the
+	 * device side, if possible.
 	 */
-	kern_source = gpuscan_codegen_quals(root, dev_quals, &context);
+	dev_projection = gpuscan_projection_available(rel, tlist,
+												  host_quals, dev_quals);
+	kern_source = gpuscan_codegen(root, dev_quals,
+								  dev_projection ? tlist : NIL,
+								  &context);
 
 	/*
 	 * Construction of GpuScanPlan node; on top of CustomPlan node
@@ -524,9 +693,17 @@ create_gpuscan_plan(PlannerInfo *root,
 
 	gs_info.kern_source = kern_source;
 	gs_info.extra_flags = context.extra_flags | DEVKERNEL_NEEDS_GPUSCAN;
+	gs_info.dev_projection = dev_projection;
 	gs_info.used_params = context.used_params;
 	gs_info.used_vars = context.used_vars;
 	gs_info.dev_quals = dev_quals;
+	/*
+	 * NOTE: planner may modify the target-list of scan node later, like
+	 * replacement by sub_tlist or resjunk entries for sorting. So, we save
+	 * a copy of the target-list used to construct the kernel, to check
+	 * whether device projection is still valid at the executor startup.
+	 */
+	gs_info.dev_tlist = (dev_projection ? copyObject(tlist) : NIL);
 	form_gpuscan_info(cscan, &gs_info);
 	cscan->flags = best_path->flags;
 	cscan->methods = &gpuscan_plan_methods;
@@ -635,13 +812,34 @@ gpuscan_begin(CustomScanState *node, EState *estate, int eflags)
 	gss->gts.cb_next_tuple = gpuscan_next_tuple;
 
 	/* initialize the start/end position */
-	gss->curr_blknum = 0;
 	gss->last_blknum = RelationGetNumberOfBlocks(scan_rel);
+	gss->syncscan = (synchronize_seqscans &&
+					 (eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0 &&
+					 !RelationUsesLocalBuffers(scan_rel) &&
+					 gss->last_blknum > NBuffers / 4);
+	gpuscan_init_position(gss, false);
+	/*
+	 * enlist the loader workers if relation is large enough to give them
+	 * a few chunks at least. Temporary relation is not visible to them.
+	 */
+	if (gpuscan_loader_workers > 0 &&
+		(eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0 &&
+		!RelationUsesLocalBuffers(scan_rel) &&
+		!RecoveryInProgress() &&
+		gss->last_blknum / Max(pgstrom_chunk_size() / BLCKSZ, 1) >=
+		2 * gpuscan_loader_workers)
+		gss->loader_nworkers = gpuscan_loader_workers;
 	/* initialize device qualifiers also, for fallback */
 	gss->dev_quals = (List *)
 		ExecInitExpr((Expr *) gs_info->dev_quals, &gss->gts.css.ss.ps);
 	/* 'tableoid' should not change during relation scan */
 	gss->scan_tuple.t_tableOid = RelationGetRelid(scan_rel);
+	/* extract referenced attributes only, if possible */
+	gss->attr_needed =
+		pgstrom_setup_lazy_fetch(&gss->gts.css.ss.ps,
+								 ((Scan *)node->ss.ps.plan)->scanrelid,
+								 gs_info->dev_quals,
+								 RelationGetDescr(scan_rel));
 	/* assign kernel source and flags */
 	pgstrom_assign_cuda_program(&gss->gts,
 								gs_info->used_params,
@@ -653,6 +851,15 @@ gpuscan_begin(CustomScanState *node, EState *estate, int eflags)
 		if ((eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
 			pgstrom_preload_cuda_program(&gss->gts);
 	}
+	/*
+	 * device projection is valid only if scan tuple is actually
+	 * projected to the result tuple, and the target-list is identical
+	 * to the one compiled to the kernel.
+	 */
+	gss->dev_projection = (gs_info->dev_projection &&
+						   gss->gts.css.ss.ps.ps_ProjInfo != NULL &&
+						   equal(gs_info->dev_tlist,
+								 node->ss.ps.plan->targetlist));
 	/* other run-time parameters */
     gss->num_rechecked = 0;
 }
@@ -674,6 +881,8 @@ pgstrom_release_gpuscan(GpuTask *gputask)
 
 	if (gpuscan->pds)
 		pgstrom_release_data_store(gpuscan->pds);
+	if (gpuscan->pds_dst)
+		pgstrom_release_data_store(gpuscan->pds_dst);
 	pgstrom_complete_gpuscan(&gpuscan->task);
 
 	pfree(gpuscan);
@@ -720,9 +929,805 @@ pgstrom_create_gpuscan(GpuScanState *gss, pgstrom_data_store *pds)
 		kresults->all_visible = true;
 		kresults->nitems = nitems;
 	}
+	/*
+	 * A data store with tuple-slot format to receive the result of
+	 * device projection. It never has more rows than the source.
+	 */
+	if (gss->dev_projection)
+	{
+		TupleTableSlot *slot = gss->gts.css.ss.ps.ps_ResultTupleSlot;
+
+		gpuscan->pds_dst =
+			pgstrom_create_data_store_slot(gcontext,
+										   slot->tts_tupleDescriptor,
+										   nitems, false, NULL);
+	}
 	return gpuscan;
 }
 
+/*
+ * gpuscan_init_position
+ *
+ * It rewinds the scan position. Like heap sequential scan, a large relation
+ * scan joins the synchronized scan already in-progress, if any, to share
+ * the I/O with the concurrent scans, then wraps around the end of relation.
+ * On rescan, we keep the previous start position, so that rewinding a
+ * cursor returns the rows in the same order.
+ */
+static void
+gpuscan_init_position(GpuScanState *gss, bool keep_startblock)
+{
+	Relation	rel = gss->gts.css.ss.ss_currentRelation;
+
+	gss->curr_blknum = 0;
+	if (keep_startblock)
+		return;
+	if (gss->syncscan)
+		gss->start_blknum = ss_get_location(rel, gss->last_blknum);
+	else
+		gss->start_blknum = 0;
+}
+
+/*
+ * gpuscan_fill_chunk
+ *
+ * It fills up the supplied data store by blocks from the current position.
+ * Chunk boundary is always block aligned.
+ */
+static void
+gpuscan_fill_chunk(GpuScanState *gss, pgstrom_data_store *pds)
+{
+	Relation	rel = gss->gts.css.ss.ss_currentRelation;
+	Snapshot	snapshot = gss->gts.css.ss.ps.state->es_snapshot;
+	BlockNumber	blknum;
+
+	while (gss->curr_blknum < gss->last_blknum)
+	{
+		blknum = gss->start_blknum + gss->curr_blknum;
+		if (blknum >= gss->last_blknum)
+			blknum -= gss->last_blknum;		/* wrap around */
+		if (pgstrom_data_store_insert_block(pds, rel, blknum,
+											snapshot, true) < 0)
+			break;
+		gss->curr_blknum++;
+	}
+
+	/*
+	 * Report the next block to read, so concurrent scans can join us.
+	 * We don't report at the end of scan, not to pull back the others
+	 * to the position we already passed through.
+	 */
+	if (gss->syncscan && gss->curr_blknum < gss->last_blknum)
+	{
+		blknum = gss->start_blknum + gss->curr_blknum;
+		if (blknum >= gss->last_blknum)
+			blknum -= gss->last_blknum;
+		ss_report_location(rel, blknum);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *
+ * Parallel chunk loader
+ *
+ * GpuScan can enlist background workers to load blocks into row-format
+ * chunks on the dynamic shared memory segment. Each worker claims a range
+ * of blocks, checks tuple's visibility using the snapshot exported by the
+ * coordinator backend, then hands the filled chunk to the backend.
+ * ----------------------------------------------------------------
+ */
+#define GSLOADER_CHUNKS_PER_WORKER	2
+/*
+ * A new export assigns a transaction ID, and commit of the read-only
+ * transaction has to write and flush its commit record. We pay the cost
+ * only if the scan is large enough to amortize it.
+ */
+#define GSLOADER_EXPORT_MIN_CHUNKS	32
+
+#define GSLOADER_CHUNK_FREE			0
+#define GSLOADER_CHUNK_FILLING		1
+#define GSLOADER_CHUNK_READY		2
+
+typedef struct
+{
+	Size			dsm_length;		/* total length of this structure */
+	slock_t			lock;			/* protection of the fields below */
+	PGPROC		   *backend_proc;	/* PGPROC of the coordinator backend */
+	PGPROC		   *worker_procs[GSLOADER_MAX_WORKERS];
+	Oid				database_oid;
+	Oid				relid;
+	char			snapshot_name[NAMEDATALEN];
+	bool			syncscan;		/* true, if synchronized scan */
+	BlockNumber		start_blknum;	/* block number to start the scan */
+	BlockNumber		last_blknum;	/* number of blocks to be read */
+	BlockNumber		next_blknum;	/* next block to be claimed */
+	BlockNumber		claim_nblocks;	/* number of blocks per claim */
+	int				nworkers;		/* number of launched workers */
+	int				nworkers_attached;
+	int				nworkers_done;
+	bool			aborted;		/* coordinator is no longer interested */
+	int				errcode;		/* error status of the workers */
+	char			errmsg[256];
+	cl_uint			nchunks;		/* number of chunks */
+	Size			chunk_length;	/* length of a kern_data_store */
+	cl_int			chunk_state[GSLOADER_MAX_WORKERS *
+								GSLOADER_CHUNKS_PER_WORKER];
+	char			data[FLEXIBLE_ARRAY_MEMBER];
+} gpuscan_loader;
+
+#define GSLOADER_CHUNK(gsl, index)						\
+	((kern_data_store *)((gsl)->data + (Size)(index) * (gsl)->chunk_length))
+
+/*
+ * Snapshot exported for the loader workers. It is shared by all the
+ * GpuScans of the transaction as long as they use an identical snapshot,
+ * because ExportSnapshot() consumes a transaction-id of read-only
+ * transaction, and the cost is paid at most once per transaction.
+ */
+static LocalTransactionId	loader_snapshot_lxid = InvalidLocalTransactionId;
+static bool					loader_snapshot_had_xid;
+static SnapshotData			loader_snapshot_data;
+static char				   *loader_snapshot_name = NULL;
+
+/*
+ * gpuscan_loader_collect_workers - needs the lock held
+ *
+ * It collects PGPROCs of the workers to be woken up; caller has to set
+ * their latches after the lock is released.
+ */
+static int
+gpuscan_loader_collect_workers(gpuscan_loader *gsl, PGPROC **procs)
+{
+	int		i, nprocs = 0;
+
+	for (i=0; i < GSLOADER_MAX_WORKERS; i++)
+	{
+		if (gsl->worker_procs[i])
+			procs[nprocs++] = gsl->worker_procs[i];
+	}
+	return nprocs;
+}
+
+static void
+gpuscan_loader_wakeup_workers(PGPROC **procs, int nprocs)
+{
+	int		i;
+
+	for (i=0; i < nprocs; i++)
+		SetLatch(&procs[i]->procLatch);
+}
+
+/*
+ * gpuscan_loader_export_snapshot
+ *
+ * It returns the name of the exported snapshot, or NULL if the workers
+ * cannot see the identical set of tuples.
+ * Workers check tuple's visibility using the imported snapshot, so they
+ * cannot see the tuples modified by the current transaction. We enlist
+ * the workers only if the transaction had no xid prior to the first
+ * export (ExportSnapshot() assigns one), and the snapshot is taken prior
+ * to any modification by the current transaction (curcid is the first).
+ * A new export, that assigns a transaction ID, is made only if the scan
+ * has GSLOADER_EXPORT_MIN_CHUNKS chunks at least; an exported snapshot
+ * is shared by any scans of the transaction.
+ */
+static char *
+gpuscan_loader_export_snapshot(Snapshot snapshot, BlockNumber nblocks)
+{
+	BlockNumber	chunk_nblocks = Max(pgstrom_chunk_size() / BLCKSZ, 1);
+
+	MemoryContext	oldcxt;
+	char		   *name;
+
+	if (loader_snapshot_lxid != MyProc->lxid)
+	{
+		loader_snapshot_lxid = MyProc->lxid;
+		loader_snapshot_had_xid
+			= TransactionIdIsValid(GetTopTransactionIdIfAny());
+		loader_snapshot_name = NULL;
+	}
+	if (IsSubTransaction() ||
+		loader_snapshot_had_xid ||
+		snapshot->curcid != FirstCommandId)
+		return NULL;
+
+	/* reuse the snapshot already exported, if identical */
+	if (loader_snapshot_name &&
+		loader_snapshot_data.xmin == snapshot->xmin &&
+		loader_snapshot_data.xmax == snapshot->xmax &&
+		loader_snapshot_data.xcnt == snapshot->xcnt &&
+		loader_snapshot_data.subxcnt == snapshot->subxcnt &&
+		loader_snapshot_data.suboverflowed == snapshot->suboverflowed &&
+		memcmp(loader_snapshot_data.xip, snapshot->xip,
+			   sizeof(TransactionId) * snapshot->xcnt) == 0 &&
+		memcmp(loader_snapshot_data.subxip, snapshot->subxip,
+			   sizeof(TransactionId) * snapshot->subxcnt) == 0)
+		return loader_snapshot_name;
+
+	/* too small to pay the transaction-id */
+	if (nblocks / chunk_nblocks < GSLOADER_EXPORT_MIN_CHUNKS)
+		return NULL;
+
+	/* remember the snapshot until end of the transaction */
+	oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+	name = ExportSnapshot(snapshot);
+	loader_snapshot_data = *snapshot;
+	loader_snapshot_data.xip = palloc(sizeof(TransactionId) *
+									  Max(snapshot->xcnt, 1));
+	memcpy(loader_snapshot_data.xip, snapshot->xip,
+		   sizeof(TransactionId) * snapshot->xcnt);
+	loader_snapshot_data.subxip = palloc(sizeof(TransactionId) *
+										 Max(snapshot->subxcnt, 1));
+	memcpy(loader_snapshot_data.subxip, snapshot->subxip,
+		   sizeof(TransactionId) * snapshot->subxcnt);
+	loader_snapshot_name = pstrdup(name);
+	MemoryContextSwitchTo(oldcxt);
+
+	return loader_snapshot_name;
+}
+
+/*
+ * gpuscan_loader_on_detach
+ *
+ * It tells the workers the coordinator is no longer interested in, even if
+ * the segment is detached on error.
+ */
+static void
+gpuscan_loader_on_detach(dsm_segment *dsm_seg, Datum arg)
+{
+	gpuscan_loader *gsl = (gpuscan_loader *) DatumGetPointer(arg);
+	PGPROC		   *procs[GSLOADER_MAX_WORKERS];
+	int				nprocs;
+
+	SpinLockAcquire(&gsl->lock);
+	gsl->aborted = true;
+	nprocs = gpuscan_loader_collect_workers(gsl, procs);
+	SpinLockRelease(&gsl->lock);
+	gpuscan_loader_wakeup_workers(procs, nprocs);
+}
+
+/*
+ * gpuscan_loader_start
+ *
+ * It launches the loader workers on the first call of gpuscan_next_chunk().
+ * If we cannot launch any workers, loader_nworkers is reset to zero, then
+ * the backend loads the blocks by itself.
+ */
+static void
+gpuscan_loader_start(GpuScanState *gss)
+{
+	EState		   *estate = gss->gts.css.ss.ps.state;
+	Relation		rel = gss->gts.css.ss.ss_currentRelation;
+	TupleDesc		tupdesc = RelationGetDescr(rel);
+	MemoryContext	oldcxt;
+	LOCKTAG			locktag;
+	dsm_segment	   *dsm_seg;
+	gpuscan_loader *gsl;
+	Size			chunk_length;
+	Size			length;
+	cl_uint			nchunks;
+	int				nworkers = gss->loader_nworkers;
+	int				i;
+
+	Assert(nworkers > 0 && nworkers <= GSLOADER_MAX_WORKERS);
+
+	/*
+	 * Workers acquire their own lock on the relation, because we have no
+	 * group locking. If we hold AccessExclusiveLock, they never get the
+	 * lock. Elsewhere, workers don't wait for the lock (a pending lock
+	 * request of others would block them behind us; it's a deadlock that
+	 * the deadlock detector cannot see), and we load the blocks they gave
+	 * up by ourselves.
+	 */
+	SET_LOCKTAG_RELATION(locktag,
+						 rel->rd_lockInfo.lockRelId.dbId,
+						 rel->rd_lockInfo.lockRelId.relId);
+	if (LockHeldByMe(&locktag, AccessExclusiveLock))
+	{
+		gss->loader_nworkers = 0;
+		return;
+	}
+	oldcxt = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	/*
+	 * Snapshot is exported once per transaction, then reused on rescan.
+	 */
+	if (!gss->loader_snapshot)
+	{
+		gss->loader_snapshot
+			= gpuscan_loader_export_snapshot(estate->es_snapshot,
+											 gss->last_blknum);
+		if (!gss->loader_snapshot)
+		{
+			gss->loader_nworkers = 0;
+			MemoryContextSwitchTo(oldcxt);
+			return;
+		}
+	}
+
+	/* allocation of the shared state and chunks */
+	nchunks = nworkers * GSLOADER_CHUNKS_PER_WORKER;
+	chunk_length = (STROMALIGN(offsetof(kern_data_store,
+										colmeta[tupdesc->natts])) +
+					STROMALIGN(pgstrom_chunk_size()));
+	length = (STROMALIGN(offsetof(gpuscan_loader, data)) +
+			  (Size) nchunks * chunk_length);
+	dsm_seg = dsm_create(length, 0);
+	gsl = dsm_segment_address(dsm_seg);
+	memset(gsl, 0, offsetof(gpuscan_loader, data));
+	gsl->dsm_length = length;
+	SpinLockInit(&gsl->lock);
+	gsl->backend_proc = MyProc;
+	gsl->database_oid = MyDatabaseId;
+	gsl->relid = RelationGetRelid(rel);
+	strlcpy(gsl->snapshot_name, gss->loader_snapshot, NAMEDATALEN);
+	gsl->syncscan = gss->syncscan;
+	gsl->start_blknum = gss->start_blknum;
+	gsl->last_blknum = gss->last_blknum;
+	gsl->next_blknum = 0;
+	gsl->claim_nblocks = Max(pgstrom_chunk_size() / BLCKSZ, 1);
+	gsl->nchunks = nchunks;
+	gsl->chunk_length = chunk_length;
+	on_dsm_detach(dsm_seg, gpuscan_loader_on_detach, PointerGetDatum(gsl));
+
+	/* launch the workers */
+	for (i=0; i < nworkers; i++)
+	{
+		BackgroundWorker	worker;
+
+		memset(&worker, 0, sizeof(BackgroundWorker));
+		snprintf(worker.bgw_name, sizeof(worker.bgw_name),
+				 "GpuScan loader-%d (pid=%d)", i, MyProcPid);
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+			BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = BGW_NEVER_RESTART;
+		worker.bgw_main = gpuscan_loader_main;
+		worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(dsm_seg));
+
+		if (!RegisterDynamicBackgroundWorker(&worker,
+											 &gss->loader_handles[i]))
+			break;
+	}
+	MemoryContextSwitchTo(oldcxt);
+
+	if (i == 0)
+	{
+		elog(DEBUG1, "GpuScan: no background worker slots for loader");
+		dsm_detach(dsm_seg);
+		gss->loader_nworkers = 0;
+		return;
+	}
+	SpinLockAcquire(&gsl->lock);
+	gsl->nworkers = i;
+	SpinLockRelease(&gsl->lock);
+
+	gss->loader_nworkers = i;
+	gss->loader_nlaunched = i;
+	gss->loader_dsm = dsm_seg;
+	gss->loader_index = 0;
+}
+
+/*
+ * gpuscan_loader_stop
+ *
+ * It asks the workers to stop, then waits for their exit.
+ */
+static void
+gpuscan_loader_stop(GpuScanState *gss)
+{
+	gpuscan_loader *gsl;
+	PGPROC		   *procs[GSLOADER_MAX_WORKERS];
+	int				nprocs;
+	pid_t			bgw_pid;
+	int				i, rc;
+
+	if (!gss->loader_dsm)
+		return;
+
+	gsl = dsm_segment_address(gss->loader_dsm);
+	SpinLockAcquire(&gsl->lock);
+	gsl->aborted = true;
+	nprocs = gpuscan_loader_collect_workers(gsl, procs);
+	SpinLockRelease(&gsl->lock);
+	gpuscan_loader_wakeup_workers(procs, nprocs);
+
+	for (i=0; i < gss->loader_nworkers; i++)
+	{
+		while (GetBackgroundWorkerPid(gss->loader_handles[i],
+									  &bgw_pid) != BGWH_STOPPED)
+		{
+			rc = WaitLatch(&MyProc->procLatch,
+						   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   100);
+			ResetLatch(&MyProc->procLatch);
+			if (rc & WL_POSTMASTER_DEATH)
+				elog(ERROR, "Emergency bail out because of Postmaster crash");
+		}
+		pfree(gss->loader_handles[i]);
+		gss->loader_handles[i] = NULL;
+	}
+	dsm_detach(gss->loader_dsm);
+	gss->loader_dsm = NULL;
+}
+
+/*
+ * gpuscan_loader_next_chunk
+ *
+ * It picks up a chunk filled by the workers, then copies it to a new data
+ * store. The copy stays on the backend, because DMA source has to be the
+ * page-locked memory of our GpuContext, and the chunk on the segment is
+ * recycled by the workers while the task is in-flight. It returns NULL once all the workers completed their job; blocks
+ * not claimed by the workers, if any, are left to the backend from
+ * the curr_blknum.
+ */
+static pgstrom_data_store *
+gpuscan_loader_next_chunk(GpuScanState *gss)
+{
+	gpuscan_loader *gsl = dsm_segment_address(gss->loader_dsm);
+	Relation		rel = gss->gts.css.ss.ss_currentRelation;
+	pid_t			bgw_pid;
+	int				nstopped;
+	int				i, rc;
+
+	for (;;)
+	{
+		kern_data_store *kds_src;
+		int			chunk_index = -1;
+		int			nworkers_done;
+
+		ResetLatch(&MyProc->procLatch);
+
+		/* count the workers exited, prior to the check of shared state */
+		nstopped = 0;
+		for (i=0; i < gss->loader_nworkers; i++)
+		{
+			if (GetBackgroundWorkerPid(gss->loader_handles[i],
+									   &bgw_pid) == BGWH_STOPPED)
+				nstopped++;
+		}
+
+		SpinLockAcquire(&gsl->lock);
+		if (gsl->errcode != 0)
+		{
+			SpinLockRelease(&gsl->lock);
+			ereport(ERROR,
+					(errcode(gsl->errcode),
+					 errmsg("GpuScan loader: %s", gsl->errmsg)));
+		}
+		for (i=0; i < gsl->nchunks; i++)
+		{
+			int		index = (gss->loader_index + i) % gsl->nchunks;
+
+			if (gsl->chunk_state[index] == GSLOADER_CHUNK_READY)
+			{
+				chunk_index = index;
+				break;
+			}
+		}
+		nworkers_done = gsl->nworkers_done;
+		SpinLockRelease(&gsl->lock);
+
+		if (chunk_index >= 0)
+		{
+			pgstrom_data_store *pds;
+			kern_data_store	   *kds;
+			Size				head_length;
+			PGPROC			   *procs[GSLOADER_MAX_WORKERS];
+			int					nprocs;
+
+			/*
+			 * Copy the index portion and the tuples at the tail of chunk,
+			 * not to touch the unused hole in the middle. Nobody modifies
+			 * the chunk being ready until we release it, so we don't need
+			 * to hold the lock during the copy.
+			 */
+			kds_src = GSLOADER_CHUNK(gsl, chunk_index);
+			pds = pgstrom_create_data_store_row(gss->gts.gcontext,
+												RelationGetDescr(rel),
+												pgstrom_chunk_size(),
+												false);
+			kds = pds->kds;
+			Assert(pds->kds_length == gsl->chunk_length);
+			head_length = ((char *)((cl_uint *)KERN_DATA_STORE_BODY(kds_src) +
+									kds_src->nitems) - (char *)kds_src);
+			memcpy(kds, kds_src, head_length);
+			memcpy((char *)kds + kds->length - kds_src->usage,
+				   (char *)kds_src + kds_src->length - kds_src->usage,
+				   kds_src->usage);
+			kds->hostptr = (hostptr_t) &kds->hostptr;
+
+			/* release the chunk for the workers */
+			SpinLockAcquire(&gsl->lock);
+			gsl->chunk_state[chunk_index] = GSLOADER_CHUNK_FREE;
+			nprocs = gpuscan_loader_collect_workers(gsl, procs);
+			SpinLockRelease(&gsl->lock);
+			gpuscan_loader_wakeup_workers(procs, nprocs);
+			gss->loader_index = (chunk_index + 1) % gsl->nchunks;
+
+			return pds;
+		}
+		/* all the workers completed the job, and no chunks left */
+		if (nworkers_done == gss->loader_nworkers)
+		{
+			SpinLockAcquire(&gsl->lock);
+			gss->curr_blknum = gsl->next_blknum;
+			gsl->next_blknum = gsl->last_blknum;
+			SpinLockRelease(&gsl->lock);
+			return NULL;
+		}
+		/* some workers exited without completion */
+		if (nstopped > nworkers_done)
+			elog(ERROR, "GpuScan loader worker exited unexpectedly");
+
+		rc = WaitLatch(&MyProc->procLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   100);
+		if (rc & WL_POSTMASTER_DEATH)
+			elog(ERROR, "Emergency bail out because of Postmaster crash");
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * gpuscan_loader_claim_blocks
+ *
+ * It claims the next range of blocks. Block numbers are relative to the
+ * start_blknum, so caller has to wrap around the end of relation.
+ */
+static bool
+gpuscan_loader_claim_blocks(gpuscan_loader *gsl,
+							BlockNumber *p_curr, BlockNumber *p_end)
+{
+	bool	result = false;
+
+	SpinLockAcquire(&gsl->lock);
+	if (!gsl->aborted && gsl->next_blknum < gsl->last_blknum)
+	{
+		*p_curr = gsl->next_blknum;
+		*p_end = Min(gsl->next_blknum + gsl->claim_nblocks,
+					 gsl->last_blknum);
+		gsl->next_blknum = *p_end;
+		result = true;
+	}
+	SpinLockRelease(&gsl->lock);
+
+	return result;
+}
+
+/*
+ * gpuscan_loader_get_chunk
+ *
+ * It assigns a free chunk to the worker. If all the chunks are in use, it
+ * waits for the coordinator to consume them. It returns -1 if aborted.
+ */
+static int
+gpuscan_loader_get_chunk(gpuscan_loader *gsl)
+{
+	int		i, rc;
+
+	for (;;)
+	{
+		ResetLatch(&MyProc->procLatch);
+
+		SpinLockAcquire(&gsl->lock);
+		if (gsl->aborted)
+		{
+			SpinLockRelease(&gsl->lock);
+			return -1;
+		}
+		for (i=0; i < gsl->nchunks; i++)
+		{
+			if (gsl->chunk_state[i] == GSLOADER_CHUNK_FREE)
+			{
+				gsl->chunk_state[i] = GSLOADER_CHUNK_FILLING;
+				SpinLockRelease(&gsl->lock);
+				return i;
+			}
+		}
+		SpinLockRelease(&gsl->lock);
+
+		rc = WaitLatch(&MyProc->procLatch,
+					   WL_LATCH_SET | WL_POSTMASTER_DEATH,
+					   0);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * gpuscan_loader_put_chunk
+ *
+ * It hands a chunk to the coordinator, or releases an empty one.
+ */
+static void
+gpuscan_loader_put_chunk(gpuscan_loader *gsl, int chunk_index)
+{
+	kern_data_store *kds = GSLOADER_CHUNK(gsl, chunk_index);
+
+	SpinLockAcquire(&gsl->lock);
+	if (kds->nitems > 0 && !gsl->aborted)
+		gsl->chunk_state[chunk_index] = GSLOADER_CHUNK_READY;
+	else
+		gsl->chunk_state[chunk_index] = GSLOADER_CHUNK_FREE;
+	SpinLockRelease(&gsl->lock);
+	SetLatch(&gsl->backend_proc->procLatch);
+}
+
+/*
+ * gpuscan_loader_exec
+ *
+ * The main loop of the loader worker; claims a range of blocks, then loads
+ * them to the chunk.
+ */
+static void
+gpuscan_loader_exec(gpuscan_loader *gsl, Relation rel, Snapshot snapshot)
+{
+	pgstrom_data_store	pds_temp;
+	kern_data_store	   *kds = NULL;
+	int					chunk_index = -1;
+	BlockNumber			curr = 0;
+	BlockNumber			end = 0;
+	BlockNumber			blknum;
+
+	memset(&pds_temp, 0, sizeof(pgstrom_data_store));
+	for (;;)
+	{
+		if (curr >= end)
+		{
+			if (!gpuscan_loader_claim_blocks(gsl, &curr, &end))
+				break;
+			/* others can join the synchronized scan from here */
+			if (gsl->syncscan)
+			{
+				blknum = gsl->start_blknum + curr;
+				if (blknum >= gsl->last_blknum)
+					blknum -= gsl->last_blknum;
+				ss_report_location(rel, blknum);
+			}
+		}
+
+		if (!kds)
+		{
+			chunk_index = gpuscan_loader_get_chunk(gsl);
+			if (chunk_index < 0)
+				return;		/* aborted */
+			kds = GSLOADER_CHUNK(gsl, chunk_index);
+			pgstrom_init_data_store_row(kds, RelationGetDescr(rel),
+										gsl->chunk_length);
+			pds_temp.kds = kds;
+			pds_temp.kds_length = gsl->chunk_length;
+		}
+
+		blknum = gsl->start_blknum + curr;
+		if (blknum >= gsl->last_blknum)
+			blknum -= gsl->last_blknum;		/* wrap around */
+		if (pgstrom_data_store_insert_block(&pds_temp, rel, blknum,
+											snapshot, true) < 0)
+		{
+			if (kds->nitems == 0)
+				elog(ERROR, "GpuScan chunk is too small to load a block");
+			/* this chunk is full, so load the block on the next one */
+			gpuscan_loader_put_chunk(gsl, chunk_index);
+			kds = NULL;
+			continue;
+		}
+		curr++;
+	}
+	if (kds)
+		gpuscan_loader_put_chunk(gsl, chunk_index);
+}
+
+/*
+ * gpuscan_loader_main
+ *
+ * Entrypoint of the loader worker
+ */
+static void
+gpuscan_loader_main(Datum main_arg)
+{
+	dsm_handle		dsm_hnd = (dsm_handle) DatumGetUInt32(main_arg);
+	dsm_segment	   *dsm_seg;
+	gpuscan_loader *gsl;
+	PGPROC		   *backend_proc;
+	MemoryContext	bgw_mcxt;
+	Relation		rel;
+	int				worker_index = -1;
+
+	/* We're now ready to receive signals */
+	BackgroundWorkerUnblockSignals();
+	/* Makes up resource owner and memory context */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "GpuScan loader");
+	bgw_mcxt = AllocSetContextCreate(TopMemoryContext,
+									 "GpuScan loader",
+									 ALLOCSET_DEFAULT_MINSIZE,
+									 ALLOCSET_DEFAULT_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE);
+	CurrentMemoryContext = bgw_mcxt;
+
+	/* coordinator may already have gone away */
+	dsm_seg = dsm_attach(dsm_hnd);
+	if (!dsm_seg)
+		return;
+	gsl = dsm_segment_address(dsm_seg);
+	backend_proc = gsl->backend_proc;
+
+	SpinLockAcquire(&gsl->lock);
+	if (gsl->nworkers_attached < GSLOADER_MAX_WORKERS)
+	{
+		worker_index = gsl->nworkers_attached++;
+		gsl->worker_procs[worker_index] = MyProc;
+	}
+	SpinLockRelease(&gsl->lock);
+
+	PG_TRY();
+	{
+		if (worker_index < 0)
+			elog(ERROR, "Bug? too many GpuScan loader workers");
+
+		/* Connect to our database */
+		BackgroundWorkerInitializeConnectionByOid(gsl->database_oid,
+												  InvalidOid);
+		/*
+		 * Import the snapshot of the coordinator. Only transactions with
+		 * REPEATABLE READ or SERIALIZABLE can import snapshot, and it is
+		 * never used to modify the database.
+		 */
+		StartTransactionCommand();
+		XactIsoLevel = XACT_REPEATABLE_READ;
+		ImportSnapshot(gsl->snapshot_name);
+
+		/*
+		 * Never wait for the lock; the coordinator loads the blocks by
+		 * itself if no workers got the lock.
+		 */
+		if (ConditionalLockRelationOid(gsl->relid, AccessShareLock))
+		{
+			rel = heap_open(gsl->relid, NoLock);
+			gpuscan_loader_exec(gsl, rel, GetTransactionSnapshot());
+			heap_close(rel, AccessShareLock);
+		}
+		else
+			elog(DEBUG1, "GpuScan loader: relation %u is locked, so leave "
+				 "the blocks to the backend", gsl->relid);
+
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		MemoryContext	ecxt = MemoryContextSwitchTo(bgw_mcxt);
+		ErrorData	   *edata = CopyErrorData();
+
+		MemoryContextSwitchTo(ecxt);
+
+		SpinLockAcquire(&gsl->lock);
+		if (gsl->errcode == 0)
+		{
+			gsl->errcode = edata->sqlerrcode;
+			strlcpy(gsl->errmsg, edata->message, sizeof(gsl->errmsg));
+		}
+		if (worker_index >= 0)
+			gsl->worker_procs[worker_index] = NULL;
+		gsl->nworkers_done++;
+		SpinLockRelease(&gsl->lock);
+		SetLatch(&backend_proc->procLatch);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	/* Inform the coordinator the worker got finished */
+	SpinLockAcquire(&gsl->lock);
+	gsl->worker_procs[worker_index] = NULL;
+	gsl->nworkers_done++;
+	SpinLockRelease(&gsl->lock);
+	SetLatch(&backend_proc->procLatch);
+
+	dsm_detach(dsm_seg);
+}
+
 static GpuTask *
 gpuscan_next_chunk(GpuTaskState *gts)
 {
@@ -730,7 +1735,6 @@ gpuscan_next_chunk(GpuTaskState *gts)
 	GpuScanState	   *gss = (GpuScanState *) gts;
 	Relation			rel = gss->gts.css.ss.ss_currentRelation;
 	TupleDesc			tupdesc = RelationGetDescr(rel);
-	Snapshot			snapshot = gss->gts.css.ss.ps.state->es_snapshot;
 	bool				end_of_scan = false;
 	pgstrom_data_store *pds;
 	struct timeval tv1, tv2;
@@ -741,18 +1745,36 @@ gpuscan_next_chunk(GpuTaskState *gts)
 
 	PERFMON_BEGIN(&gss->gts.pfm_accum, &tv1);
 
+	/* chunks are filled by the loader workers, if any */
+	if (gss->loader_nworkers > 0 && !gss->loader_dsm && !gss->loader_done)
+		gpuscan_loader_start(gss);
+	if (gss->loader_dsm)
+	{
+		pds = gpuscan_loader_next_chunk(gss);
+		if (pds)
+			gpuscan = pgstrom_create_gpuscan(gss, pds);
+		else
+		{
+			/* load the rest of blocks by ourselves, if any */
+			gpuscan_loader_stop(gss);
+			gss->loader_done = true;
+			if (gss->curr_blknum >= gss->last_blknum)
+				end_of_scan = true;
+		}
+	}
+
 	while (!gpuscan && !end_of_scan)
 	{
+		Size	remain = ((Size)(gss->last_blknum -
+								 gss->curr_blknum)) * BLCKSZ;
+		Size	chunk_size = pgstrom_adaptive_chunk_size(&gss->gts, remain);
+
 		pds = pgstrom_create_data_store_row(gss->gts.gcontext,
 											tupdesc,
-											pgstrom_chunk_size(),
+											chunk_size,
 											false);
 		/* fill up this data-store */
-		while (gss->curr_blknum < gss->last_blknum &&
-			   pgstrom_data_store_insert_block(pds, rel,
-											   gss->curr_blknum,
-											   snapshot, true) >= 0)
-			gss->curr_blknum++;
+		gpuscan_fill_chunk(gss, pds);
 
 		if (pds->kds->nitems > 0)
 			gpuscan = pgstrom_create_gpuscan(gss, pds);
@@ -780,6 +1802,69 @@ gpuscan_next_chunk(GpuTaskState *gts)
 	return &gpuscan->task;
 }
 
+/*
+ * gpuscan_next_tuple_projected
+ *
+ * It returns the next result tuple already projected by the device.
+ * Rows marked as recheck are fetched from the source data store, then
+ * device qualifiers and projection are evaluated on the host side.
+ */
+static TupleTableSlot *
+gpuscan_next_tuple_projected(GpuScanState *gss)
+{
+	pgstrom_gpuscan	   *gpuscan = (pgstrom_gpuscan *) gss->gts.curr_task;
+	pgstrom_data_store *pds = gpuscan->pds;
+	kern_data_store	   *kds_dst = gpuscan->pds_dst->kds;
+	kern_resultbuf	   *kresults = gpuscan->kresults;
+	ExprContext		   *econtext = gss->gts.css.ss.ps.ps_ExprContext;
+	TupleTableSlot	   *slot = NULL;
+	cl_int				i_result;
+	cl_uint				index;
+
+	while (gss->gts.curr_index < kresults->nitems)
+	{
+		index = gss->gts.curr_index++;
+		i_result = kresults->results[index];
+
+		if (i_result > 0)
+		{
+			/* values/isnull are copied not to reference kds_dst later */
+			slot = gss->gts.css.ss.ps.ps_ResultTupleSlot;
+			ExecClearTuple(slot);
+			memcpy(slot->tts_values,
+				   KERN_DATA_STORE_VALUES(kds_dst, index),
+				   sizeof(Datum) * kds_dst->ncols);
+			memcpy(slot->tts_isnull,
+				   KERN_DATA_STORE_ISNULL(kds_dst, index),
+				   sizeof(bool) * kds_dst->ncols);
+			ExecStoreVirtualTuple(slot);
+			break;
+		}
+		Assert(i_result < 0);
+		gss->num_rechecked++;
+
+		/* fetch the original row, then recheck and projection */
+		slot = gss->gts.css.ss.ss_ScanTupleSlot;
+		if (gss->attr_needed
+			? !pgstrom_fetch_data_store_lazy(slot, pds, -i_result - 1,
+											 gss->attr_needed)
+			: !pgstrom_fetch_data_store(slot, pds, -i_result - 1,
+										&gss->scan_tuple))
+			elog(ERROR, "failed to fetch a record from pds: %d", i_result);
+
+		ResetExprContext(econtext);
+		econtext->ecxt_scantuple = slot;
+		if (!ExecQual(gss->dev_quals, econtext, false))
+		{
+			slot = NULL;
+			continue;
+		}
+		slot = ExecProject(gss->gts.css.ss.ps.ps_ProjInfo, NULL);
+		break;
+	}
+	return slot;
+}
+
 static TupleTableSlot *
 gpuscan_next_tuple(GpuTaskState *gts)
 {
@@ -795,6 +1880,13 @@ gpuscan_next_tuple(GpuTaskState *gts)
 	Assert(kresults == KERN_GPUSCAN_RESULTBUF(&gpuscan->kern));
 
 	PERFMON_BEGIN(&gss->gts.pfm_accum, &tv1);
+	if (gpuscan->pds_dst)
+	{
+		slot = gpuscan_next_tuple_projected(gss);
+		PERFMON_END(&gss->gts.pfm_accum, time_materialize, &tv1, &tv2);
+		return slot;
+	}
+
 	while (gss->gts.curr_index < kresults->nitems)
 	{
 		if (kresults->all_visible)
@@ -812,10 +1904,21 @@ gpuscan_next_tuple(GpuTaskState *gts)
 		Assert(i_result > 0);
 
 		slot = gss->gts.css.ss.ss_ScanTupleSlot;
-		if (!pgstrom_fetch_data_store(slot, pds, i_result - 1,
-									  &gss->scan_tuple))
-			elog(ERROR, "failed to fetch a record from pds: %d", i_result);
-		Assert(slot->tts_tuple == &gss->scan_tuple);
+		if (gss->attr_needed)
+		{
+			if (!pgstrom_fetch_data_store_lazy(slot, pds, i_result - 1,
+											   gss->attr_needed))
+				elog(ERROR, "failed to fetch a record from pds: %d",
+					 i_result);
+		}
+		else
+		{
+			if (!pgstrom_fetch_data_store(slot, pds, i_result - 1,
+										  &gss->scan_tuple))
+				elog(ERROR, "failed to fetch a record from pds: %d",
+					 i_result);
+			Assert(slot->tts_tuple == &gss->scan_tuple);
+		}
 
 		if (do_recheck)
 		{
@@ -839,6 +1942,17 @@ gpuscan_next_tuple(GpuTaskState *gts)
 static TupleTableSlot *
 gpuscan_exec(CustomScanState *node)
 {
+	GpuScanState   *gss = (GpuScanState *) node;
+
+	/*
+	 * In case of device projection, GpuTask returns the result tuple
+	 * already projected. No host qualifiers are assigned in this case.
+	 */
+	if (gss->dev_projection && !node->ss.ps.state->es_epqTuple)
+	{
+		Assert(node->ss.ps.qual == NIL);
+		return pgstrom_exec_gputask(&gss->gts);
+	}
 	return ExecScan(&node->ss,
 					(ExecScanAccessMtd) pgstrom_exec_gputask,
 					(ExecScanRecheckMtd) pgstrom_recheck_gputask);
@@ -848,10 +1962,8 @@ static void *
 gpuscan_exec_bulk(CustomScanState *node)
 {
 	GpuScanState	   *gss = (GpuScanState *) node;
-	Relation			rel = node->ss.ss_currentRelation;
 	TupleTableSlot	   *slot = node->ss.ss_ScanTupleSlot;
 	TupleDesc			tupdesc = slot->tts_tupleDescriptor;
-	Snapshot			snapshot = node->ss.ps.state->es_snapshot;
 	pgstrom_data_store *pds = NULL;
 	struct timeval		tv1, tv2;
 
@@ -866,11 +1978,7 @@ gpuscan_exec_bulk(CustomScanState *node)
 											pgstrom_chunk_size(),
 											false);
 		/* fill up this data store */
-		while (gss->curr_blknum < gss->last_blknum &&
-			   pgstrom_data_store_insert_block(pds, rel,
-											   gss->curr_blknum,
-											   snapshot, true) >= 0)
-			gss->curr_blknum++;
+		gpuscan_fill_chunk(gss, pds);
 
 		if (pds->kds->nitems > 0)
 			break;
@@ -888,6 +1996,7 @@ gpuscan_end(CustomScanState *node)
 {
 	GpuScanState	   *gss = (GpuScanState *)node;
 
+	gpuscan_loader_stop(gss);
 	pgstrom_release_gputaskstate(&gss->gts);
 }
 
@@ -900,7 +2009,9 @@ gpuscan_rescan(CustomScanState *node)
     pgstrom_cleanup_gputaskstate(&gss->gts);
 
 	/* OK, rewind the position to read */
-	gss->curr_blknum = 0;
+	gpuscan_loader_stop(gss);
+	gss->loader_done = false;
+	gpuscan_init_position(gss, true);
 }
 
 static void
@@ -916,6 +2027,12 @@ gpuscan_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 		show_instrumentation_count("Rows Removed by Device Fileter",
 								   2, &gss->gts.css.ss.ps, es);
 	}
+	if (gsinfo->dev_projection)
+		ExplainPropertyText("Device Projection",
+							gss->dev_projection ? "enabled" : "disabled",
+							es);
+	if (es->analyze && gss->loader_nlaunched > 0)
+		ExplainPropertyInteger("Loader Workers", gss->loader_nlaunched, es);
 	pgstrom_explain_gputaskstate(&gss->gts, es);
 }
 
@@ -931,6 +2048,34 @@ pgstrom_init_gpuscan(void)
 							 PGC_USERSET,
 							 GUC_NOT_IN_SAMPLE,
 							 NULL, NULL, NULL);
+	/* enable_gpuscan_projection */
+	DefineCustomBoolVariable("pg_strom.enable_gpuscan_projection",
+							 "Enables to run target-list of GpuScan on GPU",
+							 NULL,
+							 &enable_gpuscan_projection,
+							 true,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+
+	/* gpuscan_loader_workers */
+	DefineCustomIntVariable("pg_strom.gpuscan_loader_workers",
+							"Number of background workers to load chunks "
+							"of GpuScan",
+							"Workers import a snapshot exported by the "
+							"backend, which assigns a transaction ID to "
+							"read-only transaction, so they are used only "
+							"for scans large enough to pay for it, and not "
+							"once the transaction modified anything. "
+							"Backend still copies each chunk from shared "
+							"memory to page-locked memory for DMA.",
+							&gpuscan_loader_workers,
+							0,
+							0,
+							GSLOADER_MAX_WORKERS,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
 
 	/* setup path methods */
 	memset(&gpuscan_path_methods, 0, sizeof(gpuscan_path_methods));
@@ -974,19 +2119,25 @@ gpuscan_cleanup_cuda_resources(pgstrom_gpuscan *gpuscan)
 {
 	CUDA_EVENT_DESTROY(gpuscan,ev_dma_recv_stop);
 	CUDA_EVENT_DESTROY(gpuscan,ev_dma_recv_start);
+	CUDA_EVENT_DESTROY(gpuscan,ev_kern_qual_end);
 	CUDA_EVENT_DESTROY(gpuscan,ev_dma_send_stop);
 	CUDA_EVENT_DESTROY(gpuscan,ev_dma_send_start);
 
 	if (gpuscan->m_kds)
 		gpuMemFree(&gpuscan->task, gpuscan->m_kds);
 
+	if (gpuscan->m_kds_dst)
+		gpuMemFree(&gpuscan->task, gpuscan->m_kds_dst);
+
 	if (gpuscan->m_gpuscan)
 		gpuMemFree(&gpuscan->task, gpuscan->m_gpuscan);
 
 	/* ensure pointers being NULL */
 	gpuscan->kern_qual = NULL;
+	gpuscan->kern_proj = NULL;
 	gpuscan->m_gpuscan = 0UL;
 	gpuscan->m_kds = 0UL;
+	gpuscan->m_kds_dst = 0UL;
 }
 
 /*
@@ -1007,9 +2158,19 @@ pgstrom_complete_gpuscan(GpuTask *gtask)
 		CUDA_EVENT_ELAPSED(gpuscan, time_dma_send,
 						   ev_dma_send_start,
 						   ev_dma_send_stop);
-		CUDA_EVENT_ELAPSED(gpuscan, time_kern_qual,
-						   ev_dma_send_stop,
-						   ev_dma_recv_start);
+		if (!gpuscan->pds_dst)
+			CUDA_EVENT_ELAPSED(gpuscan, time_kern_qual,
+							   ev_dma_send_stop,
+							   ev_dma_recv_start);
+		else
+		{
+			CUDA_EVENT_ELAPSED(gpuscan, time_kern_qual,
+							   ev_dma_send_stop,
+							   ev_kern_qual_end);
+			CUDA_EVENT_ELAPSED(gpuscan, time_kern_proj,
+							   ev_kern_qual_end,
+							   ev_dma_recv_start);
+		}
 		CUDA_EVENT_ELAPSED(gpuscan, time_dma_recv,
 						   ev_dma_recv_start,
 						   ev_dma_recv_stop);
@@ -1087,6 +2248,7 @@ __pgstrom_process_gpuscan(pgstrom_gpuscan *gpuscan)
 	kern_resultbuf	   *kresults = KERN_GPUSCAN_RESULTBUF(&gpuscan->kern);
 	pgstrom_data_store *pds = gpuscan->pds;
 	kern_data_store	   *kds = pds->kds;
+	pgstrom_data_store *pds_dst = gpuscan->pds_dst;
 	CUdeviceptr			m_ktoast = 0UL;
 	size_t				offset;
 	size_t				length;
@@ -1104,6 +2266,16 @@ __pgstrom_process_gpuscan(pgstrom_gpuscan *gpuscan)
 		elog(ERROR, "failed on cuModuleGetFunction: %s",
 			 errorText(rc));
 
+	if (pds_dst)
+	{
+		rc = cuModuleGetFunction(&gpuscan->kern_proj,
+								 gpuscan->task.cuda_module,
+								 "gpuscan_projection_slot");
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "failed on cuModuleGetFunction: %s",
+				 errorText(rc));
+	}
+
 	/*
 	 * Allocation of device memory
 	 */
@@ -1117,6 +2289,14 @@ __pgstrom_process_gpuscan(pgstrom_gpuscan *gpuscan)
 	if (!gpuscan->m_kds)
 		goto out_of_resource;
 
+	if (pds_dst)
+	{
+		length = KERN_DATA_STORE_LENGTH(pds_dst->kds);
+		gpuscan->m_kds_dst = gpuMemAlloc(&gpuscan->task, length);
+		if (!gpuscan->m_kds_dst)
+			goto out_of_resource;
+	}
+
 	/*
 	 * Creation of event objects, if any
 	 */
@@ -1130,6 +2310,13 @@ __pgstrom_process_gpuscan(pgstrom_gpuscan *gpuscan)
 		if (rc != CUDA_SUCCESS)
 			elog(ERROR, "failed on cuEventCreate: %s", errorText(rc));
 
+		if (pds_dst)
+		{
+			rc = cuEventCreate(&gpuscan->ev_kern_qual_end, CU_EVENT_DEFAULT);
+			if (rc != CUDA_SUCCESS)
+				elog(ERROR, "failed on cuEventCreate: %s", errorText(rc));
+		}
+
 		rc = cuEventCreate(&gpuscan->ev_dma_recv_start, CU_EVENT_DEFAULT);
 		if (rc != CUDA_SUCCESS)
 			elog(ERROR, "failed on cuEventCreate: %s", errorText(rc));
@@ -1164,6 +2351,19 @@ __pgstrom_process_gpuscan(pgstrom_gpuscan *gpuscan)
 	gpuscan->task.pfm.bytes_dma_send += kds->length;
     gpuscan->task.pfm.num_dma_send++;
 
+	if (pds_dst)
+	{
+		length = KERN_DATA_STORE_HEAD_LENGTH(pds_dst->kds);
+		rc = cuMemcpyHtoDAsync(gpuscan->m_kds_dst,
+							   pds_dst->kds,
+							   length,
+							   gpuscan->task.cuda_stream);
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "failed on cuMemcpyHtoDAsync: %s", errorText(rc));
+		gpuscan->task.pfm.bytes_dma_send += length;
+		gpuscan->task.pfm.num_dma_send++;
+	}
+
 	CUDA_EVENT_RECORD(gpuscan, ev_dma_send_stop);
 
 	/*
@@ -1191,6 +2391,40 @@ __pgstrom_process_gpuscan(pgstrom_gpuscan *gpuscan)
 		elog(ERROR, "failed on cuLaunchKernel: %s", errorText(rc));
 	gpuscan->task.pfm.num_kern_qual++;
 
+	/*
+	 * Launch:
+	 * KERNEL_FUNCTION(void)
+	 * gpuscan_projection_slot(kern_gpuscan *kgpuscan,
+	 *                         kern_data_store *kds_src,
+	 *                         kern_data_store *kds_dst)
+	 */
+	if (pds_dst)
+	{
+		CUDA_EVENT_RECORD(gpuscan, ev_kern_qual_end);
+
+		pgstrom_compute_workgroup_size(&grid_size,
+									   &block_size,
+									   gpuscan->kern_proj,
+									   gpuscan->task.cuda_device,
+									   false,
+									   kds->nitems,
+									   sizeof(cl_uint));
+		gpuscan->kern_qual_args[0] = &gpuscan->m_gpuscan;
+		gpuscan->kern_qual_args[1] = &gpuscan->m_kds;
+		gpuscan->kern_qual_args[2] = &gpuscan->m_kds_dst;
+
+		rc = cuLaunchKernel(gpuscan->kern_proj,
+							grid_size, 1, 1,
+							block_size, 1, 1,
+							sizeof(uint) * block_size,
+							gpuscan->task.cuda_stream,
+							gpuscan->kern_qual_args,
+							NULL);
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "failed on cuLaunchKernel: %s", errorText(rc));
+		gpuscan->task.pfm.num_kern_proj++;
+	}
+
 	/*
 	 * Recv DMA call
 	 */
@@ -1207,6 +2441,19 @@ __pgstrom_process_gpuscan(pgstrom_gpuscan *gpuscan)
 	gpuscan->task.pfm.bytes_dma_recv += length;
 	gpuscan->task.pfm.num_dma_recv++;
 
+	if (pds_dst)
+	{
+		length = KERN_DATA_STORE_LENGTH(pds_dst->kds);
+		rc = cuMemcpyDtoHAsync(pds_dst->kds,
+							   gpuscan->m_kds_dst,
+							   length,
+							   gpuscan->task.cuda_stream);
+		if (rc != CUDA_SUCCESS)
+			elog(ERROR, "cuMemcpyDtoHAsync: %s", errorText(rc));
+		gpuscan->task.pfm.bytes_dma_recv += length;
+		gpuscan->task.pfm.num_dma_recv++;
+	}
+
 	CUDA_EVENT_RECORD(gpuscan, ev_dma_recv_stop);
 
 	/*
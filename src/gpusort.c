@@ -17,21 +17,32 @@
  */
 #include "postgres.h"
 #include "access/xact.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_collation.h"
+#include "catalog/pg_opfamily.h"
 #include "catalog/pg_type.h"
 #include "commands/dbcommands.h"
+#include "commands/defrem.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/makefuncs.h"
 #include "optimizer/cost.h"
 #include "parser/parsetree.h"
 #include "postmaster/bgworker.h"
 #include "storage/dsm.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/pg_locale.h"
 #include "utils/ruleutils.h"
 #include "utils/snapmgr.h"
 #include "pg_strom.h"
 #include "cuda_gpusort.h"
+#include <math.h>
+#include <sys/mman.h>
 
 typedef struct
 {
@@ -47,6 +58,10 @@ typedef struct
 	Oid		   *collations;		/* OIDs of collations */
 	bool	   *nullsFirst;		/* NULLS FIRST/LAST directions */
 	bool		varlena_keys;	/* True, if here are varlena keys */
+	bool		outer_bulkload;	/* True, if bulk-load from the outer */
+	long		sort_bound;		/* number of rows required, if top-N */
+	bool		key_only;		/* True, if only keys are projected */
+	bool	   *xfrmKeys;		/* True, if sorted by strxfrm() image */
 } GpuSortInfo;
 
 static inline void
@@ -80,6 +95,16 @@ form_gpusort_info(CustomScan *cscan, GpuSortInfo *gs_info)
 	privs = lappend(privs, temp);
 	/* varlena_keys */
 	privs = lappend(privs, makeInteger(gs_info->varlena_keys));
+	/* outer_bulkload */
+	privs = lappend(privs, makeInteger(gs_info->outer_bulkload));
+	/* sort_bound */
+	privs = lappend(privs, makeInteger(gs_info->sort_bound));
+	/* key_only */
+	privs = lappend(privs, makeInteger(gs_info->key_only));
+	/* xfrmKeys */
+	for (temp = NIL, i=0; i < gs_info->numCols; i++)
+		temp = lappend_int(temp, gs_info->xfrmKeys[i]);
+	privs = lappend(privs, temp);
 
 	cscan->custom_private = privs;
 }
@@ -133,6 +158,19 @@ deform_gpusort_info(CustomScan *cscan)
 		gs_info->nullsFirst[i++] = lfirst_int(cell);
 	/* varlena_keys */
 	gs_info->varlena_keys = intVal(list_nth(privs, pindex++));
+	/* outer_bulkload */
+	gs_info->outer_bulkload = intVal(list_nth(privs, pindex++));
+	/* sort_bound */
+	gs_info->sort_bound = intVal(list_nth(privs, pindex++));
+	/* key_only */
+	gs_info->key_only = intVal(list_nth(privs, pindex++));
+	/* xfrmKeys */
+	temp = list_nth(privs, pindex++);
+	Assert(list_length(temp) == gs_info->numCols);
+	gs_info->xfrmKeys = palloc0(sizeof(bool) * gs_info->numCols);
+	i = 0;
+	foreach (cell, temp)
+		gs_info->xfrmKeys[i++] = lfirst_int(cell);
 
 	return gs_info;
 }
@@ -172,6 +210,7 @@ typedef struct
 	 * Fields to run CPU sorting             *
 	 * ------------------------------------- */
 	BackgroundWorkerHandle *bgw_handle;
+	bool				bgw_pooled;		/* true, if submitted to the pool */
 	/* connection info */
 	PGPROC			   *backend_proc;
 	char			   *database_name;
@@ -181,6 +220,9 @@ typedef struct
 	cl_uint				num_chunks;
 	kern_data_store	  **kern_toasts;
 	kern_data_store	  **kern_chunks;
+	cl_uint				keyprefix_len;	/* length of normalized key prefix */
+	bool				keyprefix_exact;
+	char			  **kern_kprefix;	/* key prefix array of the chunks */
 	/* definition of relation and sorting keys (BGW context only) */
 	TupleDesc			tupdesc;
 	int					numCols;
@@ -199,6 +241,7 @@ typedef struct
 	Size			database_name;	/* offset from data[] */
 	/* IPC stuff */
 	volatile bool	bgw_done;	/* flag to inform BGW gets completed */
+	bool			host_registered;	/* registered by cuMemHostRegister */
 	struct timeval	tv_bgw_launch;
 	struct timeval	tv_sort_start;
 	struct timeval	tv_sort_end;
@@ -208,6 +251,8 @@ typedef struct
 	cl_uint			varlena_keys;
 	cl_uint			num_chunks;
 	Size			kern_chunks;	/* offset from data[] */
+	cl_uint			keyprefix_len;	/* length of normalized key prefix */
+	bool			keyprefix_exact;	/* prefix covers all the keys */
 	/* definition of relation and sorting keys */
 	Size			tupdesc;		/* offset from data[] */
 	int				numCols;
@@ -215,6 +260,8 @@ typedef struct
 	Size			sortOperators;	/* offset from data[] */
 	Size			collations;		/* offset from data[] */
 	Size			nullsFirst;		/* offset from data[] */
+	/* sorted run spilled out to the temporary file, if any */
+	char			run_fname[MAXPGPATH];
 	char			data[FLEXIBLE_ARRAY_MEMBER];
 } pgstrom_flat_gpusort;
 
@@ -223,8 +270,70 @@ typedef struct
 	 (((pgstrom_flat_gpusort *)dsm_segment_address(dsmseg))->data +		\
 	  ((pgstrom_flat_gpusort *)dsm_segment_address(dsmseg))->kresults_ofs))
 
+#define GPUSORT_RUN_IS_SPILLED(dsmseg)									\
+	(((pgstrom_flat_gpusort *)											\
+	  dsm_segment_address(dsmseg))->run_fname[0] != '\0')
+
 #define MAX_MERGECHUNKS_CLASS		10		/* 1024 chunks are enough large */
 
+/*
+ * Upper limit of the fan-in of the final k-way merge. Every run holds
+ * a read buffer, and a file descriptor if spilled, during the final merge,
+ * so extra runs are merged pairwise until the limit. It has to be equal
+ * or larger than MAX_MERGECHUNKS_CLASS, because all the runs being kept
+ * in sorted_chunks[] become inputs of the final merge.
+ */
+#define MAX_FINAL_MERGE_RUNS		16
+
+/*
+ * Normalized key prefix
+ *
+ * Sorting keys of the well-known data types are encoded to a binary string
+ * once per row, in order preserving manner with NULL ordering and DESC
+ * folded in. So, merge steps can compare rows using memcmp(), then call
+ * the full comparators only when prefixes are equal. If the prefix covers
+ * all the sorting keys without any loss (keyprefix_exact), equal prefixes
+ * mean equal rows.
+ * The prefix array of a chunk is put on the file of the chunk, next to
+ * the slot format data store.
+ */
+#define GPUSORT_KEYPREFIX_LEN		16
+
+#define GPUSORT_KEYPREFIX_NONE		0
+#define GPUSORT_KEYPREFIX_BOOL		1
+#define GPUSORT_KEYPREFIX_INT2		2
+#define GPUSORT_KEYPREFIX_INT4		3
+#define GPUSORT_KEYPREFIX_INT8		4
+#define GPUSORT_KEYPREFIX_FLOAT4	5
+#define GPUSORT_KEYPREFIX_FLOAT8	6
+#define GPUSORT_KEYPREFIX_NUMERIC	7	/* lossy; encoded as float8 */
+#define GPUSORT_KEYPREFIX_XFRM		8	/* lossy; head of strxfrm() image */
+
+#define GPUSORT_KEYPREFIX_OFFSET(pds)									\
+	((pds)->kds_offset + TYPEALIGN(BLCKSZ, (pds)->kds_length))
+
+/*
+ * gpusort_run - an accessor to the sorted run (array of chunk_id/item_id
+ * pair) that is either on the DSM or spilled out to the temporary file.
+ * Items on the file are read/written through a small buffer, so merging
+ * of the runs needs only bounded amount of memory.
+ */
+#define GPUSORT_RUN_BUFSZ			8192	/* # of items per buffer */
+#define GPUSORT_ERRMSG_LEN			80
+#define GPUSORT_DSM_CACHE_SIZE		8
+#define GPUSORT_DSM_CACHE_MAXLEN	(64UL << 20)
+
+typedef struct
+{
+	kern_resultbuf *kresults;		/* header, and items if on the DSM */
+	const char	   *fname;			/* filename, if spilled */
+	int				fdesc;			/* file descriptor, or -1 if on DSM */
+	cl_long			buf_base;		/* index of the first item on buffer */
+	cl_int			buf_nitems;		/* number of valid items on buffer */
+	bool			buf_dirty;		/* true, if buffer needs to be written */
+	cl_int			buffer[2 * GPUSORT_RUN_BUFSZ];
+} gpusort_run;
+
 typedef struct
 {
 	GpuTaskState	gts;
@@ -247,22 +356,128 @@ typedef struct
 	bool			varlena_keys;	/* True, if varlena sorting key exists */
 	SortSupportData *ssup_keys;		/* XXX - used by fallback function */
 
+	/*
+	 * key-only mode; slot format chunks have only sorting keys, and rows
+	 * are fetched from the row format chunks on output.
+	 */
+	bool			key_only;
+	TupleDesc		kds_tupdesc;	/* tuple descriptor of slot format */
+	AttrNumber	   *kds_colidx;		/* attnum of sorting keys in kds */
+	Oid			   *kds_sortops;	/* operators to sort keys in kds */
+	Oid			   *kds_collations;	/* collations of keys in kds */
+
+	/*
+	 * text keys sorted by their strxfrm() image; the images are appended
+	 * to the row format chunk as hidden attributes, then compared bytewise
+	 * on both of GPU and CPU.
+	 */
+	bool		   *xfrm_keys;		/* True, if key is transformed */
+	cl_int			num_xfrm_keys;	/* number of transformed keys */
+	pg_locale_t	   *xfrm_locales;	/* locale of the transformed keys */
+	TupleDesc		row_tupdesc;	/* tuple descriptor of row format */
+	AttrNumber	   *row_colidx;		/* attnum of sorting keys in row */
+	TupleTableSlot *xfrm_slot;		/* slot of row format */
+	Datum		   *xfrm_values;
+	bool		   *xfrm_isnull;
+	MemoryContext	xfrm_memcxt;	/* per-row memory for transformed keys */
+
+	/* normalized key prefix */
+	cl_uint			keyprefix_len;	/* 0, if no keys can be encoded */
+	bool			keyprefix_exact;	/* prefix covers all the keys */
+	cl_int		   *keyprefix_kinds;	/* GPUSORT_KEYPREFIX_* of the keys */
+	char		  **kprefix_chunks;	/* key prefix array of the chunks */
+
+	/* bulk-input from the outer node */
+	BulkInputState	bulk_input;
+
 	/* running status */
 	char		   *database_name;	/* name of the current database */
 	/* chunks already sorted but no pair yet */
 	pgstrom_gpusort	*sorted_chunks[MAX_MERGECHUNKS_CLASS];
 	bool			sort_done;		/* if true, now ready to fetch records */
 	cl_int			cpusort_seqno;	/* seqno of cpusort to launch */
+	cl_uint			num_cpusort_running; /* # of CPU merges in progress */
 
 	/* random access capability */
 	bool			randomAccess;
 	cl_long			markpos_index;
 
-	/* final result */
+	/*
+	 * bounded (top-N) sorting; once we have a sorted result with more than
+	 * sort_bound rows, the sort_bound'th row performs as a threshold to
+	 * discard the upcoming rows which never appear in the final result.
+	 */
+	cl_long			sort_bound;		/* 0, if unbounded */
+	TupleTableSlot *bound_slot;		/* current threshold row */
+	TupleTableSlot *bound_temp;		/* temp slot to fetch a candidate */
+	HeapTupleData	bound_tuple_buf;
+	cl_ulong		bound_nfiltered;	/* # of rows discarded by threshold */
+
+	/* sorted runs on the DSM; spilled out to files once over the limit */
+	Size			run_mem_usage;	/* bytes of sorted runs on the DSM */
+	cl_uint			num_spilled_runs;	/* # of runs written to files */
+
+	/* DSM segments of released runs, to be reused for the upcoming runs */
+	cl_uint			num_dsm_cache;
+	dsm_segment	   *dsm_cache[GPUSORT_DSM_CACHE_SIZE];
+
+	/*
+	 * final result; sorted runs being left at the end of outer scan are not
+	 * merged by CPU merge workers any more, but merged on the fly using a
+	 * tournament tree (winner tree) of the runs.
+	 */
+	cl_uint			num_final_runs;
+	pgstrom_gpusort **final_tasks;	/* tasks that own the sorted runs */
+	gpusort_run	  **final_runs;		/* accessors to the sorted runs */
+	cl_long		   *final_index;	/* current position of the runs */
+	cl_long		   *final_markpos;	/* saved position of the runs */
+	cl_int		   *final_heads;	/* chunk_id/item_id of the current items */
+	cl_int		   *final_tree;		/* tournament tree of the run index */
+	cl_uint			final_nleaves;	/* # of leaves of the tournament tree */
+	cl_long			final_nemitted;	/* # of rows already emitted */
 	HeapTupleData	tuple_buf;		/* temp buffer during scan */
 	TupleTableSlot *overflow_slot;
 } GpuSortState;
 
+/*
+ * CPU merge worker pool
+ *
+ * Background workers being started on the server startup, to run CPU merge
+ * sorting without launching a dynamic background worker for each step.
+ * A worker is bound to the database of the first job assigned to, then it
+ * serves only the jobs of that database, because a background worker can
+ * connect to a database only once.
+ * A bound worker exits once it gets idle for GPUSORT_POOL_IDLE_TIMEOUT
+ * seconds, then the postmaster restarts it as an unbound one. It is
+ * shorter than the time DROP DATABASE waits for other sessions to go away.
+ */
+#define GPUSORT_POOL_QUEUE_SIZE		256
+#define GPUSORT_POOL_IDLE_TIMEOUT	3
+
+typedef struct
+{
+	dsm_handle		dsm_hnd;		/* DSM of pgstrom_flat_gpusort */
+	Oid				database_oid;	/* database to run the job */
+	cl_uint			worker_index;	/* worker being assigned to */
+} gpusort_pool_job;
+
+typedef struct
+{
+	PGPROC		   *proc;			/* PGPROC of the worker, if running */
+	Oid				database_oid;	/* database bound to, if any */
+	cl_uint			num_jobs;		/* # of jobs being assigned to */
+	bool			is_busy;		/* true, if a job is running */
+} gpusort_pool_worker;
+
+typedef struct
+{
+	slock_t			lock;
+	cl_uint			num_jobs;
+	gpusort_pool_job jobs[GPUSORT_POOL_QUEUE_SIZE];
+	cl_uint			num_workers;
+	gpusort_pool_worker workers[FLEXIBLE_ARRAY_MEMBER];
+} gpusort_pool_head;
+
 /*
  * declaration of static variables and functions
  */
@@ -270,7 +485,13 @@ static CustomScanMethods	gpusort_scan_methods;
 static CustomExecMethods	gpusort_exec_methods;
 static bool					enable_gpusort;
 static bool					debug_force_gpusort;
+static bool					enable_gpusort_key_only;
+static bool					enable_gpusort_strxfrm;
 static int					gpusort_max_workers;
+static int					gpusort_pool_workers;
+static int					gpusort_spill_threshold_kb;
+static shmem_startup_hook_type shmem_startup_next;
+static gpusort_pool_head   *gpusort_pool = NULL;
 
 static GpuTask *gpusort_next_chunk(GpuTaskState *gts);
 static TupleTableSlot *gpusort_next_tuple(GpuTaskState *gts);
@@ -284,9 +505,31 @@ static dsm_segment *form_pgstrom_flat_gpusort(GpuSortState *gss,
 											  pgstrom_gpusort *l_gpusort,
 											  pgstrom_gpusort *r_gpusort);
 static pgstrom_gpusort *deform_pgstrom_flat_gpusort(dsm_segment *dsm_seg);
-static void gpusort_fallback_quicksort(GpuSortState *gss,
-									   pgstrom_gpusort *gpusort);
+static void gpusort_fallback_sort(GpuSortState *gss,
+								  pgstrom_gpusort *gpusort);
+static SortSupport gpusort_setup_sortsupport(GpuSortState *gss);
+static int gpusort_compare_slots(GpuSortState *gss,
+								 TupleTableSlot *a, TupleTableSlot *b);
+static void gpusort_update_bound(GpuSortState *gss, pgstrom_gpusort *gpusort);
 static void bgw_cpusort_entrypoint(Datum main_arg);
+static void bgw_cpusort_pool_entrypoint(Datum main_arg);
+static bool gpusort_pool_submit(dsm_handle dsm_hnd);
+static void pgstrom_startup_gpusort(void);
+static dsm_segment *gpusort_create_dsm(GpuSortState *gss, Size length);
+static void gpusort_run_open(gpusort_run *run, dsm_segment *dsm_seg);
+static void gpusort_run_close(gpusort_run *run);
+static void gpusort_run_read(gpusort_run *run, cl_long index,
+							 cl_int *p_chunk_id, cl_int *p_item_id);
+static void gpusort_spill_run(GpuSortState *gss, pgstrom_gpusort *gpusort);
+static void gpusort_release_run(GpuSortState *gss, dsm_segment *dsm_seg);
+static void gpusort_final_merge_rebuild(GpuSortState *gss);
+static void gpusort_final_merge_cleanup(GpuSortState *gss);
+static void gpusort_setup_xfrm_keys(GpuSortState *gss, bool *xfrm_keys);
+static TupleTableSlot *gpusort_transform_slot(GpuSortState *gss,
+											  TupleTableSlot *slot);
+static void gpusort_setup_keyprefix(GpuSortState *gss);
+static void gpusort_make_keyprefix(GpuSortState *gss, cl_int chunk_id);
+static void gpusort_release_keyprefix(GpuSortState *gss);
 
 /*
  * cost_gpusort
@@ -298,14 +541,15 @@ static void bgw_cpusort_entrypoint(Datum main_arg);
 static void
 cost_gpusort(Cost *p_startup_cost, Cost *p_total_cost,
 			 long *p_num_chunks, Size *p_chunk_size,
-			 Plan *subplan)
+			 Plan *subplan, long sort_bound)
 {
 	Cost	subplan_total = subplan->total_cost;
 	double	ntuples = subplan->plan_rows;
+	double	ntuples_out;
 	int		width = subplan->plan_width;
 	int		nattrs = list_length(subplan->targetlist);
 	Cost	cpu_comp_cost = 2.0 * cpu_operator_cost;
-	Cost	gpu_comp_cost = 2.0 * pgstrom_gpu_operator_cost;
+	Cost	gpu_comp_cost;
 	Cost	startup_cost = subplan_total;
 	Cost	run_cost = 0.0;
 	double	nrows_per_chunk;
@@ -314,13 +558,21 @@ cost_gpusort(Cost *p_startup_cost, Cost *p_total_cost,
 	Size	chunk_head;
 	Size	chunk_size;
 	Size	chunk_size_both;
+	GpuCostCoeff coeff;
 
 	if (ntuples < 2.0)
 		ntuples = 2.0;
+	/* top-N sorting returns no more than sort_bound rows */
+	if (sort_bound > 0 && sort_bound < ntuples)
+		ntuples_out = (double) sort_bound;
+	else
+		ntuples_out = ntuples;
 	/*
 	 * Fixed cost to kick GPU kernel
 	 */
-	startup_cost += pgstrom_gpu_setup_cost;
+	pgstrom_get_cost_coeff(GpuCostNodeSort, &coeff);
+	gpu_comp_cost = 2.0 * coeff.operator_cost;
+	startup_cost += coeff.setup_cost;
 
 	/*
 	 * calculate expected number of rows per chunk and number of chunks.
@@ -364,15 +616,25 @@ cost_gpusort(Cost *p_startup_cost, Cost *p_total_cost,
 
 	/*
 	 * We'll also use CPU based merge sort, if # of chunks > 1.
+	 * In case of top-N sorting, rows worse than the threshold shall be
+	 * discarded on loading, so we need to compare every input rows.
 	 */
 	if (num_chunks > 1)
 		startup_cost += cpu_comp_cost *
 			(double) num_chunks * LOG2((double) num_chunks);
+	if (ntuples_out < ntuples)
+		startup_cost += cpu_comp_cost * ntuples;
+
+	/* extra cost to move the tuples to device */
+	startup_cost += coeff.tuple_cost * ntuples;
 
 	/*
 	 * Cost to communicate with upper node
 	 */
-	run_cost += cpu_operator_cost * ntuples;
+	run_cost += cpu_operator_cost * ntuples_out;
+
+	/* materialization of the sorted result */
+	run_cost += coeff.byte_cost * ntuples_out * subplan->plan_width;
 
 	/* result */
     *p_startup_cost = startup_cost;
@@ -387,6 +649,7 @@ cost_gpusort(Cost *p_startup_cost, Cost *p_total_cost,
 static void
 gpusort_projection_addcase(StringInfo body,
 						   AttrNumber resno,
+						   int slot_index,
 						   Oid type_oid,
 						   int type_len,
 						   bool type_byval,
@@ -427,9 +690,9 @@ gpusort_projection_addcase(StringInfo body,
 			is_sortkey ? "sortkey" : "attribute",
 			resno,
 			resno - 1,
-			resno - 1,
-			resno - 1,
-			resno - 1,
+			slot_index,
+			slot_index,
+			slot_index,
 			type_cast);
 	}
 	else if (type_oid == NUMERICOID && is_sortkey)
@@ -454,9 +717,9 @@ gpusort_projection_addcase(StringInfo body,
 			"  }\n",
 			resno,
 			resno - 1,
-			resno - 1,
-			resno - 1,
-			resno - 1);
+			slot_index,
+			slot_index,
+			slot_index);
 	}
 	else
 	{
@@ -478,15 +741,16 @@ gpusort_projection_addcase(StringInfo body,
 			"  }\n",
 			resno,
 			resno - 1,
-			resno - 1,
-			resno - 1,
-			resno - 1);
+			slot_index,
+			slot_index,
+			slot_index);
 	}
 }
 
 static void
 gpusort_fixupvar_addcase(StringInfo body,
 						 AttrNumber resno,
+						 int slot_index,
 						 Oid type_oid,
 						 int type_len,
 						 bool type_byval,
@@ -515,13 +779,14 @@ gpusort_fixupvar_addcase(StringInfo body,
 		is_sortkey ? "sortkey" : "attribute",
 		resno,
 		resno - 1,
-		resno - 1,
-		resno - 1,
-		resno - 1);
+		slot_index,
+		slot_index,
+		slot_index);
 }
 
 static char *
-pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
+pgstrom_gpusort_codegen(Sort *sort, bool key_only, bool *xfrm_keys,
+						codegen_context *context)
 {
 	StringInfoData	pj_body;
 	StringInfoData	fv_body;
@@ -529,6 +794,7 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 	StringInfoData	kc_body;
 	StringInfoData	result;
 	ListCell	   *cell;
+	AttrNumber		xfrm_resno = list_length(sort->plan.targetlist);
 	int				i;
 
 	initStringInfo(&pj_body);
@@ -572,6 +838,13 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 				 colidx, nodeToString(tle->expr));
 		sort_type = exprType((Node *) tle->expr);
 
+		/* strxfrm() image of the key is compared bytewise */
+		if (xfrm_keys[i])
+		{
+			sort_type = TEXTOID;
+			sort_collid = C_COLLATION_OID;
+		}
+
 		dtype = pgstrom_devtype_lookup_and_track(sort_type, context);
 		if (!dtype)
 			elog(ERROR, "device type %u lookup failed", sort_type);
@@ -588,7 +861,8 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 		 * reference to X-variable / Y-variable
 		 *
 		 * Because KDS has tuple-slot format, colidx should be index
-		 * from the sortkyes array, not resno on host-side.
+		 * from the sortkyes array, not resno on host-side. In key-only
+		 * mode, KDS has only sorting keys in order of the sortColIdx.
 		 */
 		appendStringInfo(
 			&kc_decl,
@@ -614,8 +888,8 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 			"  else if (!KVAR_X%d.isnull && KVAR_Y%d.isnull)\n"
 			"    return %d;\n",
 			colidx,
-			i+1, dtype->type_name, colidx-1,
-			i+1, dtype->type_name, colidx-1,
+			i+1, dtype->type_name, key_only ? i : colidx-1,
+			i+1, dtype->type_name, key_only ? i : colidx-1,
 			i+1, i+1,
 			dfunc->func_alias, i+1, i+1,
 			is_reverse ? "-comp.value" : "comp.value",
@@ -624,8 +898,34 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 	}
 
 	/*
-	 * Make projection / fixup-variable code
+	 * Make projection / fixup-variable code. In key-only mode, only the
+	 * sorting keys are projected; payload columns are fetched from the
+	 * row-format store when the row is emitted. strxfrm() images of the
+	 * transformed keys are hidden attributes next to the target list.
 	 */
+	for (i=0; key_only && i < sort->numCols; i++)
+	{
+		TargetEntry	   *tle = get_tle_by_resno(sort->plan.targetlist,
+											   sort->sortColIdx[i]);
+		AttrNumber		resno = tle->resno;
+		Oid				type_oid = exprType((Node *) tle->expr);
+		int				type_len;
+		bool			type_byval;
+
+		if (xfrm_keys[i])
+		{
+			resno = ++xfrm_resno;
+			type_oid = TEXTOID;
+		}
+		type_len = get_typlen(type_oid);
+		type_byval = get_typbyval(type_oid);
+
+		gpusort_projection_addcase(&pj_body, resno, i, type_oid,
+								   type_len, type_byval, true);
+		gpusort_fixupvar_addcase(&fv_body, resno, i, type_oid,
+								 type_len, type_byval, true);
+	}
+
 	foreach (cell, sort->plan.targetlist)
 	{
 		TargetEntry	   *tle = lfirst(cell);
@@ -634,6 +934,8 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 		bool			type_byval = get_typbyval(type_oid);
 		bool			is_sortkey = false;
 
+		if (key_only)
+			break;
 		for (i=0; i < sort->numCols; i++)
 		{
 			if (tle->resno == sort->sortColIdx[i])
@@ -642,10 +944,12 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 				break;
 			}
 		}
-		gpusort_projection_addcase(&pj_body, tle->resno, type_oid,
-								   type_len, type_byval, is_sortkey);
-		gpusort_fixupvar_addcase(&fv_body, tle->resno, type_oid,
-								 type_len, type_byval, is_sortkey);
+		gpusort_projection_addcase(&pj_body, tle->resno, tle->resno - 1,
+								   type_oid, type_len, type_byval,
+								   is_sortkey);
+		gpusort_fixupvar_addcase(&fv_body, tle->resno, tle->resno - 1,
+								 type_oid, type_len, type_byval,
+								 is_sortkey);
 	}
 
 	/* functions declarations */
@@ -704,8 +1008,60 @@ pgstrom_gpusort_codegen(Sort *sort, codegen_context *context)
 	return result.data;
 }
 
+/*
+ * gpusort_check_xfrm_key
+ *
+ * It checks whether a text key in non-C collation can be sorted by bytewise
+ * comparison of its strxfrm() image, instead of the locale aware comparison
+ * that is not available on the device.
+ */
+static bool
+gpusort_check_xfrm_key(Oid type_oid, Oid sort_op, Oid collid)
+{
+	devtype_info   *dtype;
+	Oid				opfamily;
+	Oid				opcintype;
+	Oid				opclass;
+	int16			strategy;
+
+	if (!enable_gpusort_strxfrm)
+		return false;
+	if (type_oid != TEXTOID && type_oid != BPCHAROID)
+		return false;
+	if (!OidIsValid(collid) || lc_collate_is_c(collid))
+		return false;
+#ifndef HAVE_LOCALE_T
+	if (collid != DEFAULT_COLLATION_OID)
+		return false;
+#endif
+	/* only the default ordering of the type follows the collation */
+	if (!get_ordering_op_properties(sort_op,
+									&opfamily,
+									&opcintype,
+									&strategy))
+		return false;
+	opclass = GetDefaultOpClass(type_oid, BTREE_AM_OID);
+	if (!OidIsValid(opclass) || get_opclass_family(opclass) != opfamily)
+		return false;
+
+	/* images are compared as text in C collation */
+	dtype = pgstrom_devtype_lookup(TEXTOID);
+	if (!dtype || !OidIsValid(dtype->type_cmpfunc) ||
+		!pgstrom_devfunc_lookup(dtype->type_cmpfunc, C_COLLATION_OID))
+		return false;
+
+	return true;
+}
+
+/*
+ * pgstrom_try_insert_gpusort
+ *
+ * It tries to replace the supplied Sort node by GpuSort. If sort_bound is
+ * larger than zero, the caller (Limit node) needs only the first sort_bound
+ * rows, so GpuSort runs in bounded (top-N) mode.
+ */
 void
-pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan)
+pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan, long sort_bound)
 {
 	Sort	   *sort = (Sort *)(*p_plan);
 	List	   *tlist = sort->plan.targetlist;
@@ -716,9 +1072,14 @@ pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan)
 	Size		chunk_size;
 	CustomScan *cscan;
 	Plan	   *subplan;
+	Plan	   *alter_plan;
 	GpuSortInfo	gs_info;
 	codegen_context context;
 	bool		varlena_keys = false;
+	bool		outer_bulkload = false;
+	bool		key_only;
+	bool	   *xfrm_keys;
+	int			num_xfrm_keys = 0;
 	int			i;
 
 	/* nothing to do, if feature is turned off */
@@ -731,6 +1092,7 @@ pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan)
 	Assert(sort->plan.righttree == NULL);
 	subplan = outerPlan(sort);
 
+	xfrm_keys = palloc0(sizeof(bool) * sort->numCols);
 	for (i=0; i < sort->numCols; i++)
 	{
 		TargetEntry	   *tle = get_tle_by_resno(tlist, sort->sortColIdx[i]);
@@ -754,19 +1116,52 @@ pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan)
 		dfunc = pgstrom_devfunc_lookup(dtype->type_cmpfunc,
 									   sort->collations[i]);
 		if (!dfunc)
-			return;
+		{
+			if (!gpusort_check_xfrm_key(dtype->type_oid,
+										sort->sortOperators[i],
+										sort->collations[i]))
+				return;
+			xfrm_keys[i] = true;
+			num_xfrm_keys++;
+		}
 
 		/* Does key contain varlena data type? */
 		if ((dtype->type_flags & DEVTYPE_IS_VARLENA) != 0)
 			varlena_keys = true;
 	}
 
+	/*
+	 * If the underlying node can deliver its rows by chunks, we don't need
+	 * to pay per-tuple overhead to build sorting chunks. It is not a case
+	 * if strxfrm() image of the keys has to be made for each row.
+	 */
+	if (num_xfrm_keys == 0 &&
+		(IsA(subplan, SeqScan) || IsA(subplan, CustomScan)))
+	{
+		alter_plan = pgstrom_try_replace_bulk_input(subplan, pstmt->rtable);
+		if (alter_plan)
+		{
+			subplan = alter_plan;
+			outer_bulkload = true;
+		}
+	}
+
 	/*
 	 * OK, cost estimation with GpuSort
 	 */
 	cost_gpusort(&startup_cost, &total_cost,
 				 &num_chunks, &chunk_size,
-				 subplan);
+				 subplan, sort_bound);
+
+	/* strxfrm() is likely as expensive as a comparison */
+	if (num_xfrm_keys > 0)
+	{
+		Cost	xfrm_cost = (2.0 * cpu_operator_cost * num_xfrm_keys *
+							 subplan->plan_rows);
+
+		startup_cost += xfrm_cost;
+		total_cost += xfrm_cost;
+	}
 
 	elog(DEBUG1,
 		 "GpuSort (cost=%.2f..%.2f) has%sadvantage to Sort (cost=%.2f..%.2f)",
@@ -827,8 +1222,18 @@ pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan)
 		((CustomScan *) subplan)->flags |= CUSTOMPATH_PREFERE_ROW_FORMAT;
 	outerPlan(cscan) = subplan;
 
+	/*
+	 * If any payload columns exist, only the sorting keys are projected
+	 * to the slot format chunk for sorting. Transformed keys always need
+	 * key-only mode, because the slot format chunk has their images.
+	 */
+	key_only = (num_xfrm_keys > 0 ||
+				(enable_gpusort_key_only &&
+				 sort->numCols < list_length(tlist)));
+
 	pgstrom_init_codegen_context(&context);
-	gs_info.kern_source = pgstrom_gpusort_codegen(sort, &context);
+	gs_info.kern_source = pgstrom_gpusort_codegen(sort, key_only,
+												  xfrm_keys, &context);
 	gs_info.extra_flags = context.extra_flags | DEVKERNEL_NEEDS_GPUSORT;
 	gs_info.used_params = context.used_params;
 	gs_info.num_chunks = num_chunks;
@@ -839,6 +1244,10 @@ pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan)
 	gs_info.collations = sort->collations;
 	gs_info.nullsFirst = sort->nullsFirst;
 	gs_info.varlena_keys = varlena_keys;
+	gs_info.outer_bulkload = outer_bulkload;
+	gs_info.sort_bound = sort_bound;
+	gs_info.key_only = key_only;
+	gs_info.xfrmKeys = xfrm_keys;
 	form_gpusort_info(cscan, &gs_info);
 
 	*p_plan = &cscan->scan.plan;
@@ -864,6 +1273,7 @@ gpusort_begin(CustomScanState *node, EState *estate, int eflags)
 	GpuSortState   *gss = (GpuSortState *) node;
 	CustomScan	   *cscan = (CustomScan *) node->ss.ps.plan;
 	GpuSortInfo	   *gs_info = deform_gpusort_info(cscan);
+	int				i;
 
 	/* activate GpuContext for device execution */
 	if ((eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
@@ -890,6 +1300,10 @@ gpusort_begin(CustomScanState *node, EState *estate, int eflags)
 
 	/* initialize child exec node */
 	outerPlanState(gss) = ExecInitNode(outerPlan(cscan), estate, eflags);
+	gss->gts.scan_bulk =
+		(!pgstrom_bulkload_enabled ? false : gs_info->outer_bulkload);
+	if (gss->gts.scan_bulk)
+		pgstrom_init_bulk_input(&gss->bulk_input, outerPlanState(gss));
 
 	/* for GPU bitonic sorting */
 	pgstrom_assign_cuda_program(&gss->gts,
@@ -906,6 +1320,7 @@ gpusort_begin(CustomScanState *node, EState *estate, int eflags)
 							  gss->num_chunks_limit);
 	gss->pds_toasts = palloc0(sizeof(pgstrom_data_store *) *
 							  gss->num_chunks_limit);
+	gss->kprefix_chunks = palloc0(sizeof(char *) * gss->num_chunks_limit);
 	gss->chunk_size = gs_info->chunk_size;
 
 	/* sorting keys */
@@ -916,19 +1331,82 @@ gpusort_begin(CustomScanState *node, EState *estate, int eflags)
 	gss->nullsFirst = gs_info->nullsFirst;
 	gss->varlena_keys = gs_info->varlena_keys;
 	gss->ssup_keys = NULL;	/* to be initialized on demand */
+	gss->key_only = gs_info->key_only;
+	gpusort_setup_xfrm_keys(gss, gs_info->xfrmKeys);
+	if (!gss->key_only)
+	{
+		gss->kds_tupdesc = GTS_GET_SCAN_TUPDESC(&gss->gts);
+		gss->kds_colidx = gss->sortColIdx;
+	}
+	else
+	{
+		gss->kds_tupdesc = CreateTemplateTupleDesc(gss->numCols, false);
+		gss->kds_colidx = palloc(sizeof(AttrNumber) * gss->numCols);
+		for (i=0; i < gss->numCols; i++)
+		{
+			TupleDescCopyEntry(gss->kds_tupdesc, i + 1,
+							   gss->row_tupdesc, gss->row_colidx[i]);
+			gss->kds_colidx[i] = i + 1;
+		}
+	}
+	gpusort_setup_keyprefix(gss);
 
 	/* running status */
 	gss->database_name = get_database_name(MyDatabaseId);
 	memset(gss->sorted_chunks, 0, sizeof(gss->sorted_chunks));
 	gss->sort_done = false;
 	gss->cpusort_seqno = 0;
+	gss->num_cpusort_running = 0;
 	gss->overflow_slot = NULL;
+
+	/* bounded (top-N) sorting */
+	gss->sort_bound = gs_info->sort_bound;
+	if (gss->sort_bound > 0)
+	{
+		gss->bound_slot = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(gss->bound_slot, gss->row_tupdesc);
+		gss->bound_temp = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(gss->bound_temp, gss->row_tupdesc);
+	}
+	gss->bound_nfiltered = 0;
+
+	/* sorted runs */
+	gss->run_mem_usage = 0;
+	gss->num_spilled_runs = 0;
+	gss->num_dsm_cache = 0;
+
+	/* final k-way merge */
+	gss->num_final_runs = 0;
+	gss->final_tasks = palloc(sizeof(pgstrom_gpusort *) *
+							  MAX_FINAL_MERGE_RUNS);
+	gss->final_runs = NULL;
+	gss->final_index = NULL;
+	gss->final_markpos = NULL;
+	gss->final_heads = NULL;
+	gss->final_tree = NULL;
+	gss->final_nleaves = 0;
+	gss->final_nemitted = 0;
 }
 
 static TupleTableSlot *
 gpusort_exec(CustomScanState *node)
 {
-	return pgstrom_exec_gputask((GpuTaskState *) node);
+	GpuSortState   *gss = (GpuSortState *) node;
+
+	/*
+	 * Sorted runs are not delivered via the ready_tasks, so GpuTask
+	 * framework just drives the sorting until all the runs get ready.
+	 * Then, rows are fetched from the final k-way merge directly; it
+	 * does not depend on the current GpuTask, thus rescan or restore
+	 * can rewind the position of the runs at any time.
+	 */
+	if (!gss->sort_done)
+	{
+		pgstrom_exec_gputask(&gss->gts);
+		if (!gss->sort_done)
+			return NULL;	/* outer relation has no rows */
+	}
+	return gpusort_next_tuple(&gss->gts);
 }
 
 static void
@@ -948,8 +1426,16 @@ gpusort_end(CustomScanState *node)
 	 * Cleanup and relase any concurrent tasks
 	 * (including pgstrom_data_store)
 	 */
+	gpusort_final_merge_cleanup(gss);
+	gpusort_release_keyprefix(gss);
+	if (gss->gts.scan_bulk)
+		pgstrom_release_bulk_input(&gss->bulk_input);
 	pgstrom_release_gputaskstate(&gss->gts);
 
+	/* DSM segments kept for reuse */
+	while (gss->num_dsm_cache > 0)
+		dsm_detach(gss->dsm_cache[--gss->num_dsm_cache]);
+
 	//for (i=0; i < gss->num_chunks; i++)
 	//	pgstrom_release_data_store(gss->pds_chunks[i]);
 
@@ -970,8 +1456,9 @@ gpusort_rescan(CustomScanState *node)
 
 	/*
 	 * If subnode is to be rescanned then we forget previous sort results; we
-	 * have to re-read the subplan and re-sort.  Also must re-sort if the
-	 * bounded-sort parameters changed or we didn't select randomAccess.
+	 * have to re-read the subplan and re-sort. Unlike built-in Sort node,
+	 * bounded-sort parameter is fixed on the plan construction time, so
+	 * the threshold row is the only thing to be reset.
 	 *
 	 * Otherwise we can just rewind and rescan the sorted output.
 	 */
@@ -980,12 +1467,21 @@ gpusort_rescan(CustomScanState *node)
 		Size	length = sizeof(pgstrom_data_store *) * gss->num_chunks_limit;
 
 		/* cleanup and release any concurrent tasks */
+		gpusort_final_merge_cleanup(gss);
+		gpusort_release_keyprefix(gss);
 		pgstrom_cleanup_gputaskstate(&gss->gts);
+		gss->num_cpusort_running = 0;
+		gss->num_spilled_runs = 0;
 		gss->sort_done = false;
 		memset(gss->sorted_chunks, 0, sizeof(gss->sorted_chunks));
 		memset(gss->pds_chunks, 0, length);
 		memset(gss->pds_toasts, 0, length);
 		gss->num_chunks = 0;
+		if (gss->gts.scan_bulk)
+			pgstrom_release_bulk_input(&gss->bulk_input);
+		if (gss->bound_slot)
+			ExecClearTuple(gss->bound_slot);
+		gss->bound_nfiltered = 0;
 
 		/*
 		 * if chgParam of subnode is not null then plan will be re-scanned by
@@ -994,8 +1490,10 @@ gpusort_rescan(CustomScanState *node)
     }
     else
 	{
-		/* otherwise, just rewind the pointer */
-		gss->gts.curr_index = 0;
+		/* otherwise, just rewind the position of the sorted runs */
+		memset(gss->final_index, 0, sizeof(cl_long) * gss->num_final_runs);
+		gss->final_nemitted = 0;
+		gpusort_final_merge_rebuild(gss);
 	}
 }
 
@@ -1006,7 +1504,9 @@ gpusort_mark_pos(CustomScanState *node)
 
 	if (gss->sort_done)
 	{
-		gss->markpos_index = gss->gts.curr_index;
+		memcpy(gss->final_markpos, gss->final_index,
+			   sizeof(cl_long) * gss->num_final_runs);
+		gss->markpos_index = gss->final_nemitted;
 	}
 }
 
@@ -1018,7 +1518,10 @@ gpusort_restore_pos(CustomScanState *node)
 	if (gss->sort_done)
 	{
 		Assert(gss->markpos_index >= 0);
-		gss->gts.curr_index = gss->markpos_index;
+		memcpy(gss->final_index, gss->final_markpos,
+			   sizeof(cl_long) * gss->num_final_runs);
+		gss->final_nemitted = gss->markpos_index;
+		gpusort_final_merge_rebuild(gss);
 	}
 }
 
@@ -1055,6 +1558,18 @@ gpusort_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 	if (sort_keys != NIL)
 		ExplainPropertyList("Sort Key", sort_keys, es);
 
+	/* outer bulkload */
+	ExplainPropertyText("Bulkload", gss->gts.scan_bulk ? "On" : "Off", es);
+
+	/* bounded (top-N) sorting */
+	if (gs_info->sort_bound > 0)
+	{
+		ExplainPropertyLong("Sort Bound", gs_info->sort_bound, es);
+		if (es->analyze)
+			ExplainPropertyLong("Rows Removed by Bound",
+								gss->bound_nfiltered, es);
+	}
+
 	/*
 	 * shows resource consumption, if executed and have more than zero
 	 * rows.
@@ -1066,7 +1581,11 @@ gpusort_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 		char		sort_resource[128];
 		Size		total_consumption = 0UL;
 
-		if (gss->num_chunks > 1)
+		if (gss->sort_bound > 0)
+			sort_method = (gss->num_chunks > 1
+						   ? "GPU/Bitonic + CPU/Merge top-N"
+						   : "GPU/Bitonic top-N");
+		else if (gss->num_chunks > 1)
 			sort_method = "GPU/Bitonic + CPU/Merge";
 		else
 			sort_method = "GPU/Bitonic";
@@ -1109,6 +1628,10 @@ gpusort_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 			ExplainPropertyLong("Sort Space Used", total_consumption, es);
 			ExplainPropertyText("Sort Space Type", sort_storage, es);
 		}
+		if (gss->num_spilled_runs > 0)
+			ExplainPropertyLong("Spilled Runs", gss->num_spilled_runs, es);
+		if (gss->num_final_runs > 1)
+			ExplainPropertyLong("Final Merge Runs", gss->num_final_runs, es);
 	}
 	pgstrom_explain_gputaskstate(&gss->gts, es);
 }
@@ -1118,7 +1641,6 @@ gpusort_next_chunk(GpuTaskState *gts)
 {
 	GpuContext		   *gcontext = gts->gcontext;
 	GpuSortState	   *gss = (GpuSortState *) gts;
-	TupleDesc			tupdesc = GTS_GET_SCAN_TUPDESC(gts);
 	pgstrom_gpusort	   *gpusort = NULL;
 	pgstrom_data_store *pds = NULL;
 	pgstrom_data_store *ptoast = NULL;
@@ -1134,7 +1656,41 @@ gpusort_next_chunk(GpuTaskState *gts)
 	/*
 	 * Load tuples from the underlying plan node
 	 */
-	while (!gss->gts.scan_done)
+	while (gss->gts.scan_bulk && !gss->gts.scan_done)
+	{
+		/* Makes a sorting chunk on the first call */
+		if (!ptoast)
+		{
+			ptoast = pgstrom_create_data_store_row(gcontext,
+												   gss->row_tupdesc,
+												   gss->chunk_size,
+												   true);
+		}
+
+		/* Load rows of the outer chunks as much as possible */
+		if (pgstrom_bulk_input_load(&gss->bulk_input, ptoast))
+		{
+			gss->gts.scan_done = true;
+			if (ptoast->kds->nitems == 0)
+			{
+				pgstrom_release_data_store(ptoast);
+				ptoast = NULL;
+			}
+			break;
+		}
+
+		/* Same as row-by-row mode, try to expand the ptoast */
+		nitems = ptoast->kds->nitems;
+		length = 2 * gss->chunk_size +	/* for ktoast */
+			KERN_DATA_STORE_SLOT_LENGTH_ESTIMATION(gss->kds_tupdesc,
+												   2 * nitems);
+		if (length > gpuMemMaxAllocSize())
+			break;
+		gss->chunk_size += gss->chunk_size;
+		pgstrom_expand_data_store(gcontext, ptoast, gss->chunk_size);
+	}
+
+	while (!gss->gts.scan_bulk && !gss->gts.scan_done)
 	{
 		if (gss->overflow_slot != NULL)
 		{
@@ -1150,14 +1706,28 @@ gpusort_next_chunk(GpuTaskState *gts)
 				slot = NULL;
 				break;
 			}
+			/* makes strxfrm() image of the text keys, if any */
+			if (gss->num_xfrm_keys > 0)
+				slot = gpusort_transform_slot(gss, slot);
 		}
 		Assert(!TupIsNull(slot));
 
+		/*
+		 * In top-N mode, rows not better than the current threshold never
+		 * appear in the final result, so we don't need to sort them.
+		 */
+		if (gss->bound_slot && !TupIsNull(gss->bound_slot) &&
+			gpusort_compare_slots(gss, slot, gss->bound_slot) >= 0)
+		{
+			gss->bound_nfiltered++;
+			continue;
+		}
+
 		/* Makes a sorting chunk on the first tuple */
 		if (!ptoast)
 		{
 			ptoast = pgstrom_create_data_store_row(gcontext,
-												   tupdesc,
+												   gss->row_tupdesc,
 												   gss->chunk_size,
 												   true);
 		}
@@ -1174,7 +1744,8 @@ gpusort_next_chunk(GpuTaskState *gts)
 			 */
 			nitems = ptoast->kds->nitems;
 			length = 2 * gss->chunk_size +	/* for ktoast */
-				KERN_DATA_STORE_SLOT_LENGTH_ESTIMATION(tupdesc, 2 * nitems);
+				KERN_DATA_STORE_SLOT_LENGTH_ESTIMATION(gss->kds_tupdesc,
+													   2 * nitems);
 			if (length > gpuMemMaxAllocSize())
 				break;
 			/* OK, expand it and try again */
@@ -1190,7 +1761,7 @@ gpusort_next_chunk(GpuTaskState *gts)
 	}
 	/* Expand the backend file of the data chunk */
 	nitems = ptoast->kds->nitems;
-	pds = pgstrom_create_data_store_slot(gcontext, tupdesc,
+	pds = pgstrom_create_data_store_slot(gcontext, gss->kds_tupdesc,
 										 nitems, true, ptoast);
 	/* Save this chunk on the global array */
 	chunk_id = gss->num_chunks++;
@@ -1203,10 +1774,13 @@ gpusort_next_chunk(GpuTaskState *gts)
 								   sizeof(pgstrom_data_store *) * new_limit);
 		gss->pds_toasts = repalloc(gss->pds_toasts,
 								   sizeof(pgstrom_data_store *) * new_limit);
+		gss->kprefix_chunks = repalloc(gss->kprefix_chunks,
+									   sizeof(char *) * new_limit);
 		gss->num_chunks_limit = new_limit;
 	}
 	gss->pds_chunks[chunk_id] = pds;
 	gss->pds_toasts[chunk_id] = ptoast;
+	gss->kprefix_chunks[chunk_id] = NULL;
 
 	/* Make a shared memory segment for kern_resultbuf */
 	oitems_dsm = form_pgstrom_flat_gpusort_base(gss, chunk_id);
@@ -1227,44 +1801,281 @@ gpusort_next_chunk(GpuTaskState *gts)
 	return &gpusort->task;
 }
 
+/*
+ * gpusort_final_merge_park
+ *
+ * It keeps a sorted run as an input of the final k-way merge.
+ */
+static void
+gpusort_final_merge_park(GpuSortState *gss, pgstrom_gpusort *gpusort)
+{
+	Assert(gss->num_final_runs < MAX_FINAL_MERGE_RUNS);
+	gss->final_tasks[gss->num_final_runs++] = gpusort;
+}
+
+/*
+ * gpusort_final_merge_compare
+ *
+ * It compares the current items of the two sorted runs.
+ */
+static int
+gpusort_final_merge_compare(GpuSortState *gss, cl_int x, cl_int y)
+{
+	SortSupport		ssup_keys = gpusort_setup_sortsupport(gss);
+	cl_int		   *x_head = gss->final_heads + 2 * x;
+	cl_int		   *y_head = gss->final_heads + 2 * y;
+	kern_data_store *x_kds = gss->pds_chunks[x_head[0]]->kds;
+	kern_data_store *y_kds = gss->pds_chunks[y_head[0]]->kds;
+	Datum		   *x_values = KERN_DATA_STORE_VALUES(x_kds, x_head[1]);
+	bool		   *x_isnull = KERN_DATA_STORE_ISNULL(x_kds, x_head[1]);
+	Datum		   *y_values = KERN_DATA_STORE_VALUES(y_kds, y_head[1]);
+	bool		   *y_isnull = KERN_DATA_STORE_ISNULL(y_kds, y_head[1]);
+	int				i, comp;
+
+	/* normalized key prefix first, if any */
+	if (gss->keyprefix_len > 0)
+	{
+		comp = memcmp(gss->kprefix_chunks[x_head[0]] +
+					  gss->keyprefix_len * x_head[1],
+					  gss->kprefix_chunks[y_head[0]] +
+					  gss->keyprefix_len * y_head[1],
+					  gss->keyprefix_len);
+		if (comp != 0 || gss->keyprefix_exact)
+			return comp;
+	}
+
+	/*
+	 * NOTE: varlena datum on the slot format chunk points the toast buffer
+	 * being mapped on this backend, so no need to fix up the pointer.
+	 */
+	for (i=0; i < gss->numCols; i++)
+	{
+		SortSupport	ssup = ssup_keys + i;
+		AttrNumber	anum = gss->kds_colidx[i] - 1;
+
+		comp = ApplySortComparator(x_values[anum], x_isnull[anum],
+								   y_values[anum], y_isnull[anum],
+								   ssup);
+		if (comp != 0)
+			return comp;
+	}
+	return 0;
+}
+
+/*
+ * gpusort_final_merge_winner
+ *
+ * It returns the run that has smaller current item, or -1 if both of the
+ * runs are already exhausted.
+ */
+static inline cl_int
+gpusort_final_merge_winner(GpuSortState *gss, cl_int x, cl_int y)
+{
+	if (x < 0)
+		return y;
+	if (y < 0)
+		return x;
+	return (gpusort_final_merge_compare(gss, x, y) <= 0 ? x : y);
+}
+
+/*
+ * gpusort_final_merge_head
+ *
+ * It loads the current item of the run, then returns the run index or -1
+ * if the run is already exhausted.
+ */
+static cl_int
+gpusort_final_merge_head(GpuSortState *gss, cl_int i)
+{
+	gpusort_run	   *run = gss->final_runs[i];
+	cl_int		   *head = gss->final_heads + 2 * i;
+
+	if (gss->final_index[i] >= run->kresults->nitems)
+		return -1;
+	gpusort_run_read(run, gss->final_index[i], &head[0], &head[1]);
+	if (head[0] >= gss->num_chunks || !gss->pds_chunks[head[0]])
+		elog(ERROR, "Bug? data-store of GpuSort missing (chunk-id: %d)",
+			 head[0]);
+	return i;
+}
+
+/*
+ * gpusort_final_merge_rebuild
+ *
+ * It constructs the tournament tree according to the current position of
+ * the sorted runs. Leaves of the tree are located on final_tree[nleaves ...
+ * 2*nleaves-1], and final_tree[1] is the root that points the run with the
+ * smallest current item.
+ */
+static void
+gpusort_final_merge_rebuild(GpuSortState *gss)
+{
+	cl_uint		nleaves = gss->final_nleaves;
+	cl_int		i;
+
+	for (i=0; i < nleaves; i++)
+	{
+		gss->final_tree[nleaves + i] = (i < gss->num_final_runs
+										? gpusort_final_merge_head(gss, i)
+										: -1);
+	}
+	for (i=nleaves-1; i > 0; i--)
+		gss->final_tree[i] = gpusort_final_merge_winner(gss,
+														gss->final_tree[2*i],
+														gss->final_tree[2*i+1]);
+}
+
+/*
+ * gpusort_final_merge_begin
+ *
+ * It sets up the final k-way merge on the sorted runs being left at the
+ * end of the sorting. Instead of the last several steps of pairwise merge,
+ * that reads and writes all the items for each step, the runs are merged
+ * on the fly when gpusort_next_tuple() is called.
+ */
+static void
+gpusort_final_merge_begin(GpuSortState *gss)
+{
+	MemoryContext	memcxt = gss->gts.css.ss.ps.state->es_query_cxt;
+	cl_uint			nruns;
+	cl_uint			i;
+
+	for (i=0; i < MAX_MERGECHUNKS_CLASS; i++)
+	{
+		if (gss->sorted_chunks[i])
+		{
+			gpusort_final_merge_park(gss, gss->sorted_chunks[i]);
+			gss->sorted_chunks[i] = NULL;
+		}
+	}
+	nruns = gss->num_final_runs;
+	Assert(nruns > 0);
+
+	gss->final_nleaves = 1;
+	while (gss->final_nleaves < nruns)
+		gss->final_nleaves *= 2;
+	gss->final_runs = MemoryContextAlloc(memcxt,
+										 sizeof(gpusort_run *) * nruns);
+	gss->final_index = MemoryContextAllocZero(memcxt,
+											  sizeof(cl_long) * nruns);
+	gss->final_markpos = MemoryContextAllocZero(memcxt,
+												sizeof(cl_long) * nruns);
+	gss->final_heads = MemoryContextAlloc(memcxt,
+										  sizeof(cl_int) * 2 * nruns);
+	gss->final_tree = MemoryContextAlloc(memcxt, sizeof(cl_int) *
+										 2 * gss->final_nleaves);
+	for (i=0; i < nruns; i++)
+	{
+		gss->final_runs[i] = MemoryContextAlloc(memcxt, sizeof(gpusort_run));
+		gpusort_run_open(gss->final_runs[i],
+						 gss->final_tasks[i]->oitems_dsm);
+	}
+	gss->final_nemitted = 0;
+	elog(DEBUG1, "final merge of %u sorted runs", nruns);
+
+	gpusort_final_merge_rebuild(gss);
+}
+
+/*
+ * gpusort_final_merge_cleanup
+ *
+ * It closes the sorted runs of the final k-way merge. Owner tasks of the
+ * runs are still tracked, and released with the GpuTaskState.
+ */
+static void
+gpusort_final_merge_cleanup(GpuSortState *gss)
+{
+	cl_uint		i;
+
+	if (gss->final_runs)
+	{
+		for (i=0; i < gss->num_final_runs; i++)
+		{
+			gpusort_run_close(gss->final_runs[i]);
+			pfree(gss->final_runs[i]);
+		}
+		pfree(gss->final_runs);
+		pfree(gss->final_index);
+		pfree(gss->final_markpos);
+		pfree(gss->final_heads);
+		pfree(gss->final_tree);
+		gss->final_runs = NULL;
+		gss->final_index = NULL;
+		gss->final_markpos = NULL;
+		gss->final_heads = NULL;
+		gss->final_tree = NULL;
+	}
+	gss->num_final_runs = 0;
+	gss->final_nleaves = 0;
+	gss->final_nemitted = 0;
+}
+
 static TupleTableSlot *
 gpusort_next_tuple(GpuTaskState *gts)
 {
 	GpuSortState	   *gss = (GpuSortState *) gts;
-	pgstrom_gpusort	   *gpusort = (pgstrom_gpusort *) gss->gts.curr_task;
 	TupleTableSlot	   *slot = gss->gts.css.ss.ps.ps_ResultTupleSlot;
-	kern_resultbuf	   *kresults;
 	pgstrom_data_store *pds;
+	cl_int				winner;
+	cl_int				chunk_id;
+	cl_int				item_id;
+	cl_int				i;
 
 	/* Does outer relation has any rows to read? */
-	if (!gpusort)
+	if (!gss->sort_done)
 		return NULL;
-	Assert(gss->sort_done);
 
-	kresults = GPUSORT_GET_KRESULTS(gpusort->oitems_dsm);
-	Assert(kresults->nrels == 2);	/* a pair of chunk_id and item_id */
-
-	if (gss->gts.curr_index < kresults->nitems)
-	{
-		cl_long		index = 2 * gss->gts.curr_index++;
-		cl_int		chunk_id = kresults->results[index];
-		cl_int		item_id = kresults->results[index + 1];
+	/* top-N sorting emits only the first sort_bound rows */
+	if (gss->sort_bound > 0 && gss->final_nemitted >= gss->sort_bound)
+		return NULL;
 
-		ExecClearTuple(slot);
+	winner = gss->final_tree[1];
+	if (winner < 0)
+		return NULL;
+	chunk_id = gss->final_heads[2 * winner];
+	item_id = gss->final_heads[2 * winner + 1];
+
+	/* advance the winner run, then replay the path to the root */
+	gss->final_index[winner]++;
+	i = gss->final_nleaves + winner;
+	gss->final_tree[i] = gpusort_final_merge_head(gss, winner);
+	for (i /= 2; i > 0; i /= 2)
+		gss->final_tree[i] = gpusort_final_merge_winner(gss,
+														gss->final_tree[2*i],
+														gss->final_tree[2*i+1]);
+	gss->final_nemitted++;
+
+	ExecClearTuple(slot);
+	if (!gss->key_only &&
+		(gss->gts.css.flags & CUSTOMPATH_PREFERE_ROW_FORMAT) == 0)
+		pds = gss->pds_chunks[chunk_id];
+	else
+		pds = gss->pds_toasts[chunk_id];
 
-		if (chunk_id >= gss->num_chunks || !gss->pds_chunks[chunk_id])
-			elog(ERROR, "Bug? data-store of GpuSort missing (chunk-id: %d)",
-				 chunk_id);
-		if ((gss->gts.css.flags & CUSTOMPATH_PREFERE_ROW_FORMAT) == 0)
-			pds = gss->pds_chunks[chunk_id];
-		else
-			pds = gss->pds_toasts[chunk_id];
+	/*
+	 * Rows with strxfrm() images have hidden attributes, so they should
+	 * not be delivered to the upper node as is.
+	 */
+	if (gss->num_xfrm_keys > 0)
+	{
+		TupleTableSlot *xfrm_slot = gss->xfrm_slot;
+		int				natts = slot->tts_tupleDescriptor->natts;
 
-		if (pgstrom_fetch_data_store(slot, pds, item_id, &gss->tuple_buf))
-			return slot;
-		elog(ERROR, "Bug? failed to fetch chunk_id=%d item_id=%d",
-			 chunk_id, item_id);
+		if (pgstrom_fetch_data_store(xfrm_slot, pds, item_id,
+									 &gss->tuple_buf))
+		{
+			slot_getallattrs(xfrm_slot);
+			memcpy(slot->tts_values, xfrm_slot->tts_values,
+				   sizeof(Datum) * natts);
+			memcpy(slot->tts_isnull, xfrm_slot->tts_isnull,
+				   sizeof(bool) * natts);
+			return ExecStoreVirtualTuple(slot);
+		}
 	}
+	else if (pgstrom_fetch_data_store(slot, pds, item_id, &gss->tuple_buf))
+		return slot;
+	elog(ERROR, "Bug? failed to fetch chunk_id=%d item_id=%d",
+		 chunk_id, item_id);
 	return NULL;
 }
 
@@ -1301,14 +2112,15 @@ gpusort_cleanup_cuda_resources(pgstrom_gpusort *gpusort)
 static void
 gpusort_task_release(GpuTask *gtask)
 {
+	GpuSortState	   *gss = (GpuSortState *) gtask->gts;
 	pgstrom_gpusort	   *gpusort = (pgstrom_gpusort *) gtask;
 
 	if (gpusort->litems_dsm)
-		dsm_detach(gpusort->litems_dsm);
+		gpusort_release_run(gss, gpusort->litems_dsm);
 	if (gpusort->ritems_dsm)
-		dsm_detach(gpusort->ritems_dsm);
+		gpusort_release_run(gss, gpusort->ritems_dsm);
 	if (gpusort->oitems_dsm)
-		dsm_detach(gpusort->oitems_dsm);
+		gpusort_release_run(gss, gpusort->oitems_dsm);
 	if (gpusort->bgw_handle)
 		pfree(gpusort->bgw_handle);
 
@@ -1323,97 +2135,65 @@ gpusort_merge_chunks(GpuSortState *gss, pgstrom_gpusort *gpusort_1)
 {
 	pgstrom_gpusort	   *gpusort_2;
 	dsm_segment		   *dsm_seg;
-	cl_uint				i, n, x, y;
+	cl_uint				n, x, y;
 	cl_uint				mc_class = gpusort_1->mc_class;
+	cl_uint				i, nruns;
 
 	/*
-	 * In case of no buddy at this moment, we have to wait for the next
-	 * chunk to be merged. Or, this chunk might be the final result.
+	 * Once scan of the outer relation got completed, we no longer launch
+	 * pairwise merge. The sorted runs being left are merged on the fly
+	 * by the final k-way merge, as long as its fan-in is less than the
+	 * limit. Elsewhere, the supplied run is merged with the smallest one
+	 * being left.
 	 */
 	Assert(mc_class < MAX_MERGECHUNKS_CLASS);
-	if (!gss->sorted_chunks[mc_class])
+	if (gss->gts.scan_done)
 	{
-		dlist_iter		iter;
-		pgstrom_gpusort *temp;
-		bool			has_candidate;
-
-		/* once cpusort_1 is put as partially sorted chunk */
-		gss->sorted_chunks[mc_class] = gpusort_1;
-
-		/*
-		 * Unless scan of outer relation does not completed, we try to
-		 * keep merging chunks with same size.
-		 */
-		if (!gss->gts.scan_done)
+		nruns = gss->num_final_runs;
+		for (i=0; i < MAX_MERGECHUNKS_CLASS; i++)
+		{
+			if (gss->sorted_chunks[i])
+				nruns++;
+		}
+		if (nruns < MAX_FINAL_MERGE_RUNS)
+		{
+			gpusort_final_merge_park(gss, gpusort_1);
 			return NULL;
+		}
 
-		/*
-		 * Once we forget the given cpusort_1, and find out the smallest
-		 * one that is now waiting for merging.
-		 */
+		gpusort_2 = NULL;
 		for (i=0; i < MAX_MERGECHUNKS_CLASS; i++)
 		{
 			if (gss->sorted_chunks[i])
 			{
-				gpusort_1 = gss->sorted_chunks[i];
-				Assert(gpusort_1->mc_class == i);
+				gpusort_2 = gss->sorted_chunks[i];
+				gss->sorted_chunks[i] = NULL;
 				break;
 			}
 		}
-		Assert(i < MAX_MERGECHUNKS_CLASS);
-		mc_class = gpusort_1->mc_class;
+		if (!gpusort_2)
+		{
+			cl_uint		k = 0;
 
-		/*
-		 * If we have any running or pending chunks with same merge-chunk
-		 * class, it may be a good candidate to merge.
-		 */
-		has_candidate = false;
-		SpinLockAcquire(&gss->gts.lock);
-		dlist_foreach (iter, &gss->gts.running_tasks)
-		{
-			temp = dlist_container(pgstrom_gpusort, task.chain, iter.cur);
-			if (temp->mc_class <= mc_class)
-			{
-				has_candidate = true;
-				goto out;
-			}
-		}
-		dlist_foreach (iter, &gss->gts.pending_tasks)
-		{
-			temp = dlist_container(pgstrom_gpusort, task.chain, iter.cur);
-			if (temp->mc_class == mc_class)
+			Assert(gss->num_final_runs > 0);
+			for (i=1; i < gss->num_final_runs; i++)
 			{
-				has_candidate = true;
-				goto out;
+				if (gss->final_tasks[i]->mc_class <
+					gss->final_tasks[k]->mc_class)
+					k = i;
 			}
+			gpusort_2 = gss->final_tasks[k];
+			gss->final_tasks[k] = gss->final_tasks[--gss->num_final_runs];
 		}
-	out:
-		SpinLockRelease(&gss->gts.lock);
-
-		/* wait until smaller chunk gets sorted, if any */
-		if (has_candidate)
-			return NULL;
-
+	}
+	else if (!gss->sorted_chunks[mc_class])
+	{
 		/*
-		 * Elsewhere, picks up a pair of smallest two chunks that are
-		 * already sorted, to merge them on next step.
+		 * In case of no buddy at this moment, we have to wait for the next
+		 * chunk to be merged.
 		 */
-		gpusort_2 = NULL;
-		for (i=gpusort_1->mc_class + 1; i < MAX_MERGECHUNKS_CLASS; i++)
-		{
-			if (gss->sorted_chunks[i])
-			{
-				gpusort_2 = gss->sorted_chunks[i];
-				Assert(gpusort_2->mc_class == i);
-				break;
-			}
-		}
-		/* no merginable pair found? */
-		if (!gpusort_2)
-			return NULL;
-		/* OK, let's merge this two chunks */
-		gss->sorted_chunks[gpusort_1->mc_class] = NULL;
-		gss->sorted_chunks[gpusort_2->mc_class] = NULL;
+		gss->sorted_chunks[mc_class] = gpusort_1;
+		return NULL;
 	}
 	else
 	{
@@ -1428,6 +2208,7 @@ gpusort_merge_chunks(GpuSortState *gss, pgstrom_gpusort *gpusort_1)
 	gpusort_1->ritems_dsm = gpusort_2->oitems_dsm;
 	gpusort_1->oitems_dsm = dsm_seg;
 	gpusort_1->bgw_handle = NULL;
+	gpusort_1->bgw_pooled = false;
 	gpusort_2->oitems_dsm = NULL;	/* clear it to avoid double free */
 	x = bms_num_members(gpusort_1->chunk_id_map);
 	y = bms_num_members(gpusort_2->chunk_id_map);
@@ -1476,13 +2257,27 @@ gpusort_task_complete(GpuTask *gtask)
 		}
 		gpusort_cleanup_cuda_resources(gpusort);
 
+		/* chunk is already projected, so make normalized key prefix */
+		gpusort_make_keyprefix(gss, gpusort->chunk_id);
+
 		if (gpusort->task.errcode == StromError_CpuReCheck)
-			gpusort_fallback_quicksort(gss, gpusort);
+			gpusort_fallback_sort(gss, gpusort);
 	}
 	else
 	{
 		pgstrom_flat_gpusort   *pfg = (pgstrom_flat_gpusort *)
 			dsm_segment_address(gpusort->oitems_dsm);
+		kern_resultbuf		   *kresults =
+			GPUSORT_GET_KRESULTS(gpusort->oitems_dsm);
+
+		/* CPU merge worker reports its error via the result buffer */
+		if (kresults->errcode != 0)
+			ereport(ERROR,
+					(errcode(kresults->errcode),
+					 errmsg("GpuSort: CPU merge worker failed: %s",
+							(char *) kresults->results)));
+		Assert(gss->num_cpusort_running > 0);
+		gss->num_cpusort_running--;
 
 		if (gpusort->task.pfm.enabled)
 		{
@@ -1503,12 +2298,12 @@ gpusort_task_complete(GpuTask *gtask)
 	/* ritems and litems are no longer referenced */
 	if (gpusort->litems_dsm)
 	{
-		dsm_detach(gpusort->litems_dsm);
+		gpusort_release_run(gss, gpusort->litems_dsm);
 		gpusort->litems_dsm = NULL;
 	}
 	if (gpusort->ritems_dsm)
 	{
-		dsm_detach(gpusort->ritems_dsm);
+		gpusort_release_run(gss, gpusort->ritems_dsm);
 		gpusort->ritems_dsm = NULL;
 	}
 
@@ -1518,14 +2313,28 @@ gpusort_task_complete(GpuTask *gtask)
 		pfree(gpusort->bgw_handle);
 		gpusort->bgw_handle = NULL;
 	}
+	gpusort->bgw_pooled = false;
+
+	/* top-N sorting keeps only the first sort_bound rows */
+	if (gss->sort_bound > 0)
+		gpusort_update_bound(gss, gpusort);
+
+	/*
+	 * A sorted chunk has its run on the DSM because GPU writes back the
+	 * result there. Once total amount of the runs on the DSM exceeds the
+	 * limit, we write it out to the temporary file.
+	 */
+	if (gpusort->mc_class == 0 &&
+		gss->run_mem_usage > (Size) gpusort_spill_threshold_kb << 10)
+		gpusort_spill_run(gss, gpusort);
 
 	/*
 	 * Let's try to merge with a preliminary sorted chunk.
 	 * If the supplied newer chunk can find a buddy, gpusort_merge_chunks()
 	 * put both of results as a input stream of the returned gpusort.
 	 * Otherwise, gpusort was kept in the gss->sorted_chunks[] array to wait
-	 * for the upcoming merginable chunk, or it is the final result of
-	 * bitonic sorting.
+	 * for the upcoming merginable chunk, or parked as an input of the final
+	 * k-way merge.
 	 */
 	newsort = gpusort_merge_chunks(gss, gpusort);
 	if (newsort)
@@ -1542,28 +2351,26 @@ gpusort_task_complete(GpuTask *gtask)
 	}
 	else
 	{
-		SpinLockAcquire(&gss->gts.lock);
+		bool	sort_done = false;
 
 		/*
-		 * Even if supplied gpusort chunk is kept in the sorted_chunks[]
-		 * array, it might be the last chunk that contains a single
-		 * sorted result array.
+		 * If no running or pending chunks are left, all the sorted runs are
+		 * kept in the sorted_chunks[] array or parked for the final merge.
 		 */
+		SpinLockAcquire(&gss->gts.lock);
 		if (gss->gts.scan_done &&
 			gss->gts.num_running_tasks == 0 &&
 			gss->gts.num_pending_tasks == 0)
-		{
-			Assert(gss->sorted_chunks[gpusort->mc_class] == gpusort);
-			Assert(gss->num_chunks == bms_num_members(gpusort->chunk_id_map));
-			gss->sorted_chunks[gpusort->mc_class] = NULL;
-			dlist_push_tail(&gss->gts.ready_tasks, &gpusort->task.chain);
-			gss->gts.num_ready_tasks++;
+			sort_done = true;
+		SpinLockRelease(&gss->gts.lock);
 
+		if (sort_done)
+		{
+			gpusort_final_merge_begin(gss);
 			elog(DEBUG1, "sort done (%s)",
 				 gss->gts.css.methods->CustomName);
 			gss->sort_done = true;	/* congratulation! */
 		}
-		SpinLockRelease(&gss->gts.lock);
 	}
 	return false;
 }
@@ -1843,6 +2650,9 @@ __gpusort_task_process(GpuSortState *gss, pgstrom_gpusort *gpusort)
 	Assert(rc == CUDA_SUCCESS);
 	if (rc != CUDA_SUCCESS)
 		elog(ERROR, "failed on cuMemHostRegister: %s", errorText(rc));
+	/* never reuse this segment once registered */
+	((pgstrom_flat_gpusort *)
+	 dsm_segment_address(gpusort->oitems_dsm))->host_registered = true;
 #endif
 
 	/*
@@ -2015,9 +2825,22 @@ gpusort_task_process(GpuTask *gtask)
 
 		Assert(gpusort->task.no_cuda_setup);
 
-		/* setup dynamic background worker */
+		/* keep it pending if we already run too many CPU merges */
+		if (gss->num_cpusort_running >= gpusort_max_workers)
+			return false;
+
 		dsm_hnd = dsm_segment_handle(gpusort->oitems_dsm);
 
+		/* pre-started worker pool is the first choice */
+		if (gpusort_pool_submit(dsm_hnd))
+		{
+			gpusort->bgw_pooled = true;
+			gss->num_cpusort_running++;
+			return true;
+		}
+
+		/* elsewhere, setup dynamic background worker */
+
 		memset(&worker, 0, sizeof(BackgroundWorker));
 		snprintf(worker.bgw_name, sizeof(worker.bgw_name),
 				 "GpuSort worker-%u", gss->cpusort_seqno++);
@@ -2028,7 +2851,10 @@ gpusort_task_process(GpuTask *gtask)
 		worker.bgw_main = bgw_cpusort_entrypoint;
 		worker.bgw_main_arg = PointerGetDatum(dsm_hnd);
 
-		return RegisterDynamicBackgroundWorker(&worker, &gpusort->bgw_handle);
+		if (!RegisterDynamicBackgroundWorker(&worker, &gpusort->bgw_handle))
+			return false;
+		gss->num_cpusort_running++;
+		return true;
 	}
 
 	/*
@@ -2066,6 +2892,7 @@ gpusort_task_polling(GpuTaskState *gts)
 {
 	GpuSortState	   *gss = (GpuSortState *) gts;
 	pgstrom_gpusort	   *gpusort;
+	pgstrom_flat_gpusort *pfg;
 	BgwHandleStatus		status;
 	pid_t				bgw_pid;
 	dlist_mutable_iter	iter;
@@ -2075,27 +2902,294 @@ gpusort_task_polling(GpuTaskState *gts)
 		gpusort = dlist_container(pgstrom_gpusort, task.chain, iter.cur);
 
 		/* A background worker task? */
-		if (!gpusort->bgw_handle)
+		if (!gpusort->bgw_handle && !gpusort->bgw_pooled)
 			continue;
 		/* Already finished? */
-		status = GetBackgroundWorkerPid(gpusort->bgw_handle, &bgw_pid);
-		if (status == BGWH_STARTED || status == BGWH_STOPPED)
+		if (!gpusort->bgw_pooled)
 		{
-			pgstrom_flat_gpusort   *pfg = (pgstrom_flat_gpusort *)
-				dsm_segment_address(gpusort->oitems_dsm);
-
-			/* not yet finished */
-			if (!pfg->bgw_done)
+			status = GetBackgroundWorkerPid(gpusort->bgw_handle, &bgw_pid);
+			if (status != BGWH_STARTED && status != BGWH_STOPPED)
 				continue;
+		}
+		pfg = (pgstrom_flat_gpusort *)
+			dsm_segment_address(gpusort->oitems_dsm);
+		/* not yet finished */
+		if (!pfg->bgw_done)
+			continue;
+
+		/* detach from running_tasks, then attach to completed tasks */
+		dlist_delete(&gpusort->task.chain);
+		gss->gts.num_running_tasks--;
+
+		dlist_push_tail(&gss->gts.completed_tasks, &gpusort->task.chain);
+		gss->gts.num_completed_tasks++;
+	}
+}
+
+/*
+ * gpusort_run_open / gpusort_run_close
+ *
+ * It opens an accessor to the sorted run on the supplied DSM segment.
+ * If the run is spilled out, its items are read/written using the file.
+ */
+static void
+gpusort_run_open(gpusort_run *run, dsm_segment *dsm_seg)
+{
+	pgstrom_flat_gpusort *pfg = dsm_segment_address(dsm_seg);
+
+	run->kresults = GPUSORT_GET_KRESULTS(dsm_seg);
+	run->fname = NULL;
+	run->fdesc = -1;
+	run->buf_base = 0;
+	run->buf_nitems = 0;
+	run->buf_dirty = false;
+
+	if (pfg->run_fname[0] != '\0')
+	{
+		run->fname = pfg->run_fname;
+		run->fdesc = OpenTransientFile(pfg->run_fname,
+									   O_RDWR | PG_BINARY, 0600);
+		if (run->fdesc < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not open sorted run \"%s\": %m",
+							run->fname)));
+	}
+}
+
+static void
+gpusort_run_flush(gpusort_run *run)
+{
+	Size	length = sizeof(cl_int) * 2 * run->buf_nitems;
+	off_t	offset = sizeof(cl_int) * 2 * run->buf_base;
+
+	Assert(run->fdesc >= 0);
+	if (run->buf_dirty && run->buf_nitems > 0)
+	{
+		if (lseek(run->fdesc, offset, SEEK_SET) != offset ||
+			write(run->fdesc, run->buffer, length) != length)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write sorted run \"%s\": %m",
+							run->fname)));
+	}
+	run->buf_dirty = false;
+}
+
+static void
+gpusort_run_close(gpusort_run *run)
+{
+	if (run->fdesc >= 0)
+	{
+		gpusort_run_flush(run);
+		CloseTransientFile(run->fdesc);
+		run->fdesc = -1;
+	}
+}
+
+/*
+ * gpusort_run_read
+ *
+ * It fetches the index'th pair of chunk_id/item_id from the sorted run.
+ * Items on the file are loaded to the buffer on demand, so sequential
+ * read performs well.
+ */
+static void
+gpusort_run_read(gpusort_run *run, cl_long index,
+				 cl_int *p_chunk_id, cl_int *p_item_id)
+{
+	cl_long		i;
+
+	Assert(index < run->kresults->nitems);
+	if (run->fdesc < 0)
+	{
+		*p_chunk_id = run->kresults->results[2 * index];
+		*p_item_id = run->kresults->results[2 * index + 1];
+		return;
+	}
+
+	if (index < run->buf_base || index >= run->buf_base + run->buf_nitems)
+	{
+		cl_long	nitems = Min(run->kresults->nitems - index,
+							 GPUSORT_RUN_BUFSZ);
+		Size	length = sizeof(cl_int) * 2 * nitems;
+		off_t	offset = sizeof(cl_int) * 2 * index;
+
+		gpusort_run_flush(run);
+		if (lseek(run->fdesc, offset, SEEK_SET) != offset ||
+			read(run->fdesc, run->buffer, length) != length)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read sorted run \"%s\": %m",
+							run->fname)));
+		run->buf_base = index;
+		run->buf_nitems = nitems;
+	}
+	i = index - run->buf_base;
+	*p_chunk_id = run->buffer[2 * i];
+	*p_item_id = run->buffer[2 * i + 1];
+}
+
+/*
+ * gpusort_run_write
+ *
+ * It puts a pair of chunk_id/item_id on the index'th item of the sorted
+ * run. Caller has to write items sequentially.
+ */
+static void
+gpusort_run_write(gpusort_run *run, cl_long index,
+				  cl_int chunk_id, cl_int item_id)
+{
+	cl_long		i;
+
+	Assert(index < run->kresults->nrooms);
+	if (run->fdesc < 0)
+	{
+		run->kresults->results[2 * index] = chunk_id;
+		run->kresults->results[2 * index + 1] = item_id;
+		return;
+	}
+
+	if (index != run->buf_base + run->buf_nitems ||
+		run->buf_nitems == GPUSORT_RUN_BUFSZ)
+	{
+		gpusort_run_flush(run);
+		run->buf_base = index;
+		run->buf_nitems = 0;
+	}
+	i = run->buf_nitems++;
+	run->buffer[2 * i] = chunk_id;
+	run->buffer[2 * i + 1] = item_id;
+	run->buf_dirty = true;
+}
+
+/*
+ * gpusort_spill_run
+ *
+ * It writes out the sorted run on the DSM to a temporary file, then
+ * replaces the DSM segment by a small one that has only its header.
+ */
+static void
+gpusort_spill_run(GpuSortState *gss, pgstrom_gpusort *gpusort)
+{
+	kern_resultbuf *kresults = GPUSORT_GET_KRESULTS(gpusort->oitems_dsm);
+	kern_resultbuf *kresults_new;
+	pgstrom_flat_gpusort *pfg;
+	dsm_segment	   *dsm_seg;
+	const char	   *run_fname;
+	int				run_fdesc;
+	Size			length;
+
+	Assert(!GPUSORT_RUN_IS_SPILLED(gpusort->oitems_dsm));
+	length = (STROMALIGN(offsetof(pgstrom_flat_gpusort, data)) +
+			  STROMALIGN(offsetof(kern_resultbuf, results[0])));
+	dsm_seg = gpusort_create_dsm(gss, length);
+	pfg = dsm_segment_address(dsm_seg);
+	memset(pfg, 0, sizeof(pgstrom_flat_gpusort));
+	pfg->dsm_length = length;
+	pfg->kresults_ofs = 0;
+
+	kresults_new = GPUSORT_GET_KRESULTS(dsm_seg);
+	memcpy(kresults_new, kresults, offsetof(kern_resultbuf, results[0]));
+
+	/*
+	 * The file is tracked by the new DSM segment from its creation, so it
+	 * shall be removed on detach even if we fail to write out the run.
+	 */
+	run_fdesc = pgstrom_open_tempfile(&run_fname);
+	strlcpy(pfg->run_fname, run_fname, MAXPGPATH);
+	length = sizeof(cl_int) * 2 * kresults->nitems;
+	if (write(run_fdesc, kresults->results, length) != length)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write sorted run \"%s\": %m",
+						run_fname)));
+	CloseTransientFile(run_fdesc);
+
+	gpusort_release_run(gss, gpusort->oitems_dsm);
+	gpusort->oitems_dsm = dsm_seg;
+	gss->num_spilled_runs++;
+}
+
+/*
+ * gpusort_cleanup_run_file
+ *
+ * on_dsm_detach callback of the sorted run segment. It removes the temporary
+ * file of the spilled run, if still exists, when the segment is detached by
+ * the resource owner on error or cancel.
+ */
+static void
+gpusort_cleanup_run_file(dsm_segment *dsm_seg, Datum arg)
+{
+	pgstrom_flat_gpusort *pfg = dsm_segment_address(dsm_seg);
+
+	if (pfg->run_fname[0] != '\0' &&
+		unlink(pfg->run_fname) != 0 && errno != ENOENT)
+		elog(WARNING, "failed on unlink(\"%s\") : %m", pfg->run_fname);
+	pfg->run_fname[0] = '\0';
+}
 
-			/* detach from running_tasks, then attach to completed tasks */
-			dlist_delete(&gpusort->task.chain);
-			gss->gts.num_running_tasks--;
+/*
+ * gpusort_create_dsm
+ *
+ * It returns a DSM segment larger than the required length. A segment
+ * kept on the cache shall be reused if its size is reasonable, to avoid
+ * creation of a new segment for each merge step.
+ */
+static dsm_segment *
+gpusort_create_dsm(GpuSortState *gss, Size length)
+{
+	dsm_segment	   *dsm_seg;
+	pgstrom_flat_gpusort *pfg;
+	Size			map_length;
+	cl_uint			i;
 
-			dlist_push_tail(&gss->gts.completed_tasks, &gpusort->task.chain);
-			gss->gts.num_completed_tasks++;
+	for (i=0; i < gss->num_dsm_cache; i++)
+	{
+		dsm_seg = gss->dsm_cache[i];
+		map_length = dsm_segment_map_length(dsm_seg);
+		if (map_length >= length && map_length / 2 <= length)
+		{
+			gss->dsm_cache[i] = gss->dsm_cache[--gss->num_dsm_cache];
+			return dsm_seg;
 		}
 	}
+	dsm_seg = dsm_create(length, 0);
+	pfg = dsm_segment_address(dsm_seg);
+	pfg->run_fname[0] = '\0';
+	on_dsm_detach(dsm_seg, gpusort_cleanup_run_file, (Datum) 0);
+
+	return dsm_seg;
+}
+
+/*
+ * gpusort_release_run
+ *
+ * It releases the DSM segment of sorted run, and removes the temporary
+ * file if the run was spilled out. Segment not registered to CUDA is
+ * kept for reuse, as long as it is not too large.
+ */
+static void
+gpusort_release_run(GpuSortState *gss, dsm_segment *dsm_seg)
+{
+	pgstrom_flat_gpusort *pfg = dsm_segment_address(dsm_seg);
+	kern_resultbuf		 *kresults = GPUSORT_GET_KRESULTS(dsm_seg);
+
+	if (pfg->run_fname[0] == '\0')
+		gss->run_mem_usage -= sizeof(cl_int) * 2 * kresults->nrooms;
+	else
+	{
+		if (unlink(pfg->run_fname) != 0)
+			elog(WARNING, "failed on unlink(\"%s\") : %m", pfg->run_fname);
+		pfg->run_fname[0] = '\0';
+	}
+
+	if (!pfg->host_registered &&
+		gss->num_dsm_cache < GPUSORT_DSM_CACHE_SIZE &&
+		dsm_segment_map_length(dsm_seg) <= GPUSORT_DSM_CACHE_MAXLEN)
+		gss->dsm_cache[gss->num_dsm_cache++] = dsm_seg;
+	else
+		dsm_detach(dsm_seg);
 }
 
 /*
@@ -2119,7 +3213,7 @@ form_pgstrom_flat_gpusort_base(GpuSortState *gss, cl_int chunk_id)
 	nitems = ptoast->kds->nitems;
 	dsm_length = (STROMALIGN(offsetof(pgstrom_flat_gpusort, data)) +
 				  STROMALIGN(offsetof(kern_resultbuf, results[2 * nitems])));
-	dsm_seg = dsm_create(dsm_length, 0);
+	dsm_seg = gpusort_create_dsm(gss, dsm_length);
 	pfg = dsm_segment_address(dsm_seg);
 	memset(pfg, 0, sizeof(pgstrom_flat_gpusort));
 	pfg->dsm_length = dsm_length;
@@ -2132,6 +3226,8 @@ form_pgstrom_flat_gpusort_base(GpuSortState *gss, cl_int chunk_id)
 	kresults->nitems = nitems;
 	kresults->errcode = StromError_Success;
 
+	gss->run_mem_usage += sizeof(cl_int) * 2 * nitems;
+
 	return dsm_seg;
 }
 
@@ -2143,15 +3239,17 @@ form_pgstrom_flat_gpusort(GpuSortState *gss,
 	StringInfoData	buf;
 	pgstrom_flat_gpusort  pfg;
 	pgstrom_flat_gpusort *pfg_buf;
-	TupleDesc			tupdesc = GTS_GET_SCAN_TUPDESC(&gss->gts);
+	TupleDesc			tupdesc = gss->kds_tupdesc;
 	kern_resultbuf	   *kresults;
 	kern_resultbuf	   *l_kresults;
 	kern_resultbuf	   *r_kresults;
 	Bitmapset		   *chunk_id_map;
 	size_t				length;
 	size_t				nitems;
+	size_t				nitems_dsm;
 	size_t				kresults_ofs;
 	cl_int				index;
+	bool				spill_out;
 	dsm_segment		   *dsm_seg;
 
 	Assert(l_gpusort && r_gpusort);
@@ -2172,11 +3270,35 @@ form_pgstrom_flat_gpusort(GpuSortState *gss,
 	r_kresults = GPUSORT_GET_KRESULTS(r_gpusort->oitems_dsm);
 
 	nitems = l_kresults->nitems + r_kresults->nitems;
+	if (gss->sort_bound > 0 && nitems > gss->sort_bound)
+		nitems = gss->sort_bound;	/* merge stops at the bound */
 	pfg.litems_dsmhnd = dsm_segment_handle(l_gpusort->oitems_dsm);
 	pfg.ritems_dsmhnd = dsm_segment_handle(r_gpusort->oitems_dsm);
 
+	/*
+	 * Output run shall be written to the temporary file, instead of DSM,
+	 * if it makes total amount of the runs on the DSM exceed the limit.
+	 * Background worker writes out the items through a small buffer.
+	 */
+	length = sizeof(cl_int) * 2 * nitems;
+	spill_out = (gss->run_mem_usage + length >
+				 (Size) gpusort_spill_threshold_kb << 10);
+	if (spill_out)
+	{
+		gss->num_spilled_runs++;
+		nitems_dsm = 0;
+	}
+	else
+	{
+		gss->run_mem_usage += length;
+		nitems_dsm = nitems;
+	}
+
 	/* existance of varlena sorting key */
 	pfg.varlena_keys = gss->varlena_keys;
+	/* normalized key prefix */
+	pfg.keyprefix_len = gss->keyprefix_len;
+	pfg.keyprefix_exact = gss->keyprefix_exact;
 	/* length of kern_data_store array */
 	pfg.num_chunks = gss->num_chunks;
 
@@ -2195,6 +3317,10 @@ form_pgstrom_flat_gpusort(GpuSortState *gss,
 		size_t		kds_len = pds->kds_length;
 		size_t		kds_ofs = pds->kds_offset;
 
+		/* key prefix array is mapped with kds together */
+		if (gss->keyprefix_len > 0)
+			kds_len = (GPUSORT_KEYPREFIX_OFFSET(pds) - kds_ofs +
+					   (size_t) gss->keyprefix_len * pds->kds->nitems);
 		Assert(strcmp(kds_fname, gss->pds_toasts[index]->kds_fname) == 0);
 		Assert(kds_ofs >= gss->pds_toasts[index]->kds_length);
 		Assert(gss->pds_toasts[index]->kds_offset == 0);
@@ -2231,19 +3357,19 @@ form_pgstrom_flat_gpusort(GpuSortState *gss,
 	pfg.sortColIdx = buf.len;
 	length = sizeof(AttrNumber) * gss->numCols;
 	enlargeStringInfo(&buf, MAXALIGN(length));
-	memcpy(buf.data + buf.len, gss->sortColIdx, length);
+	memcpy(buf.data + buf.len, gss->kds_colidx, length);
 	buf.len += MAXALIGN(length);
 	/* sortOperators */
 	pfg.sortOperators = buf.len;
 	length = sizeof(Oid) * gss->numCols;
 	enlargeStringInfo(&buf, MAXALIGN(length));
-    memcpy(buf.data + buf.len, gss->sortOperators, length);
+    memcpy(buf.data + buf.len, gss->kds_sortops, length);
 	buf.len += MAXALIGN(length);
 	/* collations */
 	pfg.collations = buf.len;
 	length = sizeof(Oid) * gss->numCols;
     enlargeStringInfo(&buf, MAXALIGN(length));
-	memcpy(buf.data + buf.len, gss->collations, length);
+	memcpy(buf.data + buf.len, gss->kds_collations, length);
 	buf.len += MAXALIGN(length);
 	/* nullsFirst */
 	pfg.nullsFirst = buf.len;
@@ -2254,29 +3380,49 @@ form_pgstrom_flat_gpusort(GpuSortState *gss,
 
 	/* result buffer */
 	kresults_ofs = buf.len;
-	enlargeStringInfo(&buf, MAXALIGN(sizeof(kern_resultbuf)) + 80);
+	enlargeStringInfo(&buf, MAXALIGN(sizeof(kern_resultbuf)) +
+					  GPUSORT_ERRMSG_LEN);
 	kresults = (kern_resultbuf *)(buf.data + buf.len);
 	memset(kresults, 0, sizeof(kern_resultbuf));
 	kresults->nrels = 2;
 	kresults->nrooms = nitems;
 	kresults->nitems = nitems;
 	kresults->errcode = ERRCODE_INTERNAL_ERROR;
-	snprintf((char *)kresults->results, sizeof(cl_int) * 2 * nitems,
+	snprintf((char *)kresults->results, GPUSORT_ERRMSG_LEN,
 			 "An internal error on worker prior to DSM attachment");
-	buf.len += MAXALIGN(sizeof(kern_resultbuf)) + 80;
+	buf.len += MAXALIGN(sizeof(kern_resultbuf)) + GPUSORT_ERRMSG_LEN;
 
-	/* allocation and setup of DSM */
+	/*
+	 * allocation and setup of DSM; results[] has to be large enough to
+	 * store an error message, even if the run is spilled out.
+	 */
 	length = STROMALIGN(offsetof(pgstrom_flat_gpusort, data)) +
 		STROMALIGN(kresults_ofs) +
-		STROMALIGN(offsetof(kern_resultbuf, results[2 * nitems]));
+		STROMALIGN(Max(offsetof(kern_resultbuf, results[2 * nitems_dsm]),
+					   MAXALIGN(sizeof(kern_resultbuf)) +
+					   GPUSORT_ERRMSG_LEN));
 	pfg.dsm_length = length;
 	pfg.kresults_ofs = kresults_ofs;
 
-	dsm_seg = dsm_create(pfg.dsm_length, 0);
+	dsm_seg = gpusort_create_dsm(gss, pfg.dsm_length);
 	pfg_buf = dsm_segment_address(dsm_seg);
 	memcpy(pfg_buf, &pfg, sizeof(pgstrom_flat_gpusort));
 	memcpy(pfg_buf->data, buf.data, buf.len);
 
+	/*
+	 * The output file is created once the segment that tracks it exists,
+	 * so it shall be removed on detach, even if the merge is aborted.
+	 */
+	if (spill_out)
+	{
+		const char *run_fname;
+		int			run_fdesc;
+
+		run_fdesc = pgstrom_open_tempfile(&run_fname);
+		CloseTransientFile(run_fdesc);
+		strlcpy(pfg_buf->run_fname, run_fname, MAXPGPATH);
+	}
+
 	/* release temp buffer */
 	pfree(buf.data);
 
@@ -2316,6 +3462,9 @@ deform_pgstrom_flat_gpusort(dsm_segment *dsm_seg)
 								   pfg->num_chunks);
 	gpusort->kern_chunks = palloc0(sizeof(kern_data_store *) *
 								   pfg->num_chunks);
+	gpusort->keyprefix_len = pfg->keyprefix_len;
+	gpusort->keyprefix_exact = pfg->keyprefix_exact;
+	gpusort->kern_kprefix = palloc0(sizeof(char *) * pfg->num_chunks);
 	/* chunks to be mapped */
 	pos = pfg->data + pfg->kern_chunks;
 	while (true)
@@ -2344,6 +3493,14 @@ deform_pgstrom_flat_gpusort(dsm_segment *dsm_seg)
 									 gpusort->varlena_keys
 									 ? gpusort->kern_toasts + index
 									 : NULL);
+		/* key prefix array is located next to the kds */
+		if (gpusort->keyprefix_len > 0)
+		{
+			kern_data_store *kds = gpusort->kern_chunks[index];
+
+			gpusort->kern_kprefix[index] = ((char *) kds +
+											TYPEALIGN(BLCKSZ, kds->length));
+		}
 	}
 	/* tuple descriptor */
 	tupdesc = (TupleDesc)(pfg->data + pfg->tupdesc);
@@ -2375,90 +3532,20 @@ deform_pgstrom_flat_gpusort(dsm_segment *dsm_seg)
 
 
 /*
- * gpusort_fallback_gpu_chunks
+ * gpusort_setup_sortsupport
  *
- * Fallback routine towards a particular GpuSort chunk, if GPU device
- * gave up sorting on device side.
+ * It initializes SortSupportData for host side comparison on demand.
+ * Transformed keys are compared bytewise, as text in C collation.
  */
-static inline int
-__gpusort_fallback_compare(GpuSortState *gss,
-						   kern_data_store *kds, cl_uint index,
-						   Datum *p_values, bool *p_isnull)
-{
-	Datum	   *x_values = (Datum *) KERN_DATA_STORE_VALUES(kds, index);
-	bool	   *x_isnull = (bool *) KERN_DATA_STORE_ISNULL(kds, index);
-	int			i, j, comp;
-
-	for (i=0; i < gss->numCols; i++)
-	{
-		SortSupport		ssup = gss->ssup_keys + i;
-
-		j = ssup->ssup_attno;
-		comp = ApplySortComparator(x_values[j],
-								   x_isnull[j],
-								   p_values[j],
-								   p_isnull[j],
-								   ssup);
-		if (comp != 0)
-			return comp;
-	}
-	return 0;
-}
-
-static void
-__gpusort_fallback_quicksort(GpuSortState *gss,
-							 kern_resultbuf *kresults,
-							 kern_data_store *kds,
-							 cl_uint l_index, cl_uint r_index)
-{
-	if (l_index < r_index)
-	{
-		cl_uint		i = l_index;
-		cl_uint		j = r_index;
-		cl_uint		p_index = (l_index + r_index) / 2;
-		Datum	   *p_values = (Datum *) KERN_DATA_STORE_VALUES(kds, p_index);
-		bool	   *p_isnull = (bool *) KERN_DATA_STORE_ISNULL(kds, p_index);
-		int			temp;
-
-		while (true)
-		{
-			while (__gpusort_fallback_compare(gss, kds, i,
-											  p_values, p_isnull) < 0)
-				i++;
-			while (__gpusort_fallback_compare(gss, kds, j,
-											  p_values, p_isnull) > 0)
-				j--;
-			if (i >= j)
-				break;
-			/* swap index */
-			temp = kresults->results[2 * i + 1];
-			kresults->results[2 * i + 1] = kresults->results[2 * j + 1];
-			kresults->results[2 * j + 1] = temp;
-			/* make index advanced */
-			i++;
-			j--;
-		}
-		__gpusort_fallback_quicksort(gss, kresults, kds, l_index, i - 1);
-		__gpusort_fallback_quicksort(gss, kresults, kds, j + 1, r_index);
-	}
-}
-
-static void
-gpusort_fallback_quicksort(GpuSortState *gss, pgstrom_gpusort *gpusort)
+static SortSupport
+gpusort_setup_sortsupport(GpuSortState *gss)
 {
-	SortSupportData	   *ssup_keys = gss->ssup_keys;
-	kern_resultbuf	   *kresults = GPUSORT_GET_KRESULTS(gpusort->oitems_dsm);
-	pgstrom_data_store *pds = gss->pds_chunks[gpusort->chunk_id];
-	pgstrom_data_store *ptoast = gss->pds_chunks[gpusort->chunk_id];
-	kern_data_store	   *kds = pds->kds;
-	kern_data_store	   *ktoast = ptoast->kds;
-	size_t				i, nitems = ktoast->nitems;
-
-	/* initialize SortSupportData, if first time */
-	if (!ssup_keys)
+	if (!gss->ssup_keys)
 	{
 		EState	   *estate = gss->gts.css.ss.ps.state;
 		Size		len = sizeof(SortSupportData) * gss->numCols;
+		SortSupport	ssup_keys;
+		int			i;
 
 		ssup_keys = MemoryContextAllocZero(estate->es_query_cxt, len);
 		for (i=0; i < gss->numCols; i++)
@@ -2466,61 +3553,1064 @@ gpusort_fallback_quicksort(GpuSortState *gss, pgstrom_gpusort *gpusort)
 			SortSupport		ssup = ssup_keys + i;
 
 			ssup->ssup_cxt = estate->es_query_cxt;
-			ssup->ssup_collation = gss->collations[i];
+			ssup->ssup_collation = gss->kds_collations[i];
 			ssup->ssup_nulls_first = gss->nullsFirst[i];
-			ssup->ssup_attno = gss->sortColIdx[i];
-			PrepareSortSupportFromOrderingOp(gss->sortOperators[i], ssup);
+			ssup->ssup_attno = gss->row_colidx[i];
+			PrepareSortSupportFromOrderingOp(gss->kds_sortops[i], ssup);
 		}
 		gss->ssup_keys = ssup_keys;
 	}
-	/* preparation of rindex[] */
-	Assert(kresults->nrels == 2);
-	Assert(kresults->nrooms == nitems);
+	return gss->ssup_keys;
+}
 
-	/*
-	 * NOTE: we assume gpusort_preparation() and gpusort_fixup_datastore()
-	 * has no code path that can return CpuReCheck error, so we expect
-	 * receive DMA will back already flatten data store in kds/ktoast.
-	 */
-	Assert(kds->nitems == nitems);
-#ifdef NOT_USED
-	slot = gss->css.ss.ss_ScanTupleSlot;
-	for (i=0; i < nitems; i++)
+/*
+ * gpusort_compare_slots
+ *
+ * It compares sorting keys of the two tuples in row format on the host
+ * side.
+ */
+static int
+gpusort_compare_slots(GpuSortState *gss,
+					  TupleTableSlot *a, TupleTableSlot *b)
+{
+	SortSupport	ssup_keys = gpusort_setup_sortsupport(gss);
+	int			i, comp;
+
+	for (i=0; i < gss->numCols; i++)
 	{
-		kresults->results[2 * i] = gpusort->chunk_id;
-		kresults->results[2 * i + 1] = i;
+		SortSupport	ssup = ssup_keys + i;
+		Datum		a_value;
+		Datum		b_value;
+		bool		a_isnull;
+		bool		b_isnull;
+
+		a_value = slot_getattr(a, ssup->ssup_attno, &a_isnull);
+		b_value = slot_getattr(b, ssup->ssup_attno, &b_isnull);
+		comp = ApplySortComparator(a_value, a_isnull,
+								   b_value, b_isnull,
+								   ssup);
+		if (comp != 0)
+			return comp;
+	}
+	return 0;
+}
 
-		tts_values = (Datum *) KERN_DATA_STORE_VALUES(kds, i);
-		tts_isnull = (bool *) KERN_DATA_STORE_ISNULL(kds, i);
+/*
+ * gpusort_setup_xfrm_keys
+ *
+ * It sets up the row format chunk and how the keys in the slot format chunk
+ * are compared. Text keys in non-C collation are replaced by their strxfrm()
+ * image, appended to the row format as hidden attributes, and compared as
+ * text in C collation, thus bytewise.
+ */
+static void
+gpusort_setup_xfrm_keys(GpuSortState *gss, bool *xfrm_keys)
+{
+	EState	   *estate = gss->gts.css.ss.ps.state;
+	TupleDesc	tupdesc = GTS_GET_SCAN_TUPDESC(&gss->gts);
+	int			natts = tupdesc->natts;
+	int			i;
 
-		if (!pgstrom_fetch_data_store(slot, ptoast, i, NULL))
-			elog(ERROR, "failed to fetch a tuple from data-store");
-		slot_getallattrs(slot);
+	gss->xfrm_keys = xfrm_keys;
+	gss->num_xfrm_keys = 0;
+	gss->xfrm_locales = palloc0(sizeof(pg_locale_t) * gss->numCols);
+	gss->row_colidx = palloc(sizeof(AttrNumber) * gss->numCols);
+	gss->kds_sortops = palloc(sizeof(Oid) * gss->numCols);
+	gss->kds_collations = palloc(sizeof(Oid) * gss->numCols);
+	for (i=0; i < gss->numCols; i++)
+	{
+		Oid			opfamily;
+		Oid			opcintype;
+		int16		strategy;
 
-		/* NOTE: varlena is store as host accessable pointer */
-		for (j=0; j < gss->numCols; j++)
+		if (!xfrm_keys[i])
 		{
-			SortSupport		ssup = ssup_keys + i;
-
-			tts_values[j] = slot->tts_values[ssup->ssup_attno - 1];
-			tts_isnull[j] = slot->tts_isnull[ssup->ssup_attno - 1];
+			gss->row_colidx[i] = gss->sortColIdx[i];
+			gss->kds_sortops[i] = gss->sortOperators[i];
+			gss->kds_collations[i] = gss->collations[i];
+			continue;
 		}
+		if (!get_ordering_op_properties(gss->sortOperators[i],
+										&opfamily,
+										&opcintype,
+										&strategy))
+			elog(ERROR, "operator %u is not a valid ordering operator",
+				 gss->sortOperators[i]);
+		gss->row_colidx[i] = natts + ++gss->num_xfrm_keys;
+		gss->kds_sortops[i] = get_opfamily_member(TEXT_BTREE_FAM_OID,
+												  TEXTOID, TEXTOID,
+												  strategy);
+		if (!OidIsValid(gss->kds_sortops[i]))
+			elog(ERROR, "missing operator %d(%u,%u) in opfamily %u",
+				 strategy, TEXTOID, TEXTOID, TEXT_BTREE_FAM_OID);
+		gss->kds_collations[i] = C_COLLATION_OID;
+		if (gss->collations[i] != DEFAULT_COLLATION_OID)
+			gss->xfrm_locales[i]
+				= pg_newlocale_from_collation(gss->collations[i]);
 	}
-#endif
-	/* fallback execution with QuickSort */
-	__gpusort_fallback_quicksort(gss, kresults, kds, 0, nitems - 1);
 
-	/* restore error status */
-	kresults->errcode = StromError_Success;
-	kresults->nitems = kds->nitems;
+	if (gss->num_xfrm_keys == 0)
+	{
+		gss->row_tupdesc = tupdesc;
+		return;
+	}
+	Assert(gss->key_only);
+
+	gss->row_tupdesc = CreateTemplateTupleDesc(natts + gss->num_xfrm_keys,
+											   tupdesc->tdhasoid);
+	for (i=0; i < natts; i++)
+		TupleDescCopyEntry(gss->row_tupdesc, i + 1, tupdesc, i + 1);
+	for (i=0; i < gss->numCols; i++)
+	{
+		if (!xfrm_keys[i])
+			continue;
+		TupleDescInitEntry(gss->row_tupdesc, gss->row_colidx[i],
+						   NULL, TEXTOID, -1, 0);
+		TupleDescInitEntryCollation(gss->row_tupdesc, gss->row_colidx[i],
+									C_COLLATION_OID);
+	}
+	gss->xfrm_slot = ExecInitExtraTupleSlot(estate);
+	ExecSetSlotDescriptor(gss->xfrm_slot, gss->row_tupdesc);
+	gss->xfrm_values = palloc(sizeof(Datum) * gss->row_tupdesc->natts);
+	gss->xfrm_isnull = palloc(sizeof(bool) * gss->row_tupdesc->natts);
+	gss->xfrm_memcxt = AllocSetContextCreate(estate->es_query_cxt,
+											 "GpuSort strxfrm keys",
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
 }
 
 /*
- * Entrypoint of GpuSort
+ * gpusort_transform_key
+ *
+ * It makes strxfrm() image of the text key. Original string follows the
+ * image with a '\0' separator, because varstr_cmp() sorts the strings
+ * that strcoll() considers equal by strcmp().
  */
-void
+static Datum
+gpusort_transform_key(GpuSortState *gss, int keyidx, Datum datum)
+{
+	TupleDesc	tupdesc = GTS_GET_SCAN_TUPDESC(&gss->gts);
+	AttrNumber	anum = gss->sortColIdx[keyidx] - 1;
+	text	   *t = DatumGetTextPP(datum);
+	char	   *src = VARDATA_ANY(t);
+	int			len = VARSIZE_ANY_EXHDR(t);
+	char	   *cstr;
+	text	   *result;
+	Size		bufsz;
+	Size		xlen;
+
+	/* trailing spaces of bpchar are not significant */
+	if (tupdesc->attrs[anum]->atttypid == BPCHAROID)
+		len = bpchartruelen(src, len);
+
+	cstr = palloc(len + 1);
+	memcpy(cstr, src, len);
+	cstr[len] = '\0';
+
+	bufsz = 2 * len + 32;
+	for (;;)
+	{
+		result = palloc(VARHDRSZ + bufsz + 1 + len);
+#ifdef HAVE_LOCALE_T
+		if (gss->xfrm_locales[keyidx])
+			xlen = strxfrm_l(VARDATA(result), cstr, bufsz,
+							 gss->xfrm_locales[keyidx]);
+		else
+#endif
+			xlen = strxfrm(VARDATA(result), cstr, bufsz);
+		if (xlen < bufsz)
+			break;
+		/* buffer was too small, so try again */
+		pfree(result);
+		bufsz = xlen + 1;
+	}
+	VARDATA(result)[xlen] = '\0';
+	memcpy(VARDATA(result) + xlen + 1, src, len);
+	SET_VARSIZE(result, VARHDRSZ + xlen + 1 + len);
+	pfree(cstr);
+
+	return PointerGetDatum(result);
+}
+
+/*
+ * gpusort_transform_slot
+ *
+ * It forms a tuple in row format, that has strxfrm() image of the text
+ * keys next to the attributes of the supplied slot.
+ */
+static TupleTableSlot *
+gpusort_transform_slot(GpuSortState *gss, TupleTableSlot *slot)
+{
+	TupleTableSlot *xfrm_slot = gss->xfrm_slot;
+	int				natts = slot->tts_tupleDescriptor->natts;
+	MemoryContext	oldcxt;
+	HeapTuple		tuple;
+	int				i, j;
+
+	ExecClearTuple(xfrm_slot);
+	MemoryContextReset(gss->xfrm_memcxt);
+	oldcxt = MemoryContextSwitchTo(gss->xfrm_memcxt);
+
+	slot_getallattrs(slot);
+	memcpy(gss->xfrm_values, slot->tts_values, sizeof(Datum) * natts);
+	memcpy(gss->xfrm_isnull, slot->tts_isnull, sizeof(bool) * natts);
+	for (i=0; i < gss->numCols; i++)
+	{
+		AttrNumber	anum = gss->sortColIdx[i] - 1;
+
+		if (!gss->xfrm_keys[i])
+			continue;
+		j = gss->row_colidx[i] - 1;
+		if (slot->tts_isnull[anum])
+		{
+			gss->xfrm_values[j] = (Datum) 0;
+			gss->xfrm_isnull[j] = true;
+		}
+		else
+		{
+			gss->xfrm_values[j] =
+				gpusort_transform_key(gss, i, slot->tts_values[anum]);
+			gss->xfrm_isnull[j] = false;
+		}
+	}
+	tuple = heap_form_tuple(gss->row_tupdesc,
+							gss->xfrm_values,
+							gss->xfrm_isnull);
+	MemoryContextSwitchTo(oldcxt);
+
+	return ExecStoreTuple(tuple, xfrm_slot, InvalidBuffer, false);
+}
+
+/*
+ * gpusort_keyprefix_width
+ *
+ * It returns number of bytes to encode a key, except for null-indicator.
+ */
+static inline cl_uint
+gpusort_keyprefix_width(cl_int kind)
+{
+	switch (kind)
+	{
+		case GPUSORT_KEYPREFIX_BOOL:
+			return 1;
+		case GPUSORT_KEYPREFIX_INT2:
+			return sizeof(cl_short);
+		case GPUSORT_KEYPREFIX_INT4:
+		case GPUSORT_KEYPREFIX_FLOAT4:
+			return sizeof(cl_int);
+		case GPUSORT_KEYPREFIX_INT8:
+		case GPUSORT_KEYPREFIX_FLOAT8:
+		case GPUSORT_KEYPREFIX_NUMERIC:
+			return sizeof(cl_long);
+		case GPUSORT_KEYPREFIX_XFRM:
+			return GPUSORT_KEYPREFIX_LEN;	/* truncated by the prefix */
+		default:
+			break;
+	}
+	return 0;
+}
+
+/*
+ * gpusort_setup_keyprefix
+ *
+ * It determines how sorting keys are encoded to the normalized key prefix.
+ * Only the keys ordered by the default btree operator class of the data
+ * type can be encoded. Once a key is encoded with loss of information
+ * (numeric, or truncated by the length of prefix), no more keys follow.
+ */
+static void
+gpusort_setup_keyprefix(GpuSortState *gss)
+{
+	TupleDesc	tupdesc = gss->kds_tupdesc;
+	cl_uint		length = 0;
+	bool		exact = true;
+	int			i;
+
+	gss->keyprefix_kinds = palloc0(sizeof(cl_int) * gss->numCols);
+	for (i=0; i < gss->numCols; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[gss->kds_colidx[i] - 1];
+		Oid			opfamily;
+		Oid			opcintype;
+		Oid			opclass;
+		int16		strategy;
+		cl_int		kind;
+		cl_uint		width;
+
+		if (!get_ordering_op_properties(gss->kds_sortops[i],
+										&opfamily, &opcintype, &strategy) ||
+			opcintype != attr->atttypid)
+			break;
+		opclass = GetDefaultOpClass(opcintype, BTREE_AM_OID);
+		if (!OidIsValid(opclass) || get_opclass_family(opclass) != opfamily)
+			break;
+
+		switch (attr->atttypid)
+		{
+			case BOOLOID:
+				kind = GPUSORT_KEYPREFIX_BOOL;
+				break;
+			case INT2OID:
+				kind = GPUSORT_KEYPREFIX_INT2;
+				break;
+			case INT4OID:
+			case DATEOID:
+				kind = GPUSORT_KEYPREFIX_INT4;
+				break;
+			case INT8OID:
+				kind = GPUSORT_KEYPREFIX_INT8;
+				break;
+			case FLOAT4OID:
+				kind = GPUSORT_KEYPREFIX_FLOAT4;
+				break;
+			case FLOAT8OID:
+				kind = GPUSORT_KEYPREFIX_FLOAT8;
+				break;
+			case TIMEOID:
+			case TIMESTAMPOID:
+			case TIMESTAMPTZOID:
+#ifdef HAVE_INT64_TIMESTAMP
+				kind = GPUSORT_KEYPREFIX_INT8;
+#else
+				kind = GPUSORT_KEYPREFIX_FLOAT8;
+#endif
+				break;
+			case NUMERICOID:
+				kind = GPUSORT_KEYPREFIX_NUMERIC;
+				exact = false;
+				break;
+			case TEXTOID:
+				/* only strxfrm() images we made are known to be flat */
+				if (gss->xfrm_keys[i])
+				{
+					kind = GPUSORT_KEYPREFIX_XFRM;
+					exact = false;
+				}
+				else
+					kind = GPUSORT_KEYPREFIX_NONE;
+				break;
+			default:
+				kind = GPUSORT_KEYPREFIX_NONE;
+				break;
+		}
+		width = gpusort_keyprefix_width(kind);
+		/* a null-indicator and at least one byte are needed */
+		if (kind == GPUSORT_KEYPREFIX_NONE ||
+			length + 2 > GPUSORT_KEYPREFIX_LEN)
+			break;
+		gss->keyprefix_kinds[i] = kind;
+		length += 1 + width;
+		if (length > GPUSORT_KEYPREFIX_LEN)
+		{
+			length = GPUSORT_KEYPREFIX_LEN;
+			exact = false;
+		}
+		if (!exact)
+		{
+			i++;
+			break;
+		}
+	}
+	gss->keyprefix_len = length;
+	gss->keyprefix_exact = (length > 0 && exact && i == gss->numCols);
+}
+
+/*
+ * gpusort_encode_keyprefix
+ *
+ * It encodes the sorting keys of a row to the normalized key prefix.
+ */
+static void
+gpusort_encode_keyprefix(GpuSortState *gss, Datum *values, bool *isnull,
+						 cl_uchar *prefix)
+{
+	SortSupport	ssup_keys = gpusort_setup_sortsupport(gss);
+	cl_uint		pos = 0;
+	int			i, j;
+
+	memset(prefix, 0, gss->keyprefix_len);
+	for (i=0; i < gss->numCols && pos < gss->keyprefix_len; i++)
+	{
+		SortSupport	ssup = ssup_keys + i;
+		AttrNumber	anum = gss->kds_colidx[i] - 1;
+		Datum		datum = values[anum];
+		cl_ulong	code;
+		cl_uint		width;
+		union {
+			cl_uint		ival;
+			cl_float	fval;
+		} v4;
+		union {
+			cl_ulong	ival;
+			cl_double	fval;
+		} v8;
+
+		if (gss->keyprefix_kinds[i] == GPUSORT_KEYPREFIX_NONE)
+			break;
+		if (isnull[anum])
+		{
+			/* NULLs are never reversed by DESC, like ApplySortComparator */
+			prefix[pos++] = (ssup->ssup_nulls_first ? 0x00 : 0x02);
+			pos += gpusort_keyprefix_width(gss->keyprefix_kinds[i]);
+			continue;
+		}
+		prefix[pos++] = 0x01;
+
+		/*
+		 * strxfrm() image is compared bytewise, so its head bytes are put
+		 * as is. Zero padding of short images never breaks the order.
+		 */
+		if (gss->keyprefix_kinds[i] == GPUSORT_KEYPREFIX_XFRM)
+		{
+			struct varlena *vl = (struct varlena *) DatumGetPointer(datum);
+
+			width = Min(VARSIZE_ANY_EXHDR(vl), gss->keyprefix_len - pos);
+			memcpy(prefix + pos, VARDATA_ANY(vl), width);
+			if (ssup->ssup_reverse)
+			{
+				for (j = pos; j < gss->keyprefix_len; j++)
+					prefix[j] = ~prefix[j];
+			}
+			pos = gss->keyprefix_len;
+			continue;
+		}
+
+		/* make an unsigned integer that preserves order of the values */
+		switch (gss->keyprefix_kinds[i])
+		{
+			case GPUSORT_KEYPREFIX_BOOL:
+				code = (DatumGetBool(datum) ? 1 : 0);
+				break;
+			case GPUSORT_KEYPREFIX_INT2:
+				code = (cl_ushort) DatumGetInt16(datum) ^ 0x8000U;
+				break;
+			case GPUSORT_KEYPREFIX_INT4:
+				code = (cl_uint) DatumGetInt32(datum) ^ 0x80000000U;
+				break;
+			case GPUSORT_KEYPREFIX_INT8:
+				code = (cl_ulong) DatumGetInt64(datum) ^ 0x8000000000000000UL;
+				break;
+			case GPUSORT_KEYPREFIX_FLOAT4:
+				v4.fval = DatumGetFloat4(datum);
+				if (isnan(v4.fval))
+					code = 0xffffffffU;		/* NaN is larger than any */
+				else
+				{
+					if (v4.fval == 0.0)
+						v4.fval = 0.0;		/* -0.0 is equal to 0.0 */
+					code = ((v4.ival & 0x80000000U) != 0
+							? ~v4.ival
+							: v4.ival | 0x80000000U);
+				}
+				break;
+			case GPUSORT_KEYPREFIX_FLOAT8:
+			case GPUSORT_KEYPREFIX_NUMERIC:
+				if (gss->keyprefix_kinds[i] == GPUSORT_KEYPREFIX_FLOAT8)
+					v8.fval = DatumGetFloat8(datum);
+				else
+					v8.fval = DatumGetFloat8(DirectFunctionCall1(
+											numeric_float8_no_overflow,
+											datum));
+				if (isnan(v8.fval))
+					code = ~0UL;			/* NaN is larger than any */
+				else
+				{
+					if (v8.fval == 0.0)
+						v8.fval = 0.0;		/* -0.0 is equal to 0.0 */
+					code = ((v8.ival & 0x8000000000000000UL) != 0
+							? ~v8.ival
+							: v8.ival | 0x8000000000000000UL);
+				}
+				break;
+			default:
+				elog(ERROR, "Bug? unexpected key prefix kind: %d",
+					 gss->keyprefix_kinds[i]);
+		}
+		if (ssup->ssup_reverse)
+			code = ~code;
+		width = gpusort_keyprefix_width(gss->keyprefix_kinds[i]);
+		/* put it in big-endian, may be truncated by the prefix length */
+		for (j = width - 1; j >= 0 && pos < gss->keyprefix_len; j--)
+			prefix[pos++] = (code >> (8 * j)) & 0xff;
+	}
+}
+
+/*
+ * gpusort_make_keyprefix
+ *
+ * It builds the normalized key prefix array of the chunk once the chunk
+ * is projected to the slot format by GPU. The array is put on the file
+ * of the chunk next to the slot format data store, so CPU merge workers
+ * can map it also.
+ */
+static void
+gpusort_make_keyprefix(GpuSortState *gss, cl_int chunk_id)
+{
+	pgstrom_data_store *pds = gss->pds_chunks[chunk_id];
+	kern_data_store	   *kds = pds->kds;
+	Size		length = (Size) gss->keyprefix_len * kds->nitems;
+	off_t		offset = GPUSORT_KEYPREFIX_OFFSET(pds);
+	char	   *kprefix;
+	int			fdesc;
+	cl_uint		i;
+
+	if (gss->keyprefix_len == 0 || kds->nitems == 0)
+		return;
+	Assert(pds->kds_fname != NULL);
+
+	fdesc = OpenTransientFile(pds->kds_fname, O_RDWR | PG_BINARY, 0600);
+	if (fdesc < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file-mapped data store \"%s\": %m",
+						pds->kds_fname)));
+	if (ftruncate(fdesc, offset + length) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not truncate file \"%s\" to %zu: %m",
+						pds->kds_fname, (Size)(offset + length))));
+	kprefix = mmap(NULL, length,
+				   PROT_READ | PROT_WRITE,
+				   MAP_SHARED,
+				   fdesc, offset);
+	if (kprefix == MAP_FAILED)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not mmap \"%s\" with len/ofs=%zu/%zu: %m",
+						pds->kds_fname, length, (Size) offset)));
+	CloseTransientFile(fdesc);
+
+	for (i=0; i < kds->nitems; i++)
+	{
+		gpusort_encode_keyprefix(gss,
+								 (Datum *) KERN_DATA_STORE_VALUES(kds, i),
+								 (bool *) KERN_DATA_STORE_ISNULL(kds, i),
+								 (cl_uchar *) kprefix +
+								 gss->keyprefix_len * i);
+	}
+	gss->kprefix_chunks[chunk_id] = kprefix;
+}
+
+/*
+ * gpusort_release_keyprefix
+ *
+ * It unmaps the key prefix arrays of the chunks.
+ */
+static void
+gpusort_release_keyprefix(GpuSortState *gss)
+{
+	cl_uint		i;
+
+	for (i=0; i < gss->num_chunks; i++)
+	{
+		pgstrom_data_store *pds = gss->pds_chunks[i];
+		Size		length;
+
+		if (!gss->kprefix_chunks[i])
+			continue;
+		length = (Size) gss->keyprefix_len * pds->kds->nitems;
+		if (munmap(gss->kprefix_chunks[i], length) != 0)
+			elog(WARNING, "could not unmap key prefix of chunk %u: %m", i);
+		gss->kprefix_chunks[i] = NULL;
+	}
+}
+
+/*
+ * gpusort_update_bound
+ *
+ * It truncates the sorted result to the first sort_bound rows, then
+ * tightens the threshold if the last row is better than the current one.
+ */
+static void
+gpusort_update_bound(GpuSortState *gss, pgstrom_gpusort *gpusort)
+{
+	kern_resultbuf *kresults = GPUSORT_GET_KRESULTS(gpusort->oitems_dsm);
+	gpusort_run	   *run;
+	cl_int			chunk_id;
+	cl_int			item_id;
+
+	Assert(gss->sort_bound > 0);
+	if (kresults->nitems < gss->sort_bound)
+		return;
+	kresults->nitems = gss->sort_bound;
+
+	run = palloc(sizeof(gpusort_run));
+	gpusort_run_open(run, gpusort->oitems_dsm);
+	gpusort_run_read(run, gss->sort_bound - 1, &chunk_id, &item_id);
+	gpusort_run_close(run);
+	pfree(run);
+	if (chunk_id >= gss->num_chunks || !gss->pds_toasts[chunk_id])
+		elog(ERROR, "Bug? data-store of GpuSort missing (chunk-id: %d)",
+			 chunk_id);
+	if (!pgstrom_fetch_data_store(gss->bound_temp,
+								  gss->pds_toasts[chunk_id],
+								  item_id,
+								  &gss->bound_tuple_buf))
+		elog(ERROR, "Bug? failed to fetch chunk_id=%d item_id=%d",
+			 chunk_id, item_id);
+
+	if (TupIsNull(gss->bound_slot) ||
+		gpusort_compare_slots(gss, gss->bound_temp, gss->bound_slot) < 0)
+		ExecCopySlot(gss->bound_slot, gss->bound_temp);
+	ExecClearTuple(gss->bound_temp);
+}
+
+/*
+ * gpusort_fallback_sort
+ *
+ * Fallback routine towards a particular GpuSort chunk, if GPU device
+ * gave up sorting on device side. If normalized key prefix covers all the
+ * sorting keys, LSD radix sort on the prefix is applied. Elsewhere, items
+ * are sorted by pattern-defeating quicksort (pdqsort) that has O(N*logN)
+ * worst case and bounded recursion depth.
+ */
+#define GPUSORT_RADIX_THRESHOLD			256
+#define PDQSORT_INSERTION_THRESHOLD		24
+#define PDQSORT_NINTHER_THRESHOLD		128
+#define PDQSORT_PARTIAL_INSERTION_LIMIT	8
+
+typedef struct
+{
+	GpuSortState	   *gss;
+	kern_data_store	   *kds;
+	char			   *kprefix;	/* key prefix array, or NULL */
+	cl_uint			   *items;		/* item-ids to be sorted */
+} gpusort_fallback_context;
+
+static int
+gpusort_fallback_compare(gpusort_fallback_context *fcxt,
+						 cl_uint x_index, cl_uint y_index)
+{
+	GpuSortState   *gss = fcxt->gss;
+	Datum		   *x_values = KERN_DATA_STORE_VALUES(fcxt->kds, x_index);
+	bool		   *x_isnull = KERN_DATA_STORE_ISNULL(fcxt->kds, x_index);
+	Datum		   *y_values = KERN_DATA_STORE_VALUES(fcxt->kds, y_index);
+	bool		   *y_isnull = KERN_DATA_STORE_ISNULL(fcxt->kds, y_index);
+	int				i, comp;
+
+	if (fcxt->kprefix)
+	{
+		comp = memcmp(fcxt->kprefix + gss->keyprefix_len * x_index,
+					  fcxt->kprefix + gss->keyprefix_len * y_index,
+					  gss->keyprefix_len);
+		if (comp != 0 || gss->keyprefix_exact)
+			return comp;
+	}
+
+	for (i=0; i < gss->numCols; i++)
+	{
+		SortSupport		ssup = gss->ssup_keys + i;
+		AttrNumber		anum = gss->kds_colidx[i] - 1;
+
+		comp = ApplySortComparator(x_values[anum], x_isnull[anum],
+								   y_values[anum], y_isnull[anum],
+								   ssup);
+		if (comp != 0)
+			return comp;
+	}
+	return 0;
+}
+
+#define PDQ_LESS(fcxt,a,b)										\
+	(gpusort_fallback_compare((fcxt),							\
+							  (fcxt)->items[(a)],				\
+							  (fcxt)->items[(b)]) < 0)
+#define PDQ_SWAP(fcxt,a,b)										\
+	do {														\
+		cl_uint	__temp = (fcxt)->items[(a)];					\
+		(fcxt)->items[(a)] = (fcxt)->items[(b)];				\
+		(fcxt)->items[(b)] = __temp;							\
+	} while(0)
+
+static inline void
+pdqsort_sort2(gpusort_fallback_context *fcxt, size_t a, size_t b)
+{
+	if (PDQ_LESS(fcxt, b, a))
+		PDQ_SWAP(fcxt, a, b);
+}
+
+static inline void
+pdqsort_sort3(gpusort_fallback_context *fcxt, size_t a, size_t b, size_t c)
+{
+	pdqsort_sort2(fcxt, a, b);
+	pdqsort_sort2(fcxt, b, c);
+	pdqsort_sort2(fcxt, a, b);
+}
+
+/*
+ * pdqsort_insertion_sort - sorts items[begin ... end-1]
+ */
+static void
+pdqsort_insertion_sort(gpusort_fallback_context *fcxt,
+					   size_t begin, size_t end)
+{
+	cl_uint	   *items = fcxt->items;
+	size_t		curr;
+
+	for (curr = begin + 1; curr < end; curr++)
+	{
+		cl_uint		temp = items[curr];
+		size_t		sift = curr;
+
+		while (sift > begin &&
+			   gpusort_fallback_compare(fcxt, temp, items[sift - 1]) < 0)
+		{
+			items[sift] = items[sift - 1];
+			sift--;
+		}
+		items[sift] = temp;
+	}
+}
+
+/*
+ * pdqsort_partial_insertion_sort
+ *
+ * It tries insertion sort, but gives up if more than a few items are
+ * moved. It returns true, if items are sorted successfully.
+ */
+static bool
+pdqsort_partial_insertion_sort(gpusort_fallback_context *fcxt,
+							   size_t begin, size_t end)
+{
+	cl_uint	   *items = fcxt->items;
+	size_t		limit = 0;
+	size_t		curr;
+
+	for (curr = begin + 1; curr < end; curr++)
+	{
+		cl_uint		temp = items[curr];
+		size_t		sift = curr;
+
+		while (sift > begin &&
+			   gpusort_fallback_compare(fcxt, temp, items[sift - 1]) < 0)
+		{
+			items[sift] = items[sift - 1];
+			sift--;
+		}
+		items[sift] = temp;
+		limit += curr - sift;
+		if (limit > PDQSORT_PARTIAL_INSERTION_LIMIT)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * pdqsort_heapsort - the last resort on the adversarial inputs
+ */
+static void
+pdqsort_heapsort(gpusort_fallback_context *fcxt, size_t begin, size_t end)
+{
+	size_t		nitems = end - begin;
+	size_t		i, root, child;
+
+	for (i = nitems / 2; i > 0; i--)
+	{
+		for (root = i - 1; (child = 2 * root + 1) < nitems; root = child)
+		{
+			if (child + 1 < nitems &&
+				PDQ_LESS(fcxt, begin + child, begin + child + 1))
+				child++;
+			if (!PDQ_LESS(fcxt, begin + root, begin + child))
+				break;
+			PDQ_SWAP(fcxt, begin + root, begin + child);
+		}
+	}
+	while (nitems > 1)
+	{
+		nitems--;
+		PDQ_SWAP(fcxt, begin, begin + nitems);
+		for (root = 0; (child = 2 * root + 1) < nitems; root = child)
+		{
+			if (child + 1 < nitems &&
+				PDQ_LESS(fcxt, begin + child, begin + child + 1))
+				child++;
+			if (!PDQ_LESS(fcxt, begin + root, begin + child))
+				break;
+			PDQ_SWAP(fcxt, begin + root, begin + child);
+		}
+	}
+}
+
+/*
+ * pdqsort_partition_right
+ *
+ * It partitions items[begin ... end-1] by the pivot at items[begin].
+ * Items equal to the pivot go to the right side. It also reports whether
+ * the items were already partitioned.
+ */
+static size_t
+pdqsort_partition_right(gpusort_fallback_context *fcxt,
+						size_t begin, size_t end, bool *p_partitioned)
+{
+	cl_uint	   *items = fcxt->items;
+	cl_uint		pivot = items[begin];
+	size_t		first = begin;
+	size_t		last = end;
+
+	/* median-of-3 guarantees an item not less than the pivot exists */
+	while (gpusort_fallback_compare(fcxt, items[++first], pivot) < 0);
+	if (first - 1 == begin)
+	{
+		while (first < last &&
+			   gpusort_fallback_compare(fcxt, items[--last], pivot) >= 0);
+	}
+	else
+	{
+		while (gpusort_fallback_compare(fcxt, items[--last], pivot) >= 0);
+	}
+	*p_partitioned = (first >= last);
+
+	while (first < last)
+	{
+		PDQ_SWAP(fcxt, first, last);
+		while (gpusort_fallback_compare(fcxt, items[++first], pivot) < 0);
+		while (gpusort_fallback_compare(fcxt, items[--last], pivot) >= 0);
+	}
+	items[begin] = items[first - 1];
+	items[first - 1] = pivot;
+
+	return first - 1;
+}
+
+/*
+ * pdqsort_partition_left
+ *
+ * Like pdqsort_partition_right, but items equal to the pivot go to the
+ * left side. It is used when many items are equal to the pivot.
+ */
+static size_t
+pdqsort_partition_left(gpusort_fallback_context *fcxt,
+					   size_t begin, size_t end)
+{
+	cl_uint	   *items = fcxt->items;
+	cl_uint		pivot = items[begin];
+	size_t		first = begin;
+	size_t		last = end;
+
+	while (gpusort_fallback_compare(fcxt, pivot, items[--last]) < 0);
+	if (last + 1 == end)
+	{
+		while (first < last &&
+			   gpusort_fallback_compare(fcxt, pivot, items[++first]) >= 0);
+	}
+	else
+	{
+		while (gpusort_fallback_compare(fcxt, pivot, items[++first]) >= 0);
+	}
+
+	while (first < last)
+	{
+		PDQ_SWAP(fcxt, first, last);
+		while (gpusort_fallback_compare(fcxt, pivot, items[--last]) < 0);
+		while (gpusort_fallback_compare(fcxt, pivot, items[++first]) >= 0);
+	}
+	items[begin] = items[last];
+	items[last] = pivot;
+
+	return last;
+}
+
+static void
+pdqsort_loop(gpusort_fallback_context *fcxt,
+			 size_t begin, size_t end, int bad_allowed, bool leftmost)
+{
+	while (end - begin >= PDQSORT_INSERTION_THRESHOLD)
+	{
+		size_t		nitems = end - begin;
+		size_t		half = nitems / 2;
+		size_t		pivot_pos;
+		size_t		l_size;
+		size_t		r_size;
+		bool		partitioned;
+
+		/* choose a pivot by median-of-3 or Tukey's ninther */
+		if (nitems > PDQSORT_NINTHER_THRESHOLD)
+		{
+			pdqsort_sort3(fcxt, begin, begin + half, end - 1);
+			pdqsort_sort3(fcxt, begin + 1, begin + half - 1, end - 2);
+			pdqsort_sort3(fcxt, begin + 2, begin + half + 1, end - 3);
+			pdqsort_sort3(fcxt, begin + half - 1, begin + half,
+						  begin + half + 1);
+			PDQ_SWAP(fcxt, begin, begin + half);
+		}
+		else
+			pdqsort_sort3(fcxt, begin + half, begin, end - 1);
+
+		/*
+		 * If the pivot is equal to the predecessor that is the pivot of
+		 * the upper level, all the items equal to the pivot are put on
+		 * the left side; no need to sort them any more.
+		 */
+		if (!leftmost && !PDQ_LESS(fcxt, begin - 1, begin))
+		{
+			begin = pdqsort_partition_left(fcxt, begin, end) + 1;
+			continue;
+		}
+
+		pivot_pos = pdqsort_partition_right(fcxt, begin, end, &partitioned);
+		l_size = pivot_pos - begin;
+		r_size = end - (pivot_pos + 1);
+
+		if (l_size < nitems / 8 || r_size < nitems / 8)
+		{
+			/* too many bad partitions, so switch to heapsort */
+			if (--bad_allowed == 0)
+			{
+				pdqsort_heapsort(fcxt, begin, end);
+				return;
+			}
+			/* break the patterns of the input */
+			if (l_size >= PDQSORT_INSERTION_THRESHOLD)
+			{
+				PDQ_SWAP(fcxt, begin, begin + l_size / 4);
+				PDQ_SWAP(fcxt, pivot_pos - 1, pivot_pos - l_size / 4);
+			}
+			if (r_size >= PDQSORT_INSERTION_THRESHOLD)
+			{
+				PDQ_SWAP(fcxt, pivot_pos + 1, pivot_pos + 1 + r_size / 4);
+				PDQ_SWAP(fcxt, end - 1, end - r_size / 4);
+			}
+		}
+		else if (partitioned &&
+				 pdqsort_partial_insertion_sort(fcxt, begin, pivot_pos) &&
+				 pdqsort_partial_insertion_sort(fcxt, pivot_pos + 1, end))
+		{
+			/* already sorted */
+			return;
+		}
+
+		/* recurse into the smaller side to bound the depth */
+		if (l_size < r_size)
+		{
+			pdqsort_loop(fcxt, begin, pivot_pos, bad_allowed, leftmost);
+			begin = pivot_pos + 1;
+			leftmost = false;
+		}
+		else
+		{
+			pdqsort_loop(fcxt, pivot_pos + 1, end, bad_allowed, false);
+			end = pivot_pos;
+		}
+	}
+	pdqsort_insertion_sort(fcxt, begin, end);
+}
+
+/*
+ * gpusort_fallback_radixsort
+ *
+ * LSD radix sort on the normalized key prefix, 8 bits per pass. Passes
+ * are skipped if all the items have same byte on the position.
+ */
+static void
+gpusort_fallback_radixsort(gpusort_fallback_context *fcxt, size_t nitems)
+{
+	cl_uint		keylen = fcxt->gss->keyprefix_len;
+	cl_uchar   *kprefix = (cl_uchar *) fcxt->kprefix;
+	cl_uint	   *items = fcxt->items;
+	cl_uint	   *temp = palloc(sizeof(cl_uint) * nitems);
+	size_t	   *counts = palloc0(sizeof(size_t) * 256 * keylen);
+	size_t		i;
+	int			k, d;
+
+	/* histogram of all the passes at once */
+	for (i=0; i < nitems; i++)
+	{
+		cl_uchar   *prefix = kprefix + (size_t) keylen * i;
+
+		for (k=0; k < keylen; k++)
+			counts[256 * k + prefix[k]]++;
+	}
+
+	for (k = keylen - 1; k >= 0; k--)
+	{
+		size_t	   *count = counts + 256 * k;
+		size_t		offset = 0;
+		cl_uint	   *swap;
+
+		if (count[kprefix[(size_t) keylen * items[0] + k]] == nitems)
+			continue;		/* all the items have same byte */
+
+		for (d=0; d < 256; d++)
+		{
+			size_t	n = count[d];
+
+			count[d] = offset;
+			offset += n;
+		}
+		for (i=0; i < nitems; i++)
+		{
+			cl_uint		item_id = items[i];
+
+			temp[count[kprefix[(size_t) keylen * item_id + k]]++] = item_id;
+		}
+		swap = items;
+		items = temp;
+		temp = swap;
+	}
+	if (items != fcxt->items)
+	{
+		memcpy(fcxt->items, items, sizeof(cl_uint) * nitems);
+		temp = items;
+	}
+	pfree(temp);
+	pfree(counts);
+}
+
+static void
+gpusort_fallback_sort(GpuSortState *gss, pgstrom_gpusort *gpusort)
+{
+	kern_resultbuf	   *kresults = GPUSORT_GET_KRESULTS(gpusort->oitems_dsm);
+	pgstrom_data_store *pds = gss->pds_chunks[gpusort->chunk_id];
+	kern_data_store	   *kds = pds->kds;
+	gpusort_fallback_context fcxt;
+	size_t				nitems = kds->nitems;
+	size_t				i;
+
+	/* initialize SortSupportData, if first time */
+	gpusort_setup_sortsupport(gss);
+	Assert(kresults->nrels == 2);
+	Assert(kresults->nrooms == nitems);
+
+	/*
+	 * NOTE: we assume gpusort_preparation() and gpusort_fixup_datastore()
+	 * has no code path that can return CpuReCheck error, so we expect
+	 * receive DMA will back already flatten data store in kds/ktoast.
+	 */
+	fcxt.gss = gss;
+	fcxt.kds = kds;
+	fcxt.kprefix = gss->kprefix_chunks[gpusort->chunk_id];
+	fcxt.items = palloc(sizeof(cl_uint) * Max(nitems, 1));
+	for (i=0; i < nitems; i++)
+		fcxt.items[i] = i;
+
+	if (fcxt.kprefix && gss->keyprefix_exact &&
+		nitems >= GPUSORT_RADIX_THRESHOLD)
+		gpusort_fallback_radixsort(&fcxt, nitems);
+	else if (nitems > 1)
+		pdqsort_loop(&fcxt, 0, nitems, get_next_log2(nitems) + 1, true);
+
+	for (i=0; i < nitems; i++)
+	{
+		kresults->results[2 * i] = gpusort->chunk_id;
+		kresults->results[2 * i + 1] = fcxt.items[i];
+	}
+	pfree(fcxt.items);
+
+	/* restore error status */
+	kresults->errcode = StromError_Success;
+	kresults->nitems = nitems;
+}
+
+/*
+ * Entrypoint of GpuSort
+ */
+void
 pgstrom_init_gpusort(void)
 {
+	int		i;
+
 	/* enable_gpusort parameter */
 	DefineCustomBoolVariable("pg_strom.enable_gpusort",
 							 "Enables the use of GPU accelerated sorting",
@@ -2539,6 +4629,25 @@ pgstrom_init_gpusort(void)
 							 PGC_USERSET,
 							 GUC_NOT_IN_SAMPLE,
 							 NULL, NULL, NULL);
+	/* pg_strom.gpusort_key_only */
+	DefineCustomBoolVariable("pg_strom.gpusort_key_only",
+							 "Enables key-only sorting with late payload fetch",
+							 NULL,
+							 &enable_gpusort_key_only,
+							 true,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	/* pg_strom.gpusort_strxfrm */
+	DefineCustomBoolVariable("pg_strom.gpusort_strxfrm",
+							 "Enables GpuSort on text keys in non-C collation "
+							 "by their strxfrm() image",
+							 NULL,
+							 &enable_gpusort_strxfrm,
+							 false,
+							 PGC_USERSET,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
 	/* pg_strom.gpusort_max_workers */
 	DefineCustomIntVariable("pg_strom.max_workers",
 							"Maximum number of sorting workers for GpuSort",
@@ -2551,6 +4660,31 @@ pgstrom_init_gpusort(void)
 							GUC_NOT_IN_SAMPLE,
 							NULL, NULL, NULL);
 
+	/* pg_strom.gpusort_pool_workers */
+	DefineCustomIntVariable("pg_strom.gpusort_pool_workers",
+							"Number of pre-started sorting workers for GpuSort",
+							"0 disables the worker pool",
+							&gpusort_pool_workers,
+							0,
+							0,
+							max_worker_processes,
+							PGC_POSTMASTER,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+
+	/* pg_strom.gpusort_spill_threshold */
+	DefineCustomIntVariable("pg_strom.gpusort_spill_threshold",
+							"Amount of sorted runs kept on shared memory, "
+							"prior to spill out to temporary files",
+							NULL,
+							&gpusort_spill_threshold_kb,
+							262144,
+							1024,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
 	/* initialize the plan method table */
 	memset(&gpusort_scan_methods, 0, sizeof(CustomScanMethods));
 	gpusort_scan_methods.CustomName			= "GpuSort";
@@ -2566,6 +4700,29 @@ pgstrom_init_gpusort(void)
 	gpusort_exec_methods.MarkPosCustomScan	= gpusort_mark_pos;
 	gpusort_exec_methods.RestrPosCustomScan	= gpusort_restore_pos;
 	gpusort_exec_methods.ExplainCustomScan	= gpusort_explain;
+
+	/* launch CPU merge workers of the pool */
+	for (i=0; i < gpusort_pool_workers; i++)
+	{
+		BackgroundWorker	worker;
+
+		memset(&worker, 0, sizeof(BackgroundWorker));
+		snprintf(worker.bgw_name, sizeof(worker.bgw_name),
+				 "GpuSort pool worker-%d", i);
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+			BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = 5;
+		worker.bgw_main = bgw_cpusort_pool_entrypoint;
+		worker.bgw_main_arg = UInt32GetDatum(i);
+		RegisterBackgroundWorker(&worker);
+	}
+
+	/* shared memory for the worker pool */
+	RequestAddinShmemSpace(MAXALIGN(offsetof(gpusort_pool_head,
+											 workers[gpusort_pool_workers])));
+	shmem_startup_next = shmem_startup_hook;
+	shmem_startup_hook = pgstrom_startup_gpusort;
 }
 
 /* ================================================================
@@ -2584,6 +4741,9 @@ bgw_cpusort_exec(pgstrom_gpusort *gpusort)
 	kern_resultbuf	   *litems = GPUSORT_GET_KRESULTS(gpusort->litems_dsm);
 	kern_resultbuf	   *ritems = GPUSORT_GET_KRESULTS(gpusort->ritems_dsm);
 	kern_resultbuf	   *oitems = GPUSORT_GET_KRESULTS(gpusort->oitems_dsm);
+	gpusort_run		   *lrun;
+	gpusort_run		   *rrun;
+	gpusort_run		   *orun;
 	Datum			   *rts_values = NULL;
 	Datum			   *lts_values = NULL;
 	cl_char			   *rts_isnull = NULL;
@@ -2614,16 +4774,29 @@ bgw_cpusort_exec(pgstrom_gpusort *gpusort)
 	}
 
 	/*
-	 * Begin merge sorting
+	 * Set up input/output sorted runs; either of them may be spilled out
+	 * to the temporary file, but accessed through a small buffer.
 	 */
-	while (lindex < litems->nitems && rindex < ritems->nitems)
+	lrun = palloc(sizeof(gpusort_run));
+	gpusort_run_open(lrun, gpusort->litems_dsm);
+	rrun = palloc(sizeof(gpusort_run));
+	gpusort_run_open(rrun, gpusort->ritems_dsm);
+	orun = palloc(sizeof(gpusort_run));
+	gpusort_run_open(orun, gpusort->oitems_dsm);
+
+	/*
+	 * Begin merge sorting. Output buffer may be smaller than the sum of
+	 * the input streams in top-N mode, so merging stops once it gets full.
+	 */
+	while (lindex < litems->nitems &&
+		   rindex < ritems->nitems &&
+		   oindex < oitems->nrooms)
 	{
 		int		comp = 0;
 
 		if (!lts_values)
 		{
-			lchunk_id = litems->results[2 * lindex];
-			litem_id = litems->results[2 * lindex + 1];
+			gpusort_run_read(lrun, lindex, &lchunk_id, &litem_id);
 			Assert(lchunk_id < gpusort->num_chunks);
 			kds = gpusort->kern_chunks[lchunk_id];
 			Assert(litem_id < kds->nitems);
@@ -2637,8 +4810,7 @@ bgw_cpusort_exec(pgstrom_gpusort *gpusort)
 
 		if (!rts_values)
 		{
-			rchunk_id = ritems->results[2 * rindex];
-			ritem_id = ritems->results[2 * rindex + 1];
+			gpusort_run_read(rrun, rindex, &rchunk_id, &ritem_id);
 			Assert(rchunk_id < gpusort->num_chunks);
 			kds = gpusort->kern_chunks[rchunk_id];
 			if (ritem_id >= kds->nitems)
@@ -2649,7 +4821,21 @@ bgw_cpusort_exec(pgstrom_gpusort *gpusort)
 			rtoast = gpusort->kern_toasts[rchunk_id];
 		}
 
-		for (i=0; i < gpusort->numCols; i++)
+		/*
+		 * Compare the normalized key prefix first, then full comparators
+		 * only if prefixes are equal but may not cover all the keys.
+		 */
+		if (gpusort->keyprefix_len > 0)
+		{
+			comp = memcmp(gpusort->kern_kprefix[rchunk_id] +
+						  gpusort->keyprefix_len * ritem_id,
+						  gpusort->kern_kprefix[lchunk_id] +
+						  gpusort->keyprefix_len * litem_id,
+						  gpusort->keyprefix_len);
+		}
+
+		for (i=0; comp == 0 && !gpusort->keyprefix_exact &&
+				 i < gpusort->numCols; i++)
 		{
 			SortSupport ssup = sort_keys + i;
 			AttrNumber	anum = ssup->ssup_attno - 1;
@@ -2681,24 +4867,20 @@ bgw_cpusort_exec(pgstrom_gpusort *gpusort)
 			comp = ApplySortComparator(r_value, r_isnull,
 									   l_value, l_isnull,
 									   ssup);
-			if (comp != 0)
-				break;
 		}
 
 		if (comp >= 0)
 		{
-			oitems->results[2 * oindex] = lchunk_id;
-			oitems->results[2 * oindex + 1] = litem_id;
+			gpusort_run_write(orun, oindex, lchunk_id, litem_id);
 			oindex++;
 			lindex++;
 			lts_values = NULL;
 			lts_isnull = NULL;
 		}
 
-		if (comp <= 0)
+		if (comp <= 0 && oindex < oitems->nrooms)
 		{
-			oitems->results[2 * oindex] = rchunk_id;
-			oitems->results[2 * oindex + 1] = ritem_id;
+			gpusort_run_write(orun, oindex, rchunk_id, ritem_id);
 			oindex++;
 			rindex++;
 			rts_values = NULL;
@@ -2706,46 +4888,47 @@ bgw_cpusort_exec(pgstrom_gpusort *gpusort)
 		}
 	}
 	/* move remaining left chunk-id/item-id, if any */
-	if (lindex < litems->nitems)
+	while (lindex < litems->nitems && oindex < oitems->nrooms)
 	{
-		memcpy(oitems->results + 2 * oindex,
-			   litems->results + 2 * lindex,
-			   2 * sizeof(cl_int) * (litems->nitems - lindex));
 		Assert(rindex == ritems->nitems);
+		gpusort_run_read(lrun, lindex++, &lchunk_id, &litem_id);
+		gpusort_run_write(orun, oindex++, lchunk_id, litem_id);
 	}
 	/* move remaining right chunk-id/item-id, if any */
-	if (rindex < ritems->nitems)
+	while (rindex < ritems->nitems && oindex < oitems->nrooms)
 	{
-		memcpy(oitems->results + 2 * oindex,
-			   ritems->results + 2 * rindex,
-			   2 * sizeof(cl_int) * (ritems->nitems - rindex));
 		Assert(lindex == litems->nitems);
+		gpusort_run_read(rrun, rindex++, &rchunk_id, &ritem_id);
+		gpusort_run_write(orun, oindex++, rchunk_id, ritem_id);
 	}
-	oitems->nitems = litems->nitems + ritems->nitems;
+	gpusort_run_close(lrun);
+	gpusort_run_close(rrun);
+	gpusort_run_close(orun);
+	oitems->nitems = oindex;
 }
 
+/*
+ * bgw_cpusort_run
+ *
+ * It runs a CPU merge sorting job on the supplied DSM segment. If the
+ * database_oid is valid, the caller is a worker of the pool; it connects
+ * to the database on the first job, then reuses the connection.
+ * Elsewhere, the caller is a dynamic background worker for a job.
+ * Any allocation of the job goes to the bgw_mcxt, then caller resets it.
+ */
 static void
-bgw_cpusort_entrypoint(Datum main_arg)
+bgw_cpusort_run(dsm_handle dsm_hnd, Oid database_oid, MemoryContext bgw_mcxt)
 {
-	MemoryContext		bgw_mcxt;
-	dsm_handle			dsm_hnd = (dsm_handle) main_arg;
 	dsm_segment		   *dsm_seg;
 	PGPROC			   *backend_proc;
 	pgstrom_gpusort	   *gpusort;
 	pgstrom_flat_gpusort *pfg;
 	kern_resultbuf	   *kresults;
+	cl_uint				i;
+
+	/* CommitTransactionCommand() of the previous job switched it */
+	MemoryContextSwitchTo(bgw_mcxt);
 
-	/* We're now ready to receive signals */
-	BackgroundWorkerUnblockSignals();
-	/* Makes up resource owner and memory context */
-	Assert(CurrentResourceOwner == NULL);
-	CurrentResourceOwner = ResourceOwnerCreate(NULL, "CpuSort");
-	bgw_mcxt = AllocSetContextCreate(TopMemoryContext,
-										 "CpuSort",
-										 ALLOCSET_DEFAULT_MINSIZE,
-										 ALLOCSET_DEFAULT_INITSIZE,
-										 ALLOCSET_DEFAULT_MAXSIZE);
-	CurrentMemoryContext = bgw_mcxt;
 	/* Deform caller's request */
 	dsm_seg = dsm_attach(dsm_hnd);
 	if (!dsm_seg)
@@ -2772,7 +4955,15 @@ bgw_cpusort_entrypoint(Datum main_arg)
 		gpusort = deform_pgstrom_flat_gpusort(dsm_seg);
 
 		/* Connect to our database */
-		BackgroundWorkerInitializeConnection(gpusort->database_name, NULL);
+		if (!OidIsValid(database_oid))
+			BackgroundWorkerInitializeConnection(gpusort->database_name,
+												 NULL);
+		else if (!OidIsValid(MyDatabaseId))
+			BackgroundWorkerInitializeConnectionByOid(database_oid,
+													  InvalidOid);
+		else if (MyDatabaseId != database_oid)
+			elog(ERROR, "Bug? GpuSort worker bound to database %u got a job"
+				 " of database %u", MyDatabaseId, database_oid);
 
 		/*
 		 * XXX - Eventually, we should use parallel-context to share
@@ -2793,6 +4984,7 @@ bgw_cpusort_entrypoint(Datum main_arg)
 		/* we should have no side-effect */
 		PopActiveSnapshot();
 		CommitTransactionCommand();
+		MemoryContextSwitchTo(bgw_mcxt);
 	}
 	PG_CATCH();
 	{
@@ -2801,20 +4993,299 @@ bgw_cpusort_entrypoint(Datum main_arg)
 		Size			buflen;
 
 		kresults->errcode = edata->sqlerrcode;
-		buflen = sizeof(cl_int) * kresults->nrels * kresults->nrooms;
+		buflen = pfg->dsm_length - ((char *)kresults->results - (char *)pfg);
 		snprintf((char *)kresults->results, buflen, "%s (%s, %s:%d)",
 				 edata->message, edata->funcname,
 				 edata->filename, edata->lineno);
 		MemoryContextSwitchTo(ecxt);
 
+		/* also inform the coordinator the job got finished, with error */
+		pfg->bgw_done = true;
+		pg_memory_barrier();
 		SetLatch(&backend_proc->procLatch);
 
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
 
+	/* release the chunks and input streams, prior to the next job */
+	for (i=0; i < gpusort->num_chunks; i++)
+	{
+		if (gpusort->kern_kprefix[i])
+		{
+			Size	length = ((Size) gpusort->keyprefix_len *
+							  gpusort->kern_chunks[i]->nitems);
+
+			if (munmap(gpusort->kern_kprefix[i], length) != 0)
+				elog(WARNING, "could not unmap key prefix of chunk %u: %m", i);
+		}
+		if (gpusort->kern_chunks[i])
+			pgstrom_file_munmap_data_store(gpusort->kern_chunks[i],
+										   gpusort->varlena_keys
+										   ? gpusort->kern_toasts[i]
+										   : NULL);
+	}
+	dsm_detach(gpusort->litems_dsm);
+	dsm_detach(gpusort->ritems_dsm);
+
 	/* Inform the corrdinator worker got finished */
 	pfg->bgw_done = true;
 	pg_memory_barrier();
 	SetLatch(&backend_proc->procLatch);
+	/* coordinator may reuse the segment, so we never touch it any more */
+	dsm_detach(dsm_seg);
+}
+
+static void
+bgw_cpusort_entrypoint(Datum main_arg)
+{
+	MemoryContext		bgw_mcxt;
+
+	/* We're now ready to receive signals */
+	BackgroundWorkerUnblockSignals();
+	/* Makes up resource owner and memory context */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "CpuSort");
+	bgw_mcxt = AllocSetContextCreate(TopMemoryContext,
+									 "CpuSort",
+									 ALLOCSET_DEFAULT_MINSIZE,
+									 ALLOCSET_DEFAULT_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE);
+	CurrentMemoryContext = bgw_mcxt;
+
+	bgw_cpusort_run((dsm_handle) main_arg, InvalidOid, bgw_mcxt);
+}
+
+/* ================================================================
+ *
+ * Routines for CPU merge worker pool
+ *
+ * ================================================================
+ */
+
+/*
+ * gpusort_pool_submit
+ *
+ * It assigns a CPU merge job to a worker of the pool, which is bound to the
+ * current database or not bound yet, with the least number of jobs. It
+ * returns false if no worker is available or the queue is full, then
+ * caller has to launch a dynamic background worker instead.
+ */
+static bool
+gpusort_pool_submit(dsm_handle dsm_hnd)
+{
+	gpusort_pool_worker *pworker;
+	gpusort_pool_job   *job;
+	PGPROC			   *proc = NULL;
+	cl_int				index = -1;
+	cl_uint				load = UINT_MAX;
+	cl_uint				i;
+
+	if (!gpusort_pool || gpusort_pool->num_workers == 0)
+		return false;
+
+	SpinLockAcquire(&gpusort_pool->lock);
+	if (gpusort_pool->num_jobs < GPUSORT_POOL_QUEUE_SIZE)
+	{
+		for (i=0; i < gpusort_pool->num_workers; i++)
+		{
+			cl_uint		curr_load;
+
+			pworker = &gpusort_pool->workers[i];
+			if (pworker->database_oid != MyDatabaseId &&
+				(OidIsValid(pworker->database_oid) || !pworker->proc))
+				continue;
+			curr_load = pworker->num_jobs + (pworker->is_busy ? 1 : 0);
+			/* a worker already bound to the database is preferable */
+			if (index < 0 || curr_load < load ||
+				(curr_load == load &&
+				 OidIsValid(pworker->database_oid) &&
+				 !OidIsValid(gpusort_pool->workers[index].database_oid)))
+			{
+				index = i;
+				load = curr_load;
+			}
+		}
+	}
+
+	if (index >= 0)
+	{
+		pworker = &gpusort_pool->workers[index];
+		pworker->database_oid = MyDatabaseId;
+		pworker->num_jobs++;
+		proc = pworker->proc;
+
+		job = &gpusort_pool->jobs[gpusort_pool->num_jobs++];
+		job->dsm_hnd = dsm_hnd;
+		job->database_oid = MyDatabaseId;
+		job->worker_index = index;
+	}
+	SpinLockRelease(&gpusort_pool->lock);
+
+	/* wake up the worker, if it is running now */
+	if (proc)
+		SetLatch(&proc->procLatch);
+
+	return (index >= 0);
+}
+
+/*
+ * gpusort_pool_dequeue
+ *
+ * It picks up the oldest job assigned to the worker.
+ */
+static bool
+gpusort_pool_dequeue(cl_uint worker_index, gpusort_pool_job *p_job)
+{
+	gpusort_pool_worker *pworker = &gpusort_pool->workers[worker_index];
+	bool		found = false;
+	cl_uint		i;
+
+	SpinLockAcquire(&gpusort_pool->lock);
+	for (i=0; i < gpusort_pool->num_jobs; i++)
+	{
+		gpusort_pool_job   *job = &gpusort_pool->jobs[i];
+
+		if (job->worker_index == worker_index)
+		{
+			memcpy(p_job, job, sizeof(gpusort_pool_job));
+			memmove(job, job + 1, (sizeof(gpusort_pool_job) *
+								   (gpusort_pool->num_jobs - i - 1)));
+			gpusort_pool->num_jobs--;
+			Assert(pworker->num_jobs > 0);
+			pworker->num_jobs--;
+			found = true;
+			break;
+		}
+	}
+	pworker->is_busy = found;
+	SpinLockRelease(&gpusort_pool->lock);
+
+	return found;
+}
+
+/*
+ * gpusort_pool_retire
+ *
+ * It detaches the idle worker from the pool, if no jobs are assigned.
+ * Once it returns true, no new jobs shall be assigned to the slot until
+ * the restarted worker attaches it again.
+ */
+static bool
+gpusort_pool_retire(cl_uint worker_index)
+{
+	gpusort_pool_worker *pworker = &gpusort_pool->workers[worker_index];
+	bool		retired = false;
+
+	SpinLockAcquire(&gpusort_pool->lock);
+	if (pworker->num_jobs == 0)
+	{
+		pworker->proc = NULL;
+		pworker->is_busy = false;
+		pworker->database_oid = InvalidOid;
+		retired = true;
+	}
+	SpinLockRelease(&gpusort_pool->lock);
+
+	return retired;
+}
+
+/*
+ * gpusort_pool_cleanup
+ *
+ * It detaches the worker from the pool on exit. The worker keeps its
+ * binding to the database if any jobs are still assigned, because the
+ * restarted worker on the same slot shall run them.
+ */
+static void
+gpusort_pool_cleanup(int code, Datum arg)
+{
+	gpusort_pool_worker *pworker
+		= &gpusort_pool->workers[DatumGetUInt32(arg)];
+
+	SpinLockAcquire(&gpusort_pool->lock);
+	pworker->proc = NULL;
+	pworker->is_busy = false;
+	if (pworker->num_jobs == 0)
+		pworker->database_oid = InvalidOid;
+	SpinLockRelease(&gpusort_pool->lock);
+}
+
+static void
+bgw_cpusort_pool_entrypoint(Datum main_arg)
+{
+	cl_uint				worker_index = DatumGetUInt32(main_arg);
+	gpusort_pool_worker *pworker = &gpusort_pool->workers[worker_index];
+	gpusort_pool_job	job;
+	MemoryContext		bgw_mcxt;
+	int					rc;
+
+	/* We're now ready to receive signals */
+	BackgroundWorkerUnblockSignals();
+	/* Makes up resource owner and memory context */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "CpuSort");
+	bgw_mcxt = AllocSetContextCreate(TopMemoryContext,
+									 "CpuSort",
+									 ALLOCSET_DEFAULT_MINSIZE,
+									 ALLOCSET_DEFAULT_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE);
+	CurrentMemoryContext = bgw_mcxt;
+
+	/* attach myself to the pool */
+	on_shmem_exit(gpusort_pool_cleanup, UInt32GetDatum(worker_index));
+	SpinLockAcquire(&gpusort_pool->lock);
+	pworker->proc = MyProc;
+	pworker->is_busy = false;
+	SpinLockRelease(&gpusort_pool->lock);
+
+	for (;;)
+	{
+		ResetLatch(&MyProc->procLatch);
+
+		CHECK_FOR_INTERRUPTS();
+
+		while (gpusort_pool_dequeue(worker_index, &job))
+		{
+			bgw_cpusort_run(job.dsm_hnd, job.database_oid, bgw_mcxt);
+			MemoryContextReset(bgw_mcxt);
+		}
+
+		rc = WaitLatch(&MyProc->procLatch,
+					   WL_LATCH_SET | WL_POSTMASTER_DEATH |
+					   (OidIsValid(MyDatabaseId) ? WL_TIMEOUT : 0),
+					   GPUSORT_POOL_IDLE_TIMEOUT * 1000L);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		/*
+		 * Idle worker being bound to a database exits to release the
+		 * connection; exit code 1 makes the postmaster restart it.
+		 */
+		if ((rc & WL_TIMEOUT) != 0 && gpusort_pool_retire(worker_index))
+			proc_exit(1);
+	}
+}
+
+/*
+ * pgstrom_startup_gpusort
+ */
+static void
+pgstrom_startup_gpusort(void)
+{
+	Size	length;
+	bool	found;
+
+	if (shmem_startup_next)
+		(*shmem_startup_next)();
+
+	length = offsetof(gpusort_pool_head, workers[gpusort_pool_workers]);
+	gpusort_pool = ShmemInitStruct("PG-Strom GpuSort worker pool",
+								   MAXALIGN(length), &found);
+	if (found)
+		elog(ERROR, "Bug? shared memory for GpuSort worker pool exists");
+
+	memset(gpusort_pool, 0, length);
+	SpinLockInit(&gpusort_pool->lock);
+	gpusort_pool->num_workers = gpusort_pool_workers;
 }
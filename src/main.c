@@ -315,6 +315,44 @@ pgstrom_find_path(PlannerInfo *root, RelOptInfo *rel)
 	return NULL;
 }
 
+/*
+ * pgstrom_limit_bound
+ *
+ * It returns number of rows to be fetched by the Limit node, if both of
+ * LIMIT and OFFSET clause are constant. Elsewhere, 0 shall be returned.
+ */
+static long
+pgstrom_limit_bound(Limit *limit)
+{
+	Const	   *count = (Const *) limit->limitCount;
+	Const	   *offset = (Const *) limit->limitOffset;
+	int64		bound;
+
+	if (!count || !IsA(count, Const) || count->constisnull)
+		return 0;
+	bound = DatumGetInt64(count->constvalue);
+	if (bound <= 0)
+		return 0;
+	if (offset)
+	{
+		int64	nskips;
+
+		if (!IsA(offset, Const))
+			return 0;
+		if (!offset->constisnull)
+		{
+			nskips = DatumGetInt64(offset->constvalue);
+			if (nskips < 0)
+				return 0;		/* shall be an error on run-time */
+			bound += nskips;
+		}
+	}
+	/* kern_resultbuf cannot have more than INT_MAX rows anyway */
+	if (bound <= 0 || bound > INT_MAX)
+		return 0;
+	return (long) bound;
+}
+
 /*
  * pgstrom_recursive_grafter
  *
@@ -339,6 +377,35 @@ pgstrom_recursive_grafter(PlannedStmt *pstmt, Plan **p_curr_plan)
 			pgstrom_try_insert_gpupreagg(pstmt, (Agg *) plan);
 			break;
 
+		case T_Unique:
+			/*
+			 * Unique on the Sort node is a sort-aggregate without any
+			 * aggregate functions, so GpuPreAgg can reduce the rows to
+			 * be sorted as a per-chunk deduplicator.
+			 */
+			pgstrom_try_insert_gpupreagg_unique(pstmt, (Unique *) plan);
+			break;
+
+		case T_Limit:
+			/*
+			 * Sort node just under the Limit with constant LIMIT/OFFSET
+			 * clause can be replaced by GpuSort in bounded (top-N) mode.
+			 * So, we walk down the sub-tree of the Sort node here, then
+			 * try to replace the Sort node with the bound.
+			 */
+			if (plan->lefttree && IsA(plan->lefttree, Sort))
+			{
+				Plan   *sort = plan->lefttree;
+				long	bound = pgstrom_limit_bound((Limit *) plan);
+
+				Assert(!plan->righttree && !sort->righttree);
+				if (sort->lefttree)
+					pgstrom_recursive_grafter(pstmt, &sort->lefttree);
+				pgstrom_try_insert_gpusort(pstmt, &plan->lefttree, bound);
+				return;
+			}
+			break;
+
 		case T_SubqueryScan:
 			{
 				SubqueryScan   *subquery = (SubqueryScan *) plan;
@@ -418,7 +485,7 @@ pgstrom_recursive_grafter(PlannedStmt *pstmt, Plan **p_curr_plan)
 			/* Try to replace Sort node by GpuSort node if cost of
 			 * the alternative plan is enough reasonable to replace.
 			 */
-			pgstrom_try_insert_gpusort(pstmt, p_curr_plan);
+			pgstrom_try_insert_gpusort(pstmt, p_curr_plan, 0);
 			break;
 
 		default:
@@ -514,6 +581,7 @@ _PG_init(void)
 	/* miscellaneous initializations */
 	pgstrom_init_misc_guc();
 	pgstrom_init_codegen();
+	pgstrom_init_costmodel();
 
 	/* overall planner hook registration */
 	planner_hook_next = planner_hook;
@@ -926,6 +994,6 @@ pgstrom_explain_gputaskstate(GpuTaskState *gts, ExplainState *es)
 	/*
 	 * Show performance information
 	 */
-	if (es->analyze && gts->pfm_accum.enabled)
+	if (es->analyze && gts->pfm_accum.enabled && pgstrom_perfmon_enabled)
 		pgstrom_explain_perfmon(&gts->pfm_accum, es);
 }
@@ -20,6 +20,7 @@
 #include "nodes/nodeFuncs.h"
 #include "optimizer/planmain.h"
 #include "utils/lsyscache.h"
+#include "utils/datum.h"
 #include "utils/pg_crc.h"
 #include "utils/ruleutils.h"
 #include "pg_strom.h"
@@ -40,9 +41,12 @@ typedef struct
 	int			nbatches;		/* expected number of batches */
 	Size		kmrels_length;	/* expected length of kern_multirels */
 	double		kmrels_rate;	/* expected rate to kmrels_length */
+	bool		outer_bulkload;	/* true, if bulk-load from the outer */
 
 	/* width of hash-slot if hash-join case */
 	cl_uint		nslots;
+	/* true, if entries with duplicated hash-keys can be merged */
+	bool		hash_dedup;
     /*
      * NOTE: setrefs.c adjusts varnode reference on hash_keys because
      * of custom-scan interface contract. It shall be redirected to
@@ -74,6 +78,8 @@ typedef struct
 	bool			outer_done;
 	TupleTableSlot *outer_overflow;
 	void		   *curr_chunk;
+	bool			outer_bulk;		/* true, if bulk-load from the outer */
+	BulkInputState	bulk_input;
 
 	/*
 	 * For hash-join
@@ -86,7 +92,9 @@ typedef struct
 	List		   *hash_keylen;
 	List		   *hash_keybyval;
 	List		   *hash_keytype;
-	Tuplestorestate *tupstore;	/* for JOIN_FULL or JOIN_LEFT */
+	bool			hash_dedup;
+	TupleTableSlot *dedup_slot;	/* for comparison of hash-keys */
+	Tuplestorestate *tupstore;	/* for JOIN_FULL/LEFT/SEMI/ANTI */
 } MultiRelsState;
 
 /*
@@ -127,6 +135,8 @@ form_multirels_info(CustomScan *cscan, MultiRelsInfo *mr_info)
 	kmrels_rate = (long)(mr_info->kmrels_rate * 1000000.0);
 	privs = lappend(privs, makeInteger(kmrels_rate));
 	privs = lappend(privs, makeInteger(mr_info->nslots));
+	privs = lappend(privs, makeInteger(mr_info->outer_bulkload));
+	privs = lappend(privs, makeInteger(mr_info->hash_dedup));
 	exprs = lappend(exprs, mr_info->hash_inner_keys);
 
 	cscan->custom_private = privs;
@@ -153,6 +163,8 @@ deform_multirels_info(CustomScan *cscan)
 	kmrels_rate = intVal(list_nth(privs, pindex++));
 	mr_info->kmrels_rate = (double)kmrels_rate / 1000000.0;
 	mr_info->nslots = intVal(list_nth(privs, pindex++));
+	mr_info->outer_bulkload = intVal(list_nth(privs, pindex++));
+	mr_info->hash_dedup = intVal(list_nth(privs, pindex++));
 	mr_info->hash_inner_keys = list_nth(exprs, eindex++);
 
 	return mr_info;
@@ -202,11 +214,29 @@ multirels_create_plan(PlannerInfo *root,
 					  double kmrels_rate,
 					  cl_uint nbatches,
 					  cl_uint nslots,
-					  List *hash_inner_keys)
+					  List *hash_inner_keys,
+					  bool hash_dedup)
 {
 	CustomScan	   *cscan;
 	MultiRelsInfo	mr_info;
 	Plan		   *outer_plan = create_plan_recurse(root, outer_path);
+	Plan		   *alter_plan;
+	bool			outer_bulkload = false;
+
+	/*
+	 * If the underlying node can deliver its rows by chunks, we don't
+	 * need to pay per-tuple overhead to preload the inner relation.
+	 */
+	if (IsA(outer_plan, SeqScan) || IsA(outer_plan, CustomScan))
+	{
+		alter_plan = pgstrom_try_replace_bulk_input(outer_plan,
+													root->parse->rtable);
+		if (alter_plan)
+		{
+			outer_plan = alter_plan;
+			outer_bulkload = true;
+		}
+	}
 
 	cscan = makeNode(CustomScan);
 	cscan->scan.plan.plan_rows = outer_plan->plan_rows;
@@ -229,7 +259,9 @@ multirels_create_plan(PlannerInfo *root,
 	mr_info.kmrels_length = kmrels_length;
 	mr_info.kmrels_rate = kmrels_rate;
 	mr_info.nslots = nslots;
+	mr_info.outer_bulkload = outer_bulkload;
 	mr_info.hash_inner_keys = hash_inner_keys;
+	mr_info.hash_dedup = hash_dedup;
 	form_multirels_info(cscan, &mr_info);
 
 	return cscan;
@@ -311,12 +343,25 @@ multirels_begin(CustomScanState *node, EState *estate, int eflags)
 	mrs->hash_keylen = hash_keylen;
 	mrs->hash_keybyval = hash_keybyval;
 	mrs->hash_keytype = hash_keytype;
+	mrs->hash_dedup = mr_info->hash_dedup;
+	if (mrs->hash_dedup)
+	{
+		TupleDesc	scan_desc
+			= mrs->css.ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+
+		mrs->dedup_slot = MakeSingleTupleTableSlot(scan_desc);
+	}
 
 	/*
      * initialize child nodes
      */
 	outerPlanState(mrs) = ExecInitNode(outerPlan(cscan), estate, eflags);
 	innerPlanState(mrs) = ExecInitNode(innerPlan(cscan), estate, eflags);
+
+	mrs->outer_bulk =
+		(!pgstrom_bulkload_enabled ? false : mr_info->outer_bulkload);
+	if (mrs->outer_bulk)
+		pgstrom_init_bulk_input(&mrs->bulk_input, outerPlanState(mrs));
 }
 
 static TupleTableSlot *
@@ -326,6 +371,18 @@ multirels_exec(CustomScanState *node)
 	return NULL;
 }
 
+/*
+ * multirels_fetch_outer - fetch a tuple from the outer node, using either
+ * row-by-row or bulk-load mode
+ */
+static inline TupleTableSlot *
+multirels_fetch_outer(MultiRelsState *mrs)
+{
+	if (mrs->outer_bulk)
+		return pgstrom_bulk_input_fetch(&mrs->bulk_input);
+	return ExecProcNode(outerPlanState(mrs));
+}
+
 static bool
 multirels_expand_length(MultiRelsState *mrs, pgstrom_multirels *pmrels)
 {
@@ -516,6 +573,72 @@ get_tuple_hashvalue(MultiRelsState *mrs, TupleTableSlot *slot)
 	return hash;
 }
 
+/*
+ * multirels_hash_duplicated
+ *
+ * It checks whether kern_hashtable already has an entry with identical
+ * hash-keys. SEMI JOIN probes the inner relation only for existence, so
+ * no need to load the entries with duplicated keys.
+ * Keys are compared by binary, thus it may miss some duplications (like
+ * 1.0 and 1.00 in numeric), but never merges distinct ones.
+ */
+static bool
+multirels_hash_duplicated(MultiRelsState *mrs, kern_hashtable *khtable,
+						  TupleTableSlot *slot, cl_uint hash)
+{
+	ExprContext	   *econtext = mrs->css.ss.ps.ps_ExprContext;
+	MemoryContext	oldcxt;
+	kern_hashentry *khentry;
+	HeapTupleData	tupData;
+	ListCell	   *lc1;
+	ListCell	   *lc2;
+	ListCell	   *lc3;
+
+	/* key values are evaluated on the per-tuple memory, reset for each */
+	oldcxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+	for (khentry = KERN_HASH_FIRST_ENTRY(khtable, hash);
+		 khentry != NULL;
+		 khentry = KERN_HASH_NEXT_ENTRY(khtable, khentry))
+	{
+		if (khentry->hash != hash)
+			continue;
+
+		tupData.t_len = khentry->t_len;
+		ItemPointerSetInvalid(&tupData.t_self);
+		tupData.t_tableOid = InvalidOid;
+		tupData.t_data = &khentry->htup;
+		ExecStoreTuple(&tupData, mrs->dedup_slot, InvalidBuffer, false);
+
+		forthree (lc1, mrs->hash_keys,
+				  lc2, mrs->hash_keylen,
+				  lc3, mrs->hash_keybyval)
+		{
+			ExprState  *clause = lfirst(lc1);
+			Datum		value1;
+			Datum		value2;
+			bool		isnull1;
+			bool		isnull2;
+
+			econtext->ecxt_scantuple = slot;
+			value1 = ExecEvalExpr(clause, econtext, &isnull1, NULL);
+			econtext->ecxt_scantuple = mrs->dedup_slot;
+			value2 = ExecEvalExpr(clause, econtext, &isnull2, NULL);
+			if (isnull1 || isnull2 ||
+				!datumIsEqual(value1, value2,
+							  lfirst_int(lc3), lfirst_int(lc2)))
+				break;
+		}
+		ExecClearTuple(mrs->dedup_slot);
+		ResetExprContext(econtext);
+
+		if (lc1 == NULL)
+			break;			/* all the keys are identical */
+	}
+	MemoryContextSwitchTo(oldcxt);
+
+	return (khentry != NULL);
+}
+
 static bool
 multirels_preload_hash_partial(MultiRelsState *mrs, kern_hashtable *khtable)
 {
@@ -577,6 +700,10 @@ multirels_preload_hash_partial(MultiRelsState *mrs, kern_hashtable *khtable)
 			Size		entry_size;
 			cl_int		index;
 
+			if (mrs->hash_dedup &&
+				multirels_hash_duplicated(mrs, khtable, tupslot, hash))
+				continue;
+
 			entry_size = MAXALIGN(offsetof(kern_hashentry, htup) +
 								  tuple->t_len);
 			khentry = (kern_hashentry *)((char *)khtable + khtable->usage);
@@ -618,7 +745,7 @@ multirels_preload_hash(MultiRelsState *mrs,
 	while (!mrs->outer_done)
 	{
 		if (!mrs->outer_overflow)
-			scan_slot = ExecProcNode(outerPlanState(mrs));
+			scan_slot = multirels_fetch_outer(mrs);
 		else
 		{
 			scan_slot = mrs->outer_overflow;
@@ -646,6 +773,11 @@ multirels_preload_hash(MultiRelsState *mrs,
 			continue;
 		}
 
+		/* SEMI JOIN needs only one of the entries with identical keys */
+		if (mrs->hash_dedup &&
+			multirels_hash_duplicated(mrs, khtable, scan_slot, hash))
+			continue;
+
 		/* do we have enough space to store? */
 		if (khtable->usage + entry_size <= khtable->length)
 		{
@@ -694,10 +826,12 @@ multirels_preload_hash(MultiRelsState *mrs,
 			else
 			{
 				/*
-				 * If join logic is one of outer, and we cannot expand
-				 * a single kern_hashtable chunk any more, we switch to
-				 * use tuple-store to materialize the underlying relation
-				 * once. Then, we split tuples according to the hash range.
+				 * If join logic is one of outer, semi or anti, and we
+				 * cannot expand a single kern_hashtable chunk any more,
+				 * we switch to use tuple-store to materialize the
+				 * underlying relation once. Then, we split tuples
+				 * according to the hash range, so an outer row is
+				 * probed against all the candidate inner rows at once.
 				 */
 				kern_hashentry *khentry;
 				HeapTupleData	tupData;
@@ -765,53 +899,68 @@ multirels_preload_heap(MultiRelsState *mrs,
 										scan_desc, chunk_size, false);
 	while (true)
 	{
-		if (!mrs->outer_overflow)
-			scan_slot = ExecProcNode(outerPlanState(mrs));
-		else
+		if (mrs->outer_bulk && !mrs->outer_overflow)
 		{
-			scan_slot = mrs->outer_overflow;
-			mrs->outer_overflow = NULL;
+			/* load rows of the outer chunks as much as possible */
+			if (pgstrom_bulk_input_load(&mrs->bulk_input, pds))
+			{
+				mrs->outer_done = true;
+				break;
+			}
 		}
-
-		if (TupIsNull(scan_slot))
+		else
 		{
-			mrs->outer_done = true;
-			break;
-		}
+			if (!mrs->outer_overflow)
+				scan_slot = multirels_fetch_outer(mrs);
+			else
+			{
+				scan_slot = mrs->outer_overflow;
+				mrs->outer_overflow = NULL;
+			}
+
+			if (TupIsNull(scan_slot))
+			{
+				mrs->outer_done = true;
+				break;
+			}
+
+			if (pgstrom_data_store_insert_tuple(pds, scan_slot))
+				continue;
 
-		if (!pgstrom_data_store_insert_tuple(pds, scan_slot))
-		{
 			/* to be inserted on the next try */
 			Assert(mrs->outer_overflow == NULL);
 			mrs->outer_overflow = scan_slot;
-
-			/*
-			 * We try to expand total length of pgstrom_multirels buffer,
-			 * as long as it can be acquired on the device memory.
-			 * If no more physical space is expected, we give up to preload
-			 * entire relation on this store.
-			 */
-			if (!multirels_expand_length(mrs, pmrels))
-				break;
-			/*
-			 * Once total length of the buffer got expanded, current store
-			 * also can have wider space.
-			 */
-			chunk_size = (Size)(mrs->kmrels_rate *
-								(double)(pmrels->kmrels_length -
-										 pmrels->head_length));
-			chunk_size = STROMALIGN_DOWN(chunk_size);
-			pgstrom_expand_data_store(mrs->gcontext, pds, chunk_size);
 		}
+
+		/*
+		 * We try to expand total length of pgstrom_multirels buffer,
+		 * as long as it can be acquired on the device memory.
+		 * If no more physical space is expected, we give up to preload
+		 * entire relation on this store.
+		 */
+		if (!multirels_expand_length(mrs, pmrels))
+			break;
+		/*
+		 * Once total length of the buffer got expanded, current store
+		 * also can have wider space. It is appended as a new extent,
+		 * so tuples already loaded are not copied on every expansion.
+		 */
+		chunk_size = (Size)(mrs->kmrels_rate *
+							(double)(pmrels->kmrels_length -
+									 pmrels->head_length));
+		chunk_size = STROMALIGN_DOWN(chunk_size);
+		pgstrom_append_data_store_extent(mrs->gcontext, pds, chunk_size);
 	}
 
 	/* actually not loaded */
-	if (pds->kds->nitems == 0)
+	if (pgstrom_data_store_nitems(pds) == 0)
 	{
 		Assert(mrs->outer_done);
 		pgstrom_release_data_store(pds);
 		return;
 	}
+	/* kern_multirels needs a contiguous image of the data store */
+	pgstrom_flatten_data_store(mrs->gcontext, pds);
 
 	/*
 	 * NOTE: all we need here is kern_data_store, not pgstrom_data_store.
@@ -959,6 +1108,10 @@ multirels_exec_bulk(CustomScanState *node)
 		}
 		if (mrs->join_type == JOIN_LEFT || mrs->join_type == JOIN_FULL)
 			pmrels->kern.chunks[depth-1].left_outer = true;
+		if (mrs->join_type == JOIN_SEMI)
+			pmrels->kern.chunks[depth-1].semi_join = true;
+		if (mrs->join_type == JOIN_ANTI)
+			pmrels->kern.chunks[depth-1].anti_join = true;
 	}
 out:
 	/* must provide our own instrumentation support */
@@ -990,6 +1143,10 @@ multirels_end(CustomScanState *node)
 		// TODO: put kds or hash here
 		mrs->curr_chunk = NULL;
 	}
+	if (mrs->outer_bulk)
+		pgstrom_release_bulk_input(&mrs->bulk_input);
+	if (mrs->dedup_slot)
+		ExecDropSingleTupleTableSlot(mrs->dedup_slot);
 
 	/*
 	 * Shutdown the subplans
@@ -1014,6 +1171,8 @@ multirels_rescan(CustomScanState *node)
 	ExecReScan(outerPlanState(node));
 	mrs->outer_done = false;
 	mrs->outer_overflow = NULL;
+	if (mrs->outer_bulk)
+		pgstrom_release_bulk_input(&mrs->bulk_input);
 }
 
 static void
@@ -1066,6 +1225,8 @@ multirels_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 		appendStringInfo(es->str, ", Buffer Usage: %.2f%%\n",
 						 100.0 * mr_info->kmrels_rate);
 	}
+	/* outer bulkload */
+	ExplainPropertyText("Bulkload", mrs->outer_bulk ? "On" : "Off", es);
 }
 
 /****/
@@ -34,6 +34,24 @@ CREATE FUNCTION pgstrom_program_info()
   AS 'MODULE_PATHNAME'
   LANGUAGE C STRICT;
 
+CREATE TYPE __pgstrom_cost_model AS (
+  node			text,
+  calibrated	bool,
+  setup_cost	float8,
+  tuple_cost	float8,
+  operator_cost	float8,
+  byte_cost		float8
+);
+CREATE FUNCTION pgstrom_cost_model()
+  RETURNS SETOF __pgstrom_cost_model
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C STRICT;
+
+CREATE FUNCTION pgstrom_calibrate_cost_model()
+  RETURNS SETOF __pgstrom_cost_model
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C STRICT VOLATILE;
+
 --
 -- functions for GpuPreAgg
 --
@@ -491,3 +509,159 @@ CREATE AGGREGATE pgstrom.regr_syy(int4, float8, float8,
   finalfunc = pg_catalog.float8_regr_syy,
   initcond = '{0,0,0,0,0,0}'
 );
+
+--
+-- HyperLogLog based approximate distinct count
+--
+CREATE FUNCTION pgstrom.hll_item(int2)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(int4)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(int8)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(float4)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(float8)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(date)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(time)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(timestamp)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+CREATE FUNCTION pgstrom.hll_item(timestamptz)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_hll_item'
+  LANGUAGE C STRICT;
+
+CREATE FUNCTION pgstrom.hll_item_accum(bytea, int4)
+  RETURNS bytea
+  AS 'MODULE_PATHNAME', 'pgstrom_hll_item_accum'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.hll_accum(bytea, anyelement)
+  RETURNS bytea
+  AS 'MODULE_PATHNAME', 'pgstrom_hll_accum'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.hll_combine(bytea, bytea)
+  RETURNS bytea
+  AS 'MODULE_PATHNAME', 'pgstrom_hll_combine'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.hll_final(bytea)
+  RETURNS int8
+  AS 'MODULE_PATHNAME', 'pgstrom_hll_final'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+-- alternative aggregate of approx_count_distinct() on GpuPreAgg
+CREATE AGGREGATE pgstrom.hll_count(int4)
+(
+  sfunc = pgstrom.hll_item_accum,
+  stype = bytea,
+  finalfunc = pgstrom.hll_final
+);
+
+-- registers as a sketch; sketches can be merged across partitions
+CREATE AGGREGATE pgstrom.hll_sketch(anyelement)
+(
+  sfunc = pgstrom.hll_accum,
+  stype = bytea
+);
+
+CREATE AGGREGATE pgstrom.hll_merge(bytea)
+(
+  sfunc = pgstrom.hll_combine,
+  stype = bytea,
+  finalfunc = pgstrom.hll_final
+);
+
+CREATE AGGREGATE approx_count_distinct(anyelement)
+(
+  sfunc = pgstrom.hll_accum,
+  stype = bytea,
+  finalfunc = pgstrom.hll_final
+);
+
+--
+-- Quantile sketch based approximate percentile
+--
+CREATE FUNCTION pgstrom.qsketch_item(float8)
+  RETURNS int4
+  AS 'MODULE_PATHNAME', 'gpupreagg_qsketch_item'
+  LANGUAGE C STRICT;
+
+CREATE FUNCTION pgstrom.qsketch_accum(internal, float8, float8)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'pgstrom_qsketch_accum'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.qsketch_accum(internal, float8, float8[])
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'pgstrom_qsketch_accum'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.qsketch_item_accum(internal, int4, int4, float8)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'pgstrom_qsketch_item_accum'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.qsketch_item_accum(internal, int4, int4, float8[])
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'pgstrom_qsketch_item_accum'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.qsketch_final(internal)
+  RETURNS float8
+  AS 'MODULE_PATHNAME', 'pgstrom_qsketch_final'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pgstrom.qsketch_final_array(internal)
+  RETURNS float8[]
+  AS 'MODULE_PATHNAME', 'pgstrom_qsketch_final_array'
+  LANGUAGE C CALLED ON NULL INPUT;
+
+-- alternative aggregates of approx_percentile() on GpuPreAgg
+CREATE AGGREGATE pgstrom.approx_percentile(int4, int4, float8)
+(
+  sfunc = pgstrom.qsketch_item_accum,
+  stype = internal,
+  finalfunc = pgstrom.qsketch_final
+);
+
+CREATE AGGREGATE pgstrom.approx_percentile(int4, int4, float8[])
+(
+  sfunc = pgstrom.qsketch_item_accum,
+  stype = internal,
+  finalfunc = pgstrom.qsketch_final_array
+);
+
+CREATE AGGREGATE approx_percentile(float8, float8)
+(
+  sfunc = pgstrom.qsketch_accum,
+  stype = internal,
+  finalfunc = pgstrom.qsketch_final
+);
+
+CREATE AGGREGATE approx_percentile(float8, float8[])
+(
+  sfunc = pgstrom.qsketch_accum,
+  stype = internal,
+  finalfunc = pgstrom.qsketch_final_array
+);
@@ -268,6 +268,22 @@ struct GpuTaskState
 	void		  (*cb_task_polling)(GpuTaskState *gts);
 	GpuTask		 *(*cb_next_chunk)(GpuTaskState *gts);
 	TupleTableSlot *(*cb_next_tuple)(GpuTaskState *gts);
+	/* adaptive chunk size (see pgstrom_adaptive_chunk_size) */
+	Size			chunk_size;		/* current chunk size, or 0 */
+	cl_int			chunk_direction;/* +1: grow, -1: shrink */
+	cl_double		chunk_cost;		/* last cost per MB in milliseconds */
+	pgstrom_perfmon	chunk_pfm;		/* snapshot on the last adjustment */
+	/* adaptive concurrency (see adjust_async_limit) */
+	cl_uint			async_limit;	/* current in-flight window */
+	cl_int			async_direction;/* +1: grow, -1: shrink */
+	cl_uint			async_nr_fetched;	/* tasks fetched since last adjust */
+	struct timeval	async_tv_last;	/* timestamp of the last adjustment */
+	cl_double		async_rate;		/* last throughput in tasks/sec */
+	cl_double		async_latency;	/* last average queueing delay in ms */
+	cl_double		async_latency_sum;	/* sum of delay since last adjust */
+	cl_uint			async_latency_cnt;	/* num of samples since last adjust */
+	bool			async_overbudget;	/* host memory budget was hit */
+	Size			async_budget_used;	/* host memory charged on budget */
 	/* performance counter  */
 	pgstrom_perfmon	pfm_accum;
 };
@@ -288,6 +304,8 @@ struct GpuTask
 	CUstream		cuda_stream;	/* owned for each GpuTask */
 	CUmodule		cuda_module;	/* just reference, no cleanup needed */
 	cl_int			errcode;
+	Size			budget_size;	/* host memory charged on budget */
+	struct timeval	tv_enqueue;		/* timestamp when task was enqueued */
 	pgstrom_perfmon	pfm;
 };
 
@@ -346,8 +364,22 @@ typedef struct pgstrom_data_store
 	Size		kds_length;	/* length of the kernel data store */
 	kern_data_store *kds;
 	struct pgstrom_data_store *ptoast;
+	/*
+	 * extent table of segmented data store; kds_extents[0] is identical
+	 * to kds, and others are appended on expansion instead of copying.
+	 * num_extents == 0 means a usual contiguous data store.
+	 */
+	cl_uint		num_extents;	/* number of extents in use */
+	cl_uint		max_extents;	/* capacity of the extent table */
+	kern_data_store **kds_extents;
 } pgstrom_data_store;
 
+#define PDS_IS_SEGMENTED(pds)	((pds)->num_extents > 0)
+#define PDS_LAST_EXTENT(pds)							\
+	(PDS_IS_SEGMENTED(pds)								\
+	 ? (pds)->kds_extents[(pds)->num_extents - 1]		\
+	 : (pds)->kds)
+
 /* --------------------------------------------------------------------
  *
  * Private enhancement of CustomScan Interface
@@ -379,6 +411,23 @@ typedef struct
 #define CUSTOMPATH_SUPPORT_BULKLOAD			0x10000000
 #define CUSTOMPATH_PREFERE_ROW_FORMAT		0x20000000
 
+/*
+ * BulkInputState - state to consume the data chunks delivered by the
+ * BulkExecProcNode(), for the nodes that does not process the chunk on
+ * the device as is (GpuSort, MultiRels). Rows are moved chunk-by-chunk
+ * if layout of the chunk is identical to the expected one; elsewhere,
+ * rows are converted using projection of the outer node.
+ */
+typedef struct
+{
+	PlanState	   *outer_ps;		/* outer node that supports bulkload */
+	ProjectionInfo *bulk_proj;		/* projection of outer node, if any */
+	TupleTableSlot *bulk_slot;		/* slot to fetch rows from the chunk */
+	pgstrom_data_store *curr_pds;	/* current chunk, or NULL */
+	cl_uint			curr_index;		/* next row index in curr_pds */
+	HeapTupleData	tuple_buf;		/* temp buffer during fetch */
+} BulkInputState;
+
 /*
  * --------------------------------------------------------------------
  *
@@ -415,6 +464,7 @@ extern void pgstrom_cleanup_gputaskstate(GpuTaskState *gts);
 extern void pgstrom_release_gputaskstate(GpuTaskState *gts);
 extern void pgstrom_init_gputaskstate(GpuContext *gcontext, GpuTaskState *gts);
 extern void pgstrom_init_gputask(GpuTaskState *gts, GpuTask *gtask);
+extern void pgstrom_charge_gputask(GpuTask *gtask, Size budget_size);
 extern void pgstrom_release_gputask(GpuTask *gtask);
 extern GpuTask *pgstrom_fetch_gputask(GpuTaskState *gts);
 extern TupleTableSlot *pgstrom_exec_gputask(GpuTaskState *gts);
@@ -495,16 +545,33 @@ extern void pgstrom_init_codegen(void);
  * datastore.c
  */
 extern Size pgstrom_chunk_size(void);
+extern bool pgstrom_adaptive_chunk_enabled(void);
+extern Size pgstrom_adaptive_chunk_size(GpuTaskState *gts, Size remain);
 extern double pgstrom_get_bulkload_density(Plan *child_plan);
 extern Plan *pgstrom_try_replace_plannode(Plan *child_plan,
 										  List *range_tables,
 										  List **pullup_quals);
 extern pgstrom_data_store *BulkExecProcNode(PlanState *node);
+extern Plan *pgstrom_try_replace_bulk_input(Plan *child_plan,
+											 List *range_tables);
+extern void pgstrom_init_bulk_input(BulkInputState *bistate,
+									PlanState *outer_ps);
+extern TupleTableSlot *pgstrom_bulk_input_fetch(BulkInputState *bistate);
+extern bool pgstrom_bulk_input_load(BulkInputState *bistate,
+									pgstrom_data_store *pds);
+extern void pgstrom_release_bulk_input(BulkInputState *bistate);
 extern Datum pgstrom_fixup_kernel_numeric(Datum numeric_datum);
 extern bool pgstrom_fetch_data_store(TupleTableSlot *slot,
 									 pgstrom_data_store *pds,
 									 size_t row_index,
 									 HeapTuple tuple);
+extern bool *pgstrom_setup_lazy_fetch(PlanState *ps, Index varno,
+									  List *extra_exprs,
+									  TupleDesc tupdesc);
+extern bool pgstrom_fetch_data_store_lazy(TupleTableSlot *slot,
+										  pgstrom_data_store *pds,
+										  size_t row_index,
+										  const bool *attr_needed);
 extern bool kern_fetch_data_store(TupleTableSlot *slot,
 								  kern_data_store *kds,
 								  size_t row_index,
@@ -513,12 +580,21 @@ extern void pgstrom_release_data_store(pgstrom_data_store *pds);
 extern void pgstrom_expand_data_store(GpuContext *gcontext,
 									  pgstrom_data_store *pds,
 									  Size kds_length_new);
+extern void pgstrom_append_data_store_extent(GpuContext *gcontext,
+											 pgstrom_data_store *pds,
+											 Size kds_length_new);
+extern void pgstrom_flatten_data_store(GpuContext *gcontext,
+									   pgstrom_data_store *pds);
+extern size_t pgstrom_data_store_nitems(pgstrom_data_store *pds);
 extern void pgstrom_shrink_data_store(pgstrom_data_store *pds);
 extern pgstrom_data_store *
 pgstrom_create_data_store_row(GpuContext *gcontext,
 							  TupleDesc tupdesc,
 							  Size length,
 							  bool file_mapped);
+extern void pgstrom_init_data_store_row(kern_data_store *kds,
+										TupleDesc tupdesc,
+										Size length);
 extern pgstrom_data_store *
 pgstrom_create_data_store_slot(GpuContext *gcontext,
 							   TupleDesc tupdesc,
@@ -531,6 +607,10 @@ pgstrom_file_mmap_data_store(FileName kds_fname,
 							 Size kds_length,
 							 kern_data_store **p_kds,
 							 kern_data_store **p_ktoast);
+extern void
+pgstrom_file_munmap_data_store(kern_data_store *kds,
+							   kern_data_store *ktoast);
+extern int pgstrom_open_tempfile(const char **p_tempfilepath);
 
 extern int pgstrom_data_store_insert_block(pgstrom_data_store *pds,
 										   Relation rel,
@@ -539,6 +619,9 @@ extern int pgstrom_data_store_insert_block(pgstrom_data_store *pds,
 										   bool page_prune);
 extern bool pgstrom_data_store_insert_tuple(pgstrom_data_store *pds,
 											TupleTableSlot *slot);
+extern bool pgstrom_data_store_insert_chunk(pgstrom_data_store *pds,
+											pgstrom_data_store *pds_src,
+											cl_uint *p_src_index);
 extern void pgstrom_dump_data_store(pgstrom_data_store *pds);
 extern void pgstrom_init_datastore(void);
 
@@ -577,7 +660,8 @@ multirels_create_plan(PlannerInfo *root,
 					  double kmrels_rate,
 					  cl_uint nbatches,
 					  cl_uint nslots,
-					  List *hash_inner_keys);
+					  List *hash_inner_keys,
+					  bool hash_dedup);
 extern struct pgstrom_multirels *
 pgstrom_multirels_exec_bulk(PlanState *plannode);
 extern size_t multirels_get_nitems(pgstrom_multirels *pmrels, int depth);
@@ -607,13 +691,16 @@ extern void	pgstrom_init_gpujoin(void);
  * gpupreagg.c
  */
 extern void pgstrom_try_insert_gpupreagg(PlannedStmt *pstmt, Agg *agg);
+extern void pgstrom_try_insert_gpupreagg_unique(PlannedStmt *pstmt,
+												Unique *unique);
 extern bool pgstrom_plan_is_gpupreagg(const Plan *plan);
 extern void pgstrom_init_gpupreagg(void);
 
 /*
  * gpusort.c
  */
-extern void pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan);
+extern void pgstrom_try_insert_gpusort(PlannedStmt *pstmt, Plan **p_plan,
+									   long sort_bound);
 extern void pgstrom_init_gpusort(void);
 
 /*
@@ -644,6 +731,31 @@ extern void pgstrom_accum_perfmon(pgstrom_perfmon *accum,
 extern void
 pgstrom_explain_gputaskstate(GpuTaskState *gts, ExplainState *es);
 
+/*
+ * costmodel.c
+ */
+typedef enum
+{
+	GpuCostNodeScan,
+	GpuCostNodeJoin,
+	GpuCostNodePreAgg,
+	GpuCostNodeSort,
+	GpuCostNode__Max,
+} GpuCostNode;
+
+typedef struct
+{
+	Cost		setup_cost;		/* fixed cost to launch GPU kernel */
+	Cost		tuple_cost;		/* extra cost to move a tuple to device */
+	Cost		operator_cost;	/* cost to evaluate an operator on device */
+	Cost		byte_cost;		/* cost to materialize a byte of results */
+} GpuCostCoeff;
+
+extern void pgstrom_get_cost_coeff(GpuCostNode node, GpuCostCoeff *coeff);
+extern Datum pgstrom_calibrate_cost_model(PG_FUNCTION_ARGS);
+extern Datum pgstrom_cost_model(PG_FUNCTION_ARGS);
+extern void pgstrom_init_costmodel(void);
+
 /*
  * grafter.c
  */
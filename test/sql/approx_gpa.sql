@@ -0,0 +1,23 @@
+--#
+--#       GpuPreAgg TestCases of approx_count_distinct().
+--#
+
+set pg_strom.debug_force_gpupreagg to on;
+set enable_gpusort to off;
+set client_min_messages to warning;
+
+-- hll_item() works as an extra grouping key of GpuPreAgg
+explain (costs off)
+select key, approx_count_distinct(id) from strom_test group by key;
+
+-- id is unique, so count(*) is the exact number of distinct values
+select key, count(*),
+       abs(approx_count_distinct(id) - count(*)) <= 0.15 * count(*) as ok
+  from strom_test group by key order by key;
+
+-- CPU aggregation estimates from the same registers
+set pg_strom.enabled to off;
+select key, count(*),
+       abs(approx_count_distinct(id) - count(*)) <= 0.15 * count(*) as ok
+  from strom_test group by key order by key;
+reset pg_strom.enabled;
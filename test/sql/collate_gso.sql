@@ -0,0 +1,31 @@
+--#
+--#       Gpu Sort TestCases of text keys in non-C collation.
+--#
+
+set gpu_setup_cost=0;
+set random_page_cost=1000000;   --# force off index_scan.
+set enable_gpusort to on;
+set pg_strom.debug_force_gpusort to on;
+set client_min_messages to warning;
+
+-- every word appears twice, so equal keys are ordered by id
+create temp table collate_test (
+       id       integer,
+       text_x   text COLLATE "en_US",
+       bpchar_x char(6) COLLATE "en_US"
+);
+insert into collate_test
+select id, w, w
+  from (select id, (array['a','A','apple','Apple','APPLE','b',
+                          'B','banana','Banana','cherry','Cherry','CHERRY'])
+                   [id * 5 % 12 + 1] as w
+          from generate_series(1,24) id) as t;
+
+-- keys are sorted by the strxfrm() image, not by the bytes
+explain (costs off)
+select id, text_x from collate_test order by text_x, id;
+select id, text_x from collate_test order by text_x, id;
+-- image of the descending key is inverted
+select id, text_x from collate_test order by text_x desc, id;
+-- trailing spaces of bpchar are not a part of the image
+select bpchar_x, id from collate_test order by bpchar_x desc, id;
@@ -0,0 +1,14 @@
+--#
+--#       GpuPreAgg TestCases of SELECT DISTINCT.
+--#
+
+set pg_strom.debug_force_gpupreagg to on;
+set enable_gpusort to off;
+set enable_hashagg to off;   --# DISTINCT by Unique on Sort
+set client_min_messages to warning;
+
+-- GpuPreAgg reduces each chunk to its distinct keys under the Sort
+explain (costs off)
+select distinct key % 3 as k from strom_test order by k;
+select distinct key % 3 as k from strom_test order by k;
+select distinct key, id % 10 as r from strom_test order by key, r;
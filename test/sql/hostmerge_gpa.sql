@@ -0,0 +1,25 @@
+--#
+--#       GpuPreAgg TestCases with host merge and spill.
+--#
+
+set pg_strom.debug_force_gpupreagg to on;
+set pg_strom.gpupreagg_host_merge to on;
+set enable_gpusort to off;
+set client_min_messages to warning;
+
+-- merged groups are aggregated without hash table
+explain (costs off)
+select key, count(*), sum(id), min(id), max(id) from strom_test group by key;
+select key, count(*), sum(id), min(id), max(id) from strom_test group by key order by key;
+
+-- every group has 20 rows over the chunks; spilled out by work_mem
+set work_mem to '64kB';
+select id % 2000 as grp, count(*), sum(id), min(id), max(id)
+  from strom_test group by id % 2000 order by grp limit 10;
+select count(*) as groups, sum(cnt) as nrows,
+       count(*) filter (where not (cnt = 20 and mx - mn = 38000 and
+                                   s = 20 * mn + 380000)) as wrong
+  from (select id % 2000 as grp, count(*) as cnt, sum(id) as s,
+               min(id) as mn, max(id) as mx
+          from strom_test group by id % 2000) as t;
+reset work_mem;
@@ -0,0 +1,24 @@
+--#
+--#       GpuPreAgg TestCases of approx_percentile().
+--#
+
+set pg_strom.debug_force_gpupreagg to on;
+set enable_gpusort to off;
+set client_min_messages to warning;
+
+-- qsketch_item() works as an extra grouping key of GpuPreAgg
+explain (costs off)
+select key, approx_percentile(id::float8, 0.5) from strom_test group by key;
+
+-- id is evenly spaced in each group, so percentiles are linear on min..max
+select key, min(id), max(id),
+       abs(approx_percentile(id::float8, 0.5) - (min(id) + max(id)) / 2.0)
+           <= 0.03 * (min(id) + max(id)) / 2.0 as ok
+  from strom_test group by key order by key;
+select key,
+       abs(p[1] - (mn + 0.1 * (mx - mn))) <= 0.03 * (mn + 0.1 * (mx - mn)) and
+       abs(p[2] - (mn + 0.9 * (mx - mn))) <= 0.03 * (mn + 0.9 * (mx - mn)) as ok
+  from (select key, min(id) as mn, max(id) as mx,
+               approx_percentile(id::float8, array[0.1, 0.9]) as p
+          from strom_test group by key) as t
+ order by key;
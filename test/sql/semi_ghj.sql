@@ -0,0 +1,27 @@
+--#
+--#       Gpu Hash Join TestCases of semi and anti joins.
+--#
+
+set gpu_setup_cost=0;
+set enable_gpupreagg to off;
+set enable_gpusort to off;
+set enable_mergejoin to off;
+set enable_nestloop to off;
+set random_page_cost=1000000;   --# force off index_scan.
+set client_min_messages to warning;
+
+-- inner rows have duplicated keys; only key 10, 20 and 30 have id % 1000 = 0
+explain (costs off)
+select a.id, a.key from strom_test a
+ where exists (select 1 from strom_test b
+                where b.key = a.key and b.id % 1000 = 0);
+select a.key, count(*) from strom_test a
+ where exists (select 1 from strom_test b
+                where b.key = a.key and b.id % 1000 = 0)
+ group by a.key order by a.key;
+select count(*), count(distinct a.key) from strom_test a
+ where not exists (select 1 from strom_test b
+                    where b.key = a.key and b.id % 1000 = 0);
+select a.key, count(*) from strom_test a
+ where a.key in (select b.key from strom_test b where b.id <= 100)
+ group by a.key order by a.key;
@@ -0,0 +1,23 @@
+--#
+--#       Gpu Sort TestCases with sorted runs spilled out.
+--#
+
+set gpu_setup_cost=0;
+set random_page_cost=1000000;   --# force off index_scan.
+set enable_gpusort to on;
+set pg_strom.debug_force_gpusort to on;
+set pg_strom.gpusort_spill_threshold to '1MB';
+set client_min_messages to warning;
+
+-- 320000 rows make 2.5MB of sorted runs, beyond the threshold
+explain (costs off)
+select id, g from strom_test, generate_series(1,8) g order by id desc, g;
+create temp view spill_sorted as
+select row_number() over () as rn, id, g
+  from (select id, g from strom_test, generate_series(1,8) g
+         order by id desc, g) as t;
+select rn, id, g from spill_sorted
+ where rn % 40000 = 1 or rn = 320000 order by rn;
+select count(*) as nrows,
+       count(*) filter (where rn <> (40000 - id) * 8 + g) as wrong
+  from spill_sorted;
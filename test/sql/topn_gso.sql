@@ -0,0 +1,20 @@
+--#
+--#       Gpu Sort Top-N (bounded sort) TestCases.
+--#
+
+set gpu_setup_cost=0;
+set random_page_cost=1000000;   --# force off index_scan.
+set enable_gpusort to on;
+set pg_strom.debug_force_gpusort to on;
+set client_min_messages to warning;
+
+-- Limit passes its bound to GpuSort
+explain (costs off)
+select id, key from strom_test order by key desc nulls last, id desc limit 5;
+select id, key from strom_test order by key desc nulls last, id desc limit 5;
+-- NULLs come first on descending order
+select id, key from strom_test order by key desc, id limit 3;
+-- the bound crosses the boundary of key groups
+select id, key from strom_test order by key, id limit 3 offset 998;
+-- the bound crosses the boundary of chunks
+select id from strom_test order by id desc limit 3 offset 19998;